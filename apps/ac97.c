@@ -22,6 +22,7 @@
 #include <Library/UefiBootServicesTableLib.h>
 #include <UEFIStarter/core.h>
 #include <UEFIStarter/ac97.h>
+#include <UEFIStarter/oscillator.h>
 #include <UEFIStarter/pci.h>
 
 
@@ -31,6 +32,31 @@
  */
 #define SAMPLES_PER_BUFFER 10000
 
+/** number of times each buffer fill function is run in benchmark mode */
+#define BENCHMARK_ROUNDS 10
+
+#define ARG_BENCHMARK _argument_list[0].value.uint64 /**< helper macro to access the "-benchmark" command-line argument */
+
+/** list of application-specific command-line arguments */
+static cmdline_argument_t _argument_list[] = {
+  {{uint64:0},ARG_BOOL,NULL,L"-benchmark",L"Benchmark buffer fill functions instead of playing audio"},
+};
+
+/** application-specific command-line arguments group */
+static ARG_GROUP(_arguments,_argument_list,L"Application-specific options");
+
+/** frequency multipliers for a harmonic scale, starting at the base note */
+static float harmonic_scale[]={
+  1.0,
+  1.12246204830937,
+  1.25992104989487,
+  1.33483985417003,
+  1.49830707687668,
+  1.68179283050743,
+  1.88774862536339,
+  2.0
+};
+
 
 /**
  * Shortcut macro to sample a (non-harmonic) frequency.
@@ -53,7 +79,7 @@ void fill_buffers_crossscale(ac97_buffers_s16_t *buffers, unsigned int start_buf
 {
   unsigned int tc, td;
 
-  LOG.debug(L"filling buffers with (nonharmonic) scale: start=%d, count=%d, offset=%d",start_buffer,buffer_count,loop_offset);
+  LOG_DEBUG(L"filling buffers with (nonharmonic) scale: start=%d, count=%d, offset=%d",start_buffer,buffer_count,loop_offset);
 
   for(td=0;td<buffer_count;td++)
   {
@@ -81,18 +107,7 @@ void fill_buffers_harmonic_scale(ac97_buffers_s16_t *buffers, unsigned int start
   float val_left, val_right;
   float attack_samples=500;
 
-  float harmonic_scale[]={
-    1.0,
-    1.12246204830937,
-    1.25992104989487,
-    1.33483985417003,
-    1.49830707687668,
-    1.68179283050743,
-    1.88774862536339,
-    2.0
-  };
-
-  LOG.debug(L"filling buffers with harmonic scale: start=%d, count=%d",start_buffer,buffer_count);
+  LOG_DEBUG(L"filling buffers with harmonic scale: start=%d, count=%d",start_buffer,buffer_count);
 
   if(buffer_count>32)
   {
@@ -141,6 +156,126 @@ void fill_buffers_harmonic_scale(ac97_buffers_s16_t *buffers, unsigned int start
 }
 
 
+/**
+ * Fills audio buffers with scales, one channel going down, the other channel going up.
+ * Generates the same output as fill_buffers_crossscale() with wavetable oscillators instead of per-sample divisions.
+ *
+ * \param buffers      the AC'97 buffer list to fill
+ * \param start_buffer index of the first buffer to fill
+ * \param buffer_count the number of buffers to fill
+ * \param loop_offset  offset for loop counter, the higher this is the higher the generated notes will be
+ */
+void fill_buffers_wavetable_crossscale(ac97_buffers_s16_t *buffers, unsigned int start_buffer, unsigned int buffer_count, unsigned int loop_offset)
+{
+  unsigned int td, index;
+  oscillator_t left, right;
+
+  LOG_DEBUG(L"filling buffers with (nonharmonic) wavetable scale: start=%d, count=%d, offset=%d",start_buffer,buffer_count,loop_offset);
+
+  for(td=0;td<buffer_count;td++)
+  {
+    index=(start_buffer+td)%32;
+    buffers->descriptors[index].length=SAMPLES_PER_BUFFER*2;
+
+    //the original notes are defined by their period in samples
+    if(init_oscillator(&left,WAVEFORM_SAWTOOTH,((double)ARG_SAMPLE_RATE)/(31+(td+loop_offset)*3),ARG_SAMPLE_RATE,30000)!=EFI_SUCCESS
+       || init_oscillator(&right,WAVEFORM_SAWTOOTH,((double)ARG_SAMPLE_RATE)/(128-(td+loop_offset)*3),ARG_SAMPLE_RATE,30000)!=EFI_SUCCESS)
+      return;
+    oscillator_fill_s16(&left,buffers->buffers[index],SAMPLES_PER_BUFFER,2);
+    oscillator_fill_s16(&right,buffers->buffers[index]+1,SAMPLES_PER_BUFFER,2);
+  }
+}
+
+/**
+ * Fills audio buffers with harmonic scales.
+ * Generates the same output as fill_buffers_harmonic_scale() with wavetable oscillators instead of per-sample float
+ * calculations.
+ *
+ * \param buffers      the audio buffers to write to
+ * \param start_buffer index of the first buffer to fill
+ * \param buffer_count number of buffers to fill
+ */
+void fill_buffers_wavetable_harmonic_scale(ac97_buffers_s16_t *buffers, unsigned int start_buffer, unsigned int buffer_count)
+{
+  unsigned int td, index;
+  double frequency;
+  oscillator_t left, right;
+
+  LOG_DEBUG(L"filling buffers with wavetable harmonic scale: start=%d, count=%d",start_buffer,buffer_count);
+
+  if(buffer_count>32)
+  {
+    LOG.error(L"buffer count too high (max 32, got %d), would wrap around and overwrite start of data",buffer_count);
+    return;
+  }
+
+  for(td=0;td<buffer_count;td++)
+  {
+    index=(start_buffer+td)%32;
+    buffers->descriptors[index].length=SAMPLES_PER_BUFFER*2;
+
+    frequency=440.0*harmonic_scale[index%16>7?7-index%8:index%8];
+    if(init_oscillator(&left,WAVEFORM_SAWTOOTH,index%16<8?frequency:frequency/2,ARG_SAMPLE_RATE,15000)!=EFI_SUCCESS
+       || init_oscillator(&right,WAVEFORM_SAWTOOTH,index%16<8?frequency/2:frequency,ARG_SAMPLE_RATE,15000)!=EFI_SUCCESS)
+      return;
+    set_oscillator_attack(&left,500);
+    set_oscillator_attack(&right,500);
+    oscillator_fill_s16(&left,buffers->buffers[index],SAMPLES_PER_BUFFER,2);
+    oscillator_fill_s16(&right,buffers->buffers[index]+1,SAMPLES_PER_BUFFER,2);
+  }
+}
+
+
+/**
+ * Shortcut macro: runs a buffer fill function BENCHMARK_ROUNDS times and prints the time it took.
+ *
+ * \param DESC the description to print
+ * \param CALL the function call to time
+ */
+#define BENCHMARK_FILL(DESC,CALL) \
+  start=get_timestamp(); \
+  for(tc=0;tc<BENCHMARK_ROUNDS;tc++) \
+    CALL; \
+  seconds=timestamp_diff_seconds(start,get_timestamp()); \
+  Print(L"%-28s %8s ms/round, %6s Msamples/s\n",DESC,ftowcs(seconds*1000/BENCHMARK_ROUNDS), \
+        ftowcs(seconds>0?BENCHMARK_ROUNDS*32.0*SAMPLES_PER_BUFFER*2/seconds/1000000:0));
+
+/**
+ * Compares the direct sample calculation against wavetable oscillators.
+ * Every round fills all 32 buffers, the device isn't used so this works without audio hardware.
+ */
+void benchmark_fill_functions()
+{
+  ac97_buffers_s16_t *buffers;
+  UINTN pages, tc;
+  UINT64 start;
+  double seconds;
+
+  if(init_timestamps()!=0)
+  {
+    LOG.error(L"could not initialize timestamps");
+    return;
+  }
+
+  pages=(sizeof(ac97_buffers_s16_t)+AC97_BUFFER_COUNT*SAMPLES_PER_BUFFER*2*sizeof(INT16)+4095)/4096;
+  if((buffers=allocate_pages(pages))==NULL)
+  {
+    LOG.error(L"could not allocate benchmark buffers");
+    return;
+  }
+  for(tc=0;tc<AC97_BUFFER_COUNT;tc++)
+    buffers->buffers[tc]=((INT16 *)(buffers+1))+tc*SAMPLES_PER_BUFFER*2;
+
+  Print(L"filling %d buffers with %d stereo samples, %d rounds each:\n",AC97_BUFFER_COUNT,SAMPLES_PER_BUFFER,BENCHMARK_ROUNDS);
+  BENCHMARK_FILL(L"crossscale",fill_buffers_crossscale(buffers,0,32,0));
+  BENCHMARK_FILL(L"crossscale (wavetable)",fill_buffers_wavetable_crossscale(buffers,0,32,0));
+  BENCHMARK_FILL(L"harmonic scale",fill_buffers_harmonic_scale(buffers,0,32));
+  BENCHMARK_FILL(L"harmonic scale (wavetable)",fill_buffers_wavetable_harmonic_scale(buffers,0,32));
+
+  free_pages(buffers,pages);
+}
+
+
 /**
  * Fills audio buffers with scales, copies buffers to AC'97 device and starts playback.
  * This is pretty much how you'd output prepared audio, e.g. when playing music.
@@ -153,7 +288,7 @@ void output_audio(ac97_handle_t *handle)
 {
   EFI_STATUS result;
 
-  fill_buffers_harmonic_scale(handle->buffers,0,32);
+  fill_buffers_wavetable_harmonic_scale(handle->buffers,0,32);
 
   result=flush_ac97_output(handle);
   ON_ERROR_RETURN(L"flush_ac97_output",);
@@ -177,80 +312,68 @@ void output_audio(ac97_handle_t *handle)
  * This fills audio buffers while they're being played.
  * This is how you'd output audio on the fly, e.g. sound effects that depend on user inputs.
  *
- * Seems like the timer granularity can't be decreased much, setting it to e.g. 5ms loses count of a few ticks.
+ * Waits for buffer completion events instead of polling the current index: the CPU is free to do other work (e.g.
+ * render graphics) between buffer refills.
  *
  * \param handle the AC'97 handle to use
  */
 void loop_civ(ac97_handle_t *handle)
 {
-  unsigned int tc, td;
+  unsigned int tc;
   EFI_STATUS result;
-  UINTN last=0xff;
   UINTN value=0, value2=0xff;
-  EFI_EVENT event;
-  UINTN index;
   UINT8 volume_left, volume_right;
 
-  result=gST->BootServices->CreateEvent(EVT_TIMER,TPL_CALLBACK,NULL,NULL,&event);
-  ON_ERROR_RETURN(L"CreateEvent",);
-  result=gST->BootServices->SetTimer(event,TimerPeriodic,25*1000*10); //25ms
-  ON_ERROR_RETURN(L"SetTimer",);
-
   for(tc=0;tc<64;tc++)
   {
-    for(td=0;td<40;td++)
-    {
-      result=gST->BootServices->WaitForEvent(1,&event,&index);
-      ON_ERROR_RETURN(L"WaitForEvent",);
+    result=ac97_wait_for_buffer_completion(handle,1000);
+    if(result==EFI_TIMEOUT)
+      continue;
+    ON_ERROR_RETURN(L"ac97_wait_for_buffer_completion",);
 
-      result=read_busmaster_reg(handle,AC97_CIV_PCM_OUT,&value);
-      ON_ERROR_RETURN(L"read_busmaster_reg",);
-      if(last==value)
-        continue;
-      LOG.trace(L"civ=%02d (%3dms)",value,td*25);
+    result=read_busmaster_reg(handle,AC97_CIV_PCM_OUT,&value);
+    ON_ERROR_RETURN(L"read_busmaster_reg",);
+    LOG_TRACE(L"civ=%02d (%d buffers completed)",value,handle->completed_buffers);
 
-      if(value==31 && tc<40)
-      {
-        fill_buffers_crossscale(handle->buffers,0,16,0);
-        value2=0;
-      }
-      else if(value==0 && tc>1 && tc<40)
-      {
-        fill_buffers_crossscale(handle->buffers,16,16,16);
-        value2=31;
-      }
+    if(value==31 && tc<40)
+    {
+      fill_buffers_wavetable_crossscale(handle->buffers,0,16,0);
+      value2=0;
+    }
+    else if(value==0 && tc>1 && tc<40)
+    {
+      fill_buffers_wavetable_crossscale(handle->buffers,16,16,16);
+      value2=31;
+    }
 
-      if(tc==16)
-        LOG.debug(L"starting master volume panning");
+    if(tc==16)
+      LOG_DEBUG(L"starting master volume panning");
 
-      if(tc>=16 && tc<31)
-      {
-        volume_left=(value-16)*4+3;
-        volume_right=66-volume_left;
-        if(handle->max_master_vol<63)
-        {
-          volume_left/=2;
-          volume_right/=2;
-        }
-        result=write_mixer_reg(handle,AC97_MIXER_MASTER,ac97_mixer_value(volume_left,volume_right,ARG_MUTE));
-        ON_ERROR_RETURN(L"  write_mixer_reg",);
-        LOG.trace(L"wrote master volume values: left=%02d, right=%02d",volume_left,volume_right);
-      }
-      else if(tc==31)
+    if(tc>=16 && tc<31)
+    {
+      volume_left=(value-16)*4+3;
+      volume_right=66-volume_left;
+      if(handle->max_master_vol<63)
       {
-        write_mixer_reg(handle,AC97_MIXER_MASTER,ac97_mixer_value(8,8,ARG_MUTE));
-        LOG.debug(L"reset master volume");
+        volume_left/=2;
+        volume_right/=2;
       }
+      result=write_mixer_reg(handle,AC97_MIXER_MASTER,ac97_mixer_value(volume_left,volume_right,ARG_MUTE));
+      ON_ERROR_RETURN(L"  write_mixer_reg",);
+      LOG_TRACE(L"wrote master volume values: left=%02d, right=%02d",volume_left,volume_right);
+    }
+    else if(tc==31)
+    {
+      write_mixer_reg(handle,AC97_MIXER_MASTER,ac97_mixer_value(8,8,ARG_MUTE));
+      LOG_DEBUG(L"reset master volume");
+    }
 
-      if(value2<32)
-      {
-        result=write_busmaster_reg(handle,AC97_LVI_PCM_OUT,value2);
-        ON_ERROR_RETURN(L"  write_busmaster_reg",);
-        LOG.debug(L"wrote %d to PCM OUT LVI",value2);
-        value2=0xff;
-      }
-      last=value;
-      break;
+    if(value2<32)
+    {
+      result=write_busmaster_reg(handle,AC97_LVI_PCM_OUT,value2);
+      ON_ERROR_RETURN(L"  write_busmaster_reg",);
+      LOG_DEBUG(L"wrote %d to PCM OUT LVI",value2);
+      value2=0xff;
     }
   }
   Print(L"Press any key to continue...\n");
@@ -282,6 +405,13 @@ EFI_STATUS run_audio_stuff(EFI_PCI_IO_PROTOCOL *audio)
   result=set_ac97_cmdline_volume(&handle);
   ON_ERROR_WARN(L"could not set volume");
 
+  result=ac97_enable_completion_events(&handle,AC97_DEFAULT_COMPLETION_INTERVAL);
+  if(result!=EFI_SUCCESS)
+  {
+    close_ac97_handle(&handle);
+    return result;
+  }
+
   dump_audio_registers(&handle,AC97_DUMP_ALL);
 
   output_audio(&handle);
@@ -301,8 +431,16 @@ INTN EFIAPI ShellAppMain(UINTN argc, CHAR16 **argv)
 {
   EFI_PCI_IO_PROTOCOL *audio;
   EFI_STATUS rv;
-  if((rv=init(argc,argv,1,&ac97_arguments))!=EFI_SUCCESS)
+  if((rv=init(argc,argv,2,&ac97_arguments,&_arguments))!=EFI_SUCCESS)
     return rv;
+
+  if(ARG_BENCHMARK)
+  {
+    benchmark_fill_functions();
+    shutdown();
+    return EFI_SUCCESS;
+  }
+
   init_pci_lib();
 
   audio=find_ac97_device();
@@ -36,7 +36,7 @@ void cpuid()
       :"=b" (id1), "=d" (id2), "=c" (id3)
       :
       :"rax");
-  LOG.trace(L"id1=%l08X id2=%l08X id3=%l08X\n",id1,id2,id3);
+  LOG_TRACE(L"id1=%l08X id2=%l08X id3=%l08X\n",id1,id2,id3);
 
   buf[0]=(id1&0xff);
   buf[1]=(id1&0xff00)>>8;
@@ -56,7 +56,7 @@ void cpuid()
   asm("mov $1,%%rax\n"
       "cpuid\n"
       :"=a" (rax), "=b" (rbx), "=c" (rcx), "=d" (rdx));
-  LOG.trace(L"rax=%l08X rbx=%l08X rcx=%l08X rdx=%l08X\n",rax,rbx,rcx,rdx);
+  LOG_TRACE(L"rax=%l08X rbx=%l08X rcx=%l08X rdx=%l08X\n",rax,rbx,rcx,rdx);
 
   Print(L"stepping: %d\n",rax&0xf);
   Print(L"model: %d\n",(rax&0xf0)>>4);
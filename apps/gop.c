@@ -27,13 +27,35 @@
 #include <Library/BaseMemoryLib.h>
 #include <UEFIStarter/core.h>
 #include <UEFIStarter/graphics.h>
+#include <UEFIStarter/capture.h>
+#include <UEFIStarter/particles.h>
 
 
-#define ARG_SKIP_BARS     _argument_list[0].value.uint64 /**< helper macro to access the "-skip-bars" command-line argument */
-#define ARG_SKIP_IMAGES   _argument_list[1].value.uint64 /**< helper macro to access the "-skip-images" command-line argument */
-#define ARG_SKIP_FONT     _argument_list[2].value.uint64 /**< helper macro to access the "-skip-font" command-line argument */
-#define ARG_SKIP_OBJECTS  _argument_list[3].value.uint64 /**< helper macro to access the "-skip-objects" command-line argument */
-#define ARG_SKIP_ANIM     _argument_list[4].value.uint64 /**< helper macro to access the "-skip-anim" command-line argument */
+#define ARG_SKIP_BARS      _argument_list[0].value.uint64 /**< helper macro to access the "-skip-bars" command-line argument */
+#define ARG_SKIP_IMAGES    _argument_list[1].value.uint64 /**< helper macro to access the "-skip-images" command-line argument */
+#define ARG_SKIP_FONT      _argument_list[2].value.uint64 /**< helper macro to access the "-skip-font" command-line argument */
+#define ARG_SKIP_OBJECTS   _argument_list[3].value.uint64 /**< helper macro to access the "-skip-objects" command-line argument */
+#define ARG_SKIP_ANIM      _argument_list[4].value.uint64 /**< helper macro to access the "-skip-anim" command-line argument */
+#define ARG_CAPTURE        _argument_list[5].value.wcstr  /**< helper macro to access the "-capture" command-line argument */
+#define ARG_CAPTURE_EVERY  _argument_list[6].value.uint64 /**< helper macro to access the "-capture-every" command-line argument */
+#define ARG_SKIP_PARTICLES _argument_list[7].value.uint64 /**< helper macro to access the "-skip-particles" command-line argument */
+#define ARG_PARTICLES      _argument_list[8].value.uint64 /**< helper macro to access the "-particles" command-line argument */
+
+/**
+ * Validates the "capture interval" command-line parameter
+ *
+ * \param v the input to check
+ * \return whether the input is a valid capture interval
+ */
+INT_RANGE_VALIDATOR(_validate_capture_every,L"capture interval",1,1000);
+
+/**
+ * Validates the "particle count" command-line parameter
+ *
+ * \param v the input to check
+ * \return whether the input is a valid number of particles
+ */
+INT_RANGE_VALIDATOR(_validate_particle_count,L"particle count",1,1000000);
 
 /** list of command-line arguments */
 static cmdline_argument_t _argument_list[] = {
@@ -42,6 +64,10 @@ static cmdline_argument_t _argument_list[] = {
   {{uint64:0},ARG_BOOL,NULL,L"-skip-font",   L"Skip font test"},
   {{uint64:0},ARG_BOOL,NULL,L"-skip-objects",L"Skip moving objects test"},
   {{uint64:0},ARG_BOOL,NULL,L"-skip-anim",   L"Skip animation test"},
+  {{wcstr:L""},ARG_STRING,NULL,L"-capture",L"Record the animation test's frames to this file, e.g. \\capture.fcp"},
+  {{uint64:1},ARG_INT,_validate_capture_every,L"-capture-every",L"Record every Nth frame [1..1000]"},
+  {{uint64:0},ARG_BOOL,NULL,L"-skip-particles",L"Skip particles test"},
+  {{uint64:20000},ARG_INT,_validate_particle_count,L"-particles",L"Number of particles in particles test [1..1000000]"},
 };
 
 /** command-line arguments group */
@@ -143,7 +169,7 @@ void draw_moving_objects(EFI_GRAPHICS_OUTPUT_PROTOCOL *gop)
 
   limit=width>height?height:width;
   limit-=64;
-  LOG.debug(L"limit: %d",limit);
+  LOG_DEBUG(L"limit: %d",limit);
   for(tc=0;tc<limit;tc++)
   {
     limit_framerate(&previous_ts,minimum_frame_ticks);
@@ -164,12 +190,13 @@ void draw_moving_objects(EFI_GRAPHICS_OUTPUT_PROTOCOL *gop)
 /**
  * Draws an animated progress bar, then a full-screen animation.
  * This actually prepares a background buffer that's twice the screen height and then scrolls down to simulate movement.
+ * If the "-capture" option is set the frames get recorded, see tools/decode_capture.py for extracting them.
  *
  * \param gop the UEFI graphics protocol to draw with
  */
 void draw_prepared_fs_anim(EFI_GRAPHICS_OUTPUT_PROTOCOL *gop)
 {
-  EFI_STATUS result;
+  EFI_STATUS result=EFI_SUCCESS;
   EFI_GRAPHICS_OUTPUT_BLT_PIXEL *buffer;
   EFI_GRAPHICS_OUTPUT_BLT_PIXEL *current;
   unsigned int x, y, tc;
@@ -186,6 +213,8 @@ void draw_prepared_fs_anim(EFI_GRAPHICS_OUTPUT_PROTOCOL *gop)
   UINT64 times[4];
   UINT64 previous_ts;
   UINT64 minimum_frame_ticks;
+  frame_capture_t capture;
+  BOOLEAN capturing=FALSE;
 
   unsigned int buffer_size_bytes=width*buffer_height*sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL);
 
@@ -221,15 +250,35 @@ void draw_prepared_fs_anim(EFI_GRAPHICS_OUTPUT_PROTOCOL *gop)
   }
   times[2]=get_timestamp();
 
+  if(ARG_CAPTURE[0])
+    capturing=start_frame_capture(&capture,ARG_CAPTURE,width,height,ARG_CAPTURE_EVERY)==EFI_SUCCESS;
+
   previous_ts=times[0];
   for(tc=0;tc<count;tc++)
   {
     limit_framerate(&previous_ts,minimum_frame_ticks);
     result=gop->Blt(gop,buffer+(tc%512)*width,EfiBltBufferToVideo,0,0,0,0,width,height,0);
-    ON_ERROR_RETURN(L"gop->Blt",);
+    if(result!=EFI_SUCCESS)
+    {
+      //stop the capture and free the buffer below instead of returning
+      LOG.error(L"gop->Blt() returned status %d (%r)",result,result);
+      break;
+    }
+    if(capturing && capture_frame(&capture,buffer+(tc%512)*width)!=EFI_SUCCESS)
+    {
+      stop_frame_capture(&capture);
+      capturing=FALSE;
+    }
   }
 
   times[3]=get_timestamp();
+  if(capturing)
+    stop_frame_capture(&capture);
+  if(result!=EFI_SUCCESS)
+  {
+    free_pages(buffer,pages);
+    return;
+  }
 
   double prepare_time=timestamp_diff_seconds(times[1],times[2]);
   double run_time=timestamp_diff_seconds(times[2],times[3]);
@@ -240,11 +289,118 @@ void draw_prepared_fs_anim(EFI_GRAPHICS_OUTPUT_PROTOCOL *gop)
 }
 
 
+/** the number of frames the particle animation runs for */
+#define PARTICLE_DEMO_FRAMES 600
+
+/**
+ * Spawns a particle for the particle animation: above the screen, with random column, speed and brightness.
+ * Faster particles are brighter and react more to wind, as if they were closer.
+ *
+ * \param particles the particle system, its context is the frame buffer image
+ * \param index     the index of the particle to spawn
+ */
+void spawn_demo_particle(particle_system_t *particles, UINTN index)
+{
+  image_t *frame=particles->context;
+  INT32 speed=PARTICLE_FIXED_ONE/2+(INT32)next_random_below(&particles->random,3*PARTICLE_FIXED_ONE);
+
+  particles->x[index]=PARTICLE_FROM_INT(next_random_below(&particles->random,frame->width));
+  particles->y[index]=-PARTICLE_FROM_INT(next_random_below(&particles->random,frame->height));
+  particles->velocity_x[index]=0;
+  particles->velocity_y[index]=speed;
+  particles->drift_response[index]=speed/4;
+  particles->shade[index]=(UINT8)(96+speed*159/(7*PARTICLE_FIXED_ONE/2));
+}
+
+/**
+ * Draws a particle into the frame buffer as a gray pixel.
+ *
+ * \param particles the particle system
+ * \param index     the index of the particle to draw
+ * \param x         the particle's column
+ * \param y         the particle's row
+ * \param context   the frame buffer image
+ */
+void render_demo_particle(particle_system_t *particles, UINTN index, INT32 x, INT32 y, void *context)
+{
+  image_t *frame=context;
+  EFI_GRAPHICS_OUTPUT_BLT_PIXEL *pixel=frame->data+y*frame->width+x;
+
+  pixel->Red=particles->shade[index];
+  pixel->Green=particles->shade[index];
+  pixel->Blue=particles->shade[index];
+}
+
+/**
+ * Draws a full-screen particle animation: particles falling through changing wind.
+ * Each frame is rendered into a buffer that's copied to the screen at once. The time spent updating and rendering
+ * particles is printed afterwards.
+ *
+ * \param gop the UEFI graphics protocol to draw with
+ */
+void draw_particles(EFI_GRAPHICS_OUTPUT_PROTOCOL *gop)
+{
+  EFI_STATUS result;
+  particle_system_t particles;
+  image_t *frame;
+  INT32 wind;
+  unsigned int tc;
+
+  unsigned int width=gop->Mode->Info->HorizontalResolution;
+  unsigned int height=gop->Mode->Info->VerticalResolution;
+
+  UINT64 previous_ts;
+  UINT64 minimum_frame_ticks;
+  UINT64 start, particle_ticks=0;
+
+  if((frame=create_image(width,height))==NULL)
+    return;
+  init_timestamps();
+  if(init_particle_system(&particles,ARG_PARTICLES,PARTICLE_FROM_INT(height),spawn_demo_particle,get_timestamp(),frame)!=EFI_SUCCESS)
+  {
+    free_image(frame);
+    return;
+  }
+
+  previous_ts=get_timestamp();
+  minimum_frame_ticks=get_timestamp_ticks_per_second()/ARG_FPS;
+  for(tc=0;tc<PARTICLE_DEMO_FRAMES;tc++)
+  {
+    //the wind slowly changes direction, between -2 and 2 pixels per frame
+    wind=PARTICLE_FROM_INT((INT32)ramp(tc)-128)/64;
+
+    start=get_timestamp();
+    update_particles(&particles,wind,0);
+    ZeroMem(frame->data,width*height*sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+    render_particles(&particles,width,height,render_demo_particle,frame);
+    particle_ticks+=get_timestamp()-start;
+
+    limit_framerate(&previous_ts,minimum_frame_ticks);
+    result=gop->Blt(gop,frame->data,EfiBltBufferToVideo,0,0,0,0,width,height,0);
+    if(result!=EFI_SUCCESS)
+    {
+      LOG.error(L"gop->Blt() returned status %d (%r)",result,result);
+      break;
+    }
+  }
+
+  free_particle_system(&particles);
+  free_image(frame);
+  if(tc>0 && get_timestamp_ticks_per_second()>0)
+  {
+    gST->ConOut->SetCursorPosition(gST->ConOut,0,0);
+    Print(L"updated and rendered %d particles in %ldus per frame\n",ARG_PARTICLES,
+          particle_ticks*1000000/get_timestamp_ticks_per_second()/tc);
+  }
+}
+
+
 /** data type for image parser function pointers */
 typedef image_t *image_parser_f(file_contents_t *);
 
 /**
  * Loads an image and then draws it to the screen.
+ * The file is read in the background while a progress bar is shown.
  *
  * \TODO remove parser function pointer and use newer load_netpbm_file() instead
  *
@@ -254,13 +410,23 @@ typedef image_t *image_parser_f(file_contents_t *);
  */
 void draw_image(EFI_GRAPHICS_OUTPUT_PROTOCOL *gop, CHAR16 *filename, image_parser_f parser)
 {
+  async_read_t read;
   file_contents_t *contents;
   image_t *image;
   EFI_STATUS result;
+  unsigned int width=gop->Mode->Info->HorizontalResolution;
+  unsigned int height=gop->Mode->Info->VerticalResolution;
 
-  contents=get_file_contents(filename);
+  start_async_read(&read,filename);
+  while(!is_async_read_done(&read))
+  {
+    draw_progress_bar(gop,width,height,get_async_read_progress(1,&read));
+    gBS->Stall(10000);
+  }
+  contents=finish_async_read(&read);
   if(!contents)
     return;
+  draw_progress_bar(gop,width,height,1.0);
 
   image=parser(contents);
   if(!free_pages(contents,contents->memory_pages))
@@ -485,6 +651,11 @@ void do_graphics_stuff()
     draw_moving_objects(gop);
     wait_for_key();
   }
+  if(!ARG_SKIP_PARTICLES)
+  {
+    draw_particles(gop);
+    wait_for_key();
+  }
   if(!ARG_SKIP_ANIM)
   {
     draw_prepared_fs_anim(gop);
@@ -78,14 +78,14 @@ void *find_device(EFI_GUID *guid, unsigned int offset)
   result=gST->BootServices->LocateHandle(ByProtocol,guid,NULL,&handles_size,(void **)&handles);
   ON_ERROR_RETURN(L"LocateHandle",NULL);
   handle_count=handles_size/sizeof(EFI_HANDLE);
-  LOG.debug(L"handles size: %d bytes (%d entries)",handles_size,handle_count);
+  LOG_DEBUG(L"handles size: %d bytes (%d entries)",handles_size,handle_count);
 
   if(offset>=handle_count)
   {
     LOG.error(L"cannot get protocol handle, requested offset %d beyond handle count %d",offset,handle_count);
     return NULL;
   }
-  LOG.trace(L"handle: %016lX",handles[offset]);
+  LOG_TRACE(L"handle: %016lX",handles[offset]);
   result=gST->BootServices->OpenProtocol(handles[offset],guid,&device,gImageHandle,NULL,EFI_OPEN_PROTOCOL_BY_HANDLE_PROTOCOL);
   ON_ERROR_RETURN(L"OpenProtocol",NULL);
 
@@ -16,12 +16,16 @@
 #include <math.h>
 #include <stdio.h>
 #include <UEFIStarter/graphics.h>
+#include <UEFIStarter/framepacing.h>
 #include <UEFIStarter/core.h>
 
 
 /** additional buffer required to rotate image */
 EFI_GRAPHICS_OUTPUT_BLT_PIXEL *buffer2;
 
+/** frame pacer for the animated gradient, its statistics get printed at exit */
+frame_pacer_t gradient_pacer;
+
 
 /** shortcut macro to access "radius" command-line parameter */
 #define ARG_RADIUS args[0].value.uint64
@@ -38,6 +42,7 @@ ARG_GROUP(arggroup,args,L"Application-specific options");
 /**
  * This draws an animated gradient.
  * It's actually a bilinear interpolation between the 4 corners of the screen: the corner colors change between frames.
+ * Frames are paced to the "-fps" limit, the frame time statistics get printed when the application exits.
  */
 void draw_gradient()
 {
@@ -45,7 +50,6 @@ void draw_gradient()
   EFI_STATUS result;
   UINTN x, y;
   UINTN tc;
-  UINT64 prev_ts, cur_ts;
   UINTN td;
 
   UINTN rel_pages;
@@ -67,7 +71,11 @@ void draw_gradient()
   for(tc=0;tc<graphics_fs_height;tc++)
     rel_ys[tc]=(float)tc/graphics_fs_height;
 
-  prev_ts=get_timestamp();
+  if(init_frame_pacer(&gradient_pacer,ARG_FPS)!=EFI_SUCCESS)
+  {
+    free_pages(rel_xs,rel_pages);
+    return;
+  }
   for(tc=0;tc<256;tc++)
   {
     corners[0].Green=tc;
@@ -89,10 +97,9 @@ void draw_gradient()
 
     result=graphics_protocol->Blt(graphics_protocol,graphics_fs_buffer,EfiBltBufferToVideo,0,0,0,0,graphics_fs_width,graphics_fs_height,0);
     ON_ERROR_RETURN(L"graphics_protocol->Blt",);
-    cur_ts=get_timestamp();
     gST->ConOut->SetCursorPosition(gST->ConOut,0,0);
-    Print(L"%dms",(int)(timestamp_diff_seconds(prev_ts,cur_ts)*1000));
-    prev_ts=cur_ts;
+    Print(L"%dms (avg %dms, %ld dropped)  ",(int)get_last_frame_ms(&gradient_pacer),(int)get_average_frame_ms(&gradient_pacer),gradient_pacer.dropped_frames);
+    end_frame(&gradient_pacer);
   }
 
   free_pages(rel_xs,rel_pages);
@@ -220,6 +227,7 @@ int main(int argc, char **argv_ascii)
   draw_gradient();
 
   shutdown_graphics();
+  print_frame_statistics(&gradient_pacer);
   shutdown();
   return EFI_SUCCESS;
 }
@@ -15,12 +15,13 @@
 #include <Library/UefiLib.h>
 #include <Library/UefiBootServicesTableLib.h>
 #include <UEFIStarter/core.h>
+#include <UEFIStarter/particles.h>
 
 //if defined, this will output the current crosswind speed
 //#define SHOW_CROSS_SPEED
 
-#define FLAKE_SCREEN_WIDTH _screen_width               /**< the snowflake canvas width */
-#define FLAKE_SCREEN_HEIGHT (_screen_height-2)         /**< the snowflake canvas height */
+#define FLAKE_SCREEN_WIDTH _screen.columns             /**< the snowflake canvas width */
+#define FLAKE_SCREEN_HEIGHT (_screen.rows-2)           /**< the snowflake canvas height */
 #define FLAKE_DEFAULT_DURATION_SECONDS 60              /**< the default time (in seconds) this application should run */
 #define FLAKE_DEFAULT_UPDATE_INTERVAL_MILLISECONDS 100 /**< the default update interval (in ms) between frames */
 #define FLAKE_DEFAULT_COUNT 100                        /**< the default number of flakes, including off-screen ones */
@@ -30,16 +31,51 @@
 #define FLAKE_CROSS_SPEED_FALLOFF_MULT 0.8 /**< the default wind speed falloff multiplier */
 #define FLAKE_CROSS_SPEED_BASE 0.1         /**< the default base wind speed */
 
+/**
+ * Validates the "flake count" command-line parameter
+ *
+ * \param v the input to check
+ * \return whether the input is a valid number of flakes
+ */
+INT_RANGE_VALIDATOR(_validate_flake_count,L"flake count",1,1000000);
+
+/**
+ * Validates the "maximum crosswind speed" command-line parameter.
+ * Wind speeds are multiplied with flakes' wind response (below 1.0) in 16.16 fixed point, the product must stay below
+ * 128.0 to fit in 32 bits.
+ *
+ * \param v the input to check
+ * \return whether the input is a valid wind speed
+ */
+DOUBLE_RANGE_VALIDATOR(_validate_max_cross_speed,L"maximum crosswind speed",0.0,100.0);
+
+/**
+ * Validates the "crosswind falloff multiplier" command-line parameter, larger values would make the wind speed grow
+ * without bounds
+ *
+ * \param v the input to check
+ * \return whether the input is a valid multiplier
+ */
+DOUBLE_RANGE_VALIDATOR(_validate_cross_falloff,L"crosswind falloff multiplier",0.0,1.0);
+
+/**
+ * Validates the "base crosswind speed" command-line parameter, see _validate_max_cross_speed() for limits
+ *
+ * \param v the input to check
+ * \return whether the input is a valid wind speed
+ */
+DOUBLE_RANGE_VALIDATOR(_validate_base_cross_speed,L"base crosswind speed",-100.0,100.0);
+
 /** command-line arguments */
 static cmdline_argument_t _argument_list[] = {
-  {{uint64:FLAKE_DEFAULT_DURATION_SECONDS},            ARG_INT,   NULL,L"-duration",           L"Duration (in seconds) snow should fall"},
-  {{uint64:FLAKE_DEFAULT_COUNT},                       ARG_INT,   NULL,L"-count",              L"Number of flakes generated (about half of them on screen)"},
-  {{uint64:FLAKE_DEFAULT_UPDATE_INTERVAL_MILLISECONDS},ARG_INT,   NULL,L"-interval",           L"Interval (in milliseconds) between frames"},
-  {{uint64:FLAKE_DEFAULT_GROUND_LIFETIME},             ARG_INT,   NULL,L"-lifetime",           L"Lifetime (in seconds) of flakes on ground"},
-  {{dbl:FLAKE_CROSS_STEP},                             ARG_DOUBLE,NULL,L"-cross-step",         L"Crosswind increment step"},
-  {{dbl:FLAKE_MAX_CROSS_SPEED},                        ARG_DOUBLE,NULL,L"-max-cross-speed",    L"Maximum crosswind speed"},
-  {{dbl:FLAKE_CROSS_SPEED_FALLOFF_MULT},               ARG_DOUBLE,NULL,L"-cross-falloff-multi",L"Crosswind speed falloff multiplier (keep <=1.0)"},
-  {{dbl:FLAKE_CROSS_SPEED_BASE},                       ARG_DOUBLE,NULL,L"-base-cross-speed",   L"Base crosswind speed"}
+  {{uint64:FLAKE_DEFAULT_DURATION_SECONDS},            ARG_INT,   NULL,                      L"-duration",           L"Duration (in seconds) snow should fall"},
+  {{uint64:FLAKE_DEFAULT_COUNT},                       ARG_INT,   _validate_flake_count,     L"-count",              L"Number of flakes generated (about half of them on screen) [1..1000000]"},
+  {{uint64:FLAKE_DEFAULT_UPDATE_INTERVAL_MILLISECONDS},ARG_INT,   NULL,                      L"-interval",           L"Interval (in milliseconds) between frames"},
+  {{uint64:FLAKE_DEFAULT_GROUND_LIFETIME},             ARG_INT,   NULL,                      L"-lifetime",           L"Lifetime (in seconds) of flakes on ground"},
+  {{dbl:FLAKE_CROSS_STEP},                             ARG_DOUBLE,NULL,                      L"-cross-step",         L"Crosswind increment step"},
+  {{dbl:FLAKE_MAX_CROSS_SPEED},                        ARG_DOUBLE,_validate_max_cross_speed, L"-max-cross-speed",    L"Maximum crosswind speed [0..100]"},
+  {{dbl:FLAKE_CROSS_SPEED_FALLOFF_MULT},               ARG_DOUBLE,_validate_cross_falloff,   L"-cross-falloff-multi",L"Crosswind speed falloff multiplier [0..1]"},
+  {{dbl:FLAKE_CROSS_SPEED_BASE},                       ARG_DOUBLE,_validate_base_cross_speed,L"-base-cross-speed",   L"Base crosswind speed [-100..100]"}
 };
 
 #define ARG_SECONDS         _argument_list[0].value.uint64 /**< helper macro to access application lifetime parameter */
@@ -55,126 +91,91 @@ static cmdline_argument_t _argument_list[] = {
 /** command-line argument group */
 static ARG_GROUP(_arguments,_argument_list,L"Weather options (in a UEFI boot time executable, mind you)");
 
-static UINTN _screen_width;           /**< internal storage for screen's total width (in characters) */
-static UINTN _screen_height;          /**< internal storage for screen's total height (in characters) */
+static text_screen_t _screen;         /**< internal storage for the virtual text screen */
 static UINTN _ground_lifetime_frames; /**< internal storage for snowflake's ground lifetime (in number of frames) */
 
+/** helper macro to get the text attribute for a foreground color on the screen's background */
+#define FLAKE_ATTRIBUTE(COLOR) ((_screen.attribute&0xF0)|(COLOR))
 
-/**
- * This generates a very-pseudo random number.
- * Don't use this function for anything but trivial applications, the numbers are nowhere near random.
- *
- * \return a number random enough for this application
- *
- * \TODO There's a GetRandomNumber32() function in EDK2 but it seems to segfault all the time, see what's up
- */
-UINT32 random()
-{
-  return get_timestamp();
-/*  UINT32 value;
-  GetRandomNumber32(&value);
-  return value;*/
-}
 
-/** data type describing a snowflake */
+/** data type for the render callback's context */
 typedef struct {
-  double column;   /**< the text column this flake currently is in (as double, so movement across screen is smoother) */
-  double speed;    /**< the flake's speed */
-  int previous_x;  /**< the flake's previous text column */
-  int previous_y;  /**< the flake*s previous height */
-  int y_offset;    /**< the flake*s current height */
-  int time_offset; /**< the flake's time of creation (as frame number) */
-} flake_t;
+  int iteration;   /**< the animation loop iteration number */
+  int *land_times; /**< the list of flakes' last landing times, one entry per text column */
+} flake_render_context_t;
 
 /**
- * Initializes a snowflake.
+ * Spawns a snowflake above the screen, with random column and speed.
+ * Faster flakes are affected by wind more, as if they were closer to the viewer.
  *
- * \param flake       the flake to initialize/reset
- * \param time_offset the time of the flake's creation
+ * \param flakes the snowflakes' particle system
+ * \param index  the index of the flake to spawn
  */
-void init_flake(flake_t *flake, int time_offset)
+void spawn_flake(particle_system_t *flakes, UINTN index)
 {
-  flake->column=(double)(random()%(FLAKE_SCREEN_WIDTH*2))-(double)FLAKE_SCREEN_WIDTH/2; /** \TODO use screen height and max cross speed to accurately calculate this */
-  flake->speed=((random()%60)+40)/100.0;
-  flake->previous_y=-10000;
-  flake->previous_x=-10000;
-  flake->y_offset=random()%20;
-  flake->time_offset=time_offset;
-  LOG.debug(L"initialized flake: col=%5s, speed=%s, y_offset=%d",ftowcs(flake->column),ftowcs(flake->speed),flake->y_offset);
+  INT32 speed=PARTICLE_FROM_INT(next_random_below(&flakes->random,60)+40)/100;
+
+  flakes->x[index]=PARTICLE_FROM_INT((INT32)next_random_below(&flakes->random,FLAKE_SCREEN_WIDTH*2)-FLAKE_SCREEN_WIDTH/2); /** \TODO use screen height and max cross speed to accurately calculate this */
+  flakes->y[index]=-PARTICLE_FROM_INT(next_random_below(&flakes->random,20));
+  flakes->velocity_x[index]=0;
+  flakes->velocity_y[index]=speed;
+  flakes->drift_response[index]=(INT32)(((INT64)speed*speed)>>PARTICLE_FIXED_SHIFT);
+  flakes->shade[index]=speed>PARTICLE_FROM_DOUBLE(0.9)?15:7;
 }
 
 /**
- * Handles snow flake movement for a single frame of animation.
+ * Draws a snowflake into the virtual text screen.
  *
  * This function doesn't handle flakes on the ground: those are actually just visual artifacts. The snowflakes fall
- * "through" the ground, get reset to above the screen and start from there. The flakes seen on the ground were just
+ * "through" the ground, get respawned above the screen and start from there. The flakes seen on the ground were just
  * never removed during animation. Instead the flake's landing time is written to land_times, update_ground() will
  * draw over those flakes that landed more than the configured ground lifetime ago.
  *
- * \param flakes      the snowflakes' data
- * \param iteration   the animation loop iteration number
- * \param cross_speed the current wind speed
- * \param land_times  the list of flakes' last landing times, one entry per text column
- * \return the number of currently moving snowflakes; on error the (1-based) snowflake number the error happened at
+ * \param flakes  the snowflakes' particle system
+ * \param index   the index of the flake to draw
+ * \param x       the flake's text column
+ * \param y       the flake's text row
+ * \param context the render context, a flake_render_context_t
  */
-int update_flakes(flake_t flakes[], int iteration, float cross_speed, int land_times[])
+void render_flake(particle_system_t *flakes, UINTN index, INT32 x, INT32 y, void *context)
 {
-  EFI_STATUS result;
-  int x, y;
-  int td, active_count=0;
-  for(td=0;td<ARG_FLAKE_COUNT;td++)
+  flake_render_context_t *render_context=context;
+
+  set_text_cell(&_screen,x,y,L'*',FLAKE_ATTRIBUTE(flakes->shade[index]));
+  if(y==FLAKE_SCREEN_HEIGHT)
   {
-    flakes[td].column+=cross_speed*flakes[td].speed*flakes[td].speed;
-    y=flakes[td].speed*(iteration-flakes[td].time_offset);
-    LOG.trace(L"flake %02d: y=%d, previous_y=%d",td,y,flakes[td].previous_y);
-    if(y>FLAKE_SCREEN_HEIGHT+flakes[td].y_offset)
-    {
-      init_flake(&flakes[td],iteration);
-      continue;
-    }
-    active_count++;
-    if(y<flakes[td].y_offset)
-    {
-      flakes[td].previous_y=y;
-      continue;
-    }
-    y-=flakes[td].y_offset;
-    if(y==flakes[td].previous_y && x==flakes[td].previous_x)
-      continue;
-    x=flakes[td].column;
-    if(flakes[td].previous_y>=flakes[td].y_offset && flakes[td].previous_y<FLAKE_SCREEN_HEIGHT+flakes[td].y_offset && flakes[td].previous_x>=0 && flakes[td].previous_x<FLAKE_SCREEN_WIDTH)
-    {
-      result=gST->ConOut->SetCursorPosition(gST->ConOut,flakes[td].previous_x,flakes[td].previous_y-flakes[td].y_offset);
-      ON_ERROR_RETURN(L"SetCursorPosition",active_count);
-      Print(L" ");
-    }
-    if(x>=0 && x<FLAKE_SCREEN_WIDTH)
-    {
-      result=gST->ConOut->SetCursorPosition(gST->ConOut,x,y);
-      ON_ERROR_RETURN(L"SetCursorPosition",active_count);
+    render_context->land_times[x]=render_context->iteration;
+    LOG_DEBUG(L"flake %d landed",index);
+  }
+}
 
-      if(flakes[td].speed>0.9)
-        color_print(15,L"*");
-//      else if(flakes[td].speed<0.5) //this was intended to add another layer of depth:
-//        color_print(8,L"*");        //very slow flakes should be far away, but the gray on black looks fugly
-      else
-        color_print(7,L"*");
+/**
+ * Clears the sky, i.e. the snowflake canvas above the ground.
+ */
+void clear_sky()
+{
+  int x, y;
 
-      if(y==FLAKE_SCREEN_HEIGHT)
-      {
-        land_times[x]=iteration;
-        LOG.debug(L"flake %d landed",td);
-      }
-    }
-    flakes[td].previous_y=y+flakes[td].y_offset;
-    flakes[td].previous_x=x;
-  }
+  for(y=0;y<FLAKE_SCREEN_HEIGHT;y++)
+    for(x=0;x<FLAKE_SCREEN_WIDTH;x++)
+      set_text_cell(&_screen,x,y,L' ',_screen.attribute);
+}
 
-  //the color_print() calls above allocate pool memory entries, there's currently an upper limit for these, so let's
-  //free them before the memory tracker runs out of entries.
-  free_pool_memory_entries();
+/**
+ * Handles snow flake movement for a single frame of animation, drawing into the virtual text screen.
+ *
+ * \param flakes      the snowflakes' particle system
+ * \param iteration   the animation loop iteration number
+ * \param cross_speed the current wind speed
+ * \param land_times  the list of flakes' last landing times, one entry per text column
+ */
+void update_flakes(particle_system_t *flakes, int iteration, double cross_speed, int land_times[])
+{
+  flake_render_context_t context={iteration,land_times};
 
-  return active_count;
+  update_particles(flakes,PARTICLE_FROM_DOUBLE(cross_speed),0);
+  clear_sky();
+  render_particles(flakes,FLAKE_SCREEN_WIDTH,FLAKE_SCREEN_HEIGHT+1,render_flake,&context);
 }
 
 /**
@@ -206,10 +207,7 @@ EFI_INPUT_KEY read_key()
  */
 void print_cross_speed(double speed)
 {
-  EFI_STATUS result;
-  result=gST->ConOut->SetCursorPosition(gST->ConOut,40,FLAKE_SCREEN_HEIGHT+1);
-  ON_ERROR_RETURN(L"SetCursorPosition",);
-  Print(L"%5s",ftowcs(speed));
+  print_text_screen(&_screen,40,FLAKE_SCREEN_HEIGHT+1,_screen.attribute,L"%5s",ftowcs(speed));
 }
 
 /**
@@ -220,26 +218,21 @@ void print_cross_speed(double speed)
  */
 void update_ground(int iteration, int land_times[])
 {
-  EFI_STATUS result;
   int tc;
 
   for(tc=0;tc<FLAKE_SCREEN_WIDTH;tc++)
-  {
-    if(iteration-land_times[tc]!=_ground_lifetime_frames)
-      continue;
-    result=gST->ConOut->SetCursorPosition(gST->ConOut,tc,FLAKE_SCREEN_HEIGHT);
-    ON_ERROR_RETURN(L"SetCursorPosition",);
-    Print(L" ");
-  }
+    if(iteration-land_times[tc]==_ground_lifetime_frames)
+      set_text_cell(&_screen,tc,FLAKE_SCREEN_HEIGHT,L' ',_screen.attribute);
 }
 
 /**
  * Main animation loop.
+ *
+ * \param flakes the snowflakes' particle system
  */
-void do_print_snow()
+void do_print_snow(particle_system_t *flakes)
 {
   EFI_STATUS result;
-  flake_t flakes[ARG_FLAKE_COUNT];
   int tc;
   EFI_EVENT events[2];
   UINTN index;
@@ -252,9 +245,6 @@ void do_print_snow()
     land_times[tc]=-100000;
   _ground_lifetime_frames=ARG_GROUND_LIFETIME*1000/ARG_UPDATE_INTERVAL;
 
-  for(tc=0;tc<ARG_FLAKE_COUNT;tc++)
-    init_flake(&flakes[tc],0);
-
   result=gST->BootServices->CreateEvent(EVT_TIMER,TPL_CALLBACK,NULL,NULL,&events[1]);
   ON_ERROR_RETURN(L"CreateEvent",);
   result=gST->BootServices->SetTimer(events[1],TimerPeriodic,ARG_UPDATE_INTERVAL*1000*10);
@@ -262,9 +252,7 @@ void do_print_snow()
   gST->ConOut->EnableCursor(gST->ConOut,FALSE);
   events[0]=gST->ConIn->WaitForKey;
 
-  result=gST->ConOut->SetCursorPosition(gST->ConOut,0,FLAKE_SCREEN_HEIGHT+1);
-  ON_ERROR_RETURN(L"SetCursorPosition",);
-  Print(L"[Q]uit, [L/Rarr] wind");
+  print_text_screen(&_screen,0,FLAKE_SCREEN_HEIGHT+1,_screen.attribute,L"[Q]uit, [L/Rarr] wind");
   for(tc=0;tc<duration;tc++)
   {
     result=gST->BootServices->WaitForEvent(2,events,&index);
@@ -290,31 +278,25 @@ void do_print_snow()
       }
 #ifdef SHOW_CROSS_SPEED
       print_cross_speed(cross_speed);
+      console_present(&_screen);
 #endif
       continue;
     }
-    if(update_flakes(flakes,tc,cross_speed,land_times)<1)
-      break;
+    update_flakes(flakes,tc,cross_speed,land_times);
     update_ground(tc,land_times);
     cross_speed=(cross_speed-ARG_CROSS_SPEED_BASE)*ARG_CROSS_SPEED_FALLOFF_MULT+ARG_CROSS_SPEED_BASE;
 #ifdef SHOW_CROSS_SPEED
     print_cross_speed(cross_speed);
 #endif
+    result=console_present(&_screen);
+    ON_ERROR_RETURN(L"console_present",);
   }
-  LOG.debug(L"finished after %d iterations",tc+1);
+  LOG_DEBUG(L"finished after %d iterations",tc+1);
   result=gST->ConOut->SetCursorPosition(gST->ConOut,0,FLAKE_SCREEN_HEIGHT+1);
   ON_ERROR_RETURN(L"SetCursorPosition",);
   gST->ConOut->EnableCursor(gST->ConOut,TRUE);
 }
 
-/**
- * Clears the screen.
- */
-void clear()
-{
-  gST->ConOut->ClearScreen(gST->ConOut);
-}
-
 /**
  * Main function, gets invoked by UEFI shell.
  *
@@ -325,15 +307,22 @@ void clear()
 INTN EFIAPI ShellAppMain(UINTN argc, CHAR16 **argv)
 {
   EFI_STATUS result;
+  particle_system_t flakes;
+
   if((result=init(argc,argv,1,&_arguments))!=EFI_SUCCESS)
     return result;
 
-  result=gST->ConOut->QueryMode(gST->ConOut,gST->ConOut->Mode->Mode,&_screen_width,&_screen_height);
-  ON_ERROR_RETURN(L"ConOut->QueryMode",result);
-
-  clear();
-  do_print_snow();
+  result=init_text_screen(&_screen);
+  ON_ERROR_RETURN(L"init_text_screen",result);
+  //flakes falling below the ground row get respawned
+  result=init_particle_system(&flakes,ARG_FLAKE_COUNT,PARTICLE_FROM_INT(FLAKE_SCREEN_HEIGHT+1)-1,spawn_flake,get_timestamp(),NULL);
+  if(result==EFI_SUCCESS)
+  {
+    do_print_snow(&flakes);
+    free_particle_system(&flakes);
+  }
 
+  free_text_screen(&_screen);
   shutdown();
-  return EFI_SUCCESS;
+  return result;
 }
@@ -134,7 +134,7 @@ void do_event_tests()
   Print(L"waiting for events (c..callback, w..wait)...\n");
   for(tc=0;tc<20;tc++)
   {
-    LOG.trace(L"waiting...");
+    LOG_TRACE(L"waiting...");
     result=gST->BootServices->WaitForEvent(1,&events[0],&index);
     ON_ERROR_RETURN(L"WaitForEvent",);
     Print(L" %dw%s",index+1,index>0?L"\n":L"");
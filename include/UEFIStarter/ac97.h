@@ -47,6 +47,11 @@ extern cmdline_argument_group_t ac97_arguments;
 #define AC97_CONTROL_PCM_OUT    0x1B /**< "PCM OUT control" bus master register */
 #define AC97_GLOBAL_CONTROL     0x2C /**< "global control" bus master register */
 
+#define AC97_STATUS_LVBCI 0x04 /**< PCM OUT status register: "last valid buffer completion interrupt" bit */
+#define AC97_STATUS_BCIS  0x08 /**< PCM OUT status register: "buffer completion interrupt status" bit */
+
+#define AC97_DEFAULT_COMPLETION_INTERVAL 10000 /**< default buffer completion check interval, in 100ns units (1ms) */
+
 
 /**
  * Data type for an AC'97 "baseline audio register set".
@@ -166,6 +171,10 @@ typedef struct
   void *mapping;                       /**< DMA memory mapping for transferring audio data to AC'97 */
   EFI_PCI_IO_PROTOCOL *pci;            /**< UEFI PCI handle to use */
   UINT8 max_master_vol;                /**< maximum master volume, either 31 or 63, depending on hardware */
+  EFI_EVENT completion_event;          /**< signaled when a buffer completed, NULL if completion events are disabled */
+  EFI_EVENT completion_timer;          /**< periodic timer checking for buffer completion */
+  volatile UINTN completed_buffers;    /**< number of buffers completed since completion events were enabled */
+  volatile BOOLEAN last_valid_sent;    /**< whether the last valid buffer was completed */
 } ac97_handle_t;
 
 /** data type for bus master status register */
@@ -213,6 +222,10 @@ EFI_STATUS flush_ac97_output(ac97_handle_t *handle);
 EFI_STATUS ac97_play(ac97_handle_t *handle);
 void ac97_wait_until_last_buffer_sent(ac97_handle_t *handle, UINTN timeout_in_milliseconds);
 
+EFI_STATUS ac97_enable_completion_events(ac97_handle_t *handle, UINT64 interval);
+void ac97_disable_completion_events(ac97_handle_t *handle);
+EFI_STATUS ac97_wait_for_buffer_completion(ac97_handle_t *handle, UINTN timeout_in_milliseconds);
+
 
 #define AC97_DUMP_VOLUME  0x00000001 /**< flag for dump_audio_registers(): dump volume registers */
 #define AC97_DUMP_OTHER   0x80000000 /**< flag for dump_audio_registers(): dump other registers */
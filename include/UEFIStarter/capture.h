@@ -0,0 +1,103 @@
+/** \file
+ * Frame capture for analyzing animations
+ *
+ * A frame capture records every Nth frame of an animation to a file on the boot volume, along with each frame's
+ * timestamp. Frames are delta-encoded against the previously captured frame: unchanged pixels are skipped, changed
+ * pixels are stored either as literal run or, if they repeat, as a single fill value. Animations that only change
+ * parts of the screen thus produce little data, and encoding a frame costs about one comparison per pixel.
+ *
+ * Usage:
+ *
+ *     frame_capture_t capture;
+ *
+ *     start_frame_capture(&capture,L"\\capture.fcp",width,height,4);
+ *     while(animating)
+ *     {
+ *       draw_frame(buffer);
+ *       capture_frame(&capture,buffer);
+ *     }
+ *     stop_frame_capture(&capture);
+ *
+ * The capture file can be converted to individual PPM images with tools/decode_capture.py.
+ *
+ * File format, all numbers little-endian:
+ *
+ *   - the capture header (capture_file_header_t)
+ *   - for each captured frame: the frame header (capture_frame_header_t), followed by runs until the frame's pixels
+ *     are covered. Each run starts with a 32-bit word: the top 2 bits are the run type (CAPTURE_RUN_*), the lower 30
+ *     bits the number of pixels. Fill runs are followed by one pixel, copy runs by as many pixels as they cover.
+ *     Pixels are 32-bit BGRX values, in the same order as EFI_GRAPHICS_OUTPUT_BLT_PIXEL.
+ *
+ * The first frame is encoded against a black frame.
+ *
+ * \author Richard Nusser
+ * \copyright 2017-2018 Richard Nusser
+ * \license GPLv3 (see http://www.gnu.org/licenses/)
+ * \sa https://github.com/rinusser/UEFIStarter
+ * \ingroup group_lib_capture
+ */
+
+#ifndef __CAPTURE_H
+#define __CAPTURE_H
+
+#include <Uefi.h>
+#include <Protocol/GraphicsOutput.h>
+#include "core/files.h"
+
+
+#define CAPTURE_FILE_MAGIC 0x50434655 /**< magic number at the start of capture files, "UFCP" in ASCII */
+#define CAPTURE_FILE_VERSION 1        /**< the capture file format's version */
+
+#define CAPTURE_RUN_SKIP 0         /**< run type: the pixels are unchanged from the previous frame */
+#define CAPTURE_RUN_FILL 1         /**< run type: the pixels all have the value that follows */
+#define CAPTURE_RUN_COPY 2         /**< run type: the pixels' values follow */
+#define CAPTURE_RUN_TYPE_SHIFT 30  /**< bit position of the run type within run words */
+#define CAPTURE_RUN_MAX 0x3FFFFFFF /**< maximum number of pixels per run */
+
+#define CAPTURE_MIN_FILL_RUN 4 /**< minimum number of identical changed pixels to encode as fill run */
+
+
+/** data type for capture file headers */
+typedef struct
+{
+  UINT32 magic;            /**< always CAPTURE_FILE_MAGIC */
+  UINT32 version;          /**< always CAPTURE_FILE_VERSION */
+  UINT32 width;            /**< the frames' width, in pixels */
+  UINT32 height;           /**< the frames' height, in pixels */
+  UINT64 ticks_per_second; /**< the number of timestamp ticks per second */
+  UINT32 interval;         /**< the number of frames per captured frame */
+  UINT32 reserved;         /**< reserved, always 0 */
+} capture_file_header_t;
+
+/** data type for headers of captured frames */
+typedef struct
+{
+  UINT32 frame;     /**< the frame's number, counting all frames passed to capture_frame() */
+  UINT32 reserved;  /**< reserved, always 0 */
+  UINT64 timestamp; /**< the time the frame was captured at, in timestamp ticks since the capture started */
+} capture_frame_header_t;
+
+/** data type for a frame capture's state */
+typedef struct
+{
+  file_writer_t writer;                    /**< the capture file's writer */
+  UINT32 width;                            /**< the frames' width, in pixels */
+  UINT32 height;                           /**< the frames' height, in pixels */
+  UINTN interval;                          /**< the number of frames per captured frame */
+  UINT32 *previous;                        /**< the previously captured frame */
+  EFI_GRAPHICS_OUTPUT_BLT_PIXEL *readback; /**< the buffer for frames read from the screen, NULL until first used */
+  UINTN frame_pages;                       /**< the number of memory pages allocated per frame buffer */
+  UINT64 start_timestamp;                  /**< the time the capture started at */
+  UINT64 frame_count;                      /**< the number of frames passed to capture_frame() */
+  UINT64 captured_frames;                  /**< the number of frames written to the file */
+  UINT64 encode_ticks;                     /**< the time spent encoding frames, in timestamp ticks */
+} frame_capture_t;
+
+
+EFI_STATUS start_frame_capture(frame_capture_t *capture, CHAR16 *filename, UINT32 width, UINT32 height, UINTN interval);
+EFI_STATUS capture_frame(frame_capture_t *capture, EFI_GRAPHICS_OUTPUT_BLT_PIXEL *frame);
+EFI_STATUS capture_screen(frame_capture_t *capture, EFI_GRAPHICS_OUTPUT_PROTOCOL *gop);
+EFI_STATUS stop_frame_capture(frame_capture_t *capture);
+
+
+#endif
@@ -8,5 +8,7 @@
 #include "core/memory.h"
 #include "core/string.h"
 #include "core/timestamp.h"
+#include "core/serial.h"
+#include "core/profiler.h"
 
 #endif
@@ -1,6 +1,21 @@
 /** \file
  * Command line parameter parser
  *
+ * Argument values can also be loaded from config files on the boot volume, with "-config <file>" or load_config().
+ * Config files contain one "name=value" setting per line, names are the argument names without the leading dash:
+ *
+ *     # lines starting with '#' are comments
+ *     width=800
+ *     fullscreen=true
+ *     title=some text
+ *
+ * Boolean settings accept 1/true/yes/on and 0/false/no/off. Values are validated the same way as command-line
+ * arguments, and arguments given on the command line override the config file's values.
+ *
+ * Parsing config files can be skipped on repeated runs by saving all argument values as binary snapshot, with
+ * "-save-config <file>" or save_config_snapshot(). Snapshots are loaded with "-config <file>" as well; they only load
+ * into argument groups with the same argument names and types as the ones they were saved from.
+ *
  * \author Richard Nusser
  * \copyright 2017-2018 Richard Nusser
  * \license GPLv3 (see http://www.gnu.org/licenses/)
@@ -16,6 +31,13 @@
 /** EFI_STATUS compatible return value, indicating user wanted the help screen */
 #define RV_HELP 0x10000000
 
+/** maximum number of argument groups parse_parameters() accepts */
+#define CMDLINE_MAX_GROUPS 16
+
+#define CONFIG_MAX_LINE_LENGTH 256        /**< maximum length of config file lines, in characters */
+#define CONFIG_SNAPSHOT_MAGIC 0x47464355  /**< magic number at the start of config snapshots, "UCFG" in ASCII */
+#define CONFIG_SNAPSHOT_VERSION 1         /**< the config snapshot format's version */
+
 /** the supported command line argument types */
 typedef enum
 {
@@ -53,6 +75,19 @@ typedef struct {
   cmdline_argument_t *list;  /**< the list of arguments in this group */
 } cmdline_argument_group_t;
 
+/**
+ * data type for config snapshot headers
+ * The header is followed by one UINT64 per argument, in group order. String arguments store their string's size in
+ * bytes there (0 for NULL), the strings follow the values as null-terminated UTF-16.
+ */
+typedef struct
+{
+  UINT32 magic;       /**< always CONFIG_SNAPSHOT_MAGIC */
+  UINT32 version;     /**< always CONFIG_SNAPSHOT_VERSION */
+  UINT32 layout_hash; /**< hash over all arguments' names and types */
+  UINT32 count;       /**< the number of arguments */
+} config_snapshot_header_t;
+
 /**
  * shortcut macro for quickly defining an argument group
  *
@@ -93,6 +128,8 @@ BOOLEAN validate_uint64_range(cmdline_value_t v, CHAR16 *field, UINT64 min, UINT
 
 EFI_STATUS parse_parameters(INTN argc, CHAR16 **argv, UINTN group_count, VA_LIST groups);
 void print_help_text(UINTN group_count, VA_LIST groups);
+EFI_STATUS load_config(CHAR16 *filename, UINTN group_count, VA_LIST groups);
+EFI_STATUS save_config_snapshot(CHAR16 *filename, UINTN group_count, VA_LIST groups);
 
 CHAR16 **argv_from_ascii(int argc, char **argv_ascii);
 void free_argv();
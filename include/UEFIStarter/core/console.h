@@ -14,6 +14,41 @@
 #include <Uefi.h>
 #include "cmdline.h"
 
+
+/**
+ * the maximum number of unchanged cells console_present() includes in a run to avoid another SetCursorPosition() call
+ */
+#define TEXT_SCREEN_MAX_GAP 4
+
+/** data type for a text screen's character cells */
+typedef struct
+{
+  CHAR16 character; /**< the cell's character */
+  UINT16 attribute; /**< the cell's text attribute, see EFI_TEXT_ATTR() */
+} text_cell_t;
+
+/**
+ * data type for virtual text screens
+ *
+ * Text-mode animations write into a text screen's cells instead of the console, then call console_present() once per
+ * frame. That compares the cells to what's currently on screen and only outputs the changed spans, so the firmware's
+ * console (which may render every call through the graphics output) is called once per span instead of once per
+ * character.
+ *
+ * The bottom right cell is never output: writing it would scroll some consoles.
+ */
+typedef struct
+{
+  UINTN columns;         /**< the screen's width, in characters */
+  UINTN rows;            /**< the screen's height, in characters */
+  text_cell_t *cells;    /**< the cells drawn by the application, row by row */
+  text_cell_t *shown;    /**< the cells currently on screen */
+  CHAR16 *run;           /**< buffer for the characters of one output span */
+  UINTN memory_pages;    /**< the number of memory pages allocated for the buffers */
+  UINT16 attribute;      /**< the attribute for cleared cells */
+  UINT64 presented_runs; /**< statistics: the number of spans output so far */
+} text_screen_t;
+
 EFI_STATUS EFIAPI init(INTN argc, CHAR16 **argv, UINTN arg_group_count, ...);
 void shutdown();
 
@@ -21,6 +56,13 @@ void print_console_modes();
 EFI_STATUS set_console_mode(unsigned int requested_mode);
 void EFIAPI color_print(UINTN color, CHAR16 *fmt, ...);
 
+EFI_STATUS init_text_screen(text_screen_t *screen);
+void free_text_screen(text_screen_t *screen);
+void clear_text_screen(text_screen_t *screen);
+void set_text_cell(text_screen_t *screen, INTN x, INTN y, CHAR16 character, UINTN attribute);
+void EFIAPI print_text_screen(text_screen_t *screen, INTN x, INTN y, UINTN attribute, CHAR16 *fmt, ...);
+EFI_STATUS console_present(text_screen_t *screen);
+
 
 void drain_key_buffer();
 void wait_for_key();
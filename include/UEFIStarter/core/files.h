@@ -14,6 +14,22 @@
 #include <Uefi.h>
 #include <Guid/FileInfo.h>
 #include <Protocol/SimpleFileSystem.h>
+#include "string.h"
+
+
+#define FILES_MAX_VOLUMES 16            /**< maximum number of volumes kept in the file system cache */
+#define FILES_MAX_CACHED_DIRECTORIES 16 /**< maximum number of directory handles kept in the file system cache */
+#define FILES_MAX_DIRECTORY_LENGTH 128  /**< maximum length of cached directory paths, longer paths aren't cached */
+
+#define ASYNC_READ_CHUNK_SIZE 65536      /**< bytes read per file and timer tick if the firmware doesn't support ReadEx() */
+#define ASYNC_READ_TIMER_INTERVAL 100000 /**< interval between chunked reads, in 100ns units */
+#define ASYNC_READ_MAX_CHUNKED 16        /**< maximum number of concurrent chunked reads */
+#define ASYNC_READ_POLL_INTERVAL 1000    /**< interval between checks while waiting for reads to finish, in microseconds */
+
+#define FILE_READER_DEFAULT_BUFFER_SIZE 4096  /**< default buffer size for file readers, in bytes */
+#define FILE_WRITER_DEFAULT_BUFFER_SIZE 65536 /**< default buffer size for file writers, in bytes */
+#define FILE_WRITER_MAX_FORMAT_LENGTH 512     /**< maximum length of each formatted write, longer output gets truncated */
+
 
 /**
  * Data structure for file contents.
@@ -25,9 +41,87 @@ typedef struct {
   char data[];        /**< the file's content data */
 } file_contents_t;
 
+/**
+ * Data type for asynchronous file reads.
+ * Start reads with start_async_read() and finish them with finish_async_read(). The instance is accessed in event
+ * notification functions until the read finished, so it needs to remain valid until then.
+ */
+typedef struct
+{
+  EFI_FILE_HANDLE file;       /**< the file being read */
+  file_contents_t *contents;  /**< the file's contents, allocated when the read starts */
+  volatile UINT64 bytes_read; /**< the number of bytes read so far */
+  volatile EFI_STATUS status; /**< EFI_NOT_READY while reading, the read's result afterwards */
+  EFI_FILE_IO_TOKEN token;    /**< the I/O token, if the file is read with ReadEx() */
+  BOOLEAN chunked;            /**< whether the file is read in chunks on a timer event instead */
+} async_read_t;
+
+/**
+ * Data type for buffered file readers.
+ * Files are read sequentially through a fixed-size buffer, so arbitrarily large files can be processed in constant
+ * memory. Views returned by the reader point into the buffer: they're only valid until the next read or seek.
+ */
+typedef struct
+{
+  EFI_FILE_HANDLE file; /**< the file being read */
+  CHAR8 *buffer;        /**< the read buffer */
+  UINTN buffer_size;    /**< the read buffer's size, in bytes */
+  UINTN buffer_pages;   /**< the number of memory pages allocated for the read buffer */
+  UINT64 buffer_offset; /**< the file position of the buffer's first byte */
+  UINTN position;       /**< the read position within the buffer */
+  UINTN length;         /**< the number of valid bytes in the buffer */
+  BOOLEAN end_of_file;  /**< whether the file's end was reached */
+  EFI_STATUS status;    /**< the first error that occurred, EFI_SUCCESS otherwise */
+} file_reader_t;
+
+/**
+ * Data type for buffered file writers.
+ * Small writes are collected in the buffer and written to the file in large blocks, which is much faster than writing
+ * each piece on its own. Errors are sticky: after the first failed write all further writes are discarded, so callers
+ * only need to check the status when flushing or closing.
+ */
+typedef struct
+{
+  EFI_FILE_HANDLE file; /**< the file being written */
+  CHAR8 *buffer;        /**< the write buffer */
+  UINTN buffer_size;    /**< the write buffer's size, in bytes */
+  UINTN buffer_pages;   /**< the number of memory pages allocated for the write buffer */
+  UINTN length;         /**< the number of bytes waiting in the buffer */
+  UINT64 bytes_written; /**< the total number of bytes written, including buffered bytes */
+  EFI_STATUS status;    /**< the first error that occurred, EFI_SUCCESS otherwise */
+} file_writer_t;
+
+
+UINTN get_volume_count();
+EFI_FILE_HANDLE get_volume_root(UINTN volume);
+void flush_file_system_cache();
+
 EFI_FILE_HANDLE find_root_volume();
 EFI_FILE_HANDLE find_file(CHAR16 *pathname);
+EFI_FILE_HANDLE find_file_on_volume(UINTN volume, CHAR16 *pathname);
+EFI_FILE_HANDLE create_file(CHAR16 *pathname);
+EFI_FILE_HANDLE create_file_on_volume(UINTN volume, CHAR16 *pathname);
 file_contents_t *get_file_contents(CHAR16 *filename);
 
+EFI_STATUS start_async_read(async_read_t *read, CHAR16 *filename);
+BOOLEAN is_async_read_done(async_read_t *read);
+UINTN count_pending_async_reads(UINTN count, async_read_t *reads);
+double get_async_read_progress(UINTN count, async_read_t *reads);
+file_contents_t *finish_async_read(async_read_t *read);
+
+EFI_STATUS open_file_reader(file_reader_t *reader, CHAR16 *filename, UINTN buffer_size);
+UINTN read_file_chunk(file_reader_t *reader, void *target, UINTN size);
+ascii_view_t peek_file_reader(file_reader_t *reader, UINTN size);
+BOOLEAN read_file_line(file_reader_t *reader, ascii_view_t *line);
+EFI_STATUS seek_file_reader(file_reader_t *reader, UINT64 position);
+UINT64 get_file_reader_position(file_reader_t *reader);
+void close_file_reader(file_reader_t *reader);
+
+EFI_STATUS open_file_writer(file_writer_t *writer, CHAR16 *filename, UINTN buffer_size);
+EFI_STATUS write_file_chunk(file_writer_t *writer, CONST void *data, UINTN size);
+EFI_STATUS EFIAPI write_file_format(file_writer_t *writer, CONST CHAR8 *format, ...);
+EFI_STATUS flush_file_writer(file_writer_t *writer);
+EFI_STATUS close_file_writer(file_writer_t *writer);
+
 
 #endif
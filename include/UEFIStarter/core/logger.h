@@ -14,7 +14,7 @@
 #include <Uefi.h>
 
 /** helper macro to log a TRACE message containing the current file and line */
-#define TRACE_HERE LOG.trace(L"%a#%d",__FILE__,__LINE__);
+#define TRACE_HERE LOG_TRACE(L"%a#%d",__FILE__,__LINE__);
 
 /**
  * helper macro to quickly log a WARN message if an EFI result is anything but EFI_SUCCESS
@@ -81,6 +81,39 @@ typedef struct
 extern const loggers_t LOG;
 
 
+#ifndef LOG_COMPILE_LEVEL
+/**
+ * The highest log level compiled in when using the LOG_* macros.
+ * Log calls above this level are removed entirely at compile time, including their arguments. Override this with e.g.
+ * -DLOG_COMPILE_LEVEL=INFO in the build options, the release build does this already.
+ */
+#define LOG_COMPILE_LEVEL TRACE
+#endif
+
+/**
+ * Logs a message if the given log level is compiled in and enabled.
+ * Unlike calling the LOG functions directly the arguments are only evaluated if the message will actually be logged,
+ * so e.g. `LOG_TRACE(L"%s",ftowcs(value))` doesn't allocate anything if TRACE is disabled.
+ *
+ * \param LEVEL the log level to log at
+ * \param FUNC  the LOG function to call
+ * \param ...   the format string and any arguments
+ */
+#define LOG_AT(LEVEL,FUNC,...) do \
+  { \
+    if((LEVEL)<=LOG_COMPILE_LEVEL && logger_admit_entry(LEVEL)) \
+      FUNC(__VA_ARGS__); \
+  } while(0)
+
+#define LOG_TRACE(...) LOG_AT(TRACE,LOG.trace,__VA_ARGS__) /**< logs a TRACE message, see LOG_AT() */
+#define LOG_DEBUG(...) LOG_AT(DEBUG,LOG.debug,__VA_ARGS__) /**< logs a DEBUG message, see LOG_AT() */
+#define LOG_INFO(...)  LOG_AT(INFO, LOG.info, __VA_ARGS__) /**< logs an INFO message, see LOG_AT() */
+#define LOG_WARN(...)  LOG_AT(WARN, LOG.warn, __VA_ARGS__) /**< logs a WARN message, see LOG_AT() */
+#define LOG_ERROR(...) LOG_AT(ERROR,LOG.error,__VA_ARGS__) /**< logs an ERROR message, see LOG_AT() */
+
+BOOLEAN logger_admit_entry(LOGLEVEL level);
+
+
 LOGLEVEL get_log_level();
 LOGLEVEL set_log_level(LOGLEVEL level);
 
@@ -91,4 +124,21 @@ void kill();
 
 logger_print_function_t *set_logger_function(logger_print_function_t *func);
 
+
+/** maximum number of format arguments stored per deferred log entry, messages with more get printed immediately */
+#define LOG_DEFERRED_MAX_ARGS 8
+
+/** data type for deferred log entries: the message is only formatted when the log gets flushed */
+typedef struct
+{
+  UINT64 timestamp;                   /**< the timestamp the message was logged at */
+  LOGLEVEL level;                     /**< the log level */
+  CHAR16 *format;                     /**< the message's format string, must still be valid when flushing */
+  UINT64 args[LOG_DEFERRED_MAX_ARGS]; /**< the raw format arguments */
+} deferred_log_entry_t;
+
+EFI_STATUS enable_deferred_logging(UINTN capacity);
+UINTN flush_deferred_log();
+void disable_deferred_logging();
+
 #endif
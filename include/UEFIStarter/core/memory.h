@@ -69,5 +69,9 @@ void print_pool_memory_list();
 void init_tracking_memory();
 UINTN stop_tracking_memory();
 
+UINTN get_tracked_page_count();
+UINTN get_peak_tracked_page_count();
+void reset_peak_tracked_page_count();
+
 
 #endif
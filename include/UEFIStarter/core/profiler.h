@@ -0,0 +1,135 @@
+/** \file
+ * Scoped profiler for measuring hot code paths
+ *
+ * Place PROFILE_SCOPE(L"name") at the start of a block to measure how long the block takes, e.g.:
+ *
+ *     EFI_STATUS graphics_fs_blt(GFX_BUFFER buffer)
+ *     {
+ *       PROFILE_SCOPE(L"graphics_fs_blt");
+ *       ...
+ *     }
+ *
+ * Zones are cheap while the profiler isn't running: entering a scope only checks a flag. While running, every scope
+ * exit updates its zone's statistics and records an event with the scope's enter and exit timestamps.
+ *
+ * Define PROFILING_ENABLED as 0 to compile out all PROFILE_SCOPE() instrumentation.
+ *
+ * The scope's exit is tracked with GCC's "cleanup" variable attribute, so early returns are measured correctly.
+ *
+ * \author Richard Nusser
+ * \copyright 2017-2018 Richard Nusser
+ * \license GPLv3 (see http://www.gnu.org/licenses/)
+ * \sa https://github.com/rinusser/UEFIStarter
+ * \ingroup group_lib_profiler
+ */
+
+#ifndef __PROFILER_H
+#define __PROFILER_H
+
+#include <Uefi.h>
+#include "timestamp.h"
+
+
+#ifndef PROFILING_ENABLED
+#define PROFILING_ENABLED 1 /**< whether PROFILE_SCOPE() instrumentation gets compiled in */
+#endif
+
+#define PROFILER_DEFAULT_EVENT_CAPACITY 65536           /**< default number of events to record */
+#define PROFILER_TRACE_FILENAME         L"\\profile.json" /**< file shutdown_profiler() writes the trace to */
+
+
+/** data type for a profiling zone, usually declared by PROFILE_SCOPE() */
+typedef struct profile_zone_s
+{
+  const CHAR16 *name;          /**< the zone's name, as UTF-16 */
+  UINT64 count;                /**< number of times the zone was exited while profiling */
+  UINT64 total_ticks;          /**< sum of all durations, in timestamp ticks */
+  UINT64 min_ticks;            /**< shortest duration, in timestamp ticks */
+  UINT64 max_ticks;            /**< longest duration, in timestamp ticks */
+  struct profile_zone_s *next; /**< internal: next zone in the list of active zones */
+  BOOLEAN registered;          /**< internal: whether the zone is in the list of active zones */
+} profile_zone_t;
+
+/** data type for a single recorded zone execution */
+typedef struct
+{
+  profile_zone_t *zone; /**< the executed zone */
+  UINT64 start;         /**< timestamp at zone entry */
+  UINT64 end;           /**< timestamp at zone exit */
+} profile_event_t;
+
+/** data type for an entered scope, PROFILE_SCOPE() declares these */
+typedef struct
+{
+  profile_zone_t *zone; /**< the entered zone, NULL if the profiler wasn't running at entry */
+  UINT64 start;         /**< timestamp at zone entry */
+} profile_scope_t;
+
+/** data type for aggregated zone statistics, all durations are in timestamp ticks */
+typedef struct
+{
+  UINT64 count; /**< number of executions */
+  UINT64 min;   /**< shortest duration */
+  UINT64 max;   /**< longest duration */
+  UINT64 mean;  /**< average duration */
+  UINT64 p99;   /**< 99th percentile duration, based on recorded events */
+} profile_stats_t;
+
+
+extern BOOLEAN profiler_running;
+
+/**
+ * Enters a profiling scope.
+ * Use PROFILE_SCOPE() instead of calling this directly.
+ *
+ * \param zone the zone to enter
+ * \return the entered scope
+ */
+static inline profile_scope_t profile_scope_enter(profile_zone_t *zone)
+{
+  profile_scope_t scope={NULL,0};
+  if(profiler_running)
+  {
+    scope.zone=zone;
+    scope.start=get_timestamp();
+  }
+  return scope;
+}
+
+void profile_scope_exit(profile_scope_t *scope);
+
+/** internal: helper macro for PROFILE_SCOPE() */
+#define _PROFILE_CONCAT2(A,B) A##B
+/** internal: helper macro for PROFILE_SCOPE(), expands macro arguments before concatenating */
+#define _PROFILE_CONCAT(A,B) _PROFILE_CONCAT2(A,B)
+
+#if PROFILING_ENABLED
+/**
+ * Measures the current block from this point until it's left.
+ * This is a declaration, so it must go where declarations are allowed.
+ *
+ * \param NAME the zone's name, as UTF-16 string literal
+ */
+#define PROFILE_SCOPE(NAME) \
+  static profile_zone_t _PROFILE_CONCAT(_profile_zone_,__LINE__)={NAME}; \
+  profile_scope_t _PROFILE_CONCAT(_profile_scope_,__LINE__) __attribute__((cleanup(profile_scope_exit))) \
+    =profile_scope_enter(&_PROFILE_CONCAT(_profile_zone_,__LINE__))
+#else
+#define PROFILE_SCOPE(NAME)
+#endif
+
+
+EFI_STATUS start_profiling(UINTN event_capacity);
+void stop_profiling();
+void reset_profiler();
+void shutdown_profiler();
+
+profile_zone_t *find_profile_zone(CHAR16 *name);
+BOOLEAN get_profile_zone_stats(profile_zone_t *zone, profile_stats_t *stats);
+UINTN get_profile_dropped_event_count();
+
+void print_profile_report();
+EFI_STATUS write_profile_trace(CHAR16 *filename);
+
+
+#endif
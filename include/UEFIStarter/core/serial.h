@@ -0,0 +1,29 @@
+/** \file
+ * Log writer for serial ports and the QEMU debug console
+ *
+ * \author Richard Nusser
+ * \copyright 2017-2018 Richard Nusser
+ * \license GPLv3 (see http://www.gnu.org/licenses/)
+ * \sa https://github.com/rinusser/UEFIStarter
+ * \ingroup group_lib_logger
+ */
+
+#ifndef __SERIAL_H
+#define __SERIAL_H
+
+#include <Uefi.h>
+#include "logger.h"
+
+
+#define SERIAL_PORT_COM1     0x3F8  /**< I/O port base of the first serial port */
+#define SERIAL_PORT_DEBUGCON 0xE9   /**< I/O port of QEMU's/Bochs' "isa-debugcon" device */
+#define SERIAL_BAUD_RATE     115200 /**< baud rate serial ports get configured with */
+#define SERIAL_LOG_BUFFER_SIZE 4096 /**< number of bytes buffered before log output gets written to the port */
+
+
+EFI_STATUS init_serial_logger(UINT16 port);
+void serial_log_print(LOGLEVEL level, CHAR16 *msg);
+void flush_serial_log();
+
+
+#endif
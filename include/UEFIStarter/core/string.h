@@ -13,6 +13,103 @@
 
 #include <Uefi.h>
 
+
+/** buffer size that fits any number converted by the *_to_wcs() and *_to_ascii() functions, in characters */
+#define NUMBER_STRING_LENGTH 32
+
+/** the maximum number of decimals for double_to_wcs() and double_to_ascii() */
+#define MAX_DOUBLE_DECIMALS 9
+
+/** the initial capacity of string builders without a caller-provided buffer, in characters */
+#define STRING_BUILDER_DEFAULT_CAPACITY 128
+
+/**
+ * data type for string builders
+ *
+ * String builders append formatted text to a buffer, e.g. a caller-provided stack buffer. Once that buffer is full
+ * they continue in pool memory, growing as needed. Cleared builders keep their buffer, so repeatedly formatting text
+ * with the same builder doesn't allocate anything after the first few calls.
+ */
+typedef struct
+{
+  CHAR16 *buffer;    /**< the built string, always null-terminated */
+  UINTN capacity;    /**< the buffer's size, in characters */
+  UINTN length;      /**< the built string's length, in characters */
+  BOOLEAN allocated; /**< whether the buffer is pool memory owned by the builder */
+  BOOLEAN truncated; /**< whether any appended text was cut off because the buffer couldn't grow */
+} string_builder_t;
+
+/** data type for non-owning views into UTF-16 strings, the viewed text doesn't need to be null-terminated */
+typedef struct
+{
+  CONST CHAR16 *start; /**< the view's first character */
+  UINTN length;        /**< the view's length, in characters */
+} wcs_view_t;
+
+/** data type for non-owning views into ASCII strings, the viewed text doesn't need to be null-terminated */
+typedef struct
+{
+  CONST CHAR8 *start; /**< the view's first character */
+  UINTN length;       /**< the view's length, in characters */
+} ascii_view_t;
+
+/**
+ * data type for tokenizers splitting UTF-16 string views by a separator character
+ *
+ * Tokens are returned as views into the input, so the input isn't modified and nothing gets allocated. Empty tokens
+ * between adjacent separators are returned as well.
+ */
+typedef struct
+{
+  wcs_view_t remaining; /**< the part of the input that wasn't tokenized yet */
+  CHAR16 separator;     /**< the character separating tokens */
+  BOOLEAN finished;     /**< whether the last token was returned already */
+} wcs_tokenizer_t;
+
+/** data type for tokenizers splitting ASCII string views by a separator character, see wcs_tokenizer_t */
+typedef struct
+{
+  ascii_view_t remaining; /**< the part of the input that wasn't tokenized yet */
+  CHAR8 separator;        /**< the character separating tokens */
+  BOOLEAN finished;       /**< whether the last token was returned already */
+} ascii_tokenizer_t;
+
+
+void init_string_builder(string_builder_t *builder, CHAR16 *buffer, UINTN capacity);
+void clear_string_builder(string_builder_t *builder);
+void free_string_builder(string_builder_t *builder);
+BOOLEAN append_string(string_builder_t *builder, CONST CHAR16 *str);
+BOOLEAN append_char(string_builder_t *builder, CHAR16 ch);
+BOOLEAN EFIAPI append_format(string_builder_t *builder, CONST CHAR16 *fmt, ...);
+BOOLEAN append_format_va(string_builder_t *builder, CONST CHAR16 *fmt, VA_LIST args);
+BOOLEAN append_double(string_builder_t *builder, double value, UINTN decimals);
+BOOLEAN append_status(string_builder_t *builder, CHAR16 *function, EFI_STATUS code);
+BOOLEAN append_wcs_view(string_builder_t *builder, wcs_view_t view);
+BOOLEAN append_ascii_view(string_builder_t *builder, ascii_view_t view);
+
+wcs_view_t wcs_view(CONST CHAR16 *str);
+wcs_view_t wcs_view_n(CONST CHAR16 *start, UINTN length);
+ascii_view_t ascii_view(CONST CHAR8 *str);
+ascii_view_t ascii_view_n(CONST CHAR8 *start, UINTN length);
+ascii_view_t ascii_view_skip(ascii_view_t view, UINTN count);
+BOOLEAN wcs_view_equals(wcs_view_t view, CONST CHAR16 *str);
+BOOLEAN ascii_view_starts_with(ascii_view_t view, CONST CHAR8 *prefix);
+UINTN find_wcs_char(CONST CHAR16 *str, UINTN length, CHAR16 ch);
+UINTN find_ascii_char(CONST CHAR8 *str, UINTN length, CHAR8 ch);
+void init_wcs_tokenizer(wcs_tokenizer_t *tokenizer, wcs_view_t input, CHAR16 separator);
+BOOLEAN next_wcs_token(wcs_tokenizer_t *tokenizer, wcs_view_t *token);
+void init_ascii_tokenizer(ascii_tokenizer_t *tokenizer, ascii_view_t input, CHAR8 separator);
+BOOLEAN next_ascii_token(ascii_tokenizer_t *tokenizer, ascii_view_t *token);
+
+UINTN uint64_to_wcs(CHAR16 *buffer, UINTN size, UINT64 value);
+UINTN uint64_to_ascii(CHAR8 *buffer, UINTN size, UINT64 value);
+UINTN double_to_wcs(CHAR16 *buffer, UINTN size, double value, UINTN decimals);
+UINTN double_to_ascii(CHAR8 *buffer, UINTN size, double value, UINTN decimals);
+UINTN wcs_to_uint64(CONST CHAR16 *str, UINT64 *value);
+UINTN ascii_to_uint64(CONST CHAR8 *str, UINT64 *value);
+UINTN wcs_to_double(CONST CHAR16 *str, double *value);
+UINTN ascii_to_double(CONST CHAR8 *str, double *value);
+
 CHAR16 *ftowcs(double value);
 CHAR16 *sprint_status(CHAR16 *funcname, EFI_STATUS status);
 
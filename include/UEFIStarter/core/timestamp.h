@@ -14,10 +14,23 @@
 #include <Uefi.h>
 
 
+/** list of methods the timestamp frequency can be determined with */
+typedef enum
+{
+  TIMESTAMP_CALIBRATION_NONE=0,     /**< timestamps weren't initialized yet */
+  TIMESTAMP_CALIBRATION_CPUID,      /**< the frequency was reported by the CPU */
+  TIMESTAMP_CALIBRATION_PM_TIMER,   /**< the frequency was measured against the ACPI power management timer */
+  TIMESTAMP_CALIBRATION_UEFI_TIMER  /**< the frequency was measured against a UEFI timer event */
+} timestamp_calibration_t;
+
+
 double timestamp_diff_seconds(UINT64 start, UINT64 end);
 int init_timestamps();
 UINT64 get_timestamp();
 UINT64 get_timestamp_ticks_per_second();
+timestamp_calibration_t get_timestamp_calibration_method();
+BOOLEAN timestamp_is_invariant();
+EFI_STATUS wait_until_timestamp(UINT64 deadline);
 
 
 #endif
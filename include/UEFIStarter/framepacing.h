@@ -0,0 +1,67 @@
+/** \file
+ * Frame pacing and frame time statistics for animations
+ *
+ * A frame pacer schedules frame deadlines at a fixed rate and waits for them at the end of each frame. Frames taking
+ * longer than their budget are counted as dropped, the next deadline then gets rescheduled relative to the late frame
+ * instead of trying to catch up.
+ *
+ * Usage:
+ *
+ *     frame_pacer_t pacer;
+ *
+ *     init_frame_pacer(&pacer,ARG_FPS);
+ *     while(animating)
+ *     {
+ *       draw_frame();
+ *       end_frame(&pacer);
+ *     }
+ *     print_frame_statistics(&pacer);
+ *
+ * \author Richard Nusser
+ * \copyright 2017-2018 Richard Nusser
+ * \license GPLv3 (see http://www.gnu.org/licenses/)
+ * \sa https://github.com/rinusser/UEFIStarter
+ * \ingroup group_lib_framepacing
+ */
+
+#ifndef __FRAMEPACING_H
+#define __FRAMEPACING_H
+
+#include <Uefi.h>
+
+
+#define FRAME_HISTOGRAM_BUCKETS   64 /**< number of frame time histogram buckets, the last bucket collects all longer frames */
+#define FRAME_HISTOGRAM_BUCKET_MS 1  /**< width of each frame time histogram bucket, in milliseconds */
+
+
+/** data type for a frame pacer's state, the statistics fields may be read at any time */
+typedef struct
+{
+  UINT64 budget_ticks;                       /**< the target frame time in timestamp ticks, 0 for no limit */
+  UINT64 ticks_per_ms;                       /**< timestamp ticks per millisecond */
+  UINT64 deadline;                           /**< timestamp the current frame should end at */
+  UINT64 frame_start;                        /**< timestamp the current frame started at */
+  UINT64 last_frame_ticks;                   /**< the previous frame's time, in timestamp ticks */
+  UINT64 frame_count;                        /**< number of recorded frames */
+  UINT64 dropped_frames;                     /**< number of frame deadlines missed */
+  UINT64 total_ticks;                        /**< sum of all frame times, in timestamp ticks */
+  UINT64 min_ticks;                          /**< shortest frame time, in timestamp ticks */
+  UINT64 max_ticks;                          /**< longest frame time, in timestamp ticks */
+  UINT32 histogram[FRAME_HISTOGRAM_BUCKETS]; /**< number of frames per frame time range */
+} frame_pacer_t;
+
+
+EFI_STATUS init_frame_pacer(frame_pacer_t *pacer, UINT64 fps);
+void reset_frame_statistics(frame_pacer_t *pacer);
+
+UINT64 get_frame_budget_remaining_ticks(frame_pacer_t *pacer);
+EFI_STATUS end_frame(frame_pacer_t *pacer);
+void record_frame_time(frame_pacer_t *pacer, UINT64 ticks);
+
+double get_last_frame_ms(frame_pacer_t *pacer);
+double get_average_frame_ms(frame_pacer_t *pacer);
+double get_frame_time_percentile_ms(frame_pacer_t *pacer, UINTN percentile);
+void print_frame_statistics(frame_pacer_t *pacer);
+
+
+#endif
@@ -21,6 +21,9 @@
 #define SPRITE     EFI_GRAPHICS_OUTPUT_BLT_PIXEL *  /**< shortcut macro: indicates pixel data is intended to be as a drawable image */
 #define GFX_BUFFER EFI_GRAPHICS_OUTPUT_BLT_PIXEL *  /**< shortcut macro: indicates pixel data is intended to be used as a screen buffer */
 
+#define NETPBM_HEADER_PEEK_SIZE 512 /**< the number of bytes read to determine a netpbm file's dimensions */
+#define PPM_SAVE_CHUNK_PIXELS 1024  /**< the number of pixels converted at once while saving PPM files */
+
 
 extern EFI_GRAPHICS_OUTPUT_PROTOCOL *graphics_protocol;
 extern EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *graphics_info;
@@ -77,10 +80,24 @@ typedef struct
 /** data type for image assets */
 typedef struct
 {
-  image_t **image;  /**< the asset's content */
-  CHAR16 *filename; /**< the asset's filename */
+  image_t **image;     /**< the asset's content */
+  CHAR16 *filename;    /**< the asset's filename */
+  UINT64 file_bytes;   /**< the asset file's size, set by load_image_manifest() */
+  UINT64 read_ticks;   /**< the time spent waiting for the file to be read, set by load_image_manifest() */
+  UINT64 decode_ticks; /**< the time spent decoding the image, set by load_image_manifest() */
 } image_asset_t;
 
+/** data type for image asset manifests, their images share a single memory allocation */
+typedef struct
+{
+  UINTN count;             /**< the number of assets */
+  image_asset_t *assets;   /**< the list of assets */
+  void *arena;             /**< the memory holding all images */
+  UINTN arena_pages;       /**< the number of memory pages allocated for the images */
+  UINT64 total_file_bytes; /**< the combined size of all loaded files */
+  UINT64 total_ticks;      /**< the time spent loading the manifest, in timestamp ticks */
+} image_manifest_t;
+
 
 image_t *parse_ppm_image_data(file_contents_t *contents);
 image_t *parse_pgm_image_data(file_contents_t *contents);
@@ -90,10 +107,14 @@ image_t *load_ppm_file(CHAR16 *filename);
 image_t *load_pgm_file(CHAR16 *filename);
 image_t *load_pbm_file(CHAR16 *filename);
 image_t *load_netpbm_file(CHAR16 *filename);
+EFI_STATUS save_ppm_image(image_t *image, CHAR16 *filename);
 image_t *create_image(INTN width, INTN height);
 void free_image(image_t *image);
 void load_image_assets(UINTN count, image_asset_t *assets);
 void free_image_assets(UINTN count, image_asset_t *assets);
+EFI_STATUS load_image_manifest(image_manifest_t *manifest, UINTN count, image_asset_t *assets);
+void free_image_manifest(image_manifest_t *manifest);
+void print_image_manifest_report(image_manifest_t *manifest);
 
 COLOR interpolate_2px(COLOR *colors, float ratio);
 COLOR interpolate_4px(COLOR *corners, UINTN row_width, float x, float y);
@@ -0,0 +1,61 @@
+/** \file
+ * Wavetable oscillators for generating audio samples
+ *
+ * Oscillators use a 32 bit fixed-point phase accumulator: the upper bits select the wavetable entry, so the per-sample
+ * work is one addition, one shift, one table lookup and one multiplication. This is fast enough to generate tones
+ * (e.g. beeps and alerts) on the fly while audio buffers are being played.
+ *
+ * \author Richard Nusser
+ * \copyright 2017-2018 Richard Nusser
+ * \license GPLv3 (see http://www.gnu.org/licenses/)
+ * \sa https://github.com/rinusser/UEFIStarter
+ * \ingroup group_lib_oscillator
+ */
+
+#ifndef __OSCILLATOR_H
+#define __OSCILLATOR_H
+
+#include <Uefi.h>
+
+
+#define OSCILLATOR_TABLE_BITS  10                            /**< number of phase bits used to index wavetables */
+#define OSCILLATOR_TABLE_SIZE  (1<<OSCILLATOR_TABLE_BITS)    /**< number of entries per wavetable */
+#define OSCILLATOR_PHASE_SHIFT (32-OSCILLATOR_TABLE_BITS)    /**< shift to convert a phase into a wavetable index */
+#define OSCILLATOR_MAX_AMPLITUDE 32767                       /**< maximum oscillator amplitude */
+
+
+/** list of available waveforms */
+typedef enum
+{
+  WAVEFORM_SINE=0,  /**< sine wave */
+  WAVEFORM_SQUARE,  /**< square wave, 50% duty cycle */
+  WAVEFORM_SAWTOOTH,/**< rising sawtooth wave */
+  WAVEFORM_TRIANGLE,/**< triangle wave */
+  WAVEFORM_COUNT    /**< number of waveforms, keep this last */
+} waveform_t;
+
+/** data type for a single oscillator */
+typedef struct
+{
+  const INT16 *table;      /**< the wavetable to sample */
+  UINT32 phase;            /**< current phase, the full 32 bit range is one period */
+  UINT32 increment;        /**< phase increment per sample */
+  UINT32 amplitude;        /**< peak output amplitude, up to OSCILLATOR_MAX_AMPLITUDE */
+  UINT32 attack_samples;   /**< length of linear attack ramp in samples, 0 to disable */
+  UINT32 attack_position;  /**< number of attack samples generated so far */
+} oscillator_t;
+
+
+const INT16 *get_wavetable(waveform_t waveform);
+
+UINT32 oscillator_phase_increment(double frequency, UINT32 sample_rate);
+EFI_STATUS init_oscillator(oscillator_t *osc, waveform_t waveform, double frequency, UINT32 sample_rate, UINT32 amplitude);
+EFI_STATUS set_oscillator_frequency(oscillator_t *osc, double frequency, UINT32 sample_rate);
+void set_oscillator_attack(oscillator_t *osc, UINT32 samples);
+void restart_oscillator(oscillator_t *osc);
+
+void oscillator_fill_s16(oscillator_t *osc, INT16 *buffer, UINTN count, UINTN stride);
+EFI_STATUS generate_tone_s16(INT16 *buffer, UINTN frames, UINTN channels, waveform_t waveform, double frequency, UINT32 sample_rate, UINT32 amplitude);
+
+
+#endif
@@ -0,0 +1,107 @@
+/** \file
+ * Particle systems for snow and similar effects
+ *
+ * A particle system keeps its particles' data as separate arrays (structure of arrays) in 16.16 fixed point, so the
+ * per-frame position update is a plain integer loop over contiguous memory that compilers can vectorize. Particles
+ * falling below the system's limit are respawned by an application-defined callback, using the system's random number
+ * generator. Rendering is done through a callback as well, so the same system can draw into text screens or images.
+ *
+ * Each update moves every particle by its velocity plus the update's drift, scaled by the particle's drift response:
+ * e.g. wind affecting light particles more than heavy ones.
+ *
+ * Usage:
+ *
+ *     particle_system_t system;
+ *
+ *     init_particle_system(&system,count,PARTICLE_FROM_INT(height),spawn_particle,get_timestamp(),NULL);
+ *     while(animating)
+ *     {
+ *       update_particles(&system,wind,0);
+ *       render_particles(&system,width,height,draw_particle,NULL);
+ *     }
+ *     free_particle_system(&system);
+ *
+ * \author Richard Nusser
+ * \copyright 2017-2018 Richard Nusser
+ * \license GPLv3 (see http://www.gnu.org/licenses/)
+ * \sa https://github.com/rinusser/UEFIStarter
+ * \ingroup group_lib_particles
+ */
+
+#ifndef __PARTICLES_H
+#define __PARTICLES_H
+
+#include <Uefi.h>
+
+
+#define PARTICLE_FIXED_SHIFT 16                      /**< the number of fractional bits in particle coordinates */
+#define PARTICLE_FIXED_ONE (1<<PARTICLE_FIXED_SHIFT) /**< 1.0 in particle coordinates */
+
+/** converts an integer to particle coordinates */
+#define PARTICLE_FROM_INT(VALUE) ((INT32)(VALUE)*PARTICLE_FIXED_ONE)
+
+/** converts particle coordinates to an integer, rounding down */
+#define PARTICLE_TO_INT(VALUE) ((INT32)(VALUE)>>PARTICLE_FIXED_SHIFT)
+
+/** converts a double to particle coordinates */
+#define PARTICLE_FROM_DOUBLE(VALUE) ((INT32)((VALUE)*PARTICLE_FIXED_ONE))
+
+
+/** data type for the PCG32 random number generator's state */
+typedef struct
+{
+  UINT64 state; /**< the generator's internal state */
+} random_t;
+
+typedef struct particle_system particle_system_t;
+
+/**
+ * function pointer type for particle spawn callbacks
+ * Callbacks set the particle's coordinates, velocities, drift response and shade, e.g. with random values.
+ *
+ * \param system the particle system
+ * \param index  the index of the particle to spawn
+ */
+typedef void particle_spawn_f(particle_system_t *system, UINTN index);
+
+/**
+ * function pointer type for particle render callbacks
+ *
+ * \param system  the particle system
+ * \param index   the index of the particle to render
+ * \param x       the particle's column, as integer
+ * \param y       the particle's row, as integer
+ * \param context the context passed to render_particles()
+ */
+typedef void particle_render_f(particle_system_t *system, UINTN index, INT32 x, INT32 y, void *context);
+
+/** data type for particle systems, the particle arrays may be read and written by callbacks */
+struct particle_system
+{
+  UINTN count;              /**< the number of particles */
+  INT32 *x;                 /**< the particles' columns */
+  INT32 *y;                 /**< the particles' rows */
+  INT32 *velocity_x;        /**< the particles' horizontal movement per update */
+  INT32 *velocity_y;        /**< the particles' vertical movement per update */
+  INT32 *drift_response;    /**< the factor each update's drift gets multiplied with, PARTICLE_FIXED_ONE for 1.0 */
+  UINT8 *shade;             /**< an application-defined value per particle, e.g. a color */
+  INT32 limit_y;            /**< particles with rows below this get respawned */
+  particle_spawn_f *spawn;  /**< the spawn callback */
+  void *context;            /**< an application-defined pointer, e.g. for spawn callbacks */
+  random_t random;          /**< the random number generator for spawn callbacks */
+  void *memory;             /**< the memory holding the particle arrays */
+  UINTN memory_pages;       /**< the number of memory pages allocated for the particle arrays */
+};
+
+
+void seed_random(random_t *random, UINT64 seed);
+UINT32 next_random(random_t *random);
+UINT32 next_random_below(random_t *random, UINT32 bound);
+
+EFI_STATUS init_particle_system(particle_system_t *system, UINTN count, INT32 limit_y, particle_spawn_f *spawn, UINT64 seed, void *context);
+void free_particle_system(particle_system_t *system);
+UINTN update_particles(particle_system_t *system, INT32 drift_x, INT32 drift_y);
+void render_particles(particle_system_t *system, INT32 width, INT32 height, particle_render_f *render, void *context);
+
+
+#endif
@@ -15,6 +15,7 @@
 #include <Protocol/PciIo.h>
 #include <IndustryStandard/Pci.h>
 #include "core/logger.h"
+#include "core/string.h"
 
 
 /** data type for PCI device subclass names */
@@ -33,6 +34,8 @@ typedef struct
 } pci_class_names_t;
 
 
+BOOLEAN append_pci_device_name(string_builder_t *builder, UINT16 vendor_id, UINT16 device_id, UINT16 subvendor_id, UINT16 subdevice_id);
+BOOLEAN append_pci_class_name(string_builder_t *builder, UINT8 class_code[3]);
 CHAR16 *find_pci_device_name(UINT16 vendor_id, UINT16 device_id, UINT16 subvendor_id, UINT16 subdevice_id);
 CHAR16 *find_pci_class_name(UINT8 class_code[3]);
 void print_pci_devices();
@@ -42,7 +45,7 @@ EFI_PCI_IO_PROTOCOL *find_pci_device(UINT16 vendor_id, UINT16 device_id);
 //call before using PCI library
 void init_pci_lib();
 
-//call whenever PCI library is used (currently frees device ID file buffer)
+//call whenever PCI library is used (currently closes the pci.ids reader)
 void shutdown_pci_lib();
 
 #endif
@@ -18,6 +18,9 @@
 //invert next assertion check - there probably won't be a use case for this other than testing assertions themselves
 extern BOOLEAN invert_next_assert;
 
+//scales assert_max_duration_us() limits, in percent - e.g. for slow emulators
+extern UINTN duration_limit_percent;
+
 //boolean
 
 BOOLEAN assert_true(BOOLEAN actual, CHAR16 *message);
@@ -54,4 +57,10 @@ BOOLEAN assert_pixel_near(EFI_GRAPHICS_OUTPUT_BLT_PIXEL expected, INTN epsilon,
 BOOLEAN assert_pixel_values_near(UINT8 red, UINT8 green, UINT8 blue, UINT8 reserved, INTN epsilon, EFI_GRAPHICS_OUTPUT_BLT_PIXEL actual, CHAR16 *message);
 
 
+//performance
+
+BOOLEAN assert_max_duration_us(UINT64 max_us, CHAR16 *message);
+BOOLEAN assert_max_pages(UINTN max_pages, CHAR16 *message);
+
+
 #endif
@@ -0,0 +1,72 @@
+/** \file
+ * Benchmarks for test suites
+ *
+ * Benchmarks are functions executing one iteration of the code to measure, e.g.:
+ *
+ *     void benchmark_something()
+ *     {
+ *       do_something();
+ *     }
+ *
+ * Run them inside test groups with RUN_BENCHMARK(benchmark_something,L"description"). The runner executes warmup
+ * iterations, then takes a number of timed samples and reports the median, the median absolute deviation (MAD) and
+ * the resulting throughput. Very short functions are executed in batches, so each sample is long enough to be timed
+ * accurately.
+ *
+ * If a baseline file exists on the boot volume, benchmarks fail when their median exceeds the baseline by more than
+ * the configured threshold. Use the "-save-benchmarks" command-line argument to write the current results as baseline.
+ * The baseline file contains one "<group>/<description>=<median in ns>" line per benchmark, so it's easy to edit.
+ *
+ * \author Richard Nusser
+ * \copyright 2017-2018 Richard Nusser
+ * \license GPLv3 (see http://www.gnu.org/licenses/)
+ * \sa https://github.com/rinusser/UEFIStarter
+ * \ingroup group_tests_runner
+ */
+
+#ifndef __TEST_BENCHMARKS_H
+#define __TEST_BENCHMARKS_H
+
+#include <Uefi.h>
+#include "types.h"
+
+
+#define BENCHMARK_MAX_RESULTS        256    /**< maximum number of benchmark results kept per test suite run */
+#define BENCHMARK_MAX_NAME_LENGTH    128    /**< maximum length of benchmark names, including group name */
+#define BENCHMARK_MAX_SAMPLES        1000   /**< maximum number of timed samples per benchmark */
+#define BENCHMARK_DEFAULT_SAMPLES    15     /**< default number of timed samples per benchmark */
+#define BENCHMARK_DEFAULT_THRESHOLD  10     /**< default regression threshold, in percent of the baseline */
+#define BENCHMARK_WARMUP_ITERATIONS  3      /**< number of untimed iterations before sampling */
+#define BENCHMARK_MIN_SAMPLE_US      200    /**< minimum duration of each timed sample, in microseconds */
+#define BENCHMARK_BASELINE_FILENAME  L"\\benchmark_baseline.txt" /**< default baseline file */
+
+
+/** data type for a benchmark's results */
+typedef struct
+{
+  CHAR8 name[BENCHMARK_MAX_NAME_LENGTH]; /**< the benchmark's name: "<group>/<description>", as ASCII */
+  UINTN samples;                         /**< the number of timed samples */
+  UINTN batch_size;                      /**< the number of iterations per sample */
+  UINT64 median_ns;                      /**< median time per iteration, in nanoseconds */
+  UINT64 mad_ns;                         /**< median absolute deviation per iteration, in nanoseconds */
+  UINT64 baseline_ns;                    /**< the baseline's median time per iteration, 0 if there's no baseline */
+  test_outcome outcome;                  /**< FAILURE if the benchmark regressed beyond the threshold */
+} benchmark_result_t;
+
+
+extern benchmark_result_t benchmark_results[];
+extern UINTN benchmark_result_count;
+
+
+void run_benchmark(void (*func)(), CHAR16 *description);
+void configure_benchmarks(BOOLEAN enabled, UINTN samples, UINTN threshold_percent);
+EFI_STATUS load_benchmark_baseline(CHAR16 *filename);
+EFI_STATUS save_benchmark_baseline(CHAR16 *filename);
+void reset_benchmarks();
+
+UINT64 find_benchmark_baseline(CHAR8 *name);
+
+double get_benchmark_throughput(benchmark_result_t *result);
+
+
+#endif
@@ -13,6 +13,7 @@
 
 #include <Uefi.h>
 #include "types.h"
+#include "benchmarks.h"
 
 
 void print_test_group_start(CHAR16 *name);
@@ -22,6 +23,8 @@ void print_test_group_end();
 void print_individual_test_start(CHAR16 *description);
 void print_individual_result(test_results_t *results);
 void print_assert_counts(INT64 fails, INT64 asserts);
+void print_test_timings(test_results_t *results);
+void print_benchmark_result(benchmark_result_t *result);
 void print_test_result_summary(test_results_t *results);
 void print_assertion(BOOLEAN success, CHAR16 *description, CHAR16 *message);
 
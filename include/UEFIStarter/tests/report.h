@@ -0,0 +1,32 @@
+/** \file
+ * Machine-readable test reports
+ *
+ * Test suites started with "-report <file>" write their results as JUnit XML file to the boot volume after all tests
+ * ran, e.g. for CI hosts to extract from the disk image after QEMU exits. Each test group becomes a testsuite element,
+ * each test and benchmark a testcase element. Testcases include their duration and peak number of tracked memory pages,
+ * benchmark timings are added as additional testcase properties.
+ *
+ * \author Richard Nusser
+ * \copyright 2017-2018 Richard Nusser
+ * \license GPLv3 (see http://www.gnu.org/licenses/)
+ * \sa https://github.com/rinusser/UEFIStarter
+ * \ingroup group_tests_runner
+ */
+
+#ifndef __TEST_REPORT_H
+#define __TEST_REPORT_H
+
+#include <Uefi.h>
+#include "types.h"
+#include "benchmarks.h"
+
+
+#define TEST_REPORT_MAX_ENTRIES 1024 /**< maximum number of tests kept for the report */
+
+
+void record_test_result(CHAR16 *group, CHAR16 *description, test_results_t *results, benchmark_result_t *benchmark);
+EFI_STATUS write_test_report(CHAR16 *filename, test_results_t *global_results);
+void reset_test_report();
+
+
+#endif
@@ -15,12 +15,15 @@
 #include "types.h"
 #include "asserts.h"
 #include "output.h"
+#include "benchmarks.h"
 #include <UEFIStarter/core/console.h>
 
 
 extern test_results_t individual_test_results;
 extern test_results_t global_test_results;
 extern test_verbosity_t test_verbosity;
+extern CHAR16 *current_test_group;
+extern UINT64 current_test_start_timestamp;
 
 
 /**
@@ -29,6 +32,12 @@ extern test_verbosity_t test_verbosity;
  */
 void run_tests();
 
+void reset_test_results(test_results_t *results);
+void reset_test_environment();
+void handle_individual_result();
+void start_test_measurement();
+void stop_test_measurement();
+
 void run_test(void (*func)(), CHAR16 *description);
 void run_group(BOOLEAN (*func)());
 BOOLEAN is_skipped_test(CHAR16 *name);
@@ -44,6 +53,7 @@ BOOLEAN is_skipped_test(CHAR16 *name);
     global_test_results.skipped_count++; \
     return FALSE; \
   } \
+  current_test_group=NAME; \
   print_test_group_start(NAME);
 
 /**
@@ -59,6 +69,14 @@ BOOLEAN is_skipped_test(CHAR16 *name);
  */
 #define RUN_TEST(FUNC,DESC) run_test(FUNC,DESC);
 
+/**
+ * Helper macro to run a benchmark.
+ *
+ * \param FUNC the benchmark's function to execute, once per iteration
+ * \param DESC the benchmark's description
+ */
+#define RUN_BENCHMARK(FUNC,DESC) run_benchmark(FUNC,DESC);
+
 /** Helper macro to mark a test as incomplete */
 #define mark_test_incomplete() individual_test_results.incomplete_count++;
 
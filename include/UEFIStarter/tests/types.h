@@ -24,6 +24,7 @@ typedef struct
   UINTN assertion_counts:1;        /**< whether the number of assertions should be shown */
   UINTN individual_assertions:1;   /**< whether individual assertions should be shown */
   UINTN summary_statistics:1;      /**< whether test result statistics should be shown */
+  UINTN test_timings:1;            /**< whether each test's duration and peak memory usage should be shown */
 } test_verbosity_t;
 
 /** data type for test outcome status */
@@ -43,6 +44,8 @@ typedef struct
   INT64 failed_test_count;     /**< the number of failed tests */
   INT64 incomplete_count;      /**< the number of incomplete tests */
   INT64 skipped_count;         /**< the number of skipped tests */
+  UINT64 duration_ticks;       /**< the time spent in tests, in timestamp ticks */
+  UINTN peak_pages;            /**< the highest number of tracked memory pages during tests */
   test_outcome outcome;        /**< the test outcome */
 } test_results_t;
 
@@ -44,15 +44,19 @@ BOOLEAN validate_sample_rate(cmdline_value_t value)
 {
   UINTN allowed[]={8000,11025,16000,22050,32000,44100,48000};
   UINTN tc;
-  CHAR16 *helpstr=L"";
+  CHAR16 buffer[64];
+  string_builder_t helpstr;
 
   for(tc=0;tc<sizeof(allowed)/sizeof(UINTN);tc++)
     if(value.uint64==allowed[tc])
       return TRUE;
 
+  init_string_builder(&helpstr,buffer,64);
   for(tc=0;tc<sizeof(allowed)/sizeof(UINTN);tc++)
-    helpstr=memsprintf(L"%s, %d",helpstr,allowed[tc]);
-  LOG.error(L"sample rate must one of %s",helpstr+2);
+    append_format(&helpstr,tc>0?L", %d":L"%d",allowed[tc]);
+  //deferred logging keeps pointer arguments until it's flushed, so the list gets copied out of the stack buffer
+  LOG.error(L"sample rate must one of %s",memsprintf(L"%s",helpstr.buffer));
+  free_string_builder(&helpstr);
   return FALSE;
 }
 
@@ -94,7 +98,7 @@ int init_buffers(ac97_buffers_s16_t *buffers, UINT64 hardware_address)
   if(hardware_address>0xfffff000) //needs to be castable to 32 bit, probably reduce limit further
     return -1;
 
-  LOG.debug(L"setting up audio buffers at virtual %X, hardware %X",buffers,hardware_address);
+  LOG_DEBUG(L"setting up audio buffers at virtual %X, hardware %X",buffers,hardware_address);
 
   ZeroMem(buffers->descriptors,sizeof(ac97_buffer_descriptor_t)*AC97_BUFFER_COUNT+sizeof(INT16 *)*AC97_BUFFER_COUNT);
   hardware_base_addr=(void *)(hardware_address+sizeof(ac97_buffers_s16_t));
@@ -104,7 +108,7 @@ int init_buffers(ac97_buffers_s16_t *buffers, UINT64 hardware_address)
   {
     buffers->descriptors[tc].address=(UINT64)(hardware_base_addr+tc*65536*2);
     buffers->buffers[tc]=virtual_base_addr+tc*65536*2;
-    LOG.trace(L"descriptor %02d is at %X; .address=%X, actual buffer points to %X",
+    LOG_TRACE(L"descriptor %02d is at %X; .address=%X, actual buffer points to %X",
         tc,&buffers->descriptors[tc],buffers->descriptors[tc].address,buffers->buffers[tc]);
   }
 
@@ -206,7 +210,7 @@ EFI_STATUS set_ac97_cmdline_volume(ac97_handle_t *handle)
   master_vol=(UINT8)(ARG_VOLUME*handle->max_master_vol);
   master_vol=handle->max_master_vol-master_vol;
   pcm_out_vol=31-pcm_out_vol;
-  LOG.debug(L"master vol=%d, PCM vol=%d, mute=%d",master_vol,pcm_out_vol,ARG_MUTE);
+  LOG_DEBUG(L"master vol=%d, PCM vol=%d, mute=%d",master_vol,pcm_out_vol,ARG_MUTE);
 
   result=write_mixer_reg(handle,AC97_MIXER_MASTER,ac97_mixer_value(master_vol,master_vol,ARG_MUTE));
   ON_ERROR_RETURN(L"write_mixer_reg",result);
@@ -277,6 +281,8 @@ void *init_ac97_handle(ac97_handle_t *handle, EFI_PCI_IO_PROTOCOL *pip)
   UINTN bufsize;
 
   handle->pci=pip;
+  handle->completion_event=NULL;
+  handle->completion_timer=NULL;
 
   bufsize=AC97_BUFFER_COUNT*65536*2+sizeof(ac97_buffers_s16_t);
   pages=bufsize/4096+1;
@@ -289,7 +295,7 @@ void *init_ac97_handle(ac97_handle_t *handle, EFI_PCI_IO_PROTOCOL *pip)
 
   result=pip->Map(pip,EfiPciIoOperationBusMasterWrite,handle->buffers,&bufsize,&handle->device_address,&handle->mapping);
   ON_ERROR_RETURN(L"pip->Map",NULL);
-  LOG.debug(L"bytes mapped: %d, device address: %016lX",bufsize,handle->device_address);
+  LOG_DEBUG(L"bytes mapped: %d, device address: %016lX",bufsize,handle->device_address);
 
   if(handle->device_address>0xffffffff)
   {
@@ -317,6 +323,8 @@ void close_ac97_handle(ac97_handle_t *handle)
 {
   EFI_STATUS result;
 
+  ac97_disable_completion_events(handle);
+
   result=handle->pci->Unmap(handle->pci,handle->mapping);
   ON_ERROR_WARN(L"could not unmap AC'97 PCI memory");
 
@@ -346,7 +354,8 @@ EFI_STATUS ac97_play(ac97_handle_t *handle)
 {
   EFI_STATUS result;
 
-  LOG.debug(L"starting playback...");
+  LOG_DEBUG(L"starting playback...");
+  handle->last_valid_sent=FALSE;
 
   result=write_busmaster_reg(handle,AC97_STATUS_PCM_OUT,0x1C);
   ON_ERROR_WARN(L"could not reset PCM OUT status flags");
@@ -365,13 +374,191 @@ EFI_STATUS ac97_play(ac97_handle_t *handle)
  */
 static void _trace_busmaster_status_register(CHAR16 *name, ac97_busmaster_status_t value)
 {
-  LOG.trace(L"%s status: %04X (fifoe=%d, bcis=%d, lvbci=%d, celv=%d, dch=%d",name,value.raw,
+  LOG_TRACE(L"%s status: %04X (fifoe=%d, bcis=%d, lvbci=%d, celv=%d, dch=%d",name,value.raw,
       value.fifo_error,value.buffer_completion_interrupt,value.last_valid_buffer_completion_interrupt,
       value.current_equals_last_valid,value.dma_controller_halted);
 }
 
+/**
+ * internal: timer event handler, checks the PCM OUT status register for buffer completion.
+ * This acts as a stand-in for the AC'97 interrupt: UEFI applications have no portable way of attaching to PCI
+ * interrupt lines, but the codec still sets the status bits for descriptors with the "ioc" bit set.
+ *
+ * This runs at TPL_NOTIFY, so it must not log or print anything.
+ *
+ * \param event   the timer event
+ * \param context the AC'97 handle to check
+ */
+static void EFIAPI _check_buffer_completion(EFI_EVENT event, void *context)
+{
+  ac97_handle_t *handle=(ac97_handle_t *)context;
+  ac97_busmaster_status_t status;
+  UINTN regval;
+  UINTN clear=0;
+
+  if(read_busmaster_reg(handle,AC97_STATUS_PCM_OUT,&regval)!=EFI_SUCCESS)
+    return;
+  status.raw=regval;
+
+  if(status.buffer_completion_interrupt)
+  {
+    handle->completed_buffers++;
+    clear|=AC97_STATUS_BCIS;
+  }
+  if(status.last_valid_buffer_completion_interrupt)
+  {
+    handle->last_valid_sent=TRUE;
+    clear|=AC97_STATUS_LVBCI;
+  }
+  if(!clear)
+    return;
+
+  write_busmaster_reg(handle,AC97_STATUS_PCM_OUT,clear);
+  gBS->SignalEvent(handle->completion_event);
+}
+
+/**
+ * Enables buffer completion events.
+ * Sets the "interrupt on completion" bit in all buffer descriptors and starts a periodic timer checking for completed
+ * buffers. Whenever a buffer completes, handle->completion_event gets signaled and handle->completed_buffers gets
+ * incremented. Applications can wait for that event (e.g. with ac97_wait_for_buffer_completion()) instead of polling
+ * the current index, or check the counter between rendering frames.
+ *
+ * Call this before starting playback. If more than one buffer completes within a single interval they're counted
+ * once: keep the interval well below a buffer's playback time.
+ *
+ * \param handle   the AC'97 handle to use
+ * \param interval the check interval, in 100ns units - use AC97_DEFAULT_COMPLETION_INTERVAL if unsure
+ * \return the resulting status, EFI_SUCCESS if everything went well
+ */
+EFI_STATUS ac97_enable_completion_events(ac97_handle_t *handle, UINT64 interval)
+{
+  EFI_STATUS result;
+  unsigned int tc;
+
+  if(handle->completion_event)
+    return EFI_SUCCESS;
+
+  for(tc=0;tc<AC97_BUFFER_COUNT;tc++)
+    handle->buffers->descriptors[tc].control.ioc=1;
+  handle->completed_buffers=0;
+  handle->last_valid_sent=FALSE;
+
+  result=gBS->CreateEvent(0,TPL_NOTIFY,NULL,NULL,&handle->completion_event);
+  ON_ERROR_RETURN(L"CreateEvent",result);
+
+  result=gBS->CreateEvent(EVT_TIMER|EVT_NOTIFY_SIGNAL,TPL_NOTIFY,_check_buffer_completion,handle,&handle->completion_timer);
+  if(result==EFI_SUCCESS)
+    result=gBS->SetTimer(handle->completion_timer,TimerPeriodic,interval);
+  if(result!=EFI_SUCCESS)
+  {
+    LOG.error(L"could not start buffer completion timer: %r",result);
+    ac97_disable_completion_events(handle);
+    return result;
+  }
+
+  LOG_DEBUG(L"enabled buffer completion events, checking every %ldus",interval/10);
+  return EFI_SUCCESS;
+}
+
+/**
+ * Disables buffer completion events.
+ * Does nothing if they aren't enabled.
+ *
+ * \param handle the AC'97 handle to use
+ */
+void ac97_disable_completion_events(ac97_handle_t *handle)
+{
+  unsigned int tc;
+
+  if(handle->completion_timer)
+  {
+    gBS->SetTimer(handle->completion_timer,TimerCancel,0);
+    gBS->CloseEvent(handle->completion_timer);
+    handle->completion_timer=NULL;
+  }
+  if(handle->completion_event)
+  {
+    gBS->CloseEvent(handle->completion_event);
+    handle->completion_event=NULL;
+    for(tc=0;tc<AC97_BUFFER_COUNT;tc++)
+      handle->buffers->descriptors[tc].control.ioc=0;
+  }
+}
+
+/**
+ * internal: waits until the completion event or the timeout event gets signaled.
+ *
+ * \param handle  the AC'97 handle to use
+ * \param timeout the timeout event
+ * \return EFI_SUCCESS if a buffer completed, EFI_TIMEOUT if the timeout event was signaled, an error otherwise
+ */
+static EFI_STATUS _wait_for_completion_event(ac97_handle_t *handle, EFI_EVENT timeout)
+{
+  EFI_STATUS result;
+  EFI_EVENT events[2];
+  UINTN index;
+
+  events[0]=handle->completion_event;
+  events[1]=timeout;
+  result=gBS->WaitForEvent(2,events,&index);
+  ON_ERROR_RETURN(L"WaitForEvent",result);
+  return index==0?EFI_SUCCESS:EFI_TIMEOUT;
+}
+
+/**
+ * Waits until the next buffer completes.
+ * The CPU is idle while waiting, no registers are polled in the meantime. Requires completion events, see
+ * ac97_enable_completion_events().
+ *
+ * \param handle  the AC'97 handle to use
+ * \param timeout the number of milliseconds to wait before aborting
+ * \return EFI_SUCCESS if a buffer completed, EFI_TIMEOUT if the timeout expired, an error otherwise
+ */
+EFI_STATUS ac97_wait_for_buffer_completion(ac97_handle_t *handle, UINTN timeout)
+{
+  EFI_STATUS result;
+  EFI_EVENT timer;
+
+  if(!handle->completion_event)
+  {
+    LOG.error(L"buffer completion events aren't enabled");
+    return EFI_NOT_READY;
+  }
+
+  result=gBS->CreateEvent(EVT_TIMER,TPL_CALLBACK,NULL,NULL,&timer);
+  ON_ERROR_RETURN(L"CreateEvent",result);
+  result=gBS->SetTimer(timer,TimerRelative,timeout*10000);
+  if(result==EFI_SUCCESS)
+    result=_wait_for_completion_event(handle,timer);
+  gBS->CloseEvent(timer);
+  return result;
+}
+
+/**
+ * internal: waits for the "last valid buffer completion" flag set by buffer completion events.
+ *
+ * \param handle  the AC'97 handle to use
+ * \param timeout the number of milliseconds to wait before aborting
+ */
+static void _wait_until_last_buffer_sent_event(ac97_handle_t *handle, UINTN timeout)
+{
+  EFI_STATUS result;
+  EFI_EVENT timer;
+
+  result=gBS->CreateEvent(EVT_TIMER,TPL_CALLBACK,NULL,NULL,&timer);
+  ON_ERROR_RETURN(L"CreateEvent",);
+  result=gBS->SetTimer(timer,TimerRelative,timeout*10000);
+  while(result==EFI_SUCCESS && !handle->last_valid_sent)
+    result=_wait_for_completion_event(handle,timer);
+  if(result==EFI_TIMEOUT)
+    LOG_DEBUG(L"timed out waiting for last valid buffer");
+  gBS->CloseEvent(timer);
+}
+
 /**
  * Waits until the AC'97 codec signaled the "last valid buffer completion" event.
+ * If buffer completion events are enabled this waits for them, otherwise the status register gets polled.
  *
  * \param handle  the AC'97 handle to use
  * \param timeout the (approximate) number of milliseconds to wait before aborting
@@ -385,6 +572,12 @@ void ac97_wait_until_last_buffer_sent(ac97_handle_t *handle, UINTN timeout)
   ac97_busmaster_status_t value;
   UINTN regval;
 
+  if(handle->completion_event)
+  {
+    _wait_until_last_buffer_sent_event(handle,timeout);
+    return;
+  }
+
   for(tc=0;tc<timeout_iteration;tc++)
   {
     result=read_busmaster_reg(handle,AC97_STATUS_PCM_OUT,&regval);
@@ -0,0 +1,247 @@
+/** \file
+ * Frame capture for analyzing animations
+ *
+ * \author Richard Nusser
+ * \copyright 2017-2018 Richard Nusser
+ * \license GPLv3 (see http://www.gnu.org/licenses/)
+ * \sa https://github.com/rinusser/UEFIStarter
+ * \ingroup group_lib_capture
+ */
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <UEFIStarter/capture.h>
+#include <UEFIStarter/core/files.h>
+#include <UEFIStarter/core/memory.h>
+#include <UEFIStarter/core/timestamp.h>
+#include <UEFIStarter/core/profiler.h>
+#include <UEFIStarter/core/logger.h>
+
+
+/**
+ * Starts a frame capture, replacing the capture file if it already exists.
+ * Timestamps will be initialized if they haven't been yet.
+ *
+ * \param capture  the capture to start
+ * \param filename the capture file's full path within the boot volume, e.g. "\\capture.fcp"
+ * \param width    the frames' width, in pixels
+ * \param height   the frames' height, in pixels
+ * \param interval the number of frames per captured frame, e.g. 1 to capture every frame
+ * \return EFI_SUCCESS, or an error code; the capture doesn't need to be stopped on errors
+ */
+EFI_STATUS start_frame_capture(frame_capture_t *capture, CHAR16 *filename, UINT32 width, UINT32 height, UINTN interval)
+{
+  capture_file_header_t header;
+  EFI_STATUS result;
+
+  capture->previous=NULL;
+  capture->readback=NULL;
+  if(width==0 || height==0 || interval==0 || (UINT64)width*height>CAPTURE_RUN_MAX)
+    return EFI_INVALID_PARAMETER;
+  if(get_timestamp_ticks_per_second()==0 && init_timestamps()!=0)
+    return EFI_NOT_READY;
+
+  capture->width=width;
+  capture->height=height;
+  capture->interval=interval;
+  capture->frame_pages=((UINTN)width*height*sizeof(UINT32)-1)/4096+1;
+  capture->frame_count=0;
+  capture->captured_frames=0;
+  capture->encode_ticks=0;
+
+  if((capture->previous=allocate_pages(capture->frame_pages))==NULL)
+    return EFI_OUT_OF_RESOURCES;
+  ZeroMem(capture->previous,capture->frame_pages*4096);
+
+  if((result=open_file_writer(&capture->writer,filename,0))!=EFI_SUCCESS)
+  {
+    LOG.error(L"could not create capture file %s: %r",filename,result);
+    free_pages(capture->previous,capture->frame_pages);
+    capture->previous=NULL;
+    return result;
+  }
+
+  header.magic=CAPTURE_FILE_MAGIC;
+  header.version=CAPTURE_FILE_VERSION;
+  header.width=width;
+  header.height=height;
+  header.ticks_per_second=get_timestamp_ticks_per_second();
+  header.interval=(UINT32)interval;
+  header.reserved=0;
+  write_file_chunk(&capture->writer,&header,sizeof(header));
+
+  capture->start_timestamp=get_timestamp();
+  return capture->writer.status;
+}
+
+/**
+ * Internal: writes a run to the capture file.
+ *
+ * \param capture the capture to write to
+ * \param type    the run's type, one of CAPTURE_RUN_*
+ * \param count   the number of pixels the run covers
+ * \param pixels  the pixels following the run word: one for fill runs, count for copy runs, NULL for skip runs
+ */
+static void _write_capture_run(frame_capture_t *capture, UINT32 type, UINTN count, UINT32 *pixels)
+{
+  UINT32 word=(type<<CAPTURE_RUN_TYPE_SHIFT)|(UINT32)count;
+
+  write_file_chunk(&capture->writer,&word,sizeof(word));
+  if(type==CAPTURE_RUN_FILL)
+    write_file_chunk(&capture->writer,pixels,sizeof(UINT32));
+  else if(type==CAPTURE_RUN_COPY)
+    write_file_chunk(&capture->writer,pixels,count*sizeof(UINT32));
+}
+
+/**
+ * Internal: checks whether a fill run starts at the given pixel.
+ *
+ * \param current the frame's pixels
+ * \param pos     the position to check
+ * \param count   the frame's number of pixels
+ * \return whether the next CAPTURE_MIN_FILL_RUN pixels are identical
+ */
+static BOOLEAN _is_fill_run(UINT32 *current, UINTN pos, UINTN count)
+{
+  UINTN tc;
+
+  if(pos+CAPTURE_MIN_FILL_RUN>count)
+    return FALSE;
+  for(tc=1;tc<CAPTURE_MIN_FILL_RUN;tc++)
+    if(current[pos+tc]!=current[pos])
+      return FALSE;
+  return TRUE;
+}
+
+/**
+ * Internal: delta-encodes a frame against the previously captured frame and stores it as the new previous frame.
+ *
+ * \param capture the capture to write to
+ * \param current the frame's pixels
+ */
+static void _encode_frame(frame_capture_t *capture, UINT32 *current)
+{
+  PROFILE_SCOPE(L"capture_frame");
+  UINT32 *previous=capture->previous;
+  UINTN count=(UINTN)capture->width*capture->height;
+  UINTN pos=0, end;
+
+  while(pos<count)
+  {
+    for(end=pos;end<count && current[end]==previous[end];end++);
+    if(end>pos)
+    {
+      _write_capture_run(capture,CAPTURE_RUN_SKIP,end-pos,NULL);
+      pos=end;
+      continue;
+    }
+
+    if(_is_fill_run(current,pos,count))
+    {
+      for(end=pos+CAPTURE_MIN_FILL_RUN;end<count && current[end]==current[pos];end++);
+      _write_capture_run(capture,CAPTURE_RUN_FILL,end-pos,current+pos);
+    }
+    else
+    {
+      //literal pixels until the next unchanged pixel or fill run, the current pixel is neither
+      for(end=pos+1;end<count && current[end]!=previous[end] && !_is_fill_run(current,end,count);end++);
+      _write_capture_run(capture,CAPTURE_RUN_COPY,end-pos,current+pos);
+    }
+    CopyMem(previous+pos,current+pos,(end-pos)*sizeof(UINT32));
+    pos=end;
+  }
+}
+
+/**
+ * Passes a frame to the capture: every interval'th frame gets encoded and written to the capture file.
+ * Call this once per animation frame, e.g. right before or after showing the frame.
+ *
+ * \param capture the capture to add the frame to
+ * \param frame   the frame's pixels, in the capture's dimensions; not accessed if the frame isn't captured
+ * \return EFI_SUCCESS, or the first error that occurred while writing the capture file
+ */
+EFI_STATUS capture_frame(frame_capture_t *capture, EFI_GRAPHICS_OUTPUT_BLT_PIXEL *frame)
+{
+  capture_frame_header_t header;
+  UINT64 start;
+
+  if(capture->previous==NULL)
+    return EFI_NOT_READY;
+  if(capture->writer.status!=EFI_SUCCESS)
+    return capture->writer.status;
+  if((capture->frame_count++)%capture->interval!=0)
+    return EFI_SUCCESS;
+
+  start=get_timestamp();
+  header.frame=(UINT32)(capture->frame_count-1);
+  header.reserved=0;
+  header.timestamp=start-capture->start_timestamp;
+  write_file_chunk(&capture->writer,&header,sizeof(header));
+  _encode_frame(capture,(UINT32 *)frame);
+
+  capture->captured_frames++;
+  capture->encode_ticks+=get_timestamp()-start;
+  return capture->writer.status;
+}
+
+/**
+ * Passes the screen's current contents to the capture, reading them back with EfiBltVideoToBltBuffer.
+ * Use this if the animation doesn't draw into a full-frame buffer. Reading video memory is slow, so the screen is only
+ * read if the frame gets captured.
+ *
+ * \param capture the capture to add the frame to
+ * \param gop     the graphics output to read from, the capture's dimensions starting at (0,0) get read
+ * \return EFI_SUCCESS, or an error code
+ */
+EFI_STATUS capture_screen(frame_capture_t *capture, EFI_GRAPHICS_OUTPUT_PROTOCOL *gop)
+{
+  EFI_STATUS result;
+
+  if(capture->previous!=NULL && capture->frame_count%capture->interval==0)
+  {
+    if(capture->readback==NULL && (capture->readback=allocate_pages(capture->frame_pages))==NULL)
+      return EFI_OUT_OF_RESOURCES;
+    result=gop->Blt(gop,capture->readback,EfiBltVideoToBltBuffer,0,0,0,0,capture->width,capture->height,0);
+    if(result!=EFI_SUCCESS)
+    {
+      LOG.error(L"could not read screen for capture: %r",result);
+      return result;
+    }
+  }
+  return capture_frame(capture,capture->readback);
+}
+
+/**
+ * Stops a frame capture: closes the capture file, frees the capture's buffers and logs a summary.
+ *
+ * \param capture the capture to stop
+ * \return EFI_SUCCESS, or the first error that occurred while writing the capture file
+ */
+EFI_STATUS stop_frame_capture(frame_capture_t *capture)
+{
+  EFI_STATUS result;
+  UINT64 ticks_per_second=get_timestamp_ticks_per_second();
+  UINT64 encode_us=0;
+
+  if(capture->previous==NULL)
+    return EFI_NOT_READY;
+
+  result=close_file_writer(&capture->writer);
+  free_pages(capture->previous,capture->frame_pages);
+  if(capture->readback)
+    free_pages(capture->readback,capture->frame_pages);
+  capture->previous=NULL;
+  capture->readback=NULL;
+
+  if(result!=EFI_SUCCESS)
+  {
+    LOG.error(L"could not write capture file: %r",result);
+    return result;
+  }
+  if(capture->captured_frames>0 && ticks_per_second>0)
+    encode_us=capture->encode_ticks*1000000/ticks_per_second/capture->captured_frames;
+  LOG.info(L"captured %ld of %ld frames, %ld bytes, %ldus per frame",capture->captured_frames,capture->frame_count,
+           capture->writer.bytes_written,encode_us);
+  return EFI_SUCCESS;
+}
@@ -14,7 +14,10 @@
 #include <UEFIStarter/core/cmdline.h>
 #include <UEFIStarter/core/memory.h>
 #include <UEFIStarter/core/logger.h>
+#include <UEFIStarter/core/serial.h>
+#include <UEFIStarter/core/profiler.h>
 #include <UEFIStarter/core/string.h>
+#include <UEFIStarter/core/files.h>
 
 /**
  * (internal) performs check whether string is numeric
@@ -82,68 +85,25 @@ BOOLEAN wctype_float(CHAR16 *string)
  *
  * \param str the string to convert
  * \return the parsed number; -1.0 on error
- *
- * \TODO replace _wcstof() with built-in, or move to separate file
  */
 double _wcstof(CHAR16 *str)
 {
-  double rv=0;
-  BOOLEAN after_decimal=FALSE;
-  BOOLEAN negative=FALSE;
-  BOOLEAN is_digit;
-  CHAR16 ch;
-  unsigned int tc=0, digit_value;
-  double fraction=10.0;
+  double rv;
+  UINTN length;
 
   if(str==NULL || str[0]==0)
   {
     LOG.error(L"_wcstof: cannot parse NULL or empty string");
     return -1.0;
   }
-  LOG.debug(L"_wcstof: parsing \"%s\"",str);
-  if(str[0]==L'-')
-  {
-    negative=TRUE;
-    tc++;
-  }
 
-  while((ch=str[tc++])!=0)
+  length=wcs_to_double(str,&rv);
+  if(length==0 || str[length]!=0)
   {
-    is_digit=ch>=L'0'&&ch<=L'9';
-    digit_value=ch-L'0';
-    if(after_decimal)
-    {
-      if(ch==L'.')
-      {
-        LOG.error(L"_wcstof: encountered more than 1 decimal point");
-        return -1.0;
-      }
-      else if(is_digit)
-      {
-        rv=rv+digit_value/fraction;
-        fraction*=10;
-      }
-      else
-      {
-        LOG.error(L"_wcstof: invalid string: %s, failing character: 0x%02X",str,ch);
-        return -1.0;
-      }
-    }
-    else
-    {
-      if(ch==L'.')
-        after_decimal=TRUE;
-      else if(is_digit)
-        rv=rv*10+digit_value;
-      else
-      {
-        LOG.error(L"_wcstof: invalid string: %s, failing character: 0x%02X",str,ch);
-        return -1.0;
-      }
-    }
+    LOG.error(L"_wcstof: invalid string: %s, failing character: 0x%02X",str,str[length]);
+    return -1.0;
   }
-
-  return negative?-rv:rv;
+  return rv;
 }
 
 
@@ -204,6 +164,24 @@ static logger_args_mapping_t logger_args[]=
   { OFF,   L"-no-log" }
 };
 
+/**
+ * data type to map a serial log output port to a command line argument
+ */
+typedef struct
+{
+  UINT16 port;  /**< the I/O port to log to */
+  CHAR16 *str;  /**< the command line argument, as UTF-16 */
+} logger_output_args_mapping_t;
+
+/**
+ * serial log output port -> command line argument mappings
+ */
+static logger_output_args_mapping_t logger_output_args[]=
+{
+  { SERIAL_PORT_COM1,     L"-log-serial" },
+  { SERIAL_PORT_DEBUGCON, L"-log-debugcon" }
+};
+
 /**
  * (internal) prints the help text for a command line argument group
  *
@@ -213,7 +191,8 @@ static void _print_argument_group_help(cmdline_argument_group_t *arguments)
 {
   unsigned int tc;
   CHAR16 *typetext;
-  CHAR16 *defaulttext;
+  CHAR16 buffer[64];
+  string_builder_t defaulttext;
   CHAR16 *padding=L"                                ";
   unsigned int max_pad_length=StrLen(padding);
   unsigned int max_arg_length=0;
@@ -231,15 +210,16 @@ static void _print_argument_group_help(cmdline_argument_group_t *arguments)
       max_arg_length=arg_length;
   }
 
+  init_string_builder(&defaulttext,buffer,64);
   for(tc=0;tc<arguments->count;tc++)
   {
-    defaulttext=NULL;
+    clear_string_builder(&defaulttext);
     arg_length=StrLen(arguments->list[tc].name);
     if(arg_length+max_pad_length<max_arg_length)
       pad_start=0;
     else
       pad_start=max_pad_length-1-max_arg_length+arg_length;
-    LOG.trace(L"arg_length=%d, max_pad_length=%d, max_arg_length=%d, pad_start=%d",arg_length,max_pad_length,max_arg_length,pad_start);
+    LOG_TRACE(L"arg_length=%d, max_pad_length=%d, max_arg_length=%d, pad_start=%d",arg_length,max_pad_length,max_arg_length,pad_start);
     switch(arguments->list[tc].type)
     {
       case ARG_BOOL:
@@ -247,24 +227,25 @@ static void _print_argument_group_help(cmdline_argument_group_t *arguments)
         break;
       case ARG_INT:
         typetext=L"<integer>";
-        defaulttext=CatSPrint(NULL,L" [default: %d]",arguments->list[tc].value.uint64);
+        append_format(&defaulttext,L" [default: %d]",arguments->list[tc].value.uint64);
         break;
       case ARG_DOUBLE:
         typetext=L"<decimal>";
-        defaulttext=CatSPrint(NULL,L" [default: %s]",ftowcs(arguments->list[tc].value.dbl));
+        append_string(&defaulttext,L" [default: ");
+        append_double(&defaulttext,arguments->list[tc].value.dbl,2);
+        append_char(&defaulttext,L']');
         break;
       case ARG_STRING:
         typetext=L"<string>";
         if(arguments->list[tc].value.wcstr!=NULL)
-          defaulttext=CatSPrint(NULL,L" [default: %s]",arguments->list[tc].value.wcstr);
+          append_format(&defaulttext,L" [default: %s]",arguments->list[tc].value.wcstr);
         break;
       default:
         LOG.error(L"unhandled argument type: %d",arguments->list[tc].type);
     }
-    Print(L"  %s %9s%s %s%s\n",arguments->list[tc].name,typetext,padding+pad_start,arguments->list[tc].helptext,defaulttext?defaulttext:L"");
-    if(defaulttext!=NULL)
-      FreePool(defaulttext);
+    Print(L"  %s %9s%s %s%s\n",arguments->list[tc].name,typetext,padding+pad_start,arguments->list[tc].helptext,defaulttext.buffer);
   }
+  free_string_builder(&defaulttext);
 }
 
 /**
@@ -280,6 +261,9 @@ void print_help_text(UINTN argument_group_count, VA_LIST args)
 
   Print(L"General options:\n\
   -help    This text\n\
+  -profile Record PROFILE_SCOPE() zones, print a report at exit and write a trace to \\profile.json\n\
+  -config <file>       Load argument values from a config file or snapshot, command-line arguments override them\n\
+  -save-config <file>  Save all argument values as snapshot, for faster loading with -config\n\
 \n\
 Logging options:\n\
   -trace   Set log threshold to TRACE\n\
@@ -287,7 +271,9 @@ Logging options:\n\
   -info    Set log threshold to INFO\n\
   -warn    Set log threshold to WARN\n\
   -error   Set log threshold to ERROR\n\
-  -no-log  Disable logging\n");
+  -no-log  Disable logging\n\
+  -log-serial    Write log messages to COM1 instead of the console\n\
+  -log-debugcon  Write log messages to QEMU's debug console (port 0xE9)\n");
 
   for(tc=0;tc<argument_group_count;tc++)
   {
@@ -320,154 +306,744 @@ BOOLEAN check_no_arguments_remaining(INTN argc, CHAR16 **argv)
   return errors<1;
 }
 
+/** the FNV-1a hash function's initial value */
+#define ARGUMENT_HASH_BASIS 2166136261U
+
+/** the FNV-1a hash function's prime */
+#define ARGUMENT_HASH_PRIME 16777619U
+
+/** built-in argument types in the argument index */
+typedef enum
+{
+  BUILTIN_NONE=0,      /**< not a built-in argument, but one from an argument group */
+  BUILTIN_HELP,        /**< the "-help" argument */
+  BUILTIN_PROFILE,     /**< the "-profile" argument */
+  BUILTIN_CONFIG,      /**< the "-config" argument */
+  BUILTIN_SAVE_CONFIG, /**< the "-save-config" argument */
+  BUILTIN_LOG_LEVEL,   /**< a log level argument, see logger_args */
+  BUILTIN_LOG_OUTPUT   /**< a log output argument, see logger_output_args */
+} builtin_argument_type;
+
+/** data type for entries in the argument index */
+typedef struct
+{
+  CHAR16 *name;                  /**< the argument's name, NULL for empty slots */
+  UINT32 hash;                   /**< the name's hash */
+  cmdline_argument_t *argument;  /**< the argument group entry, NULL for built-in arguments */
+  builtin_argument_type builtin; /**< the built-in argument's type */
+  UINTN mapping;                 /**< the built-in argument's index in its mapping list */
+} argument_index_entry_t;
+
 /**
- * (internal) parses logger/help parameters from command line
+ * data type for argument indexes: hash tables mapping all known argument names to their definitions, so each
+ * command line argument can be looked up in constant time regardless of how many arguments are defined
+ */
+typedef struct
+{
+  UINTN size;                       /**< the number of slots, always a power of 2 */
+  argument_index_entry_t *entries;  /**< the slots */
+} argument_index_t;
+
+/** data type for command line arguments matched to argument group entries */
+typedef struct
+{
+  UINTN position;               /**< the argument's position in argv */
+  cmdline_argument_t *argument; /**< the matched argument group entry */
+} argument_match_t;
+
+
+/**
+ * (internal) continues hashing with 32-bit FNV-1a over a UTF-16 string
  *
- * \param argc the number of command-line arguments
- * \param argv the list of command-line arguments, as UTF-16
- * \return whether the help screen was requested
+ * \param hash the hash so far, ARGUMENT_HASH_BASIS to start a new hash
+ * \param str  the string to hash
+ * \return the updated hash
  */
-static BOOLEAN _parse_logger_args(INTN argc, CHAR16 **argv)
+static UINT32 _hash_argument_name(UINT32 hash, CONST CHAR16 *str)
 {
-  unsigned int logger_args_count=sizeof(logger_args)/sizeof(logger_args_mapping_t);
-  LOGLEVEL log_level=INFO;
-  unsigned int tc, td;
-  BOOLEAN help=FALSE;
+  for(;*str;str++)
+  {
+    hash^=*str;
+    hash*=ARGUMENT_HASH_PRIME;
+  }
+  return hash;
+}
 
-  reset_logger_entry_counts();
+/**
+ * (internal) finds an argument name's slot in the argument index
+ *
+ * \param index the argument index to search
+ * \param name  the argument name to look for, as UTF-16
+ * \param hash  the name's hash
+ * \return the name's slot, or the empty slot it would go into
+ */
+static argument_index_entry_t *_find_argument_slot(argument_index_t *index, CHAR16 *name, UINT32 hash)
+{
+  UINTN pos=hash&(index->size-1);
 
-  for(tc=0;tc<argc;tc++)
+  while(index->entries[pos].name!=NULL && (index->entries[pos].hash!=hash || StrCmp(index->entries[pos].name,name)!=0))
+    pos=(pos+1)&(index->size-1);
+  return index->entries+pos;
+}
+
+/**
+ * (internal) adds an argument name to the argument index
+ * Names already in the index are kept: built-in arguments take precedence, then argument groups in the order passed.
+ *
+ * \param index    the argument index to add to
+ * \param name     the argument's name, as UTF-16
+ * \param argument the argument group entry, NULL for built-in arguments
+ * \param builtin  the built-in argument's type
+ * \param mapping  the built-in argument's index in its mapping list
+ */
+static void _add_argument_name(argument_index_t *index, CHAR16 *name, cmdline_argument_t *argument, builtin_argument_type builtin, UINTN mapping)
+{
+  UINT32 hash=_hash_argument_name(ARGUMENT_HASH_BASIS,name);
+  argument_index_entry_t *entry=_find_argument_slot(index,name,hash);
+
+  if(entry->name!=NULL)
+    return;
+  entry->name=name;
+  entry->hash=hash;
+  entry->argument=argument;
+  entry->builtin=builtin;
+  entry->mapping=mapping;
+}
+
+/**
+ * (internal) builds the argument index for the built-in arguments and the given argument groups
+ *
+ * \param index       the argument index to build, needs to be freed with FreePool(index->entries) on success
+ * \param group_count the number of argument groups
+ * \param groups      the argument groups
+ * \return whether the index could be built
+ */
+static BOOLEAN _build_argument_index(argument_index_t *index, UINTN group_count, cmdline_argument_group_t **groups)
+{
+  unsigned int logger_args_count=sizeof(logger_args)/sizeof(logger_args_mapping_t);
+  unsigned int logger_output_args_count=sizeof(logger_output_args)/sizeof(logger_output_args_mapping_t);
+  UINTN tc, td, count=4+logger_args_count+logger_output_args_count;
+
+  for(tc=0;tc<group_count;tc++)
   {
-    if(StrCmp(argv[tc],L"-help")==0)
+    if(groups[tc]->count>1000)
     {
-      help=TRUE;
-      continue;
+      LOG.error(L"argument group count is %u, can't be right",groups[tc]->count);
+      return FALSE;
     }
-    for(td=0;td<logger_args_count;td++)
-    {
-      if(StrCmp(argv[tc],logger_args[td].str)==0)
+    count+=groups[tc]->count;
+  }
+
+  //keep the table at most half full so probe sequences stay short
+  for(index->size=16;index->size<count*2;index->size*=2);
+  if((index->entries=AllocateZeroPool(index->size*sizeof(argument_index_entry_t)))==NULL)
+  {
+    LOG.error(L"could not allocate memory for argument index");
+    return FALSE;
+  }
+
+  _add_argument_name(index,L"-help",NULL,BUILTIN_HELP,0);
+  _add_argument_name(index,L"-profile",NULL,BUILTIN_PROFILE,0);
+  _add_argument_name(index,L"-config",NULL,BUILTIN_CONFIG,0);
+  _add_argument_name(index,L"-save-config",NULL,BUILTIN_SAVE_CONFIG,0);
+  for(tc=0;tc<logger_args_count;tc++)
+    _add_argument_name(index,logger_args[tc].str,NULL,BUILTIN_LOG_LEVEL,tc);
+  for(tc=0;tc<logger_output_args_count;tc++)
+    _add_argument_name(index,logger_output_args[tc].str,NULL,BUILTIN_LOG_OUTPUT,tc);
+  for(tc=0;tc<group_count;tc++)
+    for(td=0;td<groups[tc]->count;td++)
+      _add_argument_name(index,groups[tc]->list[td].name,groups[tc]->list+td,BUILTIN_NONE,0);
+  return TRUE;
+}
+
+/**
+ * (internal) looks up a command line argument in the argument index
+ *
+ * \param index the argument index to search
+ * \param name  the command line argument, as UTF-16
+ * \return the argument's index entry, or NULL if it's unknown
+ */
+static argument_index_entry_t *_find_argument(argument_index_t *index, CHAR16 *name)
+{
+  argument_index_entry_t *entry;
+
+  if(name[0]!=L'-')
+    return NULL;
+  entry=_find_argument_slot(index,name,_hash_argument_name(ARGUMENT_HASH_BASIS,name));
+  return entry->name!=NULL?entry:NULL;
+}
+
+/**
+ * (internal) collects the argument groups from a vararg list
+ *
+ * \param groups      output: the argument groups, needs to hold CMDLINE_MAX_GROUPS entries
+ * \param group_count the number of argument groups passed
+ * \param args        the vararg list of argument groups (as cmdline_argument_group_t *)
+ * \return whether all groups could be collected
+ */
+static BOOLEAN _collect_argument_groups(cmdline_argument_group_t **groups, UINTN group_count, VA_LIST args)
+{
+  UINTN tc;
+
+  if(group_count>CMDLINE_MAX_GROUPS)
+  {
+    LOG.error(L"too many argument groups: %d",group_count);
+    return FALSE;
+  }
+  for(tc=0;tc<group_count;tc++)
+    if((groups[tc]=VA_ARG(args,cmdline_argument_group_t *))==NULL)
+      return FALSE;
+  return TRUE;
+}
+
+/**
+ * (internal) parses a boolean config value
+ *
+ * \param value  the value to parse, as UTF-16
+ * \param result output: 1 for true, 0 for false
+ * \return whether the value is a valid boolean
+ */
+static BOOLEAN _parse_boolean(CHAR16 *value, UINT64 *result)
+{
+  if(!StrCmp(value,L"1") || !StrCmp(value,L"true") || !StrCmp(value,L"yes") || !StrCmp(value,L"on"))
+    *result=1;
+  else if(!StrCmp(value,L"0") || !StrCmp(value,L"false") || !StrCmp(value,L"no") || !StrCmp(value,L"off"))
+    *result=0;
+  else
+    return FALSE;
+  return TRUE;
+}
+
+/**
+ * (internal) parses a value into an argument group entry and validates it
+ *
+ * \param argument the argument group entry to parse the value into
+ * \param value    the value to parse, as UTF-16; NULL if there is none, which sets boolean arguments
+ * \return whether the value has been parsed successfully
+ */
+static BOOLEAN _set_argument_value(cmdline_argument_t *argument, CHAR16 *value)
+{
+  UINTN bytes;
+  CHAR16 *ptr;
+
+  switch(argument->type)
+  {
+    case ARG_BOOL:
+      if(!value)
+        argument->value.uint64=1;
+      else if(!_parse_boolean(value,&argument->value.uint64))
       {
-        log_level=logger_args[td].level;
-        argv[tc][0]=0;
+        LOG.error(L"argument %s must be a boolean",argument->name);
+        return FALSE;
       }
-    }
+      break;
+    case ARG_INT:
+      if(!value || !wctype_int(value) || value[0]==L'-')
+      {
+        LOG.error(L"argument %s must be followed by a non-negative number",argument->name);
+        return FALSE;
+      }
+      argument->value.uint64=StrDecimalToUint64(value);
+      break;
+    case ARG_DOUBLE:
+      if(!value || !wctype_float(value))
+      {
+        LOG.error(L"argument %s must be followed by a decimal number",argument->name);
+        return FALSE;
+      }
+      argument->value.dbl=_wcstof(value);
+      break;
+    case ARG_STRING:
+      if(!value)
+      {
+        LOG.error(L"argument %s must be followed by a string",argument->name);
+        return FALSE;
+      }
+      bytes=StrSize(value);
+      ptr=AllocatePool(bytes);
+      if(ptr==NULL)
+      {
+        LOG.error(L"could not allocate memory for string parameter");
+        return FALSE;
+      }
+      CopyMem(ptr,value,bytes);
+      argument->value.wcstr=ptr;
+      break;
+    default:
+      LOG.error(L"unhandled argument type: %d",argument->type);
+      return FALSE;
   }
-  set_log_level(log_level);
 
-  return !help;
+  if(argument->validator_func && !argument->validator_func(argument->value))
+    return FALSE;
+  return TRUE;
 }
 
 /**
- * (internal) fills argument group structure with all matching command line arguments
+ * (internal) parses an argument group entry's value from the command line and validates it
  *
- * \param argc      the number of command-line arguments
- * \param argv      the list of command-line arguments, as UTF-16
- * \param arguments the argument group to parse values into
- * \return whether all matching parameters have been parsed successfully
+ * \param argc     the number of command-line arguments
+ * \param argv     the list of command-line arguments, as UTF-16
+ * \param position the argument's position in argv
+ * \param argument the argument group entry to parse the value into
+ * \return whether the value has been parsed successfully
  */
-static BOOLEAN _parse_parameter_group(INTN argc, CHAR16 **argv, cmdline_argument_group_t *arguments)
+static BOOLEAN _parse_argument_value(INTN argc, CHAR16 **argv, INTN position, cmdline_argument_t *argument)
 {
-  unsigned int tc, td;
-  INTN bytes;
-  CHAR16 *ptr;
+  CHAR16 *value=NULL;
 
-  if(arguments->count>1000)
+  if(argument->type!=ARG_BOOL && position<argc-1)
+    value=argv[position+1];
+  if(!_set_argument_value(argument,value))
+    return FALSE;
+  argv[position][0]=0;
+  if(value)
+    value[0]=0;
+  return TRUE;
+}
+
+/**
+ * (internal) removes the file name following a built-in argument from the command line
+ * The argument is left on the command line if there is no file name, so it gets reported as unhandled.
+ *
+ * \param argc     the number of command-line arguments
+ * \param argv     the list of command-line arguments, as UTF-16
+ * \param position the argument's position in argv, gets moved to the file name
+ * \param filename output: a copy of the file name, replacing any previous one; needs to be freed with FreePool()
+ */
+static void _take_file_argument(INTN argc, CHAR16 **argv, INTN *position, CHAR16 **filename)
+{
+  CHAR16 *copy;
+
+  if(*position+1>=argc || argv[*position+1][0]==0)
+    return;
+  if((copy=AllocateCopyPool(StrSize(argv[*position+1]),argv[*position+1]))==NULL)
+    return;
+  if(*filename)
+    FreePool(*filename);
+  *filename=copy;
+  argv[(*position)++][0]=0;
+  argv[*position][0]=0;
+}
+
+/**
+ * (internal) applies a built-in argument
+ *
+ * \param entry     the argument's index entry
+ * \param log_level the log level to set after parsing, gets updated by log level arguments
+ */
+static void _apply_builtin_argument(argument_index_entry_t *entry, LOGLEVEL *log_level)
+{
+  switch(entry->builtin)
+  {
+    case BUILTIN_PROFILE:
+      start_profiling(PROFILER_DEFAULT_EVENT_CAPACITY);
+      break;
+    case BUILTIN_LOG_LEVEL:
+      *log_level=logger_args[entry->mapping].level;
+      break;
+    case BUILTIN_LOG_OUTPUT:
+      if(init_serial_logger(logger_output_args[entry->mapping].port)==EFI_SUCCESS)
+        set_logger_function(serial_log_print);
+      else
+        LOG.warn(L"log output port 0x%X not available, logging to console",logger_output_args[entry->mapping].port);
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * (internal) trims whitespace off both ends of an ASCII string view
+ *
+ * \param view the view to trim
+ * \return the trimmed view
+ */
+static ascii_view_t _trim_ascii_view(ascii_view_t view)
+{
+  while(view.length>0 && ctype_whitespace(view.start[0]))
+    view=ascii_view_skip(view,1);
+  while(view.length>0 && ctype_whitespace(view.start[view.length-1]))
+    view.length--;
+  return view;
+}
+
+/**
+ * (internal) converts an ASCII string view to UTF-16
+ *
+ * \param target the buffer to write to, needs to hold the view's length plus the null terminator
+ * \param view   the view to convert
+ */
+static void _ascii_view_to_wcs(CHAR16 *target, ascii_view_t view)
+{
+  UINTN tc;
+
+  for(tc=0;tc<view.length;tc++)
+    target[tc]=(UINT8)view.start[tc];
+  target[view.length]=0;
+}
+
+/**
+ * (internal) applies one line of a text config file
+ *
+ * \param index       the argument index to look settings up in
+ * \param line        the line to apply
+ * \param filename    the config file's name, for error messages
+ * \param line_number the line's number, for error messages
+ * \return whether the line is valid
+ */
+static BOOLEAN _apply_config_line(argument_index_t *index, ascii_view_t line, CHAR16 *filename, UINTN line_number)
+{
+  CHAR16 name[CONFIG_MAX_LINE_LENGTH+2];
+  CHAR16 value[CONFIG_MAX_LINE_LENGTH+1];
+  argument_index_entry_t *entry;
+  UINTN separator;
+
+  line=_trim_ascii_view(line);
+  if(line.length==0 || line.start[0]=='#')
+    return TRUE;
+  if(line.length>CONFIG_MAX_LINE_LENGTH)
   {
-    LOG.error(L"argument group count is %u, can't be right",arguments->count);
+    LOG.error(L"%s, line %d: line is longer than %d characters",filename,line_number,CONFIG_MAX_LINE_LENGTH);
+    return FALSE;
+  }
+  separator=find_ascii_char(line.start,line.length,'=');
+  if(separator==line.length)
+  {
+    LOG.error(L"%s, line %d: expected name=value",filename,line_number);
     return FALSE;
   }
 
-  for(tc=0;tc<argc;tc++)
+  name[0]=L'-';
+  _ascii_view_to_wcs(name+1,_trim_ascii_view(ascii_view_n(line.start,separator)));
+  _ascii_view_to_wcs(value,_trim_ascii_view(ascii_view_skip(line,separator+1)));
+  entry=_find_argument(index,name);
+  if(entry==NULL || entry->builtin!=BUILTIN_NONE)
+  {
+    LOG.error(L"%s, line %d: unknown setting \"%s\"",filename,line_number,name+1);
+    return FALSE;
+  }
+  if(!_set_argument_value(entry->argument,value))
+  {
+    LOG.error(L"%s, line %d: invalid value for \"%s\"",filename,line_number,name+1);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/**
+ * (internal) hashes the names and types of all arguments in the given groups, to match snapshots to their groups
+ *
+ * \param group_count the number of argument groups
+ * \param groups      the argument groups
+ * \param count       output: the total number of arguments
+ * \return the layout's hash
+ */
+static UINT32 _hash_argument_layout(UINTN group_count, cmdline_argument_group_t **groups, UINTN *count)
+{
+  UINT32 hash=ARGUMENT_HASH_BASIS;
+  UINTN tc, td;
+
+  *count=0;
+  for(tc=0;tc<group_count;tc++)
+  {
+    for(td=0;td<groups[tc]->count;td++)
+    {
+      hash=_hash_argument_name(hash,groups[tc]->list[td].name);
+      hash=(hash^groups[tc]->list[td].type)*ARGUMENT_HASH_PRIME;
+    }
+    *count+=groups[tc]->count;
+  }
+  return hash;
+}
+
+/**
+ * (internal) loads argument values from a config snapshot
+ *
+ * \param contents    the snapshot file's contents
+ * \param filename    the snapshot file's name, for error messages
+ * \param group_count the number of argument groups
+ * \param groups      the argument groups
+ * \return an EFI status code
+ */
+static EFI_STATUS _load_config_snapshot(file_contents_t *contents, CHAR16 *filename, UINTN group_count, cmdline_argument_group_t **groups)
+{
+  config_snapshot_header_t *header=(config_snapshot_header_t *)contents->data;
+  UINT64 *values=(UINT64 *)(header+1);
+  UINTN count, tc, td, pos=0, offset;
+  cmdline_argument_t *argument;
+  cmdline_value_t value;
+
+  if(contents->data_length<sizeof(config_snapshot_header_t) || header->version!=CONFIG_SNAPSHOT_VERSION)
+  {
+    LOG.error(L"%s: unsupported config snapshot",filename);
+    return EFI_INCOMPATIBLE_VERSION;
+  }
+  if(header->layout_hash!=_hash_argument_layout(group_count,groups,&count) || header->count!=count)
+  {
+    LOG.error(L"%s: config snapshot doesn't match this application's arguments, please save it again",filename);
+    return EFI_INCOMPATIBLE_VERSION;
+  }
+  offset=sizeof(config_snapshot_header_t)+count*sizeof(UINT64);
+  if(contents->data_length<offset)
   {
-    for(td=0;td<arguments->count;td++)
+    LOG.error(L"%s: config snapshot is truncated",filename);
+    return EFI_INVALID_PARAMETER;
+  }
+
+  for(tc=0;tc<group_count;tc++)
+  {
+    for(td=0;td<groups[tc]->count;td++)
     {
-      if(StrCmp(argv[tc],arguments->list[td].name)==0)
+      argument=groups[tc]->list+td;
+      value.uint64=values[pos++];
+      if(argument->type==ARG_STRING && value.uint64>0)
       {
-        switch(arguments->list[td].type)
+        if(value.uint64%sizeof(CHAR16) || offset+value.uint64>contents->data_length
+           || *(CHAR16 *)(contents->data+offset+value.uint64-sizeof(CHAR16))!=0)
         {
-          case ARG_BOOL:
-            arguments->list[td].value.uint64=1;
-            break;
-          case ARG_INT:
-            if(tc>(argc-2) || !wctype_int(argv[tc+1]) || argv[tc+1][0]==L'-')
-            {
-              LOG.error(L"argument %s must be followed by a non-negative number",arguments->list[td].name);
-              return FALSE;
-            }
-            arguments->list[td].value.uint64=StrDecimalToUint64(argv[tc+1]);
-            argv[tc++][0]=0;
-            break;
-          case ARG_DOUBLE:
-            if(tc>(argc-2) || !wctype_float(argv[tc+1]))
-            {
-              LOG.error(L"argument %s must be followed by a decimal number",arguments->list[td].name);
-              return FALSE;
-            }
-            arguments->list[td].value.dbl=_wcstof(argv[tc+1]);
-            argv[tc++][0]=0;
-            break;
-          case ARG_STRING:
-            if(tc>(argc-2))
-            {
-              LOG.error(L"argument %s must be followed by a string",arguments->list[td].name);
-              return FALSE;
-            }
-            bytes=StrSize(argv[tc+1]);
-            ptr=AllocatePool(bytes);
-            if(ptr==NULL)
-            {
-              LOG.error(L"could not allocate memory for string parameter");
-              return FALSE;
-            }
-            CopyMem(ptr,argv[tc+1],bytes);
-            arguments->list[td].value.wcstr=ptr;
-            argv[tc++][0]=0;
-            break;
-          default:
-            LOG.error(L"unhandled argument type: %d",arguments->list[td].type);
-            return FALSE;
+          LOG.error(L"%s: invalid string for %s",filename,argument->name);
+          return EFI_INVALID_PARAMETER;
         }
-        argv[tc][0]=0;
-        if(arguments->list[td].validator_func && !arguments->list[td].validator_func(arguments->list[td].value))
-          return FALSE;
-        break;
+        if((value.wcstr=AllocateCopyPool(value.uint64,contents->data+offset))==NULL)
+          return EFI_OUT_OF_RESOURCES;
+        offset+=(UINTN)value.uint64;
+      }
+      else if(argument->type==ARG_STRING)
+        value.wcstr=NULL;
+
+      if(argument->validator_func && !argument->validator_func(value))
+      {
+        LOG.error(L"%s: invalid value for %s",filename,argument->name);
+        return EFI_INVALID_PARAMETER;
       }
+      argument->value=value;
     }
   }
-  return TRUE;
+  return EFI_SUCCESS;
+}
+
+/**
+ * (internal) loads argument values from a text config file or config snapshot
+ *
+ * \param index       the argument index for the argument groups
+ * \param filename    the file's full path within the boot volume
+ * \param group_count the number of argument groups
+ * \param groups      the argument groups
+ * \return an EFI status code
+ */
+static EFI_STATUS _load_config(argument_index_t *index, CHAR16 *filename, UINTN group_count, cmdline_argument_group_t **groups)
+{
+  PROFILE_SCOPE(L"load_config");
+  file_contents_t *contents;
+  ascii_tokenizer_t lines;
+  ascii_view_t line;
+  UINTN line_number=0;
+  EFI_STATUS result=EFI_SUCCESS;
+
+  if((contents=get_file_contents(filename))==NULL)
+  {
+    LOG.error(L"could not read config file %s",filename);
+    return EFI_NOT_FOUND;
+  }
+
+  if(contents->data_length>=sizeof(UINT32) && *(UINT32 *)contents->data==CONFIG_SNAPSHOT_MAGIC)
+    result=_load_config_snapshot(contents,filename,group_count,groups);
+  else
+  {
+    init_ascii_tokenizer(&lines,ascii_view_n(contents->data,contents->data_length),'\n');
+    while(result==EFI_SUCCESS && next_ascii_token(&lines,&line))
+      if(!_apply_config_line(index,line,filename,++line_number))
+        result=EFI_INVALID_PARAMETER;
+  }
+
+  free_pages(contents,contents->memory_pages);
+  return result;
+}
+
+/**
+ * (internal) saves all argument values as config snapshot
+ *
+ * \param filename    the snapshot file's full path within the boot volume
+ * \param group_count the number of argument groups
+ * \param groups      the argument groups
+ * \return an EFI status code
+ */
+static EFI_STATUS _save_config_snapshot(CHAR16 *filename, UINTN group_count, cmdline_argument_group_t **groups)
+{
+  file_writer_t writer;
+  config_snapshot_header_t header;
+  cmdline_argument_t *argument;
+  UINTN count, tc, td;
+  UINT64 value;
+  EFI_STATUS result;
+
+  header.magic=CONFIG_SNAPSHOT_MAGIC;
+  header.version=CONFIG_SNAPSHOT_VERSION;
+  header.layout_hash=_hash_argument_layout(group_count,groups,&count);
+  header.count=(UINT32)count;
+
+  if((result=open_file_writer(&writer,filename,0))!=EFI_SUCCESS)
+  {
+    LOG.error(L"could not create config snapshot %s: %r",filename,result);
+    return result;
+  }
+  write_file_chunk(&writer,&header,sizeof(header));
+  for(tc=0;tc<group_count;tc++)
+  {
+    for(td=0;td<groups[tc]->count;td++)
+    {
+      argument=groups[tc]->list+td;
+      if(argument->type==ARG_STRING)
+        value=argument->value.wcstr!=NULL?StrSize(argument->value.wcstr):0;
+      else
+        value=argument->value.uint64;
+      write_file_chunk(&writer,&value,sizeof(value));
+    }
+  }
+  for(tc=0;tc<group_count;tc++)
+    for(td=0;td<groups[tc]->count;td++)
+      if(groups[tc]->list[td].type==ARG_STRING && groups[tc]->list[td].value.wcstr!=NULL)
+        write_file_chunk(&writer,groups[tc]->list[td].value.wcstr,StrSize(groups[tc]->list[td].value.wcstr));
+
+  if((result=close_file_writer(&writer))!=EFI_SUCCESS)
+    LOG.error(L"could not write config snapshot %s: %r",filename,result);
+  return result;
+}
+
+/**
+ * Loads argument values from a text config file or config snapshot on the boot volume, see cmdline.h for the format.
+ * Applications using init() can simply pass "-config <file>" on the command line instead.
+ *
+ * \param filename    the file's full path within the boot volume, e.g. "\\snow.cfg"
+ * \param group_count the number of argument groups passed, at most CMDLINE_MAX_GROUPS
+ * \param args        the vararg list of argument groups (as cmdline_argument_group_t *)
+ * \return an EFI status code
+ */
+EFI_STATUS load_config(CHAR16 *filename, UINTN group_count, VA_LIST args)
+{
+  cmdline_argument_group_t *groups[CMDLINE_MAX_GROUPS];
+  argument_index_t index;
+  EFI_STATUS result;
+
+  if(!_collect_argument_groups(groups,group_count,args) || !_build_argument_index(&index,group_count,groups))
+    return EFI_INVALID_PARAMETER;
+  result=_load_config(&index,filename,group_count,groups);
+  FreePool(index.entries);
+  return result;
+}
+
+/**
+ * Saves all argument values as config snapshot on the boot volume, replacing the file if it already exists.
+ * Applications using init() can simply pass "-save-config <file>" on the command line instead.
+ *
+ * \param filename    the snapshot file's full path within the boot volume, e.g. "\\snow.bin"
+ * \param group_count the number of argument groups passed, at most CMDLINE_MAX_GROUPS
+ * \param args        the vararg list of argument groups (as cmdline_argument_group_t *)
+ * \return an EFI status code
+ */
+EFI_STATUS save_config_snapshot(CHAR16 *filename, UINTN group_count, VA_LIST args)
+{
+  cmdline_argument_group_t *groups[CMDLINE_MAX_GROUPS];
+
+  if(!_collect_argument_groups(groups,group_count,args))
+    return EFI_INVALID_PARAMETER;
+  return _save_config_snapshot(filename,group_count,groups);
 }
 
 /**
  * Parses command-line parameters
+ * All argument names are put into a hash index first, so the command line is processed in a single pass with one
+ * lookup per argument. Built-in arguments (logging, profiling) are applied first, then values from the config file
+ * passed with "-config" are loaded, then argument group values from the command line are parsed and validated.
  *
  * \param argc        the number of command-line arguments
  * \param argv        the list of command-line arguments, as UTF-16
- * \param group_count the number of command line argument groups passed
+ * \param group_count the number of command line argument groups passed, at most CMDLINE_MAX_GROUPS
  * \param args        the vararg list of command line groups (as cmdline_argument_group_t *)
  * \return an EFI status code
  */
 EFI_STATUS parse_parameters(INTN argc, CHAR16 **argv, UINTN group_count, VA_LIST args)
 {
-  unsigned int tc;
-  cmdline_argument_group_t *group;
+  cmdline_argument_group_t *groups[CMDLINE_MAX_GROUPS];
+  argument_index_t index;
+  argument_index_entry_t *entry;
+  argument_match_t *matches=NULL;
+  UINTN match_count=0;
+  CHAR16 *config_file=NULL;
+  CHAR16 *snapshot_file=NULL;
+  LOGLEVEL log_level=INFO;
+  BOOLEAN help=FALSE;
+  EFI_STATUS result=EFI_SUCCESS;
+  VA_LIST help_args;
+  INTN tc;
 
-  if(!_parse_logger_args(argc,argv))
+  VA_COPY(help_args,args);
+  if(!_collect_argument_groups(groups,group_count,args) || !_build_argument_index(&index,group_count,groups))
+  {
+    VA_END(help_args);
+    return EFI_INVALID_PARAMETER;
+  }
+  if(argc>0 && (matches=AllocatePool(argc*sizeof(argument_match_t)))==NULL)
   {
-    print_help_text(group_count,args);
-    return RV_HELP;
+    FreePool(index.entries);
+    VA_END(help_args);
+    return EFI_OUT_OF_RESOURCES;
   }
 
-  for(tc=0;tc<group_count;tc++)
+  reset_logger_entry_counts();
+  for(tc=0;tc<argc;tc++)
   {
-    group=VA_ARG(args,cmdline_argument_group_t *);
-    if(!group || !_parse_parameter_group(argc,argv,group))
-      return EFI_INVALID_PARAMETER;
+    if((entry=_find_argument(&index,argv[tc]))==NULL)
+      continue;
+    if(entry->builtin==BUILTIN_HELP)
+      help=TRUE;
+    else if(entry->builtin==BUILTIN_CONFIG)
+      _take_file_argument(argc,argv,&tc,&config_file);
+    else if(entry->builtin==BUILTIN_SAVE_CONFIG)
+      _take_file_argument(argc,argv,&tc,&snapshot_file);
+    else if(entry->builtin!=BUILTIN_NONE)
+    {
+      _apply_builtin_argument(entry,&log_level);
+      argv[tc][0]=0;
+    }
+    else
+    {
+      matches[match_count].position=tc;
+      matches[match_count++].argument=entry->argument;
+      if(entry->argument->type!=ARG_BOOL)
+        tc++;
+    }
   }
+  set_log_level(log_level);
 
-  if(!check_no_arguments_remaining(argc,argv))
-    return EFI_INVALID_PARAMETER;
+  if(help)
+  {
+    print_help_text(group_count,help_args);
+    result=RV_HELP;
+  }
+  else
+  {
+    if(config_file)
+      result=_load_config(&index,config_file,group_count,groups);
+    for(tc=0;tc<match_count && result==EFI_SUCCESS;tc++)
+      if(!_parse_argument_value(argc,argv,matches[tc].position,matches[tc].argument))
+        result=EFI_INVALID_PARAMETER;
+    if(result==EFI_SUCCESS && !check_no_arguments_remaining(argc,argv))
+      result=EFI_INVALID_PARAMETER;
+    if(result==EFI_SUCCESS && snapshot_file)
+      result=_save_config_snapshot(snapshot_file,group_count,groups);
+  }
 
-  return EFI_SUCCESS;
+  if(config_file)
+    FreePool(config_file);
+  if(snapshot_file)
+    FreePool(snapshot_file);
+  if(matches)
+    FreePool(matches);
+  FreePool(index.entries);
+  VA_END(help_args);
+  return result;
 }
 
 
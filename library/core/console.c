@@ -11,10 +11,18 @@
 #include <Library/UefiLib.h>
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/MemoryAllocationLib.h>
+#include <Library/BaseMemoryLib.h>
 #include <UEFIStarter/core/console.h>
 #include <UEFIStarter/core/memory.h>
 #include <UEFIStarter/core/string.h>
 #include <UEFIStarter/core/logger.h>
+#include <UEFIStarter/core/serial.h>
+#include <UEFIStarter/core/profiler.h>
+#include <UEFIStarter/core/files.h>
+
+
+/** the size of color_print()'s stack buffer, in characters: longer texts are formatted in pool memory */
+#define CONSOLE_PRINT_BUFFER_LENGTH 256
 
 
 /**
@@ -62,7 +70,7 @@ EFI_STATUS set_console_mode(unsigned int requested_mode)
   }
   if(gST->ConOut->Mode->Mode==requested_mode)
   {
-    LOG.debug(L"already at console mode %d",requested_mode);
+    LOG_DEBUG(L"already at console mode %d",requested_mode);
     return EFI_SUCCESS;
   }
 
@@ -70,7 +78,7 @@ EFI_STATUS set_console_mode(unsigned int requested_mode)
   if(result!=EFI_SUCCESS)
     return result;
 
-  LOG.debug(L"switched to console mode %d",requested_mode);
+  LOG_DEBUG(L"switched to console mode %d",requested_mode);
   return result;
 }
 
@@ -84,19 +92,21 @@ EFI_STATUS set_console_mode(unsigned int requested_mode)
  */
 void EFIAPI color_print(UINTN color, CHAR16 *fmt, ...)
 {
-  CHAR16 *str;
+  CHAR16 buffer[CONSOLE_PRINT_BUFFER_LENGTH];
+  string_builder_t builder;
   UINTN attr=gST->ConOut->Mode->Attribute;
   VA_LIST args;
 
+  init_string_builder(&builder,buffer,CONSOLE_PRINT_BUFFER_LENGTH);
   VA_START(args,fmt);
-  str=CatVSPrint(NULL,fmt,args);
+  append_format_va(&builder,fmt,args);
   VA_END(args);
 
   gST->ConOut->SetAttribute(gST->ConOut,(attr&0xFFFFFFF0)+(color&0x0F));
-  Print(str);
+  gST->ConOut->OutputString(gST->ConOut,builder.buffer);
   gST->ConOut->SetAttribute(gST->ConOut,attr);
 
-  FreePool(str);
+  free_string_builder(&builder);
 }
 
 /**
@@ -133,6 +143,191 @@ void wait_for_key()
 }
 
 
+/**
+ * Creates a virtual text screen in the console's current text mode and clears the console.
+ * Cells get cleared with the console's current attribute.
+ *
+ * \param screen the text screen to initialize, needs to be freed with free_text_screen()
+ * \return an EFI status code
+ */
+EFI_STATUS init_text_screen(text_screen_t *screen)
+{
+  EFI_STATUS result;
+  UINTN count;
+
+  screen->cells=NULL;
+  result=gST->ConOut->QueryMode(gST->ConOut,gST->ConOut->Mode->Mode,&screen->columns,&screen->rows);
+  if(result!=EFI_SUCCESS)
+  {
+    LOG.error(L"could not query text mode: %r",result);
+    return result;
+  }
+  count=screen->columns*screen->rows;
+  screen->memory_pages=(count*2*sizeof(text_cell_t)+(screen->columns+1)*sizeof(CHAR16)-1)/4096+1;
+  if((screen->cells=allocate_pages(screen->memory_pages))==NULL)
+    return EFI_OUT_OF_RESOURCES;
+  screen->shown=screen->cells+count;
+  screen->run=(CHAR16 *)(screen->shown+count);
+  screen->attribute=(UINT16)gST->ConOut->Mode->Attribute;
+  screen->presented_runs=0;
+
+  clear_text_screen(screen);
+  CopyMem(screen->shown,screen->cells,count*sizeof(text_cell_t));
+  return gST->ConOut->ClearScreen(gST->ConOut);
+}
+
+/**
+ * Frees a virtual text screen's buffers.
+ *
+ * \param screen the text screen to free
+ */
+void free_text_screen(text_screen_t *screen)
+{
+  if(screen->cells==NULL)
+    return;
+  free_pages(screen->cells,screen->memory_pages);
+  screen->cells=NULL;
+}
+
+/**
+ * Clears all cells of a virtual text screen; the console doesn't change until the next console_present() call.
+ *
+ * \param screen the text screen to clear
+ */
+void clear_text_screen(text_screen_t *screen)
+{
+  UINTN tc;
+  UINTN count=screen->columns*screen->rows;
+
+  for(tc=0;tc<count;tc++)
+  {
+    screen->cells[tc].character=L' ';
+    screen->cells[tc].attribute=screen->attribute;
+  }
+}
+
+/**
+ * Sets a virtual text screen's cell. Coordinates outside the screen are ignored.
+ *
+ * \param screen    the text screen to draw on
+ * \param x         the cell's column
+ * \param y         the cell's row
+ * \param character the cell's character
+ * \param attribute the cell's text attribute, see EFI_TEXT_ATTR()
+ */
+void set_text_cell(text_screen_t *screen, INTN x, INTN y, CHAR16 character, UINTN attribute)
+{
+  text_cell_t *cell;
+
+  if(x<0 || y<0 || x>=screen->columns || y>=screen->rows)
+    return;
+  cell=screen->cells+y*screen->columns+x;
+  cell->character=character;
+  cell->attribute=(UINT16)attribute;
+}
+
+/**
+ * Prints formatted text into a virtual text screen's cells, starting at the given cell.
+ * Takes the same format strings as EDK's print functions. Text outside the screen is cut off, there's no line wrapping.
+ *
+ * \param screen    the text screen to draw on
+ * \param x         the first character's column
+ * \param y         the text's row
+ * \param attribute the text attribute, see EFI_TEXT_ATTR()
+ * \param fmt       the format string, as UTF-16
+ * \param ...       any parameters to the format string
+ */
+void EFIAPI print_text_screen(text_screen_t *screen, INTN x, INTN y, UINTN attribute, CHAR16 *fmt, ...)
+{
+  CHAR16 buffer[CONSOLE_PRINT_BUFFER_LENGTH];
+  string_builder_t builder;
+  VA_LIST args;
+  UINTN tc;
+
+  init_string_builder(&builder,buffer,CONSOLE_PRINT_BUFFER_LENGTH);
+  VA_START(args,fmt);
+  append_format_va(&builder,fmt,args);
+  VA_END(args);
+
+  for(tc=0;tc<builder.length;tc++)
+    set_text_cell(screen,x+tc,y,builder.buffer[tc],attribute);
+  free_string_builder(&builder);
+}
+
+/**
+ * (internal) checks whether a virtual text screen's cell differs from the console
+ *
+ * \param screen the text screen to check
+ * \param pos    the cell's index
+ * \return whether the cell needs to be output
+ */
+static BOOLEAN _is_cell_changed(text_screen_t *screen, UINTN pos)
+{
+  return screen->cells[pos].character!=screen->shown[pos].character
+         || screen->cells[pos].attribute!=screen->shown[pos].attribute;
+}
+
+/**
+ * Outputs a virtual text screen's changes to the console.
+ * Changed cells are grouped into spans of the same attribute, each span takes one SetCursorPosition() and one
+ * OutputString() call. Spans include up to TEXT_SCREEN_MAX_GAP unchanged cells between changed ones.
+ * The console's attribute is restored afterwards.
+ *
+ * \param screen the text screen to present
+ * \return an EFI status code
+ */
+EFI_STATUS console_present(text_screen_t *screen)
+{
+  PROFILE_SCOPE(L"console_present");
+  EFI_STATUS result=EFI_SUCCESS;
+  UINTN original_attribute=gST->ConOut->Mode->Attribute;
+  UINTN attribute=original_attribute;
+  UINTN x, y, row, limit, start, end, pos;
+
+  for(y=0;y<screen->rows && result==EFI_SUCCESS;y++)
+  {
+    row=y*screen->columns;
+    limit=y<screen->rows-1?screen->columns:screen->columns-1;
+    for(x=0;x<limit && result==EFI_SUCCESS;)
+    {
+      if(!_is_cell_changed(screen,row+x))
+      {
+        x++;
+        continue;
+      }
+
+      start=x;
+      end=x+1;
+      for(pos=end;pos<limit && pos-end<=TEXT_SCREEN_MAX_GAP && screen->cells[row+pos].attribute==screen->cells[row+start].attribute;pos++)
+        if(_is_cell_changed(screen,row+pos))
+          end=pos+1;
+      for(pos=start;pos<end;pos++)
+      {
+        screen->run[pos-start]=screen->cells[row+pos].character;
+        screen->shown[row+pos]=screen->cells[row+pos];
+      }
+      screen->run[end-start]=0;
+
+      if(attribute!=screen->cells[row+start].attribute)
+      {
+        attribute=screen->cells[row+start].attribute;
+        gST->ConOut->SetAttribute(gST->ConOut,attribute);
+      }
+      if((result=gST->ConOut->SetCursorPosition(gST->ConOut,start,y))==EFI_SUCCESS)
+        result=gST->ConOut->OutputString(gST->ConOut,screen->run);
+      screen->presented_runs++;
+      x=end;
+    }
+  }
+
+  if(attribute!=original_attribute)
+    gST->ConOut->SetAttribute(gST->ConOut,original_attribute);
+  if(result!=EFI_SUCCESS)
+    LOG.error(L"could not present text screen: %r",result);
+  return result;
+}
+
+
 /**
  * Initializes an UEFIStarter application.
  * Call this as early as possible to gain access to the memory tracking, logging and other features.
@@ -173,7 +368,9 @@ EFI_STATUS EFIAPI init(INTN argc, CHAR16 **argv, UINTN arg_group_count, ...)
 
 /**
  * Shuts the UEFIStarter internals down.
- * This will stop the memory tracker, upon which any unfreed memory gets reported.
+ * This will write the profiler report (if profiling), flush the deferred log (if enabled), close cached file system
+ * handles, flush any buffered serial log output, and stop the memory tracker, upon which any unfreed memory gets
+ * reported.
  *
  * Unfreed memory will continue to use up memory in the UEFI environment even after the application stopped. If you
  * didn't keep the pages allocated on purpose you'll probably want to free them before calling this.
@@ -184,5 +381,9 @@ EFI_STATUS EFIAPI init(INTN argc, CHAR16 **argv, UINTN arg_group_count, ...)
  */
 void shutdown()
 {
+  shutdown_profiler();
+  disable_deferred_logging();
+  flush_file_system_cache();
   stop_tracking_memory();
+  flush_serial_log();
 }
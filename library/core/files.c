@@ -1,6 +1,10 @@
 /** \file
  * File handling functions
  *
+ * Volume and directory handles are cached across calls: looking up a volume takes several boot service calls, and
+ * loading many files from the same directory shouldn't have to open it for every file. Cached handles are owned by
+ * the cache, flush_file_system_cache() closes them (shutdown() does this automatically).
+ *
  * \author Richard Nusser
  * \copyright 2017-2018 Richard Nusser
  * \license GPLv3 (see http://www.gnu.org/licenses/)
@@ -10,87 +14,342 @@
 
 #include <Library/UefiLib.h>
 #include <Library/UefiBootServicesTableLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/BaseLib.h>
+#include <Library/PrintLib.h>
 #include <Protocol/SimpleFileSystem.h>
 #include <Guid/FileInfo.h>
 #include <UEFIStarter/core/files.h>
 #include <UEFIStarter/core/memory.h>
 #include <UEFIStarter/core/logger.h>
+#include <UEFIStarter/core/string.h>
+
+
+/** data type for cached volumes */
+typedef struct
+{
+  EFI_FILE_IO_INTERFACE *protocol; /**< the volume's file system protocol */
+  EFI_FILE_HANDLE root;            /**< the volume's root directory handle, NULL until first used */
+} cached_volume_t;
+
+/** data type for cached directory handles */
+typedef struct
+{
+  UINTN volume;                            /**< the index of the volume the directory is on */
+  EFI_FILE_HANDLE handle;                  /**< the directory's handle */
+  CHAR16 path[FILES_MAX_DIRECTORY_LENGTH]; /**< the directory's full path within the volume */
+} cached_directory_t;
+
+
+static BOOLEAN _volumes_enumerated=FALSE;                             /**< whether the volume list is up to date */
+static UINTN _volume_count=0;                                         /**< the number of cached volumes */
+static cached_volume_t _volumes[FILES_MAX_VOLUMES];                   /**< internal storage for cached volumes */
+static cached_directory_t _directories[FILES_MAX_CACHED_DIRECTORIES]; /**< internal storage for cached directories */
+static UINTN _directory_count=0;                                      /**< the number of cached directories */
+static UINTN _next_evicted_directory=0;                               /**< the cache entry to replace next when full */
+
 
 /**
- * Opens a handle for the first filesystem root.
- * In the UEFI shell, this will most likely be FS0:.
+ * Internal: looks up all volumes supporting the simple file system protocol, unless already done.
  *
- * \return the root volume's handle on success, NULL otherwise
+ * \return whether any volumes are available
  */
-EFI_FILE_HANDLE find_root_volume()
+static BOOLEAN _enumerate_volumes()
 {
-  EFI_FILE_IO_INTERFACE *protocol;
-  EFI_FILE_HANDLE root;
   EFI_GUID guid=SIMPLE_FILE_SYSTEM_PROTOCOL;
-  EFI_HANDLE handles[100];
-  UINTN handles_size=100*sizeof(EFI_HANDLE);
+  EFI_HANDLE *handles;
   UINTN handle_count;
+  UINTN tc;
+
+  if(_volumes_enumerated)
+    return _volume_count>0;
+
+  if(gST->BootServices->LocateHandleBuffer(ByProtocol,&guid,NULL,&handle_count,&handles)!=EFI_SUCCESS)
+    return FALSE;
+  LOG_DEBUG(L"found %d file system handles",handle_count);
+  if(handle_count>FILES_MAX_VOLUMES)
+  {
+    LOG.warn(L"found %d volumes, only using the first %d",handle_count,FILES_MAX_VOLUMES);
+    handle_count=FILES_MAX_VOLUMES;
+  }
+
+  _volume_count=0;
+  for(tc=0;tc<handle_count;tc++)
+  {
+    if(gST->BootServices->OpenProtocol(handles[tc],&guid,(void **)&_volumes[_volume_count].protocol,gImageHandle,NULL,EFI_OPEN_PROTOCOL_BY_HANDLE_PROTOCOL)!=EFI_SUCCESS)
+      continue;
+    _volumes[_volume_count].root=NULL;
+    _volume_count++;
+  }
+  FreePool(handles);
 
-  if(gST->BootServices->LocateHandle(ByProtocol,&guid,NULL,&handles_size,(void**)&handles)!=EFI_SUCCESS)
+  _volumes_enumerated=TRUE;
+  return _volume_count>0;
+}
+
+/**
+ * Returns the number of available volumes.
+ * Volumes are numbered in the order UEFI reports them, this isn't necessarily the order of the shell's FSx: mappings.
+ *
+ * \return the number of volumes
+ */
+UINTN get_volume_count()
+{
+  _enumerate_volumes();
+  return _volume_count;
+}
+
+/**
+ * Returns a volume's cached root directory handle, opening it on first use.
+ * The handle is owned by the cache: don't close it.
+ *
+ * \param volume the volume's index, starting at 0
+ * \return the root directory's handle, or NULL on error
+ */
+EFI_FILE_HANDLE get_volume_root(UINTN volume)
+{
+  cached_volume_t *entry;
+
+  if(!_enumerate_volumes() || volume>=_volume_count)
     return NULL;
-  handle_count=handles_size/sizeof(EFI_HANDLE);
-  LOG.debug(L"handles size: %d bytes (%d entries)",handles_size,handle_count);
 
-  if(gST->BootServices->OpenProtocol(handles[0],&guid,(void **)&protocol,gImageHandle,NULL,EFI_OPEN_PROTOCOL_BY_HANDLE_PROTOCOL)!=EFI_SUCCESS)
+  entry=&_volumes[volume];
+  if(!entry->root && entry->protocol->OpenVolume(entry->protocol,&entry->root)!=EFI_SUCCESS)
+  {
+    LOG.error(L"could not open volume %d",volume);
+    entry->root=NULL;
+  }
+  return entry->root;
+}
+
+/**
+ * Internal: closes and forgets a cached directory handle.
+ *
+ * \param index the directory's cache entry
+ */
+static void _close_cached_directory(UINTN index)
+{
+  _directories[index].handle->Close(_directories[index].handle);
+  _directories[index].handle=NULL;
+}
+
+/**
+ * Closes all cached volume and directory handles.
+ * Call this after volumes were added or removed, the next file access looks them up again. File handles returned by
+ * other functions in this module remain valid.
+ */
+void flush_file_system_cache()
+{
+  UINTN tc;
+
+  for(tc=0;tc<_directory_count;tc++)
+    if(_directories[tc].handle)
+      _close_cached_directory(tc);
+  _directory_count=0;
+  _next_evicted_directory=0;
+
+  for(tc=0;tc<_volume_count;tc++)
+  {
+    if(_volumes[tc].root)
+      _volumes[tc].root->Close(_volumes[tc].root);
+    _volumes[tc].root=NULL;
+  }
+  _volume_count=0;
+  _volumes_enumerated=FALSE;
+}
+
+/**
+ * Internal: returns a cached directory handle, opening and caching the directory if necessary.
+ * When the cache is full the entries are replaced in round-robin order.
+ *
+ * \param volume the directory's volume index
+ * \param root   the volume's root directory handle
+ * \param path   the directory's full path within the volume, doesn't need to be null-terminated
+ * \param length the directory path's length, in characters, must be less than FILES_MAX_DIRECTORY_LENGTH
+ * \return the directory's handle, or NULL on error
+ */
+static EFI_FILE_HANDLE _get_cached_directory(UINTN volume, EFI_FILE_HANDLE root, CHAR16 *path, UINTN length)
+{
+  cached_directory_t *entry;
+  UINTN tc;
+
+  for(tc=0;tc<_directory_count;tc++)
+  {
+    entry=&_directories[tc];
+    if(entry->handle && entry->volume==volume && entry->path[length]==0 && CompareMem(entry->path,path,length*sizeof(CHAR16))==0)
+      return entry->handle;
+  }
+
+  if(_directory_count<FILES_MAX_CACHED_DIRECTORIES)
+    tc=_directory_count++;
+  else
+  {
+    tc=_next_evicted_directory;
+    _next_evicted_directory=(_next_evicted_directory+1)%FILES_MAX_CACHED_DIRECTORIES;
+    if(_directories[tc].handle)
+      _close_cached_directory(tc);
+  }
+
+  entry=&_directories[tc];
+  CopyMem(entry->path,path,length*sizeof(CHAR16));
+  entry->path[length]=0;
+  entry->volume=volume;
+  if(root->Open(root,&entry->handle,entry->path,EFI_FILE_MODE_READ,0)!=EFI_SUCCESS)
+  {
+    LOG_TRACE(L"could not open directory %s",entry->path);
+    entry->handle=NULL;
+  }
+  return entry->handle;
+}
+
+/**
+ * Internal: opens a file on a volume, using the cached handle of the file's directory.
+ * If the volume reports it changed, the cache gets flushed and the file is looked up once more.
+ *
+ * \param volume   the volume's index
+ * \param pathname the file's full path within the volume
+ * \param mode     the EFI_FILE_MODE_* flags to open the file with
+ * \param file     output: the file's handle
+ * \return EFI_SUCCESS, or an error code
+ */
+static EFI_STATUS _open_file(UINTN volume, CHAR16 *pathname, UINT64 mode, EFI_FILE_HANDLE *file)
+{
+  EFI_FILE_HANDLE root, directory;
+  EFI_STATUS result;
+  UINTN separator, tc, attempt;
+
+  separator=0;
+  for(tc=0;pathname[tc];tc++)
+    if(pathname[tc]==L'\\')
+      separator=tc;
+
+  for(attempt=0;attempt<2;attempt++)
+  {
+    root=get_volume_root(volume);
+    if(!root)
+      return EFI_NOT_FOUND;
+
+    //files in the root directory, and in directories with overly long paths, are opened directly
+    if(separator==0 || separator>=FILES_MAX_DIRECTORY_LENGTH)
+      result=root->Open(root,file,pathname,mode,0);
+    else if((directory=_get_cached_directory(volume,root,pathname,separator))!=NULL)
+      result=directory->Open(directory,file,pathname+separator+1,mode,0);
+    else
+      result=EFI_NOT_FOUND;
+
+    if(result!=EFI_MEDIA_CHANGED && result!=EFI_NO_MEDIA)
+      break;
+    LOG_DEBUG(L"volume %d changed, flushing file system cache",volume);
+    flush_file_system_cache();
+  }
+  return result;
+}
+
+/**
+ * Opens a new handle for the first filesystem root.
+ * In the UEFI shell, this will most likely be FS0:.
+ * The caller needs to close the returned handle, use get_volume_root() to get a cached handle instead.
+ *
+ * \return the root volume's handle on success, NULL otherwise
+ */
+EFI_FILE_HANDLE find_root_volume()
+{
+  EFI_FILE_HANDLE root;
+
+  if(!_enumerate_volumes())
     return NULL;
-  if(protocol->OpenVolume(protocol,&root)!=EFI_SUCCESS)
+  if(_volumes[0].protocol->OpenVolume(_volumes[0].protocol,&root)!=EFI_SUCCESS)
     return NULL;
-
   return root;
 }
 
+/**
+ * Opens a file handle on the given volume, if the file exists.
+ *
+ * \param volume   the volume's index, starting at 0
+ * \param pathname the file's full path within the volume, e.g. "\\startup.nsh" to get the startup script.
+ * \return a handle to the file on success, NULL otherwise
+ */
+EFI_FILE_HANDLE find_file_on_volume(UINTN volume, CHAR16 *pathname)
+{
+  EFI_FILE_HANDLE file;
+
+  LOG_TRACE(L"looking for %s on volume %d...",pathname,volume);
+  if(_open_file(volume,pathname,EFI_FILE_MODE_READ,&file)!=EFI_SUCCESS)
+    return NULL;
+  return file;
+}
+
 /**
  * Opens a file handle, if the given file exists.
- * This assumes the file is on the first root volume (usually FS0:).
+ * The first volume (usually FS0:) is searched first, then all other volumes in order.
  *
  * \param pathname the file's full path within the volume, e.g. "\\startup.nsh" to get the startup script.
  * \return a handle to the file on success, NULL otherwise
  */
 EFI_FILE_HANDLE find_file(CHAR16 *pathname)
 {
-  EFI_FILE_HANDLE root, file;
+  EFI_FILE_HANDLE file=NULL;
+  UINTN volume;
 
-  root=find_root_volume();
-  if(!root)
-    return NULL;
-  LOG.trace(L"found root volume, looking for %s...",pathname);
-  if(root->Open(root,&file,pathname,EFI_FILE_MODE_READ,0)!=EFI_SUCCESS)
-    return NULL;
-  LOG.trace(L"found requested file, closing...");
-  root->Close(root);
+  for(volume=0;volume<get_volume_count() && !file;volume++)
+    file=find_file_on_volume(volume,pathname);
   return file;
 }
 
 /**
- * Reads a file's contents.
- * If you just want to read files you'll probably want to use this function: it performs all the UEFI overhead for you
- * already. All you have to do is free the returned pointer's memory pages when you're done.
+ * Creates a file for writing on the given volume, replacing it if it already exists.
  *
- * \param filename the file's full path within the volume, e.g. "\\startup.nsh" to get the startup script.
- * \return a pointer to the file content descriptor, or NULL on error
+ * \param volume   the volume's index, starting at 0
+ * \param pathname the file's full path within the volume, e.g. "\\profile.json"
+ * \return a handle to the empty file on success, NULL otherwise
  */
-file_contents_t *get_file_contents(CHAR16 *filename)
+EFI_FILE_HANDLE create_file_on_volume(UINTN volume, CHAR16 *pathname)
 {
   EFI_FILE_HANDLE file;
+
+  //opening existing files with EFI_FILE_MODE_CREATE doesn't truncate them, so delete any previous version first
+  if(_open_file(volume,pathname,EFI_FILE_MODE_READ|EFI_FILE_MODE_WRITE,&file)==EFI_SUCCESS)
+  {
+    LOG_TRACE(L"deleting previous %s...",pathname);
+    file->Delete(file);
+  }
+  if(_open_file(volume,pathname,EFI_FILE_MODE_READ|EFI_FILE_MODE_WRITE|EFI_FILE_MODE_CREATE,&file)!=EFI_SUCCESS)
+    return NULL;
+  return file;
+}
+
+/**
+ * Creates a file for writing, replacing it if it already exists.
+ * This assumes the file is on the first root volume (usually FS0:).
+ *
+ * \param pathname the file's full path within the volume, e.g. "\\profile.json"
+ * \return a handle to the empty file on success, NULL otherwise
+ */
+EFI_FILE_HANDLE create_file(CHAR16 *pathname)
+{
+  return create_file_on_volume(0,pathname);
+}
+
+/**
+ * Internal: allocates memory for a file's contents.
+ *
+ * \param file the file to allocate memory for
+ * \return the file's (still empty) content descriptor, or NULL on error
+ */
+static file_contents_t *_allocate_file_contents(EFI_FILE_HANDLE file)
+{
   UINTN bufsize=SIZE_OF_EFI_FILE_INFO+200;
   char buffer[bufsize];
   EFI_FILE_INFO *info=(EFI_FILE_INFO *)buffer;
   EFI_GUID info_guid=EFI_FILE_INFO_ID;
   UINTN pages;
-  file_contents_t *file_contents=NULL;
-
-  file=find_file(filename);
-  if(!file)
-    return NULL;
+  file_contents_t *file_contents;
 
   if(file->GetInfo(file,&info_guid,&bufsize,info)!=EFI_SUCCESS)
     return NULL;
-  LOG.trace(L"filename: %s (%ld bytes)",info->FileName,info->FileSize);
+  LOG_TRACE(L"filename: %s (%ld bytes)",info->FileName,info->FileSize);
 
   pages=(info->FileSize+sizeof(file_contents_t))/4096+1;
   if((file_contents=allocate_pages(pages))==NULL)
@@ -98,13 +357,740 @@ file_contents_t *get_file_contents(CHAR16 *filename)
 
   file_contents->memory_pages=pages;
   file_contents->data_length=info->FileSize;
-  bufsize=pages*4096;
+  return file_contents;
+}
+
+/**
+ * Reads a file's contents.
+ * If you just want to read files you'll probably want to use this function: it performs all the UEFI overhead for you
+ * already. All you have to do is free the returned pointer's memory pages when you're done.
+ *
+ * \param filename the file's full path within the volume, e.g. "\\startup.nsh" to get the startup script.
+ * \return a pointer to the file content descriptor, or NULL on error
+ */
+file_contents_t *get_file_contents(CHAR16 *filename)
+{
+  EFI_FILE_HANDLE file;
+  UINTN bufsize;
+  file_contents_t *file_contents;
+
+  file=find_file(filename);
+  if(!file)
+    return NULL;
+
+  if((file_contents=_allocate_file_contents(file))==NULL)
+  {
+    file->Close(file);
+    return NULL;
+  }
+  bufsize=file_contents->memory_pages*4096;
 
   /** \TODO start a list of pitfalls, e.g. this: bufsize was too small (unsigned int instead of UINTN), so this call
             changed the last declared uninitialized variable in this function */
   if(file->Read(file,&bufsize,file_contents->data)!=EFI_SUCCESS)
-    return NULL;
+  {
+    free_pages(file_contents,file_contents->memory_pages);
+    file_contents=NULL;
+  }
 
   file->Close(file);
   return file_contents;
 }
+
+
+static async_read_t *_chunked_reads[ASYNC_READ_MAX_CHUNKED]; /**< internal storage for active chunked reads */
+static UINTN _chunked_read_count=0;                          /**< the number of active chunked reads */
+static EFI_EVENT _chunked_read_timer=NULL;                   /**< the timer event chunked reads are performed on */
+
+
+/**
+ * Internal: event notification function for completed ReadEx() calls.
+ * This runs at TPL_CALLBACK, so it must not log or print anything.
+ *
+ * \param event   the read token's event
+ * \param context the asynchronous read
+ */
+static void EFIAPI _async_read_completed(EFI_EVENT event, void *context)
+{
+  async_read_t *read=(async_read_t *)context;
+
+  read->bytes_read=read->token.BufferSize;
+  read->status=read->token.Status;
+}
+
+/**
+ * Internal: timer event notification function, reads the next chunk of each active chunked read.
+ * This runs at TPL_CALLBACK, so it must not log or print anything.
+ *
+ * If a file turns out to be shorter than when the read started its contents get truncated.
+ *
+ * \param event   the timer event
+ * \param context unused
+ */
+static void EFIAPI _read_next_chunks(EFI_EVENT event, void *context)
+{
+  async_read_t *read;
+  UINT64 remaining;
+  UINTN tc, size;
+  EFI_STATUS result;
+
+  for(tc=0;tc<_chunked_read_count;tc++)
+  {
+    read=_chunked_reads[tc];
+    if(read->status!=EFI_NOT_READY)
+      continue;
+
+    remaining=read->contents->data_length-read->bytes_read;
+    size=remaining<ASYNC_READ_CHUNK_SIZE?remaining:ASYNC_READ_CHUNK_SIZE;
+    result=read->file->Read(read->file,&size,read->contents->data+read->bytes_read);
+    if(result!=EFI_SUCCESS)
+    {
+      read->status=result;
+      continue;
+    }
+    read->bytes_read+=size;
+    if(size==0)
+      read->contents->data_length=read->bytes_read;
+    if(read->bytes_read>=read->contents->data_length)
+      read->status=EFI_SUCCESS;
+  }
+}
+
+/**
+ * Internal: adds a read to the active chunked reads, starting the timer if necessary.
+ *
+ * \param read the read to add
+ * \return EFI_SUCCESS, or an error code
+ */
+static EFI_STATUS _start_chunked_read(async_read_t *read)
+{
+  EFI_STATUS result=EFI_SUCCESS;
+  EFI_TPL previous_tpl;
+
+  if(!_chunked_read_timer)
+  {
+    result=gST->BootServices->CreateEvent(EVT_TIMER|EVT_NOTIFY_SIGNAL,TPL_CALLBACK,_read_next_chunks,NULL,&_chunked_read_timer);
+    if(result==EFI_SUCCESS)
+      result=gST->BootServices->SetTimer(_chunked_read_timer,TimerPeriodic,ASYNC_READ_TIMER_INTERVAL);
+    if(result!=EFI_SUCCESS)
+    {
+      LOG.error(L"could not start chunked read timer: %r",result);
+      if(_chunked_read_timer)
+        gST->BootServices->CloseEvent(_chunked_read_timer);
+      _chunked_read_timer=NULL;
+      return result;
+    }
+  }
+
+  previous_tpl=gST->BootServices->RaiseTPL(TPL_CALLBACK);
+  if(_chunked_read_count<ASYNC_READ_MAX_CHUNKED)
+    _chunked_reads[_chunked_read_count++]=read;
+  else
+    result=EFI_OUT_OF_RESOURCES;
+  gST->BootServices->RestoreTPL(previous_tpl);
+
+  if(result!=EFI_SUCCESS)
+    LOG.error(L"too many concurrent chunked reads");
+  return result;
+}
+
+/**
+ * Internal: removes a read from the active chunked reads, stopping the timer once there are none left.
+ *
+ * \param read the read to remove
+ */
+static void _stop_chunked_read(async_read_t *read)
+{
+  EFI_TPL previous_tpl;
+  UINTN tc;
+
+  previous_tpl=gST->BootServices->RaiseTPL(TPL_CALLBACK);
+  for(tc=0;tc<_chunked_read_count;tc++)
+  {
+    if(_chunked_reads[tc]==read)
+    {
+      _chunked_reads[tc]=_chunked_reads[--_chunked_read_count];
+      break;
+    }
+  }
+  gST->BootServices->RestoreTPL(previous_tpl);
+
+  if(_chunked_read_count==0 && _chunked_read_timer)
+  {
+    gST->BootServices->CloseEvent(_chunked_read_timer);
+    _chunked_read_timer=NULL;
+  }
+}
+
+/**
+ * Starts reading a file's contents in the background.
+ * If the firmware's file protocol supports ReadEx() the file is read in one request the firmware completes on its own,
+ * otherwise it's read in chunks on a timer event. Either way the application can keep e.g. drawing a progress bar
+ * while one or more files are read, and needs to call finish_async_read() for each started read to get the contents.
+ *
+ * \param read     the asynchronous read to start
+ * \param filename the file's full path within the volume
+ * \return EFI_SUCCESS if the read started, an error code otherwise
+ */
+EFI_STATUS start_async_read(async_read_t *read, CHAR16 *filename)
+{
+  EFI_STATUS result=EFI_UNSUPPORTED;
+
+  read->contents=NULL;
+  read->bytes_read=0;
+  read->status=EFI_NOT_READY;
+  read->token.Event=NULL;
+  read->chunked=FALSE;
+
+  if((read->file=find_file(filename))==NULL)
+  {
+    read->status=EFI_NOT_FOUND;
+    return read->status;
+  }
+  if((read->contents=_allocate_file_contents(read->file))==NULL)
+  {
+    read->status=EFI_OUT_OF_RESOURCES;
+    return read->status;
+  }
+
+  if(read->file->Revision>=EFI_FILE_PROTOCOL_REVISION2)
+  {
+    read->token.Buffer=read->contents->data;
+    read->token.BufferSize=read->contents->data_length;
+    read->token.Status=EFI_NOT_READY;
+    result=gST->BootServices->CreateEvent(EVT_NOTIFY_SIGNAL,TPL_CALLBACK,_async_read_completed,read,&read->token.Event);
+    if(result==EFI_SUCCESS && (result=read->file->ReadEx(read->file,&read->token))==EFI_SUCCESS)
+      return EFI_SUCCESS;
+    if(read->token.Event)
+      gST->BootServices->CloseEvent(read->token.Event);
+    read->token.Event=NULL;
+  }
+  LOG_DEBUG(L"reading %s in chunks, ReadEx() unavailable: %r",filename,result);
+
+  if((result=_start_chunked_read(read))!=EFI_SUCCESS)
+    read->status=result;
+  else
+    read->chunked=TRUE;
+  return result;
+}
+
+/**
+ * Checks whether an asynchronous read is done, successfully or not.
+ *
+ * \param read the asynchronous read to check
+ * \return whether the read is done
+ */
+BOOLEAN is_async_read_done(async_read_t *read)
+{
+  return read->status!=EFI_NOT_READY;
+}
+
+/**
+ * Counts the asynchronous reads that aren't done yet.
+ *
+ * \param count the number of reads
+ * \param reads the list of reads
+ * \return the number of pending reads
+ */
+UINTN count_pending_async_reads(UINTN count, async_read_t *reads)
+{
+  UINTN tc, pending=0;
+
+  for(tc=0;tc<count;tc++)
+    if(!is_async_read_done(reads+tc))
+      pending++;
+  return pending;
+}
+
+/**
+ * Calculates the combined progress of asynchronous reads, by bytes read.
+ * Files read with ReadEx() only progress once they're done.
+ *
+ * \param count the number of reads
+ * \param reads the list of reads
+ * \return the progress, within [0..1]
+ */
+double get_async_read_progress(UINTN count, async_read_t *reads)
+{
+  UINT64 total=0, done=0;
+  UINTN tc;
+
+  for(tc=0;tc<count;tc++)
+  {
+    if(!reads[tc].contents)
+      continue;
+    total+=reads[tc].contents->data_length;
+    done+=is_async_read_done(reads+tc)?reads[tc].contents->data_length:reads[tc].bytes_read;
+  }
+  return total>0?(double)done/total:1.0;
+}
+
+/**
+ * Finishes an asynchronous read, waiting for it to complete if necessary.
+ * This needs to be called for every started read, even if starting it failed.
+ *
+ * \param read the asynchronous read to finish
+ * \return the file's contents, or NULL on error; free the memory pages when you're done with them
+ */
+file_contents_t *finish_async_read(async_read_t *read)
+{
+  file_contents_t *contents;
+
+  while(!is_async_read_done(read))
+    gST->BootServices->Stall(ASYNC_READ_POLL_INTERVAL);
+
+  if(read->chunked)
+    _stop_chunked_read(read);
+  if(read->token.Event)
+    gST->BootServices->CloseEvent(read->token.Event);
+  if(read->file)
+    read->file->Close(read->file);
+
+  contents=read->contents;
+  if(read->status!=EFI_SUCCESS && contents)
+  {
+    LOG.warn(L"could not read file: %r",read->status);
+    free_pages(contents,contents->memory_pages);
+    contents=NULL;
+  }
+
+  read->file=NULL;
+  read->contents=NULL;
+  read->token.Event=NULL;
+  read->chunked=FALSE;
+  return contents;
+}
+
+
+/**
+ * Opens a file for buffered reading.
+ *
+ * \param reader      the reader to initialize
+ * \param filename    the file's full path within the volume
+ * \param buffer_size the read buffer's size in bytes, or 0 for FILE_READER_DEFAULT_BUFFER_SIZE
+ * \return EFI_SUCCESS, or an error code; the reader doesn't need to be closed on errors
+ */
+EFI_STATUS open_file_reader(file_reader_t *reader, CHAR16 *filename, UINTN buffer_size)
+{
+  if(buffer_size==0)
+    buffer_size=FILE_READER_DEFAULT_BUFFER_SIZE;
+
+  reader->buffer=NULL;
+  reader->buffer_size=buffer_size;
+  reader->buffer_pages=(buffer_size-1)/4096+1;
+  reader->buffer_offset=0;
+  reader->position=0;
+  reader->length=0;
+  reader->end_of_file=FALSE;
+  reader->status=EFI_SUCCESS;
+
+  if((reader->file=find_file(filename))==NULL)
+    return EFI_NOT_FOUND;
+  if((reader->buffer=allocate_pages(reader->buffer_pages))==NULL)
+  {
+    reader->file->Close(reader->file);
+    reader->file=NULL;
+    return EFI_OUT_OF_RESOURCES;
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+ * Internal: moves unread data to the start of the reader's buffer and fills the rest of it from the file.
+ *
+ * \param reader the reader to fill
+ * \return the number of bytes read from the file
+ */
+static UINTN _fill_file_reader(file_reader_t *reader)
+{
+  UINTN size;
+  EFI_STATUS result;
+
+  if(reader->end_of_file || reader->status!=EFI_SUCCESS)
+    return 0;
+
+  if(reader->position>0)
+  {
+    CopyMem(reader->buffer,reader->buffer+reader->position,reader->length-reader->position);
+    reader->buffer_offset+=reader->position;
+    reader->length-=reader->position;
+    reader->position=0;
+  }
+
+  size=reader->buffer_size-reader->length;
+  if(size==0)
+    return 0;
+  result=reader->file->Read(reader->file,&size,reader->buffer+reader->length);
+  if(result!=EFI_SUCCESS)
+  {
+    LOG.error(L"could not read file: %r",result);
+    reader->status=result;
+    return 0;
+  }
+  if(size==0)
+    reader->end_of_file=TRUE;
+  reader->length+=size;
+  return size;
+}
+
+/**
+ * Reads the next bytes from a file.
+ * Reads larger than the buffer bypass it.
+ *
+ * \param reader the reader to read from
+ * \param target the buffer to read into
+ * \param size   the number of bytes to read
+ * \return the number of bytes read, less than requested at the file's end or on errors
+ */
+UINTN read_file_chunk(file_reader_t *reader, void *target, UINTN size)
+{
+  UINTN copied=0, available, direct;
+  EFI_STATUS result;
+
+  while(copied<size)
+  {
+    available=reader->length-reader->position;
+    if(available==0)
+    {
+      if(reader->end_of_file || reader->status!=EFI_SUCCESS)
+        break;
+      if(size-copied>=reader->buffer_size)
+      {
+        //the buffer is empty: move it past the data read directly, so the file position stays consistent
+        direct=size-copied;
+        result=reader->file->Read(reader->file,&direct,(CHAR8 *)target+copied);
+        if(result!=EFI_SUCCESS)
+        {
+          LOG.error(L"could not read file: %r",result);
+          reader->status=result;
+          break;
+        }
+        if(direct==0)
+          reader->end_of_file=TRUE;
+        reader->buffer_offset+=reader->length+direct;
+        reader->length=0;
+        reader->position=0;
+        copied+=direct;
+        continue;
+      }
+      _fill_file_reader(reader);
+      continue;
+    }
+    if(available>size-copied)
+      available=size-copied;
+    CopyMem((CHAR8 *)target+copied,reader->buffer+reader->position,available);
+    reader->position+=available;
+    copied+=available;
+  }
+  return copied;
+}
+
+/**
+ * Returns the next bytes in a file without consuming them.
+ *
+ * \param reader the reader to peek into
+ * \param size   the number of bytes to return, at most the reader's buffer size
+ * \return a view of the next bytes, shorter than requested at the file's end or on errors
+ */
+ascii_view_t peek_file_reader(file_reader_t *reader, UINTN size)
+{
+  if(size>reader->buffer_size)
+    size=reader->buffer_size;
+  while(reader->length-reader->position<size && _fill_file_reader(reader)>0);
+  if(size>reader->length-reader->position)
+    size=reader->length-reader->position;
+  return ascii_view_n(reader->buffer+reader->position,size);
+}
+
+/**
+ * Reads the next line from a text file.
+ * The line separator ("\n" or "\r\n") isn't included in the line. Lines longer than the reader's buffer are returned
+ * in buffer-sized parts.
+ *
+ * \param reader the reader to read from
+ * \param line   output: the line's text, valid until the next read or seek
+ * \return whether a line was read, FALSE at the file's end or on errors
+ */
+BOOLEAN read_file_line(file_reader_t *reader, ascii_view_t *line)
+{
+  UINTN scanned=0, found, length;
+
+  for(;;)
+  {
+    length=reader->length-reader->position;
+    found=scanned+find_ascii_char(reader->buffer+reader->position+scanned,length-scanned,'\n');
+    if(found<length)
+    {
+      *line=ascii_view_n(reader->buffer+reader->position,found);
+      reader->position+=found+1;
+      break;
+    }
+    if(length==reader->buffer_size || _fill_file_reader(reader)==0)
+    {
+      if(length==0)
+        return FALSE;
+      *line=ascii_view_n(reader->buffer+reader->position,length);
+      reader->position+=length;
+      break;
+    }
+    scanned=length;
+  }
+
+  if(line->length>0 && line->start[line->length-1]=='\r')
+    line->length--;
+  return TRUE;
+}
+
+/**
+ * Moves a reader to a position within the file.
+ * Positions within the currently buffered data don't require any file access.
+ *
+ * \param reader   the reader to move
+ * \param position the new position, in bytes from the file's start
+ * \return EFI_SUCCESS, or an error code
+ */
+EFI_STATUS seek_file_reader(file_reader_t *reader, UINT64 position)
+{
+  EFI_STATUS result;
+
+  if(position>=reader->buffer_offset && position<=reader->buffer_offset+reader->length)
+  {
+    reader->position=position-reader->buffer_offset;
+    return EFI_SUCCESS;
+  }
+
+  result=reader->file->SetPosition(reader->file,position);
+  if(result!=EFI_SUCCESS)
+  {
+    LOG.error(L"could not seek to %ld: %r",position,result);
+    return result;
+  }
+  reader->buffer_offset=position;
+  reader->position=0;
+  reader->length=0;
+  reader->end_of_file=FALSE;
+  reader->status=EFI_SUCCESS;
+  return EFI_SUCCESS;
+}
+
+/**
+ * Returns a reader's current position within the file.
+ *
+ * \param reader the reader to query
+ * \return the position, in bytes from the file's start
+ */
+UINT64 get_file_reader_position(file_reader_t *reader)
+{
+  return reader->buffer_offset+reader->position;
+}
+
+/**
+ * Closes a file reader and frees its buffer.
+ *
+ * \param reader the reader to close
+ */
+void close_file_reader(file_reader_t *reader)
+{
+  if(reader->file)
+    reader->file->Close(reader->file);
+  if(reader->buffer)
+    free_pages(reader->buffer,reader->buffer_pages);
+  reader->file=NULL;
+  reader->buffer=NULL;
+}
+
+
+/**
+ * Creates a file for buffered writing, replacing it if it already exists.
+ * The buffer is allocated in whole memory pages, the writer uses all of them.
+ *
+ * \param writer      the writer to initialize
+ * \param filename    the file's full path within the volume
+ * \param buffer_size the write buffer's minimum size in bytes, or 0 for FILE_WRITER_DEFAULT_BUFFER_SIZE
+ * \return EFI_SUCCESS, or an error code; the writer doesn't need to be closed on errors
+ */
+EFI_STATUS open_file_writer(file_writer_t *writer, CHAR16 *filename, UINTN buffer_size)
+{
+  if(buffer_size==0)
+    buffer_size=FILE_WRITER_DEFAULT_BUFFER_SIZE;
+
+  writer->file=NULL;
+  writer->buffer_pages=(buffer_size-1)/4096+1;
+  writer->buffer_size=writer->buffer_pages*4096;
+  writer->length=0;
+  writer->bytes_written=0;
+  writer->status=EFI_SUCCESS;
+
+  //allocate first so a failed allocation doesn't leave an existing file truncated
+  if((writer->buffer=allocate_pages(writer->buffer_pages))==NULL)
+    return EFI_OUT_OF_RESOURCES;
+  if((writer->file=create_file(filename))==NULL)
+  {
+    free_pages(writer->buffer,writer->buffer_pages);
+    writer->buffer=NULL;
+    return EFI_DEVICE_ERROR;
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+ * Internal: writes data directly to a writer's file.
+ * Does nothing if a previous write failed.
+ *
+ * \param writer the writer to write to
+ * \param data   the data to write
+ * \param size   the number of bytes to write
+ */
+static void _write_file_writer_data(file_writer_t *writer, CONST void *data, UINTN size)
+{
+  EFI_STATUS result;
+
+  if(writer->status!=EFI_SUCCESS || size==0)
+    return;
+  result=writer->file->Write(writer->file,&size,(void *)data);
+  if(result!=EFI_SUCCESS)
+  {
+    LOG.error(L"could not write file: %r",result);
+    writer->status=result;
+  }
+}
+
+/**
+ * Internal: writes a writer's buffered data to its file and empties the buffer.
+ *
+ * \param writer the writer to empty
+ */
+static void _empty_file_writer(file_writer_t *writer)
+{
+  _write_file_writer_data(writer,writer->buffer,writer->length);
+  writer->length=0;
+}
+
+/**
+ * Writes data to a file.
+ * Writes are collected in the buffer; once it's full it gets written as one block. Data that wouldn't fit into an
+ * empty buffer anyway is written directly after topping up and writing the buffer.
+ *
+ * \param writer the writer to write to
+ * \param data   the data to write
+ * \param size   the number of bytes to write
+ * \return EFI_SUCCESS, or the first error that occurred in this writer
+ */
+EFI_STATUS write_file_chunk(file_writer_t *writer, CONST void *data, UINTN size)
+{
+  UINTN available;
+
+  if(writer->status!=EFI_SUCCESS)
+    return writer->status;
+  writer->bytes_written+=size;
+
+  available=writer->buffer_size-writer->length;
+  if(size<=available)
+  {
+    CopyMem(writer->buffer+writer->length,data,size);
+    writer->length+=size;
+    return EFI_SUCCESS;
+  }
+
+  if(writer->length>0)
+  {
+    CopyMem(writer->buffer+writer->length,data,available);
+    writer->length+=available;
+    data=(CONST CHAR8 *)data+available;
+    size-=available;
+    _empty_file_writer(writer);
+  }
+  if(size>=writer->buffer_size)
+    _write_file_writer_data(writer,data,size);
+  else
+  {
+    CopyMem(writer->buffer,data,size);
+    writer->length=size;
+  }
+  return writer->status;
+}
+
+/**
+ * Writes a formatted ASCII string to a file.
+ * The string gets formatted directly into the write buffer, output longer than FILE_WRITER_MAX_FORMAT_LENGTH-1
+ * characters is truncated.
+ * PrintLib turns line feeds into CR LF pairs, this function turns them back: "\n" is written as a single 0x0A byte, as
+ * file formats like netpbm require. Use write_file_chunk() to write CR LF pairs.
+ *
+ * \param writer the writer to write to
+ * \param format the ASCII format string
+ * \param ...    any additional parameters for the format string
+ * \return EFI_SUCCESS, or the first error that occurred in this writer
+ */
+EFI_STATUS EFIAPI write_file_format(file_writer_t *writer, CONST CHAR8 *format, ...)
+{
+  VA_LIST args;
+  CHAR8 *output;
+  UINTN length, tc, td;
+
+  if(writer->buffer_size-writer->length<FILE_WRITER_MAX_FORMAT_LENGTH)
+    _empty_file_writer(writer);
+  if(writer->status!=EFI_SUCCESS)
+    return writer->status;
+
+  output=writer->buffer+writer->length;
+  VA_START(args,format);
+  length=AsciiVSPrint(output,FILE_WRITER_MAX_FORMAT_LENGTH,format,args);
+  VA_END(args);
+
+  //the output is NUL-terminated, so the character after each CR can always be read
+  for(tc=0,td=0;tc<length;tc++)
+    if(output[tc]!='\r' || output[tc+1]!='\n')
+      output[td++]=output[tc];
+  length=td;
+  writer->length+=length;
+  writer->bytes_written+=length;
+  return EFI_SUCCESS;
+}
+
+/**
+ * Writes all buffered data to the file and flushes the file to its device.
+ * This isn't required before closing the writer, it's meant for long-running output that should survive a reset.
+ *
+ * \param writer the writer to flush
+ * \return EFI_SUCCESS, or the first error that occurred in this writer
+ */
+EFI_STATUS flush_file_writer(file_writer_t *writer)
+{
+  EFI_STATUS result;
+
+  _empty_file_writer(writer);
+  if(writer->status!=EFI_SUCCESS)
+    return writer->status;
+  result=writer->file->Flush(writer->file);
+  if(result!=EFI_SUCCESS)
+  {
+    LOG.error(L"could not flush file: %r",result);
+    writer->status=result;
+  }
+  return writer->status;
+}
+
+/**
+ * Writes all buffered data to the file, closes it and frees the writer's buffer.
+ *
+ * \param writer the writer to close
+ * \return EFI_SUCCESS, or the first error that occurred in this writer
+ */
+EFI_STATUS close_file_writer(file_writer_t *writer)
+{
+  EFI_STATUS result;
+
+  if(writer->file)
+  {
+    _empty_file_writer(writer);
+    result=writer->file->Close(writer->file);
+    if(writer->status==EFI_SUCCESS && result!=EFI_SUCCESS)
+      writer->status=result;
+  }
+  if(writer->buffer)
+    free_pages(writer->buffer,writer->buffer_pages);
+  writer->file=NULL;
+  writer->buffer=NULL;
+  return writer->status;
+}
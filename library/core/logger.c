@@ -11,8 +11,13 @@
 #include <Library/UefiLib.h>
 #include <Library/MemoryAllocationLib.h>
 #include <UEFIStarter/core/logger.h>
+#include <UEFIStarter/core/timestamp.h>
+#include <UEFIStarter/core/string.h>
 
 
+/** the size of the stack buffer log messages get formatted in, in characters: longer messages use pool memory */
+#define LOGGER_MESSAGE_BUFFER_LENGTH 256
+
 /** list of log level's printable names */
 const CHAR16 *logger_level_names[]={L"",L"ERROR",L"WARN",L"INFO",L"DEBUG",L"TRACE"};
 
@@ -22,6 +27,18 @@ static int logging_threshold=TRACE;
 /** numbers of logged messages for each log level */
 static UINTN logger_entry_counts[TRACE+1]; //technically entry 0 (OFF) will be unused, but it's probably wiser to keep indexing simple to avoid bugs
 
+/** ring buffer for deferred log entries, NULL if deferred logging is disabled */
+static deferred_log_entry_t *_deferred_entries=NULL;
+
+/** the deferred log ring buffer's capacity, in entries */
+static UINTN _deferred_capacity=0;
+
+/** total number of deferred entries written since the last flush, including overwritten ones */
+static UINTN _deferred_written=0;
+
+/** timestamp deferred logging was enabled at, flushed entries are timed relative to this */
+static UINT64 _deferred_start=0;
+
 
 /**
  * Fetches the current log level.
@@ -61,6 +78,76 @@ void log_print(LOGLEVEL level, CHAR16 *msg)
 /** pointer to the current log writer */
 logger_print_function_t *logger_print_func=log_print;
 
+/**
+ * internal: checks whether a character is part of a Print() placeholder's flags, width or precision.
+ *
+ * \param c the character to check
+ * \return whether the character is a flag
+ */
+static BOOLEAN _is_format_flag(CHAR16 c)
+{
+  return (c>=L'0' && c<=L'9') || c==L'-' || c==L'+' || c==L' ' || c==L'#' || c==L',' || c==L'.' || c==L'l' || c==L'L';
+}
+
+/**
+ * internal: counts the number of arguments a Print() format string consumes.
+ * Width and precision given as "*" take an argument each.
+ *
+ * \param format the format string to check
+ * \return the number of arguments
+ */
+static UINTN _count_format_arguments(CHAR16 *format)
+{
+  UINTN count=0;
+
+  while(*format)
+  {
+    if(*(format++)!=L'%')
+      continue;
+    for(;*format;format++)
+    {
+      if(*format==L'*')
+        count++;
+      else if(!_is_format_flag(*format))
+        break;
+    }
+    if(!*format)
+      break;
+    if(*(format++)!=L'%')
+      count++;
+  }
+  return count;
+}
+
+/**
+ * internal: stores a log message in the deferred log ring buffer.
+ * On x64 every variadic argument takes up a full 64 bit slot, so arguments get copied without knowing their types.
+ * Print() doesn't support floating point placeholders, so there are no arguments passed in vector registers.
+ *
+ * \param level   the log level to log at
+ * \param message the message's format string
+ * \param args    the vararg list of parameters matching matching the format string's placeholder
+ * \return whether the message was stored
+ */
+static BOOLEAN _defer_log_entry(LOGLEVEL level, CHAR16 *message, VA_LIST args)
+{
+  deferred_log_entry_t *entry;
+  UINTN count, tc;
+
+  count=_count_format_arguments(message);
+  if(count>LOG_DEFERRED_MAX_ARGS)
+    return FALSE;
+
+  entry=&_deferred_entries[_deferred_written%_deferred_capacity];
+  entry->timestamp=get_timestamp();
+  entry->level=level;
+  entry->format=message;
+  for(tc=0;tc<count;tc++)
+    entry->args[tc]=VA_ARG(args,UINT64);
+  _deferred_written++;
+  return TRUE;
+}
+
 /**
  * internal: formats log message and calls log writer with final string to log.
  * This function uses the same format strings as the Print() functions.
@@ -71,15 +158,20 @@ logger_print_function_t *logger_print_func=log_print;
  */
 static void _logger_function_va(LOGLEVEL level, UINT16 *message, VA_LIST args)
 {
-  CHAR16 *msg;
+  CHAR16 buffer[LOGGER_MESSAGE_BUFFER_LENGTH];
+  string_builder_t msg;
 
   logger_entry_counts[level]++;
   if(level>logging_threshold)
     return;
 
-  msg=CatVSPrint(NULL,message,args);
-  logger_print_func(level,msg);
-  FreePool(msg);
+  if(_deferred_entries!=NULL && _defer_log_entry(level,message,args))
+    return;
+
+  init_string_builder(&msg,buffer,LOGGER_MESSAGE_BUFFER_LENGTH);
+  append_format_va(&msg,message,args);
+  logger_print_func(level,msg.buffer);
+  free_string_builder(&msg);
 }
 
 /**
@@ -144,6 +236,22 @@ const loggers_t LOG={
   .error=_error
 };
 
+/**
+ * Checks whether a message at the given log level would be logged.
+ * Used by the LOG_* macros to skip evaluating arguments of filtered messages. Filtered messages still count towards
+ * get_logger_entry_count(), just like they do when calling the LOG functions directly.
+ *
+ * \param level the log level to check
+ * \return whether the message should be passed on to the LOG functions
+ */
+BOOLEAN logger_admit_entry(LOGLEVEL level)
+{
+  if(level<=logging_threshold)
+    return TRUE;
+  logger_entry_counts[level]++;
+  return FALSE;
+}
+
 /**
  * Resets all log levels' message counts.
  * Used e.g. by the test framework to detect which tests generated errors.
@@ -194,3 +302,97 @@ logger_print_function_t *set_logger_function(logger_print_function_t *func)
   logger_print_func=func;
   return previous;
 }
+
+
+/**
+ * Enables deferred logging.
+ * Log messages passing the current log level get stored in a ring buffer as format string and raw arguments instead
+ * of being formatted and printed right away. This makes logging in hot paths (e.g. TRACE messages in animation loops)
+ * much cheaper, the formatting costs are paid when flush_deferred_log() gets called.
+ *
+ * Format strings and any pointer arguments (e.g. "%s" strings) are stored as pointers: they must still be valid when
+ * the log gets flushed. String literals are always fine, strings allocated with memsprintf() or ftowcs() are valid
+ * until the next free_pool_memory_entries() call. shutdown() flushes the log before freeing tracked memory.
+ *
+ * If the ring buffer is full the oldest entries get overwritten.
+ *
+ * \param capacity the ring buffer's size, in entries
+ * \return EFI_SUCCESS, EFI_INVALID_PARAMETER for a capacity of 0 or EFI_OUT_OF_RESOURCES if allocating failed
+ */
+EFI_STATUS enable_deferred_logging(UINTN capacity)
+{
+  deferred_log_entry_t *entries;
+
+  if(capacity==0)
+    return EFI_INVALID_PARAMETER;
+  if((entries=AllocatePool(capacity*sizeof(deferred_log_entry_t)))==NULL)
+    return EFI_OUT_OF_RESOURCES;
+
+  disable_deferred_logging();
+  _deferred_entries=entries;
+  _deferred_capacity=capacity;
+  _deferred_written=0;
+  _deferred_start=get_timestamp();
+  return EFI_SUCCESS;
+}
+
+/**
+ * Formats and prints all deferred log entries with the current log writer, oldest first.
+ * Each message is prefixed with the time since deferred logging was enabled: in microseconds if timestamps were
+ * initialized with init_timestamps(), in timestamp ticks otherwise.
+ *
+ * \return the number of entries printed
+ */
+UINTN flush_deferred_log()
+{
+  deferred_log_entry_t *entry;
+  UINTN first, tc;
+  UINT64 ticks_per_second, elapsed;
+  CHAR16 buffer[LOGGER_MESSAGE_BUFFER_LENGTH];
+  string_builder_t msg;
+
+  if(_deferred_entries==NULL || _deferred_written==0)
+    return 0;
+
+  init_string_builder(&msg,buffer,LOGGER_MESSAGE_BUFFER_LENGTH);
+  first=0;
+  if(_deferred_written>_deferred_capacity)
+  {
+    first=_deferred_written-_deferred_capacity;
+    append_format(&msg,L"%d deferred log entries were overwritten",first);
+    logger_print_func(WARN,msg.buffer);
+  }
+
+  ticks_per_second=get_timestamp_ticks_per_second();
+  for(tc=first;tc<_deferred_written;tc++)
+  {
+    entry=&_deferred_entries[tc%_deferred_capacity];
+    elapsed=entry->timestamp-_deferred_start;
+    if(ticks_per_second)
+      elapsed=elapsed*1000/(ticks_per_second/1000);
+    clear_string_builder(&msg);
+    append_format(&msg,ticks_per_second?L"[+%ldus] ":L"[+%ld] ",elapsed);
+    append_format(&msg,entry->format,entry->args[0],entry->args[1],entry->args[2],entry->args[3],
+                                     entry->args[4],entry->args[5],entry->args[6],entry->args[7]);
+    logger_print_func(entry->level,msg.buffer);
+  }
+  free_string_builder(&msg);
+
+  tc=_deferred_written-first;
+  _deferred_written=0;
+  return tc;
+}
+
+/**
+ * Flushes the deferred log and returns to printing log messages immediately.
+ * Does nothing if deferred logging isn't enabled.
+ */
+void disable_deferred_logging()
+{
+  if(_deferred_entries==NULL)
+    return;
+  flush_deferred_log();
+  FreePool(_deferred_entries);
+  _deferred_entries=NULL;
+  _deferred_capacity=0;
+}
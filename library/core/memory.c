@@ -25,6 +25,9 @@ static memory_page_list_t *_memory_page_list;
 /** internal pointer to first pool memory allocation list node */
 static pool_memory_list_t _pool_memory_list;
 
+static UINTN _tracked_page_count=0;      /**< internal storage for the number of currently tracked pages */
+static UINTN _peak_tracked_page_count=0; /**< internal storage for the highest number of tracked pages since reset */
+
 
 /**
  * Debugging function: prints a human-readable list of tracked memory pages.
@@ -58,6 +61,37 @@ void print_memory_page_list()
 void reset_memory_tracking()
 {
   _memory_page_list=NULL;
+  _tracked_page_count=0;
+  _peak_tracked_page_count=0;
+}
+
+/**
+ * Gets the number of currently tracked memory pages.
+ *
+ * \return the number of tracked pages
+ */
+UINTN get_tracked_page_count()
+{
+  return _tracked_page_count;
+}
+
+/**
+ * Gets the highest number of simultaneously tracked memory pages since the last reset_peak_tracked_page_count() call.
+ *
+ * \return the peak number of tracked pages
+ */
+UINTN get_peak_tracked_page_count()
+{
+  return _peak_tracked_page_count;
+}
+
+/**
+ * Resets the peak number of tracked memory pages to the number of currently tracked pages.
+ * Use this before the code you want to measure.
+ */
+void reset_peak_tracked_page_count()
+{
+  _peak_tracked_page_count=_tracked_page_count;
 }
 
 /**
@@ -74,7 +108,7 @@ static BOOLEAN _get_next_free_entry(memory_page_list_t **page_list, UINTN *index
   if(!_memory_page_list)
   {
     _memory_page_list=allocate_pages_ex(MEMORY_PAGE_LIST_PAGE_COUNT,FALSE,AllocateAnyPages,NULL);
-    LOG.trace(L"memory page list is at %lX",_memory_page_list);
+    LOG_TRACE(L"memory page list is at %lX",_memory_page_list);
     _memory_page_list->entry_count=0;
     _memory_page_list->next=NULL;
   }
@@ -138,7 +172,7 @@ void *allocate_pages_ex(UINTN pages, BOOLEAN track, EFI_ALLOCATE_TYPE type, void
   {
     if(!_get_next_free_entry(&page_list,&index))
       return NULL;
-    LOG.trace(L"got next free page list entry index %ld",index);
+    LOG_TRACE(L"got next free page list entry index %ld",index);
   }
 
   result=gST->BootServices->AllocatePages(type,EfiLoaderData,pages,&address);
@@ -147,7 +181,7 @@ void *allocate_pages_ex(UINTN pages, BOOLEAN track, EFI_ALLOCATE_TYPE type, void
     LOG.error(L"could not allocate %d page(s): %r",pages,result);
     return NULL;
   }
-  LOG.debug(L"allocated %d page(s) at %016lX",pages,address);
+  LOG_DEBUG(L"allocated %d page(s) at %016lX",pages,address);
 
   if(track)
   {
@@ -155,6 +189,10 @@ void *allocate_pages_ex(UINTN pages, BOOLEAN track, EFI_ALLOCATE_TYPE type, void
     page_list->entries[index].pages=pages;
     if(page_list->entry_count<=index)
       page_list->entry_count=index+1;
+
+    _tracked_page_count+=pages;
+    if(_tracked_page_count>_peak_tracked_page_count)
+      _peak_tracked_page_count=_tracked_page_count;
   }
 
   return (void *)address;
@@ -205,10 +243,11 @@ BOOLEAN free_pages_ex(void *address, UINTN pages, BOOLEAN track)
     return FALSE;
   }
 
-  LOG.debug(L"freed %d page(s) at %016lX",pages,address);
+  LOG_DEBUG(L"freed %d page(s) at %016lX",pages,address);
 
   if(track)
   {
+    _tracked_page_count-=entry->pages;
     entry->address=NULL;
     entry->pages=0;
   }
@@ -243,7 +282,7 @@ void track_pool_memory(void *address)
 {
   UINTN tc;
 
-  LOG.trace(L"adding %016lX to pool memory list",address);
+  LOG_TRACE(L"adding %016lX to pool memory list",address);
 
   for(tc=0;tc<_pool_memory_list.entry_count;tc++)
   {
@@ -294,7 +333,7 @@ UINTN free_pool_memory_entries()
   }
   _pool_memory_list.entry_count=0;
 
-  LOG.debug(L"freed %d pool memory entries",rv);
+  LOG_DEBUG(L"freed %d pool memory entries",rv);
   return rv;
 }
 
@@ -324,7 +363,7 @@ UINTN stop_tracking_memory()
   if(_memory_page_list==NULL)
     return 0;
 
-  LOG.trace(L"memory page list is at %016lX, entry_count=%d",_memory_page_list,_memory_page_list->entry_count);
+  LOG_TRACE(L"memory page list is at %016lX, entry_count=%d",_memory_page_list,_memory_page_list->entry_count);
 
   if(_memory_page_list->entry_count>MEMORY_PAGE_LIST_MAX_ENTRY_COUNT)
   {
@@ -345,6 +384,7 @@ UINTN stop_tracking_memory()
     errors++;
 
   _memory_page_list=NULL;
+  _tracked_page_count=0;
 
   return errors;
 }
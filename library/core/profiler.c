@@ -0,0 +1,390 @@
+/** \file
+ * Scoped profiler for measuring hot code paths
+ *
+ * Every zone keeps exact count/min/max/total statistics for as long as the profiler runs. Additionally each zone
+ * execution gets recorded as an event, until the event buffer is full. The 99th percentile is calculated from these
+ * events, and they're written to the trace file.
+ *
+ * The trace file uses the Chrome trace event format, you can load it in chrome://tracing or similar tools.
+ *
+ * UEFI applications run on the bootstrap processor only, so there's a single event buffer.
+ *
+ * \author Richard Nusser
+ * \copyright 2017-2018 Richard Nusser
+ * \license GPLv3 (see http://www.gnu.org/licenses/)
+ * \sa https://github.com/rinusser/UEFIStarter
+ * \ingroup group_lib_profiler
+ */
+
+#include <Library/UefiLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <UEFIStarter/core/profiler.h>
+#include <UEFIStarter/core/files.h>
+#include <UEFIStarter/core/memory.h>
+#include <UEFIStarter/core/logger.h>
+
+
+/** whether the profiler is currently recording, checked on every scope entry */
+BOOLEAN profiler_running=FALSE;
+
+/** list of zones exited at least once while profiling */
+static profile_zone_t *_zones=NULL;
+
+/** event buffer, allocated by start_profiling() */
+static profile_event_t *_events=NULL;
+
+/** number of memory pages allocated for the event buffer */
+static UINTN _event_pages=0;
+
+/** maximum number of events the buffer can hold */
+static UINTN _event_capacity=0;
+
+/** number of events recorded */
+static UINTN _event_count=0;
+
+/** number of events that didn't fit into the buffer */
+static UINTN _dropped_events=0;
+
+/** timestamp when profiling started, trace event times are relative to this */
+static UINT64 _profile_start=0;
+
+
+/**
+ * Leaves a profiling scope, recording the zone's execution if the profiler was running at scope entry.
+ * PROFILE_SCOPE() sets this up to be called automatically.
+ *
+ * \param scope the scope to leave
+ */
+void profile_scope_exit(profile_scope_t *scope)
+{
+  UINT64 end=get_timestamp();
+  UINT64 duration;
+  profile_zone_t *zone=scope->zone;
+
+  if(zone==NULL || !profiler_running)
+    return;
+
+  duration=end-scope->start;
+  if(!zone->registered)
+  {
+    zone->registered=TRUE;
+    zone->count=0;
+    zone->total_ticks=0;
+    zone->min_ticks=duration;
+    zone->max_ticks=duration;
+    zone->next=_zones;
+    _zones=zone;
+  }
+  zone->count++;
+  zone->total_ticks+=duration;
+  if(duration<zone->min_ticks)
+    zone->min_ticks=duration;
+  if(duration>zone->max_ticks)
+    zone->max_ticks=duration;
+
+  if(_event_count>=_event_capacity)
+  {
+    _dropped_events++;
+    return;
+  }
+  _events[_event_count].zone=zone;
+  _events[_event_count].start=scope->start;
+  _events[_event_count].end=end;
+  _event_count++;
+}
+
+/**
+ * Starts recording profiling zones.
+ * Any previously recorded data is discarded. Timestamps will be initialized if they haven't been yet.
+ *
+ * \param event_capacity the maximum number of zone executions to record as events, 0 for statistics only
+ * \return EFI_SUCCESS, or an error code if the event buffer couldn't be allocated
+ */
+EFI_STATUS start_profiling(UINTN event_capacity)
+{
+  reset_profiler();
+
+  if(get_timestamp_ticks_per_second()==0 && init_timestamps()!=0)
+    LOG.warn(L"could not initialize timestamps, profile durations will be in ticks");
+
+  if(event_capacity>0)
+  {
+    _event_pages=(event_capacity*sizeof(profile_event_t)+4095)/4096;
+    if((_events=allocate_pages(_event_pages))==NULL)
+    {
+      LOG.error(L"could not allocate profiler event buffer");
+      _event_pages=0;
+      return EFI_OUT_OF_RESOURCES;
+    }
+  }
+  _event_capacity=event_capacity;
+
+  _profile_start=get_timestamp();
+  profiler_running=TRUE;
+  return EFI_SUCCESS;
+}
+
+/**
+ * Stops recording profiling zones.
+ * Recorded data stays available until the profiler is reset or restarted.
+ */
+void stop_profiling()
+{
+  profiler_running=FALSE;
+}
+
+/**
+ * Stops the profiler and discards all recorded data.
+ */
+void reset_profiler()
+{
+  profile_zone_t *zone, *next;
+
+  profiler_running=FALSE;
+  for(zone=_zones;zone!=NULL;zone=next)
+  {
+    next=zone->next;
+    zone->registered=FALSE;
+    zone->next=NULL;
+  }
+  _zones=NULL;
+
+  if(_events!=NULL)
+    free_pages(_events,_event_pages);
+  _events=NULL;
+  _event_pages=0;
+  _event_capacity=0;
+  _event_count=0;
+  _dropped_events=0;
+}
+
+/**
+ * Looks up a profiling zone by name.
+ * Only zones that were executed while profiling can be found.
+ *
+ * \param name the zone's name, as UTF-16
+ * \return the first zone with the given name, or NULL if there's none
+ */
+profile_zone_t *find_profile_zone(CHAR16 *name)
+{
+  profile_zone_t *zone;
+
+  for(zone=_zones;zone!=NULL;zone=zone->next)
+    if(StrCmp(zone->name,name)==0)
+      return zone;
+  return NULL;
+}
+
+/**
+ * Returns the number of zone executions that didn't fit into the event buffer.
+ * These are still included in the zones' count/min/max/mean statistics, but not in percentiles or trace files.
+ *
+ * \return the number of dropped events
+ */
+UINTN get_profile_dropped_event_count()
+{
+  return _dropped_events;
+}
+
+/**
+ * internal: sorts a list of durations in ascending order.
+ *
+ * \param values the list of durations to sort
+ * \param count  the number of entries in the list
+ */
+static void _sort_durations(UINT64 *values, UINTN count)
+{
+  UINTN gap, tc, td;
+  UINT64 value;
+
+  for(gap=count/2;gap>0;gap/=2)
+  {
+    for(tc=gap;tc<count;tc++)
+    {
+      value=values[tc];
+      for(td=tc;td>=gap && values[td-gap]>value;td-=gap)
+        values[td]=values[td-gap];
+      values[td]=value;
+    }
+  }
+}
+
+/**
+ * internal: calculates a zone's 99th percentile duration from the recorded events.
+ *
+ * \param zone the zone to calculate the percentile for
+ * \return the 99th percentile in timestamp ticks, or 0 if there are no recorded events for this zone
+ */
+static UINT64 _calculate_p99(profile_zone_t *zone)
+{
+  UINT64 *durations;
+  UINT64 result;
+  UINTN tc, count=0;
+
+  for(tc=0;tc<_event_count;tc++)
+    if(_events[tc].zone==zone)
+      count++;
+  if(count==0)
+    return 0;
+
+  if((durations=AllocatePool(count*sizeof(UINT64)))==NULL)
+  {
+    LOG.warn(L"could not allocate memory for percentile calculation");
+    return 0;
+  }
+  count=0;
+  for(tc=0;tc<_event_count;tc++)
+    if(_events[tc].zone==zone)
+      durations[count++]=_events[tc].end-_events[tc].start;
+
+  _sort_durations(durations,count);
+  result=durations[(count*99+99)/100-1];
+  FreePool(durations);
+  return result;
+}
+
+/**
+ * Aggregates a zone's statistics.
+ *
+ * \param zone  the zone to get statistics for
+ * \param stats output: the zone's statistics, all durations in timestamp ticks
+ * \return whether the zone was executed while profiling
+ */
+BOOLEAN get_profile_zone_stats(profile_zone_t *zone, profile_stats_t *stats)
+{
+  if(zone==NULL || !zone->registered || zone->count==0)
+    return FALSE;
+
+  stats->count=zone->count;
+  stats->min=zone->min_ticks;
+  stats->max=zone->max_ticks;
+  stats->mean=zone->total_ticks/zone->count;
+  stats->p99=_calculate_p99(zone);
+  return TRUE;
+}
+
+/**
+ * internal: converts timestamp ticks to nanoseconds.
+ * If timestamps weren't initialized this returns the unconverted ticks.
+ *
+ * \param ticks the number of ticks to convert
+ * \return the converted number of nanoseconds
+ */
+static UINT64 _ticks_to_ns(UINT64 ticks)
+{
+  UINT64 ticks_per_second=get_timestamp_ticks_per_second();
+
+  if(ticks_per_second==0)
+    return ticks;
+  return (UINT64)((double)ticks*1000000000/ticks_per_second);
+}
+
+/**
+ * Prints a table of all executed zones' statistics.
+ * Durations are in microseconds, or in ticks if timestamps weren't initialized.
+ */
+void print_profile_report()
+{
+  profile_zone_t *zone;
+  profile_stats_t stats;
+  UINT64 divisor=get_timestamp_ticks_per_second()==0?1:1000;
+
+  if(_zones==NULL)
+    return;
+
+  Print(L"profile zone                      count        min       mean        max        p99 %s\n",divisor>1?L"(us)":L"(ticks)");
+  for(zone=_zones;zone!=NULL;zone=zone->next)
+  {
+    if(!get_profile_zone_stats(zone,&stats))
+      continue;
+    Print(L"%-30s %8ld %10ld %10ld %10ld %10ld\n",zone->name,stats.count,_ticks_to_ns(stats.min)/divisor,
+        _ticks_to_ns(stats.mean)/divisor,_ticks_to_ns(stats.max)/divisor,_ticks_to_ns(stats.p99)/divisor);
+  }
+  if(_dropped_events>0)
+    Print(L"%ld zone executions exceeded the event buffer, p99 values are based on the first %ld\n",_dropped_events,_event_count);
+}
+
+
+/**
+ * internal: appends a zone name as JSON string contents to the trace output.
+ * Characters outside the ASCII range are replaced with question marks.
+ *
+ * \param writer the trace file's writer
+ * \param name   the name to write, as UTF-16
+ */
+static void _write_trace_name(file_writer_t *writer, const CHAR16 *name)
+{
+  CHAR8 escaped[2];
+
+  for(;*name;name++)
+  {
+    if(*name==L'"' || *name==L'\\')
+    {
+      escaped[0]='\\';
+      escaped[1]=(CHAR8)*name;
+      write_file_chunk(writer,escaped,2);
+    }
+    else
+    {
+      escaped[0]=*name>=0x20 && *name<0x80?(CHAR8)*name:'?';
+      write_file_chunk(writer,escaped,1);
+    }
+  }
+}
+
+/**
+ * Writes the recorded events to a Chrome trace event file.
+ * Event times are in microseconds, or in ticks if timestamps weren't initialized.
+ *
+ * \param filename the file's full path within the volume, e.g. PROFILER_TRACE_FILENAME
+ * \return EFI_SUCCESS, or an error code if the file couldn't be written
+ */
+EFI_STATUS write_profile_trace(CHAR16 *filename)
+{
+  file_writer_t writer;
+  UINT64 start, duration;
+  UINTN tc;
+  EFI_STATUS result;
+
+  if((result=open_file_writer(&writer,filename,0))!=EFI_SUCCESS)
+  {
+    LOG.error(L"could not create trace file %s: %r",filename,result);
+    return result;
+  }
+
+  write_file_format(&writer,"{\"traceEvents\":[\n");
+  for(tc=0;tc<_event_count;tc++)
+  {
+    start=_ticks_to_ns(_events[tc].start-_profile_start);
+    duration=_ticks_to_ns(_events[tc].end-_events[tc].start);
+    write_file_format(&writer,"%a{\"name\":\"",tc>0?",\n":"");
+    _write_trace_name(&writer,_events[tc].zone->name);
+    write_file_format(&writer,"\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%ld.%03ld,\"dur\":%ld.%03ld}",
+        start/1000,start%1000,duration/1000,duration%1000);
+  }
+  write_file_format(&writer,"\n],\"displayTimeUnit\":\"ns\"}\n");
+
+  result=close_file_writer(&writer);
+  if(result!=EFI_SUCCESS)
+    LOG.error(L"could not write trace file %s: %r",filename,result);
+  else
+    LOG.info(L"wrote %ld profile events to %s",_event_count,filename);
+  return result;
+}
+
+/**
+ * Shuts the profiler down.
+ * If anything was recorded, this prints the zone report, writes the trace file to PROFILER_TRACE_FILENAME and frees
+ * the event buffer.
+ */
+void shutdown_profiler()
+{
+  stop_profiling();
+  if(_zones!=NULL)
+  {
+    print_profile_report();
+    if(_event_count>0)
+      write_profile_trace(PROFILER_TRACE_FILENAME);
+  }
+  reset_profiler();
+}
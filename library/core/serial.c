@@ -0,0 +1,182 @@
+/** \file
+ * Log writer for serial ports and the QEMU debug console
+ *
+ * Writing log messages to ConOut is slow and paints over graphics output. This log writer sends messages to either a
+ * 16550 compatible serial port or the "isa-debugcon" port instead. The host can capture them e.g. with QEMU's
+ * `-serial file:serial.log` or `-debugcon file:debug.log` options.
+ *
+ * Output is collected in a buffer and written in batches, so it's best to call flush_serial_log() before
+ * anything that might halt the system. ERROR messages are written right away.
+ *
+ * \author Richard Nusser
+ * \copyright 2017-2018 Richard Nusser
+ * \license GPLv3 (see http://www.gnu.org/licenses/)
+ * \sa https://github.com/rinusser/UEFIStarter
+ * \ingroup group_lib_logger
+ */
+
+#include <Library/UefiLib.h>
+#include <Library/IoLib.h>
+#include <UEFIStarter/core/serial.h>
+
+
+#define UART_THR 0 /**< UART register: transmit holding register */
+#define UART_DLL 0 /**< UART register: divisor latch, low byte */
+#define UART_IER 1 /**< UART register: interrupt enable */
+#define UART_DLM 1 /**< UART register: divisor latch, high byte */
+#define UART_FCR 2 /**< UART register: FIFO control */
+#define UART_LCR 3 /**< UART register: line control */
+#define UART_MCR 4 /**< UART register: modem control */
+#define UART_LSR 5 /**< UART register: line status */
+#define UART_SCR 7 /**< UART register: scratch */
+
+#define UART_LSR_THRE  0x20 /**< line status bit: transmit holding register empty */
+#define UART_FIFO_SIZE 16   /**< number of bytes that can be written at once after THRE gets set */
+
+/** maximum number of line status reads to wait for the transmitter before giving up */
+#define UART_TIMEOUT_ITERATIONS 100000
+
+
+/** the output port, 0 if not initialized */
+static UINT16 _serial_port=0;
+
+/** output buffer */
+static CHAR8 _serial_buffer[SERIAL_LOG_BUFFER_SIZE];
+
+/** number of bytes currently in output buffer */
+static UINTN _serial_buffered=0;
+
+
+/**
+ * internal: initializes a 16550 compatible UART for 8N1 output.
+ *
+ * \param port the UART's I/O port base
+ * \return EFI_SUCCESS, or EFI_NOT_FOUND if there doesn't seem to be a UART at the given port
+ */
+static EFI_STATUS _init_uart(UINT16 port)
+{
+  UINT16 divisor=115200/SERIAL_BAUD_RATE;
+
+  IoWrite8(port+UART_SCR,0x5A);
+  if(IoRead8(port+UART_SCR)!=0x5A)
+    return EFI_NOT_FOUND;
+
+  IoWrite8(port+UART_IER,0x00);
+  IoWrite8(port+UART_LCR,0x80);
+  IoWrite8(port+UART_DLL,divisor&0xFF);
+  IoWrite8(port+UART_DLM,divisor>>8);
+  IoWrite8(port+UART_LCR,0x03);
+  IoWrite8(port+UART_FCR,0xC7);
+  IoWrite8(port+UART_MCR,0x03);
+  return EFI_SUCCESS;
+}
+
+/**
+ * Initializes the serial log writer.
+ * Use set_logger_function(serial_log_print) afterwards to send log messages to the port.
+ *
+ * \param port the I/O port to write to: SERIAL_PORT_DEBUGCON or a 16550 UART's base, e.g. SERIAL_PORT_COM1
+ * \return EFI_SUCCESS, or EFI_NOT_FOUND if the port doesn't seem to be available
+ */
+EFI_STATUS init_serial_logger(UINT16 port)
+{
+  flush_serial_log();
+
+  if(port==SERIAL_PORT_DEBUGCON)
+  {
+    //QEMU's debugcon returns its port number on reads
+    if(IoRead8(port)!=SERIAL_PORT_DEBUGCON)
+      return EFI_NOT_FOUND;
+  }
+  else if(_init_uart(port)!=EFI_SUCCESS)
+    return EFI_NOT_FOUND;
+
+  _serial_port=port;
+  return EFI_SUCCESS;
+}
+
+/**
+ * internal: writes a block of bytes to a UART, waiting for the transmitter as needed.
+ *
+ * \param data  the bytes to write
+ * \param count the number of bytes to write
+ */
+static void _write_uart(CHAR8 *data, UINTN count)
+{
+  UINTN tc, chunk, timeout;
+
+  while(count>0)
+  {
+    for(timeout=0;timeout<UART_TIMEOUT_ITERATIONS;timeout++)
+      if(IoRead8(_serial_port+UART_LSR)&UART_LSR_THRE)
+        break;
+    if(timeout>=UART_TIMEOUT_ITERATIONS)
+      return;
+
+    chunk=count<UART_FIFO_SIZE?count:UART_FIFO_SIZE;
+    for(tc=0;tc<chunk;tc++)
+      IoWrite8(_serial_port+UART_THR,data[tc]);
+    data+=chunk;
+    count-=chunk;
+  }
+}
+
+/**
+ * Writes all buffered log output to the port.
+ * Does nothing if the serial log writer isn't initialized.
+ */
+void flush_serial_log()
+{
+  if(_serial_port==0 || _serial_buffered==0)
+  {
+    _serial_buffered=0;
+    return;
+  }
+
+  if(_serial_port==SERIAL_PORT_DEBUGCON)
+    IoWriteFifo8(_serial_port,_serial_buffered,_serial_buffer);
+  else
+    _write_uart(_serial_buffer,_serial_buffered);
+  _serial_buffered=0;
+}
+
+/**
+ * internal: appends a character to the output buffer, flushing the buffer if it's full.
+ * Characters outside the ASCII range are replaced with question marks.
+ *
+ * \param c the character to append
+ */
+static inline void _append_char(CHAR16 c)
+{
+  if(_serial_buffered>=SERIAL_LOG_BUFFER_SIZE)
+    flush_serial_log();
+  _serial_buffer[_serial_buffered++]=c<0x80?(CHAR8)c:'?';
+}
+
+/**
+ * Log writer: sends log messages to the serial port.
+ * Pass this to set_logger_function() after calling init_serial_logger().
+ *
+ * \param level the log level to log at
+ * \param msg   the log message, as UTF-16
+ */
+void serial_log_print(LOGLEVEL level, CHAR16 *msg)
+{
+  const CHAR16 *name=logger_level_names[level];
+
+  if(_serial_port==0)
+    return;
+
+  while(*name)
+    _append_char(*(name++));
+  _append_char(L':');
+  _append_char(L' ');
+  while(*msg)
+    _append_char(*(msg++));
+  if(_serial_port!=SERIAL_PORT_DEBUGCON)
+    _append_char(L'\r');
+  _append_char(L'\n');
+
+  if(level<=ERROR)
+    flush_serial_log();
+}
@@ -10,6 +10,8 @@
 
 #include <Library/UefiLib.h>
 #include <Library/MemoryAllocationLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/PrintLib.h>
 #include <UEFIStarter/core/memory.h>
 #include <UEFIStarter/core/string.h>
 #include <UEFIStarter/core/logger.h>
@@ -24,20 +26,567 @@
 #define FTOWCS_MAX_VALUE  1000000000.0
 
 
+
+/** internal: shared empty buffer for string builders that didn't allocate memory yet */
+static CHAR16 _empty_builder_buffer[1]={0};
+
+
+/**
+ * Initializes a string builder.
+ * The builder starts with the given buffer, e.g. a local array on the stack. If appended text doesn't fit into it the
+ * builder switches to pool memory, so free_string_builder() must be called when the built string isn't needed anymore.
+ * If no buffer is given the builder allocates pool memory on first use.
+ *
+ * \param builder  the string builder to initialize
+ * \param buffer   the initial buffer to build the string in, may be NULL
+ * \param capacity the initial buffer's size, in characters
+ */
+void init_string_builder(string_builder_t *builder, CHAR16 *buffer, UINTN capacity)
+{
+  if(buffer==NULL || capacity==0)
+  {
+    buffer=_empty_builder_buffer;
+    capacity=1;
+  }
+  builder->buffer=buffer;
+  builder->buffer[0]=0;
+  builder->capacity=capacity;
+  builder->length=0;
+  builder->allocated=FALSE;
+  builder->truncated=FALSE;
+}
+
+/**
+ * Empties a string builder's string but keeps its buffer for reuse.
+ *
+ * \param builder the string builder to clear
+ */
+void clear_string_builder(string_builder_t *builder)
+{
+  builder->buffer[0]=0;
+  builder->length=0;
+  builder->truncated=FALSE;
+}
+
+/**
+ * Frees a string builder's pool memory, if any, and empties its string.
+ * The builder can be used again afterwards, it will allocate new pool memory as needed.
+ *
+ * \param builder the string builder to free
+ */
+void free_string_builder(string_builder_t *builder)
+{
+  if(builder->allocated)
+    FreePool(builder->buffer);
+  init_string_builder(builder,NULL,0);
+}
+
+/**
+ * internal: moves a string builder's string into a larger pool memory buffer.
+ * The buffer at least doubles in size to keep the number of reallocations low.
+ *
+ * \param builder  the string builder to grow
+ * \param required the minimum required capacity, in characters
+ * \return whether the buffer was enlarged
+ */
+static BOOLEAN _grow_string_builder(string_builder_t *builder, UINTN required)
+{
+  UINTN capacity=builder->capacity*2;
+  CHAR16 *buffer;
+
+  if(capacity<STRING_BUILDER_DEFAULT_CAPACITY)
+    capacity=STRING_BUILDER_DEFAULT_CAPACITY;
+  if(capacity<required)
+    capacity=required;
+
+  if((buffer=AllocatePool(capacity*sizeof(CHAR16)))==NULL)
+  {
+    LOG.error(L"could not grow string builder to %d characters",capacity);
+    return FALSE;
+  }
+  CopyMem(buffer,builder->buffer,builder->length*sizeof(CHAR16));
+  buffer[builder->length]=0;
+
+  if(builder->allocated)
+    FreePool(builder->buffer);
+  builder->buffer=buffer;
+  builder->capacity=capacity;
+  builder->allocated=TRUE;
+  return TRUE;
+}
+
+/**
+ * internal: appends a number of characters to a string builder.
+ * If the buffer can't grow as much as needed the text is cut off.
+ *
+ * \param builder the string builder to append to
+ * \param str     the characters to append
+ * \param length  the number of characters to append
+ * \return whether the text was appended completely
+ */
+static BOOLEAN _append_chars(string_builder_t *builder, CONST CHAR16 *str, UINTN length)
+{
+  BOOLEAN complete=TRUE;
+
+  if(builder->length+length>=builder->capacity && !_grow_string_builder(builder,builder->length+length+1))
+  {
+    length=builder->capacity-builder->length-1;
+    builder->truncated=TRUE;
+    complete=FALSE;
+  }
+  CopyMem(builder->buffer+builder->length,str,length*sizeof(CHAR16));
+  builder->length+=length;
+  builder->buffer[builder->length]=0;
+  return complete;
+}
+
+/**
+ * Appends a string to a string builder.
+ *
+ * \param builder the string builder to append to
+ * \param str     the string to append, as UTF-16
+ * \return whether the string was appended completely
+ */
+BOOLEAN append_string(string_builder_t *builder, CONST CHAR16 *str)
+{
+  if(str==NULL)
+    return TRUE;
+  return _append_chars(builder,str,StrLen(str));
+}
+
+/**
+ * Appends a single character to a string builder.
+ *
+ * \param builder the string builder to append to
+ * \param ch      the character to append
+ * \return whether the character was appended
+ */
+BOOLEAN append_char(string_builder_t *builder, CHAR16 ch)
+{
+  return _append_chars(builder,&ch,1);
+}
+
+/**
+ * Appends formatted text to a string builder.
+ * This function takes a VA_LIST parameter, use append_format() for variable arguments.
+ *
+ * The text is printed directly into the builder's buffer. If it doesn't fit, the buffer grows and the text is printed
+ * again.
+ *
+ * \param builder the string builder to append to
+ * \param fmt     the format string, as UTF-16
+ * \param args    the parameters matching the format string's placeholders
+ * \return whether the text was appended completely
+ */
+BOOLEAN append_format_va(string_builder_t *builder, CONST CHAR16 *fmt, VA_LIST args)
+{
+  VA_LIST copy;
+  UINTN available, length;
+
+  for(;;)
+  {
+    available=builder->capacity-builder->length;
+    VA_COPY(copy,args);
+    length=UnicodeVSPrint(builder->buffer+builder->length,available*sizeof(CHAR16),fmt,copy);
+    VA_END(copy);
+
+    //the printed text fits if there's at least 1 character left over, otherwise it might have been cut off
+    if(length+1<available)
+      break;
+    if(!_grow_string_builder(builder,builder->capacity*2))
+    {
+      builder->length+=length;
+      builder->truncated=TRUE;
+      return FALSE;
+    }
+  }
+  builder->length+=length;
+  return TRUE;
+}
+
+/**
+ * Appends formatted text to a string builder.
+ * This function uses the same format codes as Print().
+ *
+ * \param builder the string builder to append to
+ * \param fmt     the format string, as UTF-16
+ * \param ...     any additional parameters matching the format string's placeholders
+ * \return whether the text was appended completely
+ */
+BOOLEAN EFIAPI append_format(string_builder_t *builder, CONST CHAR16 *fmt, ...)
+{
+  BOOLEAN result;
+  VA_LIST args;
+
+  VA_START(args,fmt);
+  result=append_format_va(builder,fmt,args);
+  VA_END(args);
+  return result;
+}
+
+/**
+ * Appends a double value to a string builder.
+ *
+ * \param builder  the string builder to append to
+ * \param value    the number to convert
+ * \param decimals the number of decimals to round to, up to MAX_DOUBLE_DECIMALS
+ * \return whether the number was appended
+ */
+BOOLEAN append_double(string_builder_t *builder, double value, UINTN decimals)
+{
+  CHAR16 buffer[NUMBER_STRING_LENGTH];
+
+  if(double_to_wcs(buffer,NUMBER_STRING_LENGTH,value,decimals)==0)
+  {
+    LOG.error(L"could not convert double value with %d decimals",decimals);
+    return FALSE;
+  }
+  return append_string(builder,buffer);
+}
+
+
+/** powers of 10 that fit into UINT64, for number conversions */
+static CONST UINT64 _powers_of_10[]={
+  1ULL,10ULL,100ULL,1000ULL,10000ULL,100000ULL,1000000ULL,10000000ULL,100000000ULL,1000000000ULL,
+  10000000000ULL,100000000000ULL,1000000000000ULL,10000000000000ULL,100000000000000ULL,1000000000000000ULL,
+  10000000000000000ULL,100000000000000000ULL,1000000000000000000ULL,10000000000000000000ULL
+};
+
+/** decimal digit pairs "00" to "99", for converting 2 digits at once */
+static CONST CHAR8 _digit_pairs[]=
+  "0001020304050607080910111213141516171819202122232425262728293031323334353637383940414243444546474849"
+  "5051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+
+/** parsed mantissas stop accepting digits at this value, so one more digit always fits into UINT64 */
+#define PARSE_MANTISSA_LIMIT 1000000000000000000ULL
+
+/**
+ * internal: reads a character from an ASCII or UTF-16 string.
+ *
+ * \param STR  the string to read from
+ * \param WIDE whether the string is UTF-16
+ * \param POS  the character's position
+ */
+#define _NUMBER_CHAR(STR,WIDE,POS) ((WIDE)?((CONST CHAR16 *)(STR))[POS]:((CONST CHAR8 *)(STR))[POS])
+
+
+/**
+ * internal: writes an integer's decimal digits right-aligned, ending just before the given position.
+ *
+ * \param end   the position after the last digit
+ * \param value the number to convert
+ * \return the number of digits written
+ */
+static UINTN _format_uint64(CHAR8 *end, UINT64 value)
+{
+  CHAR8 *pos=end;
+  UINTN pair;
+
+  while(value>=100)
+  {
+    pair=(value%100)*2;
+    value/=100;
+    *--pos=_digit_pairs[pair+1];
+    *--pos=_digit_pairs[pair];
+  }
+  if(value>=10)
+  {
+    *--pos=_digit_pairs[value*2+1];
+    *--pos=_digit_pairs[value*2];
+  }
+  else
+    *--pos='0'+(CHAR8)value;
+  return end-pos;
+}
+
+/**
+ * internal: writes a double value right-aligned, ending just before the given position.
+ * Values are rounded "half away from zero". Negative values rounding to 0 keep their sign.
+ *
+ * \param end      the position after the last character, at least NUMBER_STRING_LENGTH-1 characters are available
+ * \param value    the number to convert
+ * \param decimals the number of decimals to round to
+ * \return the number of characters written; 0 if the number isn't representable
+ */
+static UINTN _format_double(CHAR8 *end, double value, UINTN decimals)
+{
+  CHAR8 *pos=end;
+  BOOLEAN negative=value<0;
+  double scaled;
+  UINT64 number;
+  UINTN length;
+
+  if(decimals>MAX_DOUBLE_DECIMALS || value!=value)
+    return 0;
+  scaled=(negative?-value:value)*_powers_of_10[decimals]+0.5;
+  if(scaled>=18446744073709551616.0)
+    return 0;
+
+  number=(UINT64)scaled;
+  if(decimals>0)
+  {
+    length=_format_uint64(pos,number%_powers_of_10[decimals]);
+    for(pos-=length;length<decimals;length++)
+      *--pos='0';
+    *--pos='.';
+    number/=_powers_of_10[decimals];
+  }
+  pos-=_format_uint64(pos,number);
+  if(negative)
+    *--pos='-';
+  return end-pos;
+}
+
+/**
+ * internal: copies converted number characters into a caller's buffer.
+ *
+ * \param buffer the target buffer, as ASCII or UTF-16
+ * \param wide   whether the target buffer is UTF-16
+ * \param size   the target buffer's size, in characters
+ * \param chars  the characters to copy
+ * \param length the number of characters to copy; 0 if the conversion failed
+ * \return the number of characters written, excluding the terminating null character; 0 if the buffer is too small
+ */
+static UINTN _copy_number(VOID *buffer, BOOLEAN wide, UINTN size, CONST CHAR8 *chars, UINTN length)
+{
+  UINTN tc;
+
+  if(buffer==NULL || size==0)
+    return 0;
+  if(length>=size)
+    length=0;
+
+  if(wide)
+  {
+    for(tc=0;tc<length;tc++)
+      ((CHAR16 *)buffer)[tc]=chars[tc];
+    ((CHAR16 *)buffer)[length]=0;
+  }
+  else
+  {
+    CopyMem(buffer,chars,length);
+    ((CHAR8 *)buffer)[length]=0;
+  }
+  return length;
+}
+
+/**
+ * Converts an unsigned integer into a UTF-16 string in a caller-provided buffer.
+ *
+ * \param buffer the target buffer
+ * \param size   the target buffer's size, in characters; NUMBER_STRING_LENGTH always suffices
+ * \param value  the number to convert
+ * \return the string's length; 0 if the buffer is too small
+ */
+UINTN uint64_to_wcs(CHAR16 *buffer, UINTN size, UINT64 value)
+{
+  CHAR8 chars[NUMBER_STRING_LENGTH];
+  UINTN length=_format_uint64(chars+NUMBER_STRING_LENGTH,value);
+  return _copy_number(buffer,TRUE,size,chars+NUMBER_STRING_LENGTH-length,length);
+}
+
+/**
+ * Converts an unsigned integer into an ASCII string in a caller-provided buffer.
+ *
+ * \param buffer the target buffer
+ * \param size   the target buffer's size, in characters; NUMBER_STRING_LENGTH always suffices
+ * \param value  the number to convert
+ * \return the string's length; 0 if the buffer is too small
+ */
+UINTN uint64_to_ascii(CHAR8 *buffer, UINTN size, UINT64 value)
+{
+  CHAR8 chars[NUMBER_STRING_LENGTH];
+  UINTN length=_format_uint64(chars+NUMBER_STRING_LENGTH,value);
+  return _copy_number(buffer,FALSE,size,chars+NUMBER_STRING_LENGTH-length,length);
+}
+
+/**
+ * Converts a double value into a UTF-16 string in a caller-provided buffer.
+ * The value is rounded "half away from zero" and always zero-padded to the given number of decimals. The absolute
+ * value times 10^decimals must be less than 2^64.
+ *
+ * \param buffer   the target buffer
+ * \param size     the target buffer's size, in characters; NUMBER_STRING_LENGTH always suffices
+ * \param value    the number to convert
+ * \param decimals the number of decimals, up to MAX_DOUBLE_DECIMALS
+ * \return the string's length; 0 if the buffer is too small or the value can't be converted
+ */
+UINTN double_to_wcs(CHAR16 *buffer, UINTN size, double value, UINTN decimals)
+{
+  CHAR8 chars[NUMBER_STRING_LENGTH];
+  UINTN length=_format_double(chars+NUMBER_STRING_LENGTH,value,decimals);
+  return _copy_number(buffer,TRUE,size,chars+NUMBER_STRING_LENGTH-length,length);
+}
+
+/**
+ * Converts a double value into an ASCII string in a caller-provided buffer.
+ * See double_to_wcs() for details.
+ *
+ * \param buffer   the target buffer
+ * \param size     the target buffer's size, in characters; NUMBER_STRING_LENGTH always suffices
+ * \param value    the number to convert
+ * \param decimals the number of decimals, up to MAX_DOUBLE_DECIMALS
+ * \return the string's length; 0 if the buffer is too small or the value can't be converted
+ */
+UINTN double_to_ascii(CHAR8 *buffer, UINTN size, double value, UINTN decimals)
+{
+  CHAR8 chars[NUMBER_STRING_LENGTH];
+  UINTN length=_format_double(chars+NUMBER_STRING_LENGTH,value,decimals);
+  return _copy_number(buffer,FALSE,size,chars+NUMBER_STRING_LENGTH-length,length);
+}
+
+/**
+ * internal: parses an unsigned integer at the start of an ASCII or UTF-16 string.
+ *
+ * \param str   the string to parse
+ * \param wide  whether the string is UTF-16
+ * \param value where to write the parsed number to
+ * \return the number of characters parsed; 0 if there's no number or it exceeds UINT64
+ */
+static UINTN _parse_uint64(CONST VOID *str, BOOLEAN wide, UINT64 *value)
+{
+  UINT64 result=0;
+  UINTN pos, digit;
+
+  if(str==NULL)
+    return 0;
+  for(pos=0;(digit=(UINTN)_NUMBER_CHAR(str,wide,pos)-'0')<10;pos++)
+  {
+    if(result>MAX_UINT64/10 || (result==MAX_UINT64/10 && digit>MAX_UINT64%10))
+      return 0;
+    result=result*10+digit;
+  }
+  if(pos>0)
+    *value=result;
+  return pos;
+}
+
+/**
+ * internal: parses a decimal number at the start of an ASCII or UTF-16 string.
+ * Digits are collected as integer and scaled once at the end, so there's only one rounding step for numbers with up
+ * to 19 significant digits. Any digits beyond that are ignored.
+ *
+ * \param str   the string to parse
+ * \param wide  whether the string is UTF-16
+ * \param value where to write the parsed number to
+ * \return the number of characters parsed; 0 if there's no number
+ */
+static UINTN _parse_double(CONST VOID *str, BOOLEAN wide, double *value)
+{
+  UINT64 mantissa=0;
+  INTN exponent=0;
+  UINTN pos=0, digit, digits=0;
+  UINTN decimal_point=0; //position after the decimal point, 0 if there is none
+  double result;
+
+  if(str==NULL)
+    return 0;
+  if(_NUMBER_CHAR(str,wide,0)=='-')
+    pos++;
+
+  for(;;pos++)
+  {
+    digit=(UINTN)_NUMBER_CHAR(str,wide,pos)-'0';
+    if(digit<10)
+    {
+      digits++;
+      if(mantissa<PARSE_MANTISSA_LIMIT)
+      {
+        mantissa=mantissa*10+digit;
+        exponent-=decimal_point>0;
+      }
+      else
+        exponent+=decimal_point==0;
+    }
+    else if(_NUMBER_CHAR(str,wide,pos)=='.' && decimal_point==0)
+      decimal_point=pos+1;
+    else
+      break;
+  }
+  if(digits==0)
+    return 0;
+  if(decimal_point==pos)
+    pos--;
+
+  result=(double)mantissa;
+  for(;exponent<-19;exponent+=19)
+    result/=_powers_of_10[19];
+  for(;exponent>19;exponent-=19)
+    result*=_powers_of_10[19];
+  if(exponent<0)
+    result/=_powers_of_10[-exponent];
+  else
+    result*=_powers_of_10[exponent];
+
+  *value=_NUMBER_CHAR(str,wide,0)=='-'?-result:result;
+  return pos;
+}
+
 /**
- * Converts a double value into a UTF-16 string with 3 decimals.
+ * Parses an unsigned integer at the start of a UTF-16 string.
+ * Parsing stops at the first non-digit, check the returned length to make sure the entire string was parsed.
+ *
+ * \param str   the string to parse
+ * \param value where to write the parsed number to, unchanged on error
+ * \return the number of characters parsed; 0 if there's no number or it exceeds UINT64
+ */
+UINTN wcs_to_uint64(CONST CHAR16 *str, UINT64 *value)
+{
+  return _parse_uint64(str,TRUE,value);
+}
+
+/**
+ * Parses an unsigned integer at the start of an ASCII string.
+ * Parsing stops at the first non-digit, check the returned length to make sure the entire string was parsed.
+ *
+ * \param str   the string to parse
+ * \param value where to write the parsed number to, unchanged on error
+ * \return the number of characters parsed; 0 if there's no number or it exceeds UINT64
+ */
+UINTN ascii_to_uint64(CONST CHAR8 *str, UINT64 *value)
+{
+  return _parse_uint64(str,FALSE,value);
+}
+
+/**
+ * Parses a decimal number (e.g. "-12.5") at the start of a UTF-16 string.
+ * Parsing stops at the first character that doesn't belong to the number, check the returned length to make sure the
+ * entire string was parsed. A trailing decimal point isn't included.
+ *
+ * \param str   the string to parse
+ * \param value where to write the parsed number to, unchanged on error
+ * \return the number of characters parsed; 0 if there's no number
+ */
+UINTN wcs_to_double(CONST CHAR16 *str, double *value)
+{
+  return _parse_double(str,TRUE,value);
+}
+
+/**
+ * Parses a decimal number (e.g. "-12.5") at the start of an ASCII string.
+ * See wcs_to_double() for details.
+ *
+ * \param str   the string to parse
+ * \param value where to write the parsed number to, unchanged on error
+ * \return the number of characters parsed; 0 if there's no number
+ */
+UINTN ascii_to_double(CONST CHAR8 *str, double *value)
+{
+  return _parse_double(str,FALSE,value);
+}
+
+/**
+ * Converts a double value into a UTF-16 string with 2 decimals.
  * Will only convert numbers between FTOWCS_MIN_VALUE and FTOWCS_MAX_VALUE.
+ * The result is tracked pool memory, use double_to_wcs() or append_double() to avoid the allocation or to change the
+ * number of decimals.
  *
  * \param value the number to convert
  * \return the number as a UTF-16 string, or NULL on error
- *
- * \TODO make number of decimals configurable
  */
 CHAR16 *ftowcs(double value)
 {
-  BOOLEAN negative=FALSE;
-  INT64 left;
-  UINT64 right;
+  CHAR16 buffer[NUMBER_STRING_LENGTH];
 
   if(value<FTOWCS_MIN_VALUE)
   {
@@ -50,28 +599,8 @@ CHAR16 *ftowcs(double value)
     return NULL;
   }
 
-  LOG.trace(L"  value<0: %s",value<0?L"yes":L"no");
-  if(value<0)
-  {
-    negative=TRUE;
-    value=-value;
-  }
-  left=(INT64)value;
-  right=(UINT64)((value-left)*1000);
-  LOG.trace(L"  left=%ld, right=%ld",left,right);
-  if(right%10>=5)
-  {
-    right+=5;
-    LOG.trace(L"  left=%ld, right=%ld (right value needs rounding up, increased it by 5)",left,right);
-    if(right>=1000)
-    {
-      right-=1000;
-      left+=1;
-      LOG.trace(L"  left=%ld, right=%ld (right value wrapped around, decreased it and increased left value by 1)",left,right);
-    }
-  }
-  right/=10;
-  return memsprintf(L"%s%ld.%02ld",negative?L"-":L"",left,right);
+  double_to_wcs(buffer,NUMBER_STRING_LENGTH,value,2);
+  return memsprintf(L"%s",buffer);
 }
 
 /**
@@ -82,26 +611,19 @@ CHAR16 *ftowcs(double value)
  */
 UINT64 atoui64(char *str)
 {
-  UINT64 rv=0;
-  UINTN tc;
+  UINT64 rv;
+  UINTN length;
 
   if(str==NULL || str[0]==0)
   {
     LOG.error(L"atoui64: cannot parse NULL or empty string");
     return -1;
   }
-  LOG.debug(L"atoui64: parsing \"%a\"",str);
-  for(tc=0;tc<20;tc++)
+  length=ascii_to_uint64(str,&rv);
+  if(length==0 || str[length]!=0)
   {
-    LOG.trace(L"atoui64: tc=%d, current=%ld",tc,rv);
-    if(str[tc]==0)
-      break;
-    if(str[tc]<'0' || str[tc]>'9')
-    {
-      LOG.error(L"invalid string to convert: %a, failing char:0x%02X",str,str[tc]);
-      return -1;
-    }
-    rv=rv*10+str[tc]-'0';
+    LOG.error(L"atoui64: invalid or too large number: %a",str);
+    return -1;
   }
   return rv;
 }
@@ -117,6 +639,56 @@ BOOLEAN ctype_whitespace(char ch)
   return ch=='\t' || ch=='\n' || ch=='\r' || ch==' ';
 }
 
+/**
+ * Appends a human-readable EFI function call result to a string builder.
+ *
+ * \param builder  the string builder to append to
+ * \param function the function name, as UTF-16
+ * \param code     the resulting EFI status code
+ * \return whether the text was appended completely
+ */
+BOOLEAN append_status(string_builder_t *builder, CHAR16 *function, EFI_STATUS code)
+{
+  return append_format(builder,L"%s() returned status %d (%r)",function,code,code);
+}
+
+/**
+ * Appends the text of a UTF-16 string view to a string builder.
+ *
+ * \param builder the string builder to append to
+ * \param view    the text to append
+ * \return whether the text was appended completely
+ */
+BOOLEAN append_wcs_view(string_builder_t *builder, wcs_view_t view)
+{
+  return _append_chars(builder,view.start,view.length);
+}
+
+/**
+ * Appends the text of an ASCII string view to a string builder.
+ *
+ * \param builder the string builder to append to
+ * \param view    the text to append
+ * \return whether the text was appended completely
+ */
+BOOLEAN append_ascii_view(string_builder_t *builder, ascii_view_t view)
+{
+  BOOLEAN complete=TRUE;
+  UINTN tc;
+
+  if(builder->length+view.length>=builder->capacity && !_grow_string_builder(builder,builder->length+view.length+1))
+  {
+    view.length=builder->capacity-builder->length-1;
+    builder->truncated=TRUE;
+    complete=FALSE;
+  }
+  for(tc=0;tc<view.length;tc++)
+    builder->buffer[builder->length+tc]=view.start[tc];
+  builder->length+=view.length;
+  builder->buffer[builder->length]=0;
+  return complete;
+}
+
 /**
  * Helper function to format an EFI function call result into a human-readable string.
  *
@@ -139,7 +711,7 @@ CHAR16 *sprint_status(CHAR16 *function, EFI_STATUS code)
  */
 void print_status(CHAR16 *function, EFI_STATUS code)
 {
-  Print(L"%s\n",sprint_status(function,code));
+  Print(L"%s() returned status %d (%r)\n",function,code,code);
 }
 
 
@@ -216,3 +788,268 @@ UINTN split_string(CHAR16 ***list, CHAR16 *input, CHAR16 separator)
 
   return count;
 }
+
+
+/** bytes with only their lowest bit set, for searching 8 ASCII characters at once */
+#define SWAR_LOW_BITS_8 0x0101010101010101ULL
+
+/** bytes with only their highest bit set, for searching 8 ASCII characters at once */
+#define SWAR_HIGH_BITS_8 0x8080808080808080ULL
+
+/** 16-bit words with only their lowest bit set, for searching 4 UTF-16 characters at once */
+#define SWAR_LOW_BITS_16 0x0001000100010001ULL
+
+/** 16-bit words with only their highest bit set, for searching 4 UTF-16 characters at once */
+#define SWAR_HIGH_BITS_16 0x8000800080008000ULL
+
+/** character searches in strings shorter than this don't bother with word-wise comparisons */
+#define SWAR_MIN_LENGTH 16
+
+
+/**
+ * Creates a view of an entire null-terminated UTF-16 string.
+ *
+ * \param str the string to view, may be NULL
+ * \return the string view; empty if str is NULL
+ */
+wcs_view_t wcs_view(CONST CHAR16 *str)
+{
+  return wcs_view_n(str,str==NULL?0:StrLen(str));
+}
+
+/**
+ * Creates a view of a number of UTF-16 characters.
+ *
+ * \param start  the view's first character
+ * \param length the view's length, in characters
+ * \return the string view
+ */
+wcs_view_t wcs_view_n(CONST CHAR16 *start, UINTN length)
+{
+  wcs_view_t view;
+  view.start=start;
+  view.length=length;
+  return view;
+}
+
+/**
+ * Creates a view of an entire null-terminated ASCII string.
+ *
+ * \param str the string to view, may be NULL
+ * \return the string view; empty if str is NULL
+ */
+ascii_view_t ascii_view(CONST CHAR8 *str)
+{
+  return ascii_view_n(str,str==NULL?0:AsciiStrLen(str));
+}
+
+/**
+ * Creates a view of a number of ASCII characters, e.g. a file's contents.
+ *
+ * \param start  the view's first character
+ * \param length the view's length, in characters
+ * \return the string view
+ */
+ascii_view_t ascii_view_n(CONST CHAR8 *start, UINTN length)
+{
+  ascii_view_t view;
+  view.start=start;
+  view.length=length;
+  return view;
+}
+
+/**
+ * Creates a view of an ASCII view without its first characters.
+ *
+ * \param view  the original view
+ * \param count the number of characters to skip
+ * \return the remaining view; empty if the view is shorter than the skipped count
+ */
+ascii_view_t ascii_view_skip(ascii_view_t view, UINTN count)
+{
+  if(count>view.length)
+    count=view.length;
+  return ascii_view_n(view.start+count,view.length-count);
+}
+
+/**
+ * Checks whether a UTF-16 view contains exactly the given string.
+ *
+ * \param view the view to check
+ * \param str  the null-terminated string to compare with
+ * \return whether the view and the string are equal
+ */
+BOOLEAN wcs_view_equals(wcs_view_t view, CONST CHAR16 *str)
+{
+  UINTN tc;
+
+  for(tc=0;tc<view.length;tc++)
+    if(str[tc]!=view.start[tc] || str[tc]==0)
+      return FALSE;
+  return str[tc]==0;
+}
+
+/**
+ * Checks whether an ASCII view starts with the given string.
+ *
+ * \param view   the view to check
+ * \param prefix the null-terminated prefix to look for
+ * \return whether the view starts with the prefix
+ */
+BOOLEAN ascii_view_starts_with(ascii_view_t view, CONST CHAR8 *prefix)
+{
+  UINTN tc;
+
+  for(tc=0;prefix[tc]!=0;tc++)
+    if(tc>=view.length || view.start[tc]!=prefix[tc])
+      return FALSE;
+  return TRUE;
+}
+
+/**
+ * Finds the first occurrence of a character in UTF-16 text.
+ * Longer texts are searched 4 characters at a time.
+ *
+ * \param str    the text to search, doesn't need to be null-terminated
+ * \param length the text's length, in characters
+ * \param ch     the character to look for
+ * \return the character's position; the text's length if it wasn't found
+ */
+UINTN find_wcs_char(CONST CHAR16 *str, UINTN length, CHAR16 ch)
+{
+  UINTN pos=0;
+  UINT64 pattern, word;
+
+  if(length>=SWAR_MIN_LENGTH)
+  {
+    for(;pos<length && ((UINTN)(str+pos))&7;pos++)
+      if(str[pos]==ch)
+        return pos;
+
+    //XORing with the pattern turns matching characters into 0, then check for any 16-bit word being 0
+    pattern=SWAR_LOW_BITS_16*ch;
+    for(;pos+4<=length;pos+=4)
+    {
+      word=*(CONST UINT64 *)(str+pos)^pattern;
+      if((word-SWAR_LOW_BITS_16)&~word&SWAR_HIGH_BITS_16)
+        break;
+    }
+  }
+  for(;pos<length;pos++)
+    if(str[pos]==ch)
+      return pos;
+  return length;
+}
+
+/**
+ * Finds the first occurrence of a character in ASCII text.
+ * Longer texts are searched 8 characters at a time.
+ *
+ * \param str    the text to search, doesn't need to be null-terminated
+ * \param length the text's length, in characters
+ * \param ch     the character to look for
+ * \return the character's position; the text's length if it wasn't found
+ */
+UINTN find_ascii_char(CONST CHAR8 *str, UINTN length, CHAR8 ch)
+{
+  UINTN pos=0;
+  UINT64 pattern, word;
+
+  if(length>=SWAR_MIN_LENGTH)
+  {
+    for(;pos<length && ((UINTN)(str+pos))&7;pos++)
+      if(str[pos]==ch)
+        return pos;
+
+    //XORing with the pattern turns matching characters into 0, then check for any byte being 0
+    pattern=SWAR_LOW_BITS_8*(UINT8)ch;
+    for(;pos+8<=length;pos+=8)
+    {
+      word=*(CONST UINT64 *)(str+pos)^pattern;
+      if((word-SWAR_LOW_BITS_8)&~word&SWAR_HIGH_BITS_8)
+        break;
+    }
+  }
+  for(;pos<length;pos++)
+    if(str[pos]==ch)
+      return pos;
+  return length;
+}
+
+/**
+ * Initializes a tokenizer for UTF-16 text.
+ * The input must remain valid while tokens are read.
+ *
+ * \param tokenizer the tokenizer to initialize
+ * \param input     the text to split
+ * \param separator the character to split the text by
+ */
+void init_wcs_tokenizer(wcs_tokenizer_t *tokenizer, wcs_view_t input, CHAR16 separator)
+{
+  tokenizer->remaining=input;
+  tokenizer->separator=separator;
+  tokenizer->finished=FALSE;
+}
+
+/**
+ * Fetches the next token from a UTF-16 tokenizer.
+ * Like split_string(), an empty input results in a single empty token.
+ *
+ * \param tokenizer the tokenizer to read from
+ * \param token     where to write the token's view to
+ * \return whether a token was read; FALSE if there are no more tokens
+ */
+BOOLEAN next_wcs_token(wcs_tokenizer_t *tokenizer, wcs_view_t *token)
+{
+  UINTN length;
+
+  if(tokenizer->finished)
+    return FALSE;
+
+  length=find_wcs_char(tokenizer->remaining.start,tokenizer->remaining.length,tokenizer->separator);
+  *token=wcs_view_n(tokenizer->remaining.start,length);
+  if(length>=tokenizer->remaining.length)
+    tokenizer->finished=TRUE;
+  else
+    tokenizer->remaining=wcs_view_n(tokenizer->remaining.start+length+1,tokenizer->remaining.length-length-1);
+  return TRUE;
+}
+
+/**
+ * Initializes a tokenizer for ASCII text.
+ * The input must remain valid while tokens are read.
+ *
+ * \param tokenizer the tokenizer to initialize
+ * \param input     the text to split
+ * \param separator the character to split the text by
+ */
+void init_ascii_tokenizer(ascii_tokenizer_t *tokenizer, ascii_view_t input, CHAR8 separator)
+{
+  tokenizer->remaining=input;
+  tokenizer->separator=separator;
+  tokenizer->finished=FALSE;
+}
+
+/**
+ * Fetches the next token from an ASCII tokenizer, e.g. the next line of a file.
+ * Like split_string(), an empty input results in a single empty token.
+ *
+ * \param tokenizer the tokenizer to read from
+ * \param token     where to write the token's view to
+ * \return whether a token was read; FALSE if there are no more tokens
+ */
+BOOLEAN next_ascii_token(ascii_tokenizer_t *tokenizer, ascii_view_t *token)
+{
+  UINTN length;
+
+  if(tokenizer->finished)
+    return FALSE;
+
+  length=find_ascii_char(tokenizer->remaining.start,tokenizer->remaining.length,tokenizer->separator);
+  *token=ascii_view_n(tokenizer->remaining.start,length);
+  if(length>=tokenizer->remaining.length)
+    tokenizer->finished=TRUE;
+  else
+    tokenizer->remaining=ascii_view_skip(tokenizer->remaining,length+1);
+  return TRUE;
+}
@@ -9,6 +9,10 @@
  */
 
 #include <Library/UefiBootServicesTableLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/IoLib.h>
+#include <Guid/Acpi.h>
+#include <IndustryStandard/Acpi.h>
 #include <UEFIStarter/core/timestamp.h>
 #include <UEFIStarter/core/logger.h>
 #include <UEFIStarter/core/string.h>
@@ -18,45 +22,296 @@
 //x86 specs shouldn't require this, so to increase timestamp accuracy this isn't compiled in by default.
 //#define DEBUG_TIMESTAMPS
 
+/** the ACPI power management timer's fixed frequency, in Hz */
+#define ACPI_PM_TIMER_FREQUENCY 3579545
+
+/** number of measurements to take when calibrating against the ACPI power management timer */
+#define PM_TIMER_CALIBRATION_SAMPLES 7
+
+/** length of each calibration measurement, in power management timer ticks (~5ms) */
+#define PM_TIMER_CALIBRATION_TICKS (ACPI_PM_TIMER_FREQUENCY/200)
+
+/** maximum number of timer reads to wait for the power management timer to change before giving up */
+#define PM_TIMER_MAX_POLLS 1000000
+
+/** margin for timer event delays to assume before any waits were measured, in microseconds */
+#define WAIT_INITIAL_MARGIN_US 2000
+
+/** minimum margin for timer event delays, in microseconds */
+#define WAIT_MINIMUM_MARGIN_US 100
+
 /** internal storage for the number of timestamp ticks per second */
 UINT64 _rdtsc_ticks_per_second=0;
 
+/** internal storage for the method the timestamp frequency was determined with */
+static timestamp_calibration_t _calibration_method=TIMESTAMP_CALIBRATION_NONE;
+
+/** internal storage for the expected timer event delay, in timestamp ticks */
+static UINT64 _wait_margin_ticks=0;
+
 
 /**
- * Initializes the timestamp features.
- * This will take ~2 seconds at current settings. This function takes the naive approach and simply measures how many
- * ticks pass in 2 seconds. This tick frequency will be used later when converting ticks to seconds.
+ * internal: executes the CPUID instruction.
  *
- * Make sure to call this function before you attempt to determine elapsed wallclock time.
+ * \param leaf the CPUID leaf to query
+ * \param eax  output: the resulting EAX register value
+ * \param ebx  output: the resulting EBX register value
+ * \param ecx  output: the resulting ECX register value
+ * \param edx  output: the resulting EDX register value
+ */
+static void _cpuid(UINT32 leaf, UINT32 *eax, UINT32 *ebx, UINT32 *ecx, UINT32 *edx)
+{
+  asm volatile ("cpuid"
+    :"=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
+    :"a" (leaf), "c" (0));
+}
+
+/**
+ * Checks whether the CPU reports an invariant timestamp counter.
+ * Invariant timestamp counters run at a constant rate regardless of power states and frequency changes. Without this
+ * feature timestamp differences may not reliably convert to wallclock time.
  *
- * \return 0 on success, an error code otherwise.
+ * \return whether the timestamp counter is invariant
  */
-int init_timestamps()
+BOOLEAN timestamp_is_invariant()
+{
+  UINT32 eax, ebx, ecx, edx;
+
+  _cpuid(0x80000000,&eax,&ebx,&ecx,&edx);
+  if(eax<0x80000007)
+    return FALSE;
+  _cpuid(0x80000007,&eax,&ebx,&ecx,&edx);
+  return (edx&(1<<8))!=0;
+}
+
+/**
+ * internal: reads the timestamp frequency from CPUID leaf 0x15 (TSC/crystal clock ratio).
+ *
+ * \return the timestamp ticks per second, or 0 if the CPU doesn't report them
+ */
+static UINT64 _read_cpuid_tsc_frequency()
+{
+  UINT32 max_leaf, denominator, numerator, crystal_hz, edx;
+
+  _cpuid(0,&max_leaf,&numerator,&crystal_hz,&edx);
+  if(max_leaf<0x15)
+    return 0;
+  _cpuid(0x15,&denominator,&numerator,&crystal_hz,&edx);
+  if(denominator==0 || numerator==0 || crystal_hz==0)
+    return 0;
+  return ((UINT64)crystal_hz)*numerator/denominator;
+}
+
+/**
+ * internal: reads the processor's base frequency from CPUID leaf 0x16.
+ * On CPUs with invariant timestamp counters this is the nominal timestamp frequency, but it's only reported in whole
+ * MHz.
+ *
+ * \return the base frequency in Hz, or 0 if the CPU doesn't report it
+ */
+static UINT64 _read_cpuid_base_frequency()
+{
+  UINT32 max_leaf, eax, ebx, ecx, edx;
+
+  _cpuid(0,&max_leaf,&ebx,&ecx,&edx);
+  if(max_leaf<0x16)
+    return 0;
+  _cpuid(0x16,&eax,&ebx,&ecx,&edx);
+  return ((UINT64)(eax&0xFFFF))*1000000;
+}
+
+/**
+ * internal: looks up the ACPI power management timer in the firmware's ACPI tables.
+ *
+ * \param mask output: the timer value's bit mask, the timer is either 24 or 32 bits wide
+ * \return the timer's I/O port, or 0 if there is no power management timer
+ */
+static UINT32 _find_pm_timer(UINT32 *mask)
+{
+  EFI_ACPI_2_0_ROOT_SYSTEM_DESCRIPTION_POINTER *rsdp=NULL;
+  EFI_ACPI_DESCRIPTION_HEADER *sdt;
+  EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE *fadt;
+  UINT64 address;
+  UINTN tc, count, entry_size;
+
+  for(tc=0;tc<gST->NumberOfTableEntries && !rsdp;tc++)
+    if(CompareGuid(&gST->ConfigurationTable[tc].VendorGuid,&gEfiAcpi20TableGuid))
+      rsdp=gST->ConfigurationTable[tc].VendorTable;
+  for(tc=0;tc<gST->NumberOfTableEntries && !rsdp;tc++)
+    if(CompareGuid(&gST->ConfigurationTable[tc].VendorGuid,&gEfiAcpi10TableGuid))
+      rsdp=gST->ConfigurationTable[tc].VendorTable;
+  if(!rsdp)
+    return 0;
+
+  //ACPI 1.0 pointers end before the XSDT address field
+  if(rsdp->Revision>=2 && rsdp->XsdtAddress!=0)
+  {
+    sdt=(EFI_ACPI_DESCRIPTION_HEADER *)(UINTN)rsdp->XsdtAddress;
+    entry_size=8;
+  }
+  else
+  {
+    sdt=(EFI_ACPI_DESCRIPTION_HEADER *)(UINTN)rsdp->RsdtAddress;
+    entry_size=4;
+  }
+  if(sdt==NULL)
+    return 0;
+
+  count=(sdt->Length-sizeof(EFI_ACPI_DESCRIPTION_HEADER))/entry_size;
+  for(tc=0;tc<count;tc++)
+  {
+    //XSDT entries aren't 8 byte aligned
+    address=0;
+    CopyMem(&address,((UINT8 *)sdt)+sizeof(EFI_ACPI_DESCRIPTION_HEADER)+tc*entry_size,entry_size);
+    fadt=(EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE *)(UINTN)address;
+    if(fadt==NULL || fadt->Header.Signature!=EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE_SIGNATURE)
+      continue;
+    *mask=(fadt->Flags&EFI_ACPI_2_0_TMR_VAL_EXT)?0xFFFFFFFF:0xFFFFFF;
+    return fadt->PmTmrBlk;
+  }
+  return 0;
+}
+
+/**
+ * internal: sorts a short list of values in ascending order.
+ *
+ * \param values the list of values to sort
+ * \param count  the number of entries in the list
+ */
+static void _sort_samples(UINT64 *values, UINTN count)
+{
+  UINTN tc, td;
+  UINT64 value;
+
+  for(tc=1;tc<count;tc++)
+  {
+    value=values[tc];
+    for(td=tc;td>0 && values[td-1]>value;td--)
+      values[td]=values[td-1];
+    values[td]=value;
+  }
+}
+
+/**
+ * internal: measures the timestamp frequency against the ACPI power management timer.
+ * This takes several short measurements, discards outliers (e.g. caused by SMIs or virtual machine scheduling) and
+ * averages the rest.
+ *
+ * \param port the timer's I/O port
+ * \param mask the timer value's bit mask
+ * \return the measured timestamp ticks per second, or 0 if the timer doesn't seem to work
+ */
+static UINT64 _measure_against_pm_timer(UINT32 port, UINT32 mask)
+{
+  UINT64 samples[PM_TIMER_CALIBRATION_SAMPLES];
+  UINT64 tsc_start, tsc_end, median, sum=0;
+  UINT32 pm_start, pm_now, elapsed;
+  UINTN tc, polls, used=0;
+
+  for(tc=0;tc<PM_TIMER_CALIBRATION_SAMPLES;tc++)
+  {
+    //start at a timer tick edge, so partial ticks don't skew the sample
+    pm_start=IoRead32(port)&mask;
+    for(polls=0;(pm_now=IoRead32(port)&mask)==pm_start;polls++)
+      if(polls>=PM_TIMER_MAX_POLLS)
+        return 0;
+    tsc_start=get_timestamp();
+
+    do
+    {
+      elapsed=(IoRead32(port)-pm_now)&mask;
+    } while(elapsed<PM_TIMER_CALIBRATION_TICKS);
+    tsc_end=get_timestamp();
+
+    samples[tc]=(tsc_end-tsc_start)*ACPI_PM_TIMER_FREQUENCY/elapsed;
+  }
+
+  _sort_samples(samples,PM_TIMER_CALIBRATION_SAMPLES);
+  median=samples[PM_TIMER_CALIBRATION_SAMPLES/2];
+  for(tc=0;tc<PM_TIMER_CALIBRATION_SAMPLES;tc++)
+  {
+    LOG_TRACE(L"PM timer calibration sample %d: %ld ticks per second",tc,samples[tc]);
+    if(samples[tc]+median/1000<median || samples[tc]>median+median/1000)
+      continue;
+    sum+=samples[tc];
+    used++;
+  }
+  LOG_TRACE(L"used %d of %d PM timer calibration samples",used,PM_TIMER_CALIBRATION_SAMPLES);
+  return sum/used;
+}
+
+/**
+ * internal: measures the timestamp frequency against a UEFI timer event.
+ * This is the slowest and least accurate method, it takes ~2 seconds and relies on the firmware's timer resolution.
+ *
+ * \return the measured timestamp ticks per second, or 0 on error
+ */
+static UINT64 _measure_against_uefi_timer()
 {
   EFI_STATUS result;
   EFI_EVENT event;
-  UINT64 start, end, diff;
+  UINT64 start, end;
   UINTN index;
 
   result=gST->BootServices->CreateEvent(EVT_TIMER,TPL_CALLBACK,NULL,NULL,&event);
-  ON_ERROR_RETURN(L"CreateEvent",-1);
+  ON_ERROR_RETURN(L"CreateEvent",0);
   result=gST->BootServices->SetTimer(event,TimerPeriodic,1000*1000*10);
-  ON_ERROR_RETURN(L"CreateEvent",-2);
+  ON_ERROR_RETURN(L"SetTimer",0);
   result=gST->BootServices->WaitForEvent(1,&event,&index);
-  ON_ERROR_RETURN(L"CreateEvent",-3);
+  ON_ERROR_RETURN(L"WaitForEvent",0);
 
   start=get_timestamp();
 
   result=gST->BootServices->WaitForEvent(1,&event,&index);
-  ON_ERROR_RETURN(L"CreateEvent",-4);
+  ON_ERROR_RETURN(L"WaitForEvent",0);
 
   end=get_timestamp();
-  diff=end-start;
-  _rdtsc_ticks_per_second=diff;
+  gST->BootServices->CloseEvent(event);
+
+  LOG_TRACE(L"start timestamp: %lX (%ld)",start,start);
+  LOG_TRACE(L"end timestamp: %lX (%ld)",end,end);
+  return end-start;
+}
+
+/**
+ * Initializes the timestamp features by determining the timestamp frequency.
+ * The frequency will be used later when converting ticks to seconds. These methods are tried in order:
+ *
+ *   1. CPUID leaf 0x15, if the CPU reports its crystal clock frequency: exact, and takes no time at all
+ *   2. several short measurements against the ACPI power management timer: takes ~40ms
+ *   3. CPUID leaf 0x16 base frequency, on CPUs with invariant timestamps: accurate to 1 MHz
+ *   4. a measurement against a 1 second UEFI timer: takes ~2 seconds
+ *
+ * Make sure to call this function before you attempt to determine elapsed wallclock time.
+ *
+ * \return 0 on success, an error code otherwise.
+ */
+int init_timestamps()
+{
+  UINT32 pm_timer_port, pm_timer_mask;
+  UINT64 frequency;
+  BOOLEAN invariant=timestamp_is_invariant();
 
-  LOG.trace(L"start timestamp: %lX (%ld)",start,start);
-  LOG.trace(L"end timestamp: %lX (%ld)",end,end);
-  LOG.trace(L"timestamp ticks per second: %lX (%s GHz)",diff,ftowcs(((double)diff)/1000000000));
+  if(!invariant)
+    LOG_DEBUG(L"timestamp counter isn't invariant, frequency may change with CPU power states");
+
+  if((frequency=_read_cpuid_tsc_frequency())!=0)
+    _calibration_method=TIMESTAMP_CALIBRATION_CPUID;
+  else if((pm_timer_port=_find_pm_timer(&pm_timer_mask))!=0
+          && (frequency=_measure_against_pm_timer(pm_timer_port,pm_timer_mask))!=0)
+    _calibration_method=TIMESTAMP_CALIBRATION_PM_TIMER;
+  else if(invariant && (frequency=_read_cpuid_base_frequency())!=0)
+    _calibration_method=TIMESTAMP_CALIBRATION_CPUID;
+  else if((frequency=_measure_against_uefi_timer())!=0)
+    _calibration_method=TIMESTAMP_CALIBRATION_UEFI_TIMER;
+  else
+  {
+    LOG.error(L"could not determine timestamp frequency");
+    return -1;
+  }
+
+  _rdtsc_ticks_per_second=frequency;
+  LOG_TRACE(L"timestamp ticks per second: %lX (%s GHz), calibration method %d",frequency,ftowcs(((double)frequency)/1000000000),_calibration_method);
 
   return 0;
 }
@@ -74,7 +329,7 @@ UINT64 get_timestamp()
   asm volatile ("rdtsc"
     :"=d" (rdx), "=a" (rax));
 #ifdef DEBUG_TIMESTAMPS
-  LOG.trace(L"rdx=%lX, rax=%lX",rdx,rax);
+  LOG_TRACE(L"rdx=%lX, rax=%lX",rdx,rax);
   if((rax>0xFFFFFFFF) || (rdx>0xFFFFFFFF))
   {
     LOG.error(L"expected 32bit values in rax and rdx, got a value exceeding that");
@@ -115,3 +370,67 @@ UINT64 get_timestamp_ticks_per_second()
 {
   return _rdtsc_ticks_per_second;
 }
+
+/**
+ * Returns the method the timestamp frequency was determined with.
+ *
+ * \return the calibration method, TIMESTAMP_CALIBRATION_NONE if init_timestamps() wasn't called yet
+ */
+timestamp_calibration_t get_timestamp_calibration_method()
+{
+  return _calibration_method;
+}
+
+/**
+ * Waits until the given timestamp is reached.
+ * Longer waits sleep on a UEFI timer event instead of keeping the CPU busy. Timer events tend to fire late, depending
+ * on the firmware's timer resolution, so this wakes up early by the recently observed delay and busy-waits for the
+ * remaining time.
+ *
+ * This will only work if init_timestamps() has been called first.
+ *
+ * \param deadline the timestamp to wait for
+ * \return EFI_SUCCESS once the deadline was reached, an error code otherwise
+ */
+EFI_STATUS wait_until_timestamp(UINT64 deadline)
+{
+  EFI_STATUS result;
+  EFI_EVENT event;
+  UINTN index;
+  UINT64 now=get_timestamp(), wakeup, delay, minimum_margin;
+
+  if(_rdtsc_ticks_per_second==0)
+  {
+    LOG.error(L"timestamp ticks per second unknown, most likely init_timestamps() wasn't called");
+    return EFI_NOT_READY;
+  }
+  minimum_margin=_rdtsc_ticks_per_second*WAIT_MINIMUM_MARGIN_US/1000000;
+  if(_wait_margin_ticks==0)
+    _wait_margin_ticks=_rdtsc_ticks_per_second*WAIT_INITIAL_MARGIN_US/1000000;
+
+  if(deadline>now+_wait_margin_ticks)
+  {
+    wakeup=deadline-_wait_margin_ticks;
+    result=gST->BootServices->CreateEvent(EVT_TIMER,0,NULL,NULL,&event);
+    ON_ERROR_RETURN(L"CreateEvent",result);
+    result=gST->BootServices->SetTimer(event,TimerRelative,(wakeup-now)*10000000/_rdtsc_ticks_per_second);
+    if(result==EFI_SUCCESS)
+      result=gST->BootServices->WaitForEvent(1,&event,&index);
+    gST->BootServices->CloseEvent(event);
+    ON_ERROR_RETURN(L"WaitForEvent",result);
+
+    //adapt to late wakeups immediately, but only slowly relax when the timer gets more punctual
+    now=get_timestamp();
+    delay=now>wakeup?now-wakeup:0;
+    if(delay>_wait_margin_ticks)
+      _wait_margin_ticks=delay;
+    else
+      _wait_margin_ticks-=(_wait_margin_ticks-delay)/8;
+    if(_wait_margin_ticks<minimum_margin)
+      _wait_margin_ticks=minimum_margin;
+  }
+
+  while(get_timestamp()<deadline)
+    asm volatile ("pause");
+  return EFI_SUCCESS;
+}
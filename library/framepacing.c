@@ -0,0 +1,235 @@
+/** \file
+ * Frame pacing and frame time statistics for animations
+ *
+ * \author Richard Nusser
+ * \copyright 2017-2018 Richard Nusser
+ * \license GPLv3 (see http://www.gnu.org/licenses/)
+ * \sa https://github.com/rinusser/UEFIStarter
+ * \ingroup group_lib_framepacing
+ */
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <UEFIStarter/framepacing.h>
+#include <UEFIStarter/core/timestamp.h>
+#include <UEFIStarter/core/logger.h>
+#include <UEFIStarter/core/string.h>
+
+
+/** maximum length of histogram bars printed by print_frame_statistics() */
+#define HISTOGRAM_BAR_LENGTH 50
+
+
+/**
+ * Discards all frame statistics, e.g. after loading screens.
+ *
+ * \param pacer the frame pacer to reset
+ */
+void reset_frame_statistics(frame_pacer_t *pacer)
+{
+  pacer->last_frame_ticks=0;
+  pacer->frame_count=0;
+  pacer->dropped_frames=0;
+  pacer->total_ticks=0;
+  pacer->min_ticks=0;
+  pacer->max_ticks=0;
+  ZeroMem(pacer->histogram,sizeof(pacer->histogram));
+}
+
+/**
+ * Initializes a frame pacer and starts the first frame.
+ * Timestamps will be initialized if they haven't been yet.
+ *
+ * \param pacer the frame pacer to initialize
+ * \param fps   the number of frames per second to pace to, 0 to only record frame times
+ * \return EFI_SUCCESS, or EFI_NOT_READY if timestamps couldn't be initialized
+ */
+EFI_STATUS init_frame_pacer(frame_pacer_t *pacer, UINT64 fps)
+{
+  UINT64 ticks_per_second=get_timestamp_ticks_per_second();
+
+  if(ticks_per_second==0)
+  {
+    if(init_timestamps()!=0)
+      return EFI_NOT_READY;
+    ticks_per_second=get_timestamp_ticks_per_second();
+  }
+
+  reset_frame_statistics(pacer);
+  pacer->budget_ticks=fps>0?ticks_per_second/fps:0;
+  pacer->ticks_per_ms=ticks_per_second/1000;
+  pacer->frame_start=get_timestamp();
+  pacer->deadline=pacer->frame_start+pacer->budget_ticks;
+  return EFI_SUCCESS;
+}
+
+/**
+ * Returns how much of the current frame's budget is left.
+ * Use this e.g. to decide whether there's enough time left for optional work.
+ *
+ * \param pacer the frame pacer to query
+ * \return the remaining time until the frame's deadline in timestamp ticks, 0 if the deadline already passed or there
+ *         is no frame limit
+ */
+UINT64 get_frame_budget_remaining_ticks(frame_pacer_t *pacer)
+{
+  UINT64 now=get_timestamp();
+
+  if(pacer->budget_ticks==0 || now>=pacer->deadline)
+    return 0;
+  return pacer->deadline-now;
+}
+
+/**
+ * Records a frame time in the pacer's statistics.
+ * end_frame() calls this automatically, you only need this to record frame times measured elsewhere.
+ *
+ * \param pacer the frame pacer to record the frame time in
+ * \param ticks the frame's duration, in timestamp ticks
+ */
+void record_frame_time(frame_pacer_t *pacer, UINT64 ticks)
+{
+  UINT64 bucket;
+
+  if(pacer->frame_count==0 || ticks<pacer->min_ticks)
+    pacer->min_ticks=ticks;
+  if(ticks>pacer->max_ticks)
+    pacer->max_ticks=ticks;
+  pacer->last_frame_ticks=ticks;
+  pacer->total_ticks+=ticks;
+  pacer->frame_count++;
+
+  bucket=pacer->ticks_per_ms>0?ticks/pacer->ticks_per_ms/FRAME_HISTOGRAM_BUCKET_MS:0;
+  if(bucket>=FRAME_HISTOGRAM_BUCKETS)
+    bucket=FRAME_HISTOGRAM_BUCKETS-1;
+  pacer->histogram[bucket]++;
+}
+
+/**
+ * Ends the current frame: waits for the frame's deadline, records the frame time and starts the next frame.
+ * If the deadline already passed, the missed frames are counted as dropped and the next deadline is scheduled one
+ * frame budget from now.
+ *
+ * \param pacer the frame pacer to use
+ * \return EFI_SUCCESS, or an error code if waiting failed
+ */
+EFI_STATUS end_frame(frame_pacer_t *pacer)
+{
+  EFI_STATUS result;
+  UINT64 now=get_timestamp();
+
+  if(pacer->budget_ticks>0)
+  {
+    if(now<pacer->deadline)
+    {
+      result=wait_until_timestamp(pacer->deadline);
+      if(result!=EFI_SUCCESS)
+        return result;
+      now=get_timestamp();
+      pacer->deadline+=pacer->budget_ticks;
+    }
+    else
+    {
+      pacer->dropped_frames+=(now-pacer->deadline)/pacer->budget_ticks+1;
+      pacer->deadline=now+pacer->budget_ticks;
+    }
+  }
+
+  record_frame_time(pacer,now-pacer->frame_start);
+  pacer->frame_start=now;
+  return EFI_SUCCESS;
+}
+
+/**
+ * Returns the previous frame's time.
+ *
+ * \param pacer the frame pacer to query
+ * \return the previous frame's time in milliseconds, 0 if there wasn't a frame yet
+ */
+double get_last_frame_ms(frame_pacer_t *pacer)
+{
+  if(pacer->ticks_per_ms==0)
+    return 0;
+  return ((double)pacer->last_frame_ticks)/pacer->ticks_per_ms;
+}
+
+/**
+ * Returns the average frame time.
+ *
+ * \param pacer the frame pacer to query
+ * \return the average frame time in milliseconds, 0 if there wasn't a frame yet
+ */
+double get_average_frame_ms(frame_pacer_t *pacer)
+{
+  if(pacer->frame_count==0 || pacer->ticks_per_ms==0)
+    return 0;
+  return ((double)pacer->total_ticks)/pacer->frame_count/pacer->ticks_per_ms;
+}
+
+/**
+ * Estimates a frame time percentile from the histogram, e.g. use 99 to get the time 99% of frames finished within.
+ * The result is the upper bound of the histogram bucket the percentile falls into.
+ *
+ * \param pacer      the frame pacer to query
+ * \param percentile the percentile to get, between 1 and 100
+ * \return the percentile's frame time in milliseconds, 0 if there wasn't a frame yet
+ */
+double get_frame_time_percentile_ms(frame_pacer_t *pacer, UINTN percentile)
+{
+  UINT64 rank, sum=0;
+  UINTN tc;
+
+  if(pacer->frame_count==0)
+    return 0;
+  rank=(pacer->frame_count*percentile+99)/100;
+  for(tc=0;tc<FRAME_HISTOGRAM_BUCKETS-1;tc++)
+  {
+    sum+=pacer->histogram[tc];
+    if(sum>=rank)
+      break;
+  }
+  if(tc==FRAME_HISTOGRAM_BUCKETS-1)
+    return ((double)pacer->max_ticks)/pacer->ticks_per_ms;
+  return (tc+1)*FRAME_HISTOGRAM_BUCKET_MS;
+}
+
+/**
+ * Prints a frame pacer's statistics and frame time histogram.
+ *
+ * \param pacer the frame pacer to print
+ */
+void print_frame_statistics(frame_pacer_t *pacer)
+{
+  UINTN tc, td, bar;
+  UINT32 max_count=0;
+  CHAR16 bar_str[HISTOGRAM_BAR_LENGTH+1];
+
+  if(pacer->frame_count==0)
+  {
+    Print(L"no frames recorded\n");
+    return;
+  }
+
+  Print(L"frames: %ld, dropped: %ld\n",pacer->frame_count,pacer->dropped_frames);
+  Print(L"frame time [ms]: average %s, min %s, max %s, p99 %s\n",
+      ftowcs(get_average_frame_ms(pacer)),ftowcs(((double)pacer->min_ticks)/pacer->ticks_per_ms),
+      ftowcs(((double)pacer->max_ticks)/pacer->ticks_per_ms),ftowcs(get_frame_time_percentile_ms(pacer,99)));
+
+  for(tc=0;tc<FRAME_HISTOGRAM_BUCKETS;tc++)
+    if(pacer->histogram[tc]>max_count)
+      max_count=pacer->histogram[tc];
+  for(tc=0;tc<FRAME_HISTOGRAM_BUCKETS;tc++)
+  {
+    if(pacer->histogram[tc]==0)
+      continue;
+    bar=((UINT64)pacer->histogram[tc])*HISTOGRAM_BAR_LENGTH/max_count;
+    for(td=0;td<bar;td++)
+      bar_str[td]=L'#';
+    bar_str[bar]=0;
+    if(tc<FRAME_HISTOGRAM_BUCKETS-1)
+      Print(L"%3d-%3dms %6d %s\n",tc*FRAME_HISTOGRAM_BUCKET_MS,(tc+1)*FRAME_HISTOGRAM_BUCKET_MS,pacer->histogram[tc],bar_str);
+    else
+      Print(L"  >=%3dms %6d %s\n",tc*FRAME_HISTOGRAM_BUCKET_MS,pacer->histogram[tc],bar_str);
+  }
+}
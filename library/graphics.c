@@ -17,6 +17,7 @@
 #include <UEFIStarter/core/logger.h>
 #include <UEFIStarter/core/cmdline.h>
 #include <UEFIStarter/core/timestamp.h>
+#include <UEFIStarter/core/profiler.h>
 #include <UEFIStarter/core/string.h>
 
 
@@ -176,6 +177,7 @@ static void _parse_pbm_pixel_data(char *in, EFI_GRAPHICS_OUTPUT_BLT_PIXEL *out,
 
 /**
  * Allocates and initializes an image
+ * Images loaded with load_image_manifest() share a single allocation instead, their memory_pages is 0.
  *
  * \param width  the image's width
  * \param height the image's height
@@ -196,67 +198,122 @@ image_t *create_image(INTN width, INTN height)
   return image;
 }
 
+/** internal: data type for parsed netpbm headers */
+typedef struct
+{
+  UINTN width;                         /**< the image's width, in pixels */
+  UINTN height;                        /**< the image's height, in pixels */
+  UINTN data_offset;                   /**< the pixel data's offset within the file */
+  UINTN data_length;                   /**< the pixel data's length, in bytes */
+  netpbm_pixel_parser_f *pixel_parser; /**< the pixel parser for the image's format */
+} netpbm_header_t;
+
+/**
+ * internal: skips whitespace and comments between netpbm header fields.
+ *
+ * \param data   the file contents
+ * \param length the file contents' length, in bytes
+ * \param pos    the current position, will be moved to the next field
+ * \return whether there's data left after the skipped characters
+ */
+static BOOLEAN _skip_netpbm_separators(char *data, UINTN length, UINTN *pos)
+{
+  while(*pos<length)
+  {
+    if(data[*pos]=='#')
+      while(*pos<length && data[*pos]!='\n')
+        (*pos)++;
+    else if(ctype_whitespace(data[*pos]))
+      (*pos)++;
+    else
+      return TRUE;
+  }
+  return FALSE;
+}
+
+/**
+ * internal: parses a netpbm file's header.
+ * The file contents aren't modified, so this works on partially read files too.
+ *
+ * \param data   the file contents to parse
+ * \param length the file contents' length, in bytes
+ * \param header output: the parsed header
+ * \return whether the header was valid
+ */
+static BOOLEAN _parse_netpbm_header(char *data, UINTN length, netpbm_header_t *header)
+{
+  UINTN pos=2, field, field_count=3, digits;
+  UINT64 values[3];
+
+  if(length<3 || data[0]!='P')
+    return FALSE;
+  switch(data[1])
+  {
+    case '4': header->pixel_parser=_parse_pbm_pixel_data; field_count=2; break;
+    case '5': header->pixel_parser=_parse_pgm_pixel_data; break;
+    case '6': header->pixel_parser=_parse_ppm_pixel_data; break;
+    default:  return FALSE;
+  }
+
+  for(field=0;field<field_count;field++)
+  {
+    if(!_skip_netpbm_separators(data,length,&pos))
+      return FALSE;
+    values[field]=0;
+    for(digits=0;pos<length && data[pos]>='0' && data[pos]<='9' && digits<9;pos++,digits++)
+      values[field]=values[field]*10+data[pos]-'0';
+    if(digits==0)
+      return FALSE;
+  }
+  //XXX ignoring maxval
+
+  //exactly one whitespace character separates the header from pixel data
+  if(pos>=length || !ctype_whitespace(data[pos]))
+    return FALSE;
+
+  header->width=values[0];
+  header->height=values[1];
+  header->data_offset=pos+1;
+  if(header->width==0 || header->height==0)
+    return FALSE;
+  LOG_DEBUG(L"width=%d, height=%d",header->width,header->height);
+
+  switch(data[1])
+  {
+    case '4': header->data_length=((header->width-1)/8+1)*header->height; break;
+    case '5': header->data_length=header->width*header->height; break;
+    default:  header->data_length=header->width*header->height*3;
+  }
+  return TRUE;
+}
+
 /**
  * internal: parses netpbm file contents into an image
  *
- * \param contents the file contents to parse
- * \param pixel_parser the pixel parser function to use
+ * \param contents    the file contents to parse
  * \param magic_digit the file's expected netpbm magic digit (indicates pixel format)
- * \param has_maxval_row whether the file has a row indicating pixels' maximum values
  * \return the parsed image, or NULL on error
  */
-static image_t *_parse_netpbm_image_data(file_contents_t *contents, netpbm_pixel_parser_f *pixel_parser, char magic_digit, char has_maxval_row)
+static image_t *_parse_netpbm_image_data(file_contents_t *contents, char magic_digit)
 {
+  netpbm_header_t header;
   image_t *image;
 
-  unsigned int start;
-  UINT64 tc;
-  unsigned int width, height;
-  char *data=contents->data;
-  unsigned int length=contents->data_length;
-
-  LOG.debug(L"data length: %d",length);
-//  DumpHex(2,(UINT64)data,length>256?256:length,data);
-  if(data[0]!='P' || data[1]!=magic_digit || !ctype_whitespace(data[2]))
+  LOG_DEBUG(L"data length: %d",contents->data_length);
+  if(contents->data_length<2 || contents->data[1]!=magic_digit || !_parse_netpbm_header(contents->data,contents->data_length,&header))
   {
-    LOG.error(L"data doesn't start with PPM magic value");
+    LOG.error(L"data doesn't start with a valid netpbm P%c header",magic_digit);
     return NULL;
   }
-  start=3;
-  while(ctype_whitespace(data[start]))
-    start++;
-  if(data[start]=='#')
-    while(data[start]!='\n')
-      start++;
-  start++;
-  for(tc=start;tc<length;tc++)
-    if(ctype_whitespace(data[tc]))
-      break;
-  data[tc]=0;
-  width=atoui64(data+start);
-  start=tc+1;
-  for(tc=start;tc<length;tc++)
-    if(ctype_whitespace(data[tc]))
-      break;
-  data[tc]=0;
-  height=atoui64(data+start);
-  LOG.debug(L"width=%d, height=%d",width,height);
-  start=tc+1;
-
-  //XXX ignoring maxval
-
-  if(has_maxval_row)
+  if(header.data_offset+header.data_length>contents->data_length)
   {
-    LOG.debug(L"skipping maxval row");
-    for(tc=start;tc<length;tc++)
-      if(ctype_whitespace(data[tc]))
-        break;
-    start=tc+1;
+    LOG.error(L"image data is truncated");
+    return NULL;
   }
 
-  image=create_image(width,height);
+  image=create_image(header.width,header.height);
   if(image)
-    pixel_parser(&data[start],image->data,width*height,width);
+    header.pixel_parser(contents->data+header.data_offset,image->data,header.width*header.height,header.width);
   return image;
 }
 
@@ -268,7 +325,8 @@ static image_t *_parse_netpbm_image_data(file_contents_t *contents, netpbm_pixel
  */
 image_t *parse_ppm_image_data(file_contents_t *contents)
 {
-  return _parse_netpbm_image_data(contents,_parse_ppm_pixel_data,'6',1);
+  PROFILE_SCOPE(L"parse_ppm_image_data");
+  return _parse_netpbm_image_data(contents,'6');
 }
 
 /**
@@ -279,7 +337,8 @@ image_t *parse_ppm_image_data(file_contents_t *contents)
  */
 image_t *parse_pgm_image_data(file_contents_t *contents)
 {
-  return _parse_netpbm_image_data(contents,_parse_pgm_pixel_data,'5',1);
+  PROFILE_SCOPE(L"parse_pgm_image_data");
+  return _parse_netpbm_image_data(contents,'5');
 }
 
 /**
@@ -290,7 +349,8 @@ image_t *parse_pgm_image_data(file_contents_t *contents)
  */
 image_t *parse_pbm_image_data(file_contents_t *contents)
 {
-  return _parse_netpbm_image_data(contents,_parse_pbm_pixel_data,'4',0);
+  PROFILE_SCOPE(L"parse_pbm_image_data");
+  return _parse_netpbm_image_data(contents,'4');
 }
 
 
@@ -505,6 +565,54 @@ image_t *load_netpbm_file(CHAR16 *filename)
   return loader(filename);
 }
 
+/**
+ * Saves an image as binary PPM file, replacing the file if it already exists.
+ * Pixels are converted in chunks of PPM_SAVE_CHUNK_PIXELS and written through a buffered file writer.
+ *
+ * \param image    the image to save
+ * \param filename the file's full path within the boot volume, e.g. "\\screenshot.ppm"
+ * \return EFI_SUCCESS, or an error code
+ */
+EFI_STATUS save_ppm_image(image_t *image, CHAR16 *filename)
+{
+  file_writer_t writer;
+  CHAR8 rgb[3*PPM_SAVE_CHUNK_PIXELS];
+  EFI_GRAPHICS_OUTPUT_BLT_PIXEL *pixel;
+  UINTN tc, count, remaining;
+  EFI_STATUS result;
+
+  if(image==NULL)
+  {
+    LOG.error(L"asked to save NULL image");
+    return EFI_INVALID_PARAMETER;
+  }
+  if((result=open_file_writer(&writer,filename,0))!=EFI_SUCCESS)
+  {
+    LOG.error(L"could not create image file %s: %r",filename,result);
+    return result;
+  }
+
+  write_file_format(&writer,"P6\n%d %d\n255\n",image->width,image->height);
+  pixel=image->data;
+  for(remaining=(UINTN)image->width*image->height;remaining>0;remaining-=count)
+  {
+    count=remaining<PPM_SAVE_CHUNK_PIXELS?remaining:PPM_SAVE_CHUNK_PIXELS;
+    for(tc=0;tc<count;tc++,pixel++)
+    {
+      rgb[tc*3]=pixel->Red;
+      rgb[tc*3+1]=pixel->Green;
+      rgb[tc*3+2]=pixel->Blue;
+    }
+    if(write_file_chunk(&writer,rgb,count*3)!=EFI_SUCCESS)
+      break;
+  }
+
+  result=close_file_writer(&writer);
+  if(result!=EFI_SUCCESS)
+    LOG.error(L"could not write image file %s: %r",filename,result);
+  return result;
+}
+
 /**
  * Frees an image resource.
  *
@@ -517,6 +625,11 @@ void free_image(image_t *image)
     LOG.error(L"asked to free NULL image");
     return;
   }
+  if(image->memory_pages==0)
+  {
+    LOG.error(L"asked to free image of a manifest, use free_image_manifest() instead");
+    return;
+  }
   free_pages(image,image->memory_pages);
 }
 
@@ -549,6 +662,207 @@ void free_image_assets(UINTN count, image_asset_t *assets)
       free_image(*assets[tc].image);
 }
 
+/**
+ * internal: calculates an image's size within a manifest's memory, keeping images 8-byte aligned.
+ *
+ * \param header the image's netpbm header
+ * \return the image's size, in bytes
+ */
+static UINTN _manifest_image_size(netpbm_header_t *header)
+{
+  return (sizeof(image_t)+header->width*header->height*sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL)+7)&~(UINTN)7;
+}
+
+/**
+ * internal: reads just the header of a netpbm file.
+ *
+ * \param filename the image's filename
+ * \param header   output: the parsed header
+ * \return whether the header was read and valid
+ */
+static BOOLEAN _read_netpbm_header(CHAR16 *filename, netpbm_header_t *header)
+{
+  char buffer[NETPBM_HEADER_PEEK_SIZE];
+  UINTN size=sizeof(buffer);
+  EFI_FILE_HANDLE file;
+  EFI_STATUS result;
+
+  if((file=find_file(filename))==NULL)
+    return FALSE;
+  result=file->Read(file,&size,buffer);
+  file->Close(file);
+  return result==EFI_SUCCESS && _parse_netpbm_header(buffer,size,header);
+}
+
+/**
+ * internal: decodes an image into the next free part of a manifest's memory.
+ *
+ * \param manifest the manifest to decode into
+ * \param asset    the asset to decode
+ * \param contents the asset file's contents
+ * \param offset   the next free byte in the manifest's memory, will be moved past the decoded image
+ * \return the decoded image, or NULL on error
+ */
+static image_t *_decode_manifest_image(image_manifest_t *manifest, image_asset_t *asset, file_contents_t *contents, UINTN *offset)
+{
+  netpbm_header_t header;
+  image_t *image;
+  UINTN size;
+
+  if(!_parse_netpbm_header(contents->data,contents->data_length,&header) || header.data_offset+header.data_length>contents->data_length)
+  {
+    LOG.error(L"invalid netpbm file '%s'",asset->filename);
+    return NULL;
+  }
+  size=_manifest_image_size(&header);
+  if(*offset+size>manifest->arena_pages*4096)
+  {
+    LOG.error(L"'%s' changed while loading",asset->filename);
+    return NULL;
+  }
+
+  image=(image_t *)((UINT8 *)manifest->arena+*offset);
+  image->memory_pages=0;
+  image->width=header.width;
+  image->height=header.height;
+  header.pixel_parser(contents->data+header.data_offset,image->data,header.width*header.height,header.width);
+  *offset+=size;
+  return image;
+}
+
+/**
+ * Loads a manifest of image assets into a single memory allocation.
+ * All headers are read first to size the allocation; after that each file is read in the background while the
+ * previous one is decoded, and each file's contents are freed right after decoding. Assets that couldn't be loaded
+ * are set to NULL.
+ *
+ * The manifest's images must not be freed individually, use free_image_manifest() to free all of them at once.
+ *
+ * \param manifest the manifest to initialize
+ * \param count    the number of assets to load
+ * \param assets   the list of assets to load, their load statistics get updated
+ * \return EFI_SUCCESS if all assets were loaded, EFI_NOT_FOUND if any failed, or another error code
+ */
+EFI_STATUS load_image_manifest(image_manifest_t *manifest, UINTN count, image_asset_t *assets)
+{
+  async_read_t reads[2];
+  netpbm_header_t header;
+  file_contents_t *contents;
+  UINTN tc, offset=0, total=0, loaded=0;
+  UINT64 start=get_timestamp(), timestamp;
+  PROFILE_SCOPE(L"load_image_manifest");
+
+  manifest->count=count;
+  manifest->assets=assets;
+  manifest->arena=NULL;
+  manifest->arena_pages=0;
+  manifest->total_file_bytes=0;
+  manifest->total_ticks=0;
+
+  for(tc=0;tc<count;tc++)
+  {
+    *assets[tc].image=NULL;
+    assets[tc].file_bytes=0;
+    assets[tc].read_ticks=0;
+    assets[tc].decode_ticks=0;
+    if(_read_netpbm_header(assets[tc].filename,&header))
+      total+=_manifest_image_size(&header);
+    else
+      LOG.warn(L"could not read netpbm header of '%s'",assets[tc].filename);
+  }
+  if(total==0)
+    return EFI_NOT_FOUND;
+
+  manifest->arena_pages=(total-1)/4096+1;
+  if((manifest->arena=allocate_pages(manifest->arena_pages))==NULL)
+  {
+    manifest->arena_pages=0;
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  start_async_read(reads,assets[0].filename);
+  for(tc=0;tc<count;tc++)
+  {
+    if(tc+1<count)
+      start_async_read(reads+(tc+1)%2,assets[tc+1].filename);
+
+    timestamp=get_timestamp();
+    contents=finish_async_read(reads+tc%2);
+    assets[tc].read_ticks=get_timestamp()-timestamp;
+    if(!contents)
+      continue;
+    assets[tc].file_bytes=contents->data_length;
+    manifest->total_file_bytes+=contents->data_length;
+
+    timestamp=get_timestamp();
+    *assets[tc].image=_decode_manifest_image(manifest,assets+tc,contents,&offset);
+    assets[tc].decode_ticks=get_timestamp()-timestamp;
+    free_pages(contents,contents->memory_pages);
+    if(*assets[tc].image)
+      loaded++;
+  }
+
+  manifest->total_ticks=get_timestamp()-start;
+  LOG_DEBUG(L"loaded %d of %d assets, %ld bytes",loaded,count,manifest->total_file_bytes);
+  return loaded==count?EFI_SUCCESS:EFI_NOT_FOUND;
+}
+
+/**
+ * Frees all images of a manifest.
+ *
+ * \param manifest the manifest to free
+ */
+void free_image_manifest(image_manifest_t *manifest)
+{
+  UINTN tc;
+
+  if(manifest->arena)
+    free_pages(manifest->arena,manifest->arena_pages);
+  manifest->arena=NULL;
+  manifest->arena_pages=0;
+  for(tc=0;tc<manifest->count;tc++)
+    *manifest->assets[tc].image=NULL;
+}
+
+/**
+ * internal: formats a duration in milliseconds.
+ *
+ * \param buffer the target buffer, at least NUMBER_STRING_LENGTH characters long
+ * \param ticks  the duration, in timestamp ticks
+ * \return the target buffer
+ */
+static CHAR16 *_format_ms(CHAR16 *buffer, UINT64 ticks)
+{
+  UINT64 ticks_per_second=get_timestamp_ticks_per_second();
+
+  if(ticks_per_second==0 || double_to_wcs(buffer,NUMBER_STRING_LENGTH,((double)ticks)*1000/ticks_per_second,2)==0)
+    StrCpyS(buffer,NUMBER_STRING_LENGTH,L"?");
+  return buffer;
+}
+
+/**
+ * Prints the file size and load times of each asset in a manifest, and the totals.
+ * Times are only available after init_timestamps() was called.
+ *
+ * \param manifest the loaded manifest
+ */
+void print_image_manifest_report(image_manifest_t *manifest)
+{
+  CHAR16 read_ms[NUMBER_STRING_LENGTH];
+  CHAR16 decode_ms[NUMBER_STRING_LENGTH];
+  image_asset_t *asset;
+  UINTN tc;
+
+  for(tc=0;tc<manifest->count;tc++)
+  {
+    asset=manifest->assets+tc;
+    Print(L"%s: %ld bytes, read %sms, decoded %sms%s\n",asset->filename,asset->file_bytes,_format_ms(read_ms,asset->read_ticks),
+          _format_ms(decode_ms,asset->decode_ticks),*asset->image?L"":L" (failed)");
+  }
+  Print(L"%d assets, %ld bytes in %ld pages, loaded in %sms\n",manifest->count,manifest->total_file_bytes,manifest->arena_pages,
+        _format_ms(read_ms,manifest->total_ticks));
+}
+
 
 /**********
  * General
@@ -616,7 +930,7 @@ EFI_GRAPHICS_OUTPUT_PROTOCOL *get_graphics_protocol()
   result=gST->BootServices->LocateHandle(ByProtocol,&gop_guid,NULL,&handles_size,(void **)&handles);
   ON_ERROR_RETURN(L"LocateHandle",NULL);
   handle_count=handles_size/sizeof(EFI_HANDLE);
-  LOG.debug(L"handles size: %d bytes (%d entries)",handles_size,handle_count);
+  LOG_DEBUG(L"handles size: %d bytes (%d entries)",handles_size,handle_count);
 
   if(handle_count<=ARG_DISPLAY)
   {
@@ -624,7 +938,7 @@ EFI_GRAPHICS_OUTPUT_PROTOCOL *get_graphics_protocol()
     return NULL;
   }
 
-  LOG.trace(L"handle: %16lX",handles[ARG_DISPLAY]);
+  LOG_TRACE(L"handle: %16lX",handles[ARG_DISPLAY]);
   result=gST->BootServices->OpenProtocol(handles[ARG_DISPLAY],&gop_guid,(void **)&gop,gImageHandle,NULL,EFI_OPEN_PROTOCOL_BY_HANDLE_PROTOCOL);
   ON_ERROR_RETURN(L"OpenProtocol",NULL);
   return gop;
@@ -897,22 +1211,17 @@ void wait_vsync()
  * This works by keeping track of timestamps: a given number of ticks needs to have elapsed between frames. If vsync is
  * enabled this function additionally waits for the next vsync event.
  *
+ * For frame time statistics and deadline tracking use the frame pacer instead.
+ *
  * \param previous            the previous timestamp value, will be updated when done waiting
  * \param minimum_frame_ticks the number of ticks that must have elapsed since the previous timestamp
  * \return TRUE on success, FALSE otherwise
  */
 BOOLEAN limit_framerate(UINT64 *previous, UINT64 minimum_frame_ticks)
 {
-  EFI_STATUS result;
-  UINT64 current=get_timestamp();
-
-  while(current-*previous<minimum_frame_ticks)
-  {
-    result=gBS->Stall(500);
-    ON_ERROR_RETURN(L"Stall",FALSE);
-    current=get_timestamp();
-  }
-  *previous=current;
+  if(wait_until_timestamp(*previous+minimum_frame_ticks)!=EFI_SUCCESS)
+    return FALSE;
+  *previous=get_timestamp();
   wait_vsync();
   return TRUE;
 }
@@ -951,6 +1260,7 @@ void free_graphics_fs_buffer(void *addr)
  */
 EFI_STATUS graphics_fs_blt(GFX_BUFFER buffer)
 {
+  PROFILE_SCOPE(L"graphics_fs_blt");
   return graphics_protocol->Blt(graphics_protocol,buffer,EfiBltBufferToVideo,0,0,0,0,graphics_fs_width,graphics_fs_height,0);
 }
 
@@ -0,0 +1,266 @@
+/** \file
+ * Wavetable oscillators for generating audio samples
+ *
+ * \author Richard Nusser
+ * \copyright 2017-2018 Richard Nusser
+ * \license GPLv3 (see http://www.gnu.org/licenses/)
+ * \sa https://github.com/rinusser/UEFIStarter
+ * \ingroup group_lib_oscillator
+ */
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <UEFIStarter/oscillator.h>
+#include <UEFIStarter/core/logger.h>
+
+
+/** internal storage for wavetables, generated on first use */
+static INT16 _wavetables[WAVEFORM_COUNT][OSCILLATOR_TABLE_SIZE];
+
+/** whether the wavetables have been generated already */
+static BOOLEAN _wavetables_initialized=FALSE;
+
+
+/**
+ * Calculates sin(x) for x within [-pi/2..pi/2] with a Taylor series.
+ * This is only used to generate the sine wavetable, so the library doesn't need to depend on a math library.
+ *
+ * \param x the angle, in radians
+ * \return sin(x)
+ */
+static double _sine(double x)
+{
+  double x2=x*x;
+  return x*(1-x2/6*(1-x2/20*(1-x2/42*(1-x2/72*(1-x2/110*(1-x2/156))))));
+}
+
+/**
+ * Generates all wavetables.
+ */
+static void _init_wavetables()
+{
+  const double pi=3.14159265358979323846;
+  UINTN tc;
+  double x;
+
+  for(tc=0;tc<OSCILLATOR_TABLE_SIZE;tc++)
+  {
+    x=2*pi*tc/OSCILLATOR_TABLE_SIZE;
+    if(x>pi/2 && x<=3*pi/2)
+      x=pi-x;
+    else if(x>3*pi/2)
+      x-=2*pi;
+    _wavetables[WAVEFORM_SINE][tc]=(INT16)(_sine(x)*OSCILLATOR_MAX_AMPLITUDE);
+
+    _wavetables[WAVEFORM_SQUARE][tc]=tc<OSCILLATOR_TABLE_SIZE/2?OSCILLATOR_MAX_AMPLITUDE:-OSCILLATOR_MAX_AMPLITUDE;
+
+    _wavetables[WAVEFORM_SAWTOOTH][tc]=(INT16)((INT32)(tc*65536/OSCILLATOR_TABLE_SIZE)-32768);
+
+    if(tc<OSCILLATOR_TABLE_SIZE/4)
+      _wavetables[WAVEFORM_TRIANGLE][tc]=(INT16)((INT32)tc*4*OSCILLATOR_MAX_AMPLITUDE/OSCILLATOR_TABLE_SIZE);
+    else if(tc<OSCILLATOR_TABLE_SIZE*3/4)
+      _wavetables[WAVEFORM_TRIANGLE][tc]=(INT16)(2*OSCILLATOR_MAX_AMPLITUDE-(INT32)tc*4*OSCILLATOR_MAX_AMPLITUDE/OSCILLATOR_TABLE_SIZE);
+    else
+      _wavetables[WAVEFORM_TRIANGLE][tc]=(INT16)((INT32)tc*4*OSCILLATOR_MAX_AMPLITUDE/OSCILLATOR_TABLE_SIZE-4*OSCILLATOR_MAX_AMPLITUDE);
+  }
+  _wavetables_initialized=TRUE;
+}
+
+/**
+ * Returns the wavetable for the given waveform, generating wavetables if necessary.
+ *
+ * \param waveform the waveform to get
+ * \return the wavetable with OSCILLATOR_TABLE_SIZE entries, or NULL if the waveform is invalid
+ */
+const INT16 *get_wavetable(waveform_t waveform)
+{
+  if(waveform>=WAVEFORM_COUNT)
+  {
+    LOG.error(L"invalid waveform %d",waveform);
+    return NULL;
+  }
+  if(!_wavetables_initialized)
+    _init_wavetables();
+  return _wavetables[waveform];
+}
+
+
+/**
+ * Calculates the fixed-point phase increment for a frequency.
+ *
+ * \param frequency   the frequency to generate, in Hz
+ * \param sample_rate the output sample rate, in Hz
+ * \return the phase increment per sample, 0 if the frequency can't be generated at this sample rate
+ */
+UINT32 oscillator_phase_increment(double frequency, UINT32 sample_rate)
+{
+  if(sample_rate==0 || frequency<0 || frequency*2>=sample_rate)
+    return 0;
+  return (UINT32)(frequency*4294967296.0/sample_rate+0.5);
+}
+
+/**
+ * Sets an oscillator's frequency without resetting its phase, so frequency changes don't click.
+ *
+ * \param osc         the oscillator to change
+ * \param frequency   the frequency to generate, in Hz
+ * \param sample_rate the output sample rate, in Hz
+ * \return EFI_SUCCESS, or EFI_INVALID_PARAMETER if the frequency is at or above the Nyquist frequency
+ */
+EFI_STATUS set_oscillator_frequency(oscillator_t *osc, double frequency, UINT32 sample_rate)
+{
+  UINT32 increment;
+
+  increment=oscillator_phase_increment(frequency,sample_rate);
+  if(increment==0 && frequency!=0)
+  {
+    LOG.error(L"can't generate frequency %d Hz at sample rate %d Hz",(INT32)frequency,sample_rate);
+    return EFI_INVALID_PARAMETER;
+  }
+  osc->increment=increment;
+  return EFI_SUCCESS;
+}
+
+/**
+ * Initializes an oscillator.
+ *
+ * \param osc         the oscillator to initialize
+ * \param waveform    the waveform to generate
+ * \param frequency   the frequency to generate, in Hz
+ * \param sample_rate the output sample rate, in Hz
+ * \param amplitude   the peak amplitude, up to OSCILLATOR_MAX_AMPLITUDE
+ * \return EFI_SUCCESS, or EFI_INVALID_PARAMETER if any input is invalid
+ */
+EFI_STATUS init_oscillator(oscillator_t *osc, waveform_t waveform, double frequency, UINT32 sample_rate, UINT32 amplitude)
+{
+  EFI_STATUS result;
+
+  if(amplitude>OSCILLATOR_MAX_AMPLITUDE)
+  {
+    LOG.error(L"amplitude %d exceeds maximum of %d",amplitude,OSCILLATOR_MAX_AMPLITUDE);
+    return EFI_INVALID_PARAMETER;
+  }
+  if((osc->table=get_wavetable(waveform))==NULL)
+    return EFI_INVALID_PARAMETER;
+
+  result=set_oscillator_frequency(osc,frequency,sample_rate);
+  if(result!=EFI_SUCCESS)
+    return result;
+
+  osc->amplitude=amplitude;
+  osc->attack_samples=0;
+  restart_oscillator(osc);
+  return EFI_SUCCESS;
+}
+
+/**
+ * Sets the length of an oscillator's linear attack ramp.
+ * The ramp starts at the next generated sample.
+ *
+ * \param osc     the oscillator to change
+ * \param samples the ramp's length in samples, 0 to disable
+ */
+void set_oscillator_attack(oscillator_t *osc, UINT32 samples)
+{
+  osc->attack_samples=samples;
+  osc->attack_position=0;
+}
+
+/**
+ * Resets an oscillator's phase and attack ramp, e.g. to start a new note.
+ *
+ * \param osc the oscillator to reset
+ */
+void restart_oscillator(oscillator_t *osc)
+{
+  osc->phase=0;
+  osc->attack_position=0;
+}
+
+
+/**
+ * Writes oscillator output into a signed 16 bit sample buffer.
+ * The stride allows writing single channels of interleaved buffers, e.g. use a stride of 2 and a buffer offset of 1
+ * to fill the right channel of a stereo buffer.
+ *
+ * \param osc    the oscillator to sample
+ * \param buffer the buffer to write to
+ * \param count  the number of samples to generate
+ * \param stride the distance between consecutive samples in the buffer, in samples
+ */
+void oscillator_fill_s16(oscillator_t *osc, INT16 *buffer, UINTN count, UINTN stride)
+{
+  const INT16 *table=osc->table;
+  UINT32 phase=osc->phase;
+  UINT32 increment=osc->increment;
+  INT32 amplitude=osc->amplitude;
+  UINT32 envelope_step;
+  UINTN tc=0;
+
+  //attack ramp: only the first few samples of a note need the extra multiplication
+  if(osc->attack_position<osc->attack_samples)
+  {
+    envelope_step=(amplitude<<16)/osc->attack_samples;
+    for(;tc<count && osc->attack_position<osc->attack_samples;tc++,osc->attack_position++)
+    {
+      buffer[tc*stride]=(table[phase>>OSCILLATOR_PHASE_SHIFT]*(INT32)((osc->attack_position*envelope_step)>>16))>>15;
+      phase+=increment;
+    }
+  }
+
+  //steady state: branch-free, unrolled to let the compiler interleave lookups
+  buffer+=tc*stride;
+  for(;tc+4<=count;tc+=4)
+  {
+    buffer[0]       =(table[phase>>OSCILLATOR_PHASE_SHIFT]*amplitude)>>15;
+    phase+=increment;
+    buffer[stride]  =(table[phase>>OSCILLATOR_PHASE_SHIFT]*amplitude)>>15;
+    phase+=increment;
+    buffer[stride*2]=(table[phase>>OSCILLATOR_PHASE_SHIFT]*amplitude)>>15;
+    phase+=increment;
+    buffer[stride*3]=(table[phase>>OSCILLATOR_PHASE_SHIFT]*amplitude)>>15;
+    phase+=increment;
+    buffer+=stride*4;
+  }
+  for(;tc<count;tc++)
+  {
+    *buffer=(table[phase>>OSCILLATOR_PHASE_SHIFT]*amplitude)>>15;
+    phase+=increment;
+    buffer+=stride;
+  }
+
+  osc->phase=phase;
+}
+
+/**
+ * Fills an interleaved buffer with a tone, e.g. for beeps and alerts.
+ * All channels get the same signal.
+ *
+ * \param buffer      the buffer to write to, must hold frames*channels samples
+ * \param frames      the number of sample frames to generate
+ * \param channels    the number of interleaved channels in the buffer
+ * \param waveform    the waveform to generate
+ * \param frequency   the frequency to generate, in Hz
+ * \param sample_rate the output sample rate, in Hz
+ * \param amplitude   the peak amplitude, up to OSCILLATOR_MAX_AMPLITUDE
+ * \return EFI_SUCCESS, or EFI_INVALID_PARAMETER if any input is invalid
+ */
+EFI_STATUS generate_tone_s16(INT16 *buffer, UINTN frames, UINTN channels, waveform_t waveform, double frequency, UINT32 sample_rate, UINT32 amplitude)
+{
+  EFI_STATUS result;
+  oscillator_t osc;
+  UINTN tc;
+
+  if(channels<1)
+    return EFI_INVALID_PARAMETER;
+  result=init_oscillator(&osc,waveform,frequency,sample_rate,amplitude);
+  if(result!=EFI_SUCCESS)
+    return result;
+
+  for(tc=0;tc<channels;tc++)
+  {
+    restart_oscillator(&osc);
+    oscillator_fill_s16(&osc,buffer+tc,frames,channels);
+  }
+  return EFI_SUCCESS;
+}
@@ -0,0 +1,199 @@
+/** \file
+ * Particle systems for snow and similar effects
+ *
+ * \author Richard Nusser
+ * \copyright 2017-2018 Richard Nusser
+ * \license GPLv3 (see http://www.gnu.org/licenses/)
+ * \sa https://github.com/rinusser/UEFIStarter
+ * \ingroup group_lib_particles
+ */
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <UEFIStarter/particles.h>
+#include <UEFIStarter/core/memory.h>
+#include <UEFIStarter/core/profiler.h>
+#include <UEFIStarter/core/logger.h>
+
+
+/** the PCG32 generator's multiplier */
+#define RANDOM_MULTIPLIER 6364136223846793005ULL
+
+/** the PCG32 generator's increment, must be odd */
+#define RANDOM_INCREMENT 1442695040888963407ULL
+
+
+/**
+ * Seeds a PCG32 random number generator.
+ * Generators with the same seed return the same numbers.
+ *
+ * \param random the generator to seed
+ * \param seed   the seed, e.g. get_timestamp() for different numbers each run
+ */
+void seed_random(random_t *random, UINT64 seed)
+{
+  random->state=0;
+  next_random(random);
+  random->state+=seed;
+  next_random(random);
+}
+
+/**
+ * Returns the next number of a PCG32 random number generator.
+ *
+ * \param random the generator to use
+ * \return a random 32-bit number
+ */
+UINT32 next_random(random_t *random)
+{
+  UINT64 state=random->state;
+  UINT32 xorshifted, rotation;
+
+  random->state=state*RANDOM_MULTIPLIER+RANDOM_INCREMENT;
+  xorshifted=(UINT32)(((state>>18)^state)>>27);
+  rotation=(UINT32)(state>>59);
+  return (xorshifted>>rotation)|(xorshifted<<((32-rotation)&31));
+}
+
+/**
+ * Returns a random number between 0 and bound-1.
+ * This scales the generator's output instead of using modulo, so there's no division involved.
+ *
+ * \param random the generator to use
+ * \param bound  the exclusive upper bound
+ * \return a random number smaller than bound, 0 if bound is 0
+ */
+UINT32 next_random_below(random_t *random, UINT32 bound)
+{
+  return (UINT32)(((UINT64)next_random(random)*bound)>>32);
+}
+
+/**
+ * Creates a particle system and spawns all its particles.
+ *
+ * \param system  the particle system to initialize, needs to be freed with free_particle_system()
+ * \param count   the number of particles
+ * \param limit_y particles with rows below this get respawned
+ * \param spawn   the spawn callback
+ * \param seed    the seed for the system's random number generator
+ * \param context an application-defined pointer, stored in the system
+ * \return an EFI status code
+ */
+EFI_STATUS init_particle_system(particle_system_t *system, UINTN count, INT32 limit_y, particle_spawn_f *spawn, UINT64 seed, void *context)
+{
+  //round up to 4 particles so each array starts 16-byte aligned
+  UINTN capacity=(count+3)&~(UINTN)3;
+  UINTN tc;
+
+  system->memory=NULL;
+  if(count==0 || spawn==NULL)
+    return EFI_INVALID_PARAMETER;
+  system->memory_pages=(capacity*(5*sizeof(INT32)+sizeof(UINT8))-1)/4096+1;
+  if((system->memory=allocate_pages(system->memory_pages))==NULL)
+  {
+    LOG.error(L"could not allocate memory for %d particles",count);
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  system->count=count;
+  system->x=system->memory;
+  system->y=system->x+capacity;
+  system->velocity_x=system->y+capacity;
+  system->velocity_y=system->velocity_x+capacity;
+  system->drift_response=system->velocity_y+capacity;
+  system->shade=(UINT8 *)(system->drift_response+capacity);
+  system->limit_y=limit_y;
+  system->spawn=spawn;
+  system->context=context;
+  seed_random(&system->random,seed);
+
+  for(tc=0;tc<count;tc++)
+  {
+    system->velocity_x[tc]=0;
+    system->velocity_y[tc]=0;
+    system->drift_response[tc]=PARTICLE_FIXED_ONE;
+    system->shade[tc]=0;
+    spawn(system,tc);
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+ * Frees a particle system's memory.
+ *
+ * \param system the particle system to free
+ */
+void free_particle_system(particle_system_t *system)
+{
+  if(system->memory==NULL)
+    return;
+  free_pages(system->memory,system->memory_pages);
+  system->memory=NULL;
+}
+
+/**
+ * Moves all particles by their velocity plus the given drift scaled by their drift response, then respawns particles
+ * that fell below the system's limit.
+ * The movement loop doesn't branch, so compilers can vectorize it; respawning happens in a separate pass.
+ * Drifts times drift responses need to stay below 128.0 per update, e.g. up to 128 rows with a drift response of 1.0.
+ *
+ * \param system  the particle system to update
+ * \param drift_x the horizontal drift, e.g. wind, in particle coordinates
+ * \param drift_y the vertical drift, in particle coordinates
+ * \return the number of respawned particles
+ */
+UINTN update_particles(particle_system_t *system, INT32 drift_x, INT32 drift_y)
+{
+  PROFILE_SCOPE(L"update_particles");
+  INT32 *x=system->x;
+  INT32 *y=system->y;
+  INT32 *velocity_x=system->velocity_x;
+  INT32 *velocity_y=system->velocity_y;
+  INT32 *response=system->drift_response;
+  UINTN count=system->count;
+  UINTN tc, respawned=0;
+  //the drift is split into its upper and lower 8 bits so the products fit into 32 bits: 64-bit multiplications would
+  //keep compilers from vectorizing this loop
+  INT32 drift_x_high=drift_x>>8, drift_x_low=drift_x&0xFF;
+  INT32 drift_y_high=drift_y>>8, drift_y_low=drift_y&0xFF;
+
+  for(tc=0;tc<count;tc++)
+  {
+    x[tc]+=velocity_x[tc]+((drift_x_high*response[tc]+((drift_x_low*response[tc])>>8))>>8);
+    y[tc]+=velocity_y[tc]+((drift_y_high*response[tc]+((drift_y_low*response[tc])>>8))>>8);
+  }
+
+  for(tc=0;tc<count;tc++)
+  {
+    if(y[tc]>system->limit_y)
+    {
+      system->spawn(system,tc);
+      respawned++;
+    }
+  }
+  return respawned;
+}
+
+/**
+ * Calls the render callback for every particle inside the given area, starting at (0,0).
+ *
+ * \param system  the particle system to render
+ * \param width   the area's width, e.g. the number of text columns or pixels
+ * \param height  the area's height
+ * \param render  the render callback
+ * \param context an application-defined pointer passed to the render callback
+ */
+void render_particles(particle_system_t *system, INT32 width, INT32 height, particle_render_f *render, void *context)
+{
+  PROFILE_SCOPE(L"render_particles");
+  UINTN tc;
+  INT32 x, y;
+
+  for(tc=0;tc<system->count;tc++)
+  {
+    x=PARTICLE_TO_INT(system->x[tc]);
+    y=PARTICLE_TO_INT(system->y[tc]);
+    if(x>=0 && y>=0 && x<width && y<height)
+      render(system,tc,x,y,context);
+  }
+}
@@ -12,22 +12,31 @@
 
 #include <Library/UefiLib.h>
 #include <Library/BaseMemoryLib.h>
+#include <Library/BaseLib.h>
 #include <Library/UefiBootServicesTableLib.h>
 #include <UEFIStarter/pci.h>
 #include <UEFIStarter/core/memory.h>
 #include <UEFIStarter/core/files.h>
 #include <UEFIStarter/core/string.h>
 #include <UEFIStarter/core/logger.h>
+#include <UEFIStarter/core/profiler.h>
 
 
 /** the highest number of PCI device entries supported */
 #define MAX_PCI_DEVICES 100
 
+/** the size of stack buffers for device and class names, in characters */
+#define PCI_NAME_BUFFER_LENGTH 256
+
+/** the read buffer size for pci.ids, in bytes */
+#define PCI_ID_READER_BUFFER_SIZE 4096
+
 static EFI_PCI_IO_PROTOCOL *_pci_protocols[MAX_PCI_DEVICES]; /**< the list of PCI UEFI protocol handlers */
 static EFI_HANDLE _pci_handles[MAX_PCI_DEVICES];             /**< the list of PCI device handles */
 static UINTN _pci_handle_count=0;                            /**< the amount of PCI device handles */
 static PCI_TYPE00 _pci_configs[MAX_PCI_DEVICES];             /**< the PCI device's TYPE00 headers */
-static file_contents_t *_pci_id_file=NULL;                   /**< the pci.ids file contents */
+static file_reader_t _pci_id_reader;                         /**< the pci.ids file reader */
+static BOOLEAN _pci_id_reader_open=FALSE;                    /**< whether the pci.ids file reader is open */
 
 
 /** PCI subclasses for Mass Storage Controllers */
@@ -137,102 +146,113 @@ static void ui16tohexa(char *buffer, UINT16 value)
 }
 
 /**
- * Looks up a PCI device's name by vendor ID and device ID.
+ * Looks up a PCI device's name by vendor ID and device ID and appends it to a string builder.
  * Subvendor and subdevice IDs are not implemented yet, they will be ignored.
  *
+ * pci.ids is streamed through a fixed-size buffer rather than loaded completely. Vendors are listed in ascending
+ * order, so the search stops at the first vendor with a higher ID.
+ *
+ * \param builder      the string builder to append to
  * \param vendor_id    the device's vendor ID
  * \param device_id    the device's device ID
  * \param subvendor_id ignored
  * \param subdevice_id ignored
- * \return the device's name, as UTF-16; returns "(unknown)" if the requested device wasn't found
+ * \return whether the name was appended completely; appends "(unknown)" if the requested device wasn't found
  *
  * \TODO later: implement sub IDs.
  */
-CHAR16 *find_pci_device_name(UINT16 vendor_id, UINT16 device_id, UINT16 subvendor_id, UINT16 subdevice_id)
+BOOLEAN append_pci_device_name(string_builder_t *builder, UINT16 vendor_id, UINT16 device_id, UINT16 subvendor_id, UINT16 subdevice_id)
 {
-  char unknown_device_str[]="unknown device";
-  char vendor_start_str[]="\nXXXX";
-  char device_str[]="XXXX";
-  char *start;
-  char *newline;
-  char vendor_name[100];
-  char device_name[100];
-  int length;
-  char eol[]="\n";
-
-
-  if(!_pci_id_file)
-  {
-    _pci_id_file=get_file_contents(L"\\pci.ids");
-    _pci_id_file->data[_pci_id_file->data_length-1]=0;
-  }
+  CHAR8 vendor_str[]="XXXX  ";
+  CHAR8 device_str[]="\tXXXX  ";
+  ascii_view_t line;
+  BOOLEAN vendor_found=FALSE;
+  PROFILE_SCOPE(L"append_pci_device_name");
 
-  ui16tohexa(vendor_start_str+1,vendor_id);
-  start=AsciiStrStr(_pci_id_file->data,vendor_start_str);
-  if(!start)
+  if(!_pci_id_reader_open)
   {
-    LOG.debug(L"unknown vendor ID: %04X",vendor_id);
-    return memsprintf(L"(unknown)");
+    if(open_file_reader(&_pci_id_reader,L"\\pci.ids",PCI_ID_READER_BUFFER_SIZE)!=EFI_SUCCESS)
+      return append_string(builder,L"(unknown)");
+    _pci_id_reader_open=TRUE;
   }
+  else if(seek_file_reader(&_pci_id_reader,0)!=EFI_SUCCESS)
+    return append_string(builder,L"(unknown)");
 
-  newline=AsciiStrStr(start+1,eol);
-  length=newline-start-7;
-  if(length>100)
-  {
-    LOG.warn(L"trimmed vendor name to 100 characters");
-    length=100;
-  }
-//  SetMem(vendor_name,100,0xca);
-  CopyMem(vendor_name,start+7,length);
-  vendor_name[length]=0;
-//  DumpHex(2,0,100,vendor_name); //this should show vendor string starting at 0, followed by \0 character without newline, then 0xCA until the end
+  ui16tohexa(vendor_str,vendor_id);
+  vendor_str[4]=' ';
+  ui16tohexa(device_str+1,device_id);
+  device_str[5]=' ';
 
-  ui16tohexa(device_str,device_id);
-
-  start=NULL;
-  while(newline)
+  while(read_file_line(&_pci_id_reader,&line))
   {
-    if(newline[1]=='#')
-    {
-      //current line contains a comment, ignore it
-    }
-    else if(newline[1]!='\t')
-    {
-      LOG.debug(L"unknown device ID: %04X",device_id);
-      break;
-    }
-    else if(newline[2]==device_str[0] && newline[3]==device_str[1] && newline[4]==device_str[2] && newline[5]==device_str[3])
+    if(line.length==0 || line.start[0]=='#')
+      continue;
+
+    if(!vendor_found)
     {
-      LOG.debug(L"found device ID at pos %X",newline-_pci_id_file->data+1);
-      start=newline+8;
-      newline=AsciiStrStr(start,eol);
-      length=newline-start;
-      if(length>100)
+      if(line.start[0]=='\t')
+        continue;
+      if(ascii_view_starts_with(line,vendor_str))
       {
-        LOG.warn(L"trimmed device name to 100 characters");
-        length=100;
+        vendor_found=TRUE;
+        append_ascii_view(builder,ascii_view_skip(line,6));
       }
-//      SetMem(device_name,100,0xca);
-      CopyMem(device_name,start,length);
-      device_name[length]=0;
-//      DumpHex(2,0,100,device_name); //same as other dumphex() above: no trailing whitespace, \0 at string end without newline
+      //lines point into the reader's buffer and aren't null-terminated, so only the vendor ID's 4 digits get compared
+      else if(line.length>=4 && CompareMem(line.start,vendor_str,4)>0)
+        break;
+      continue;
+    }
+
+    if(line.start[0]!='\t')
       break;
+    if(ascii_view_starts_with(line,device_str))
+    {
+      LOG_DEBUG(L"found device ID at pos %lX",get_file_reader_position(&_pci_id_reader)-line.length-1);
+      append_string(builder,L", ");
+      return append_ascii_view(builder,ascii_view_skip(line,7));
     }
-    newline=AsciiStrStr(newline+1,eol);
   }
-  if(!start)
-    CopyMem(device_name,unknown_device_str,AsciiStrLen(unknown_device_str)+1);
 
-  return memsprintf(L"%a, %a",vendor_name,device_name);
+  if(!vendor_found)
+  {
+    LOG_DEBUG(L"unknown vendor ID: %04X",vendor_id);
+    return append_string(builder,L"(unknown)");
+  }
+  LOG_DEBUG(L"unknown device ID: %04X",device_id);
+  return append_string(builder,L", unknown device");
 }
 
 /**
- * Finds a PCI class and subclass name by 3-byte class code.
+ * Looks up a PCI device's name by vendor ID and device ID.
+ * Subvendor and subdevice IDs are not implemented yet, they will be ignored.
  *
+ * \param vendor_id    the device's vendor ID
+ * \param device_id    the device's device ID
+ * \param subvendor_id ignored
+ * \param subdevice_id ignored
+ * \return the device's name, as UTF-16; returns "(unknown)" if the requested device wasn't found
+ */
+CHAR16 *find_pci_device_name(UINT16 vendor_id, UINT16 device_id, UINT16 subvendor_id, UINT16 subdevice_id)
+{
+  CHAR16 buffer[PCI_NAME_BUFFER_LENGTH];
+  string_builder_t builder;
+  CHAR16 *name;
+
+  init_string_builder(&builder,buffer,PCI_NAME_BUFFER_LENGTH);
+  append_pci_device_name(&builder,vendor_id,device_id,subvendor_id,subdevice_id);
+  name=memsprintf(L"%s",builder.buffer);
+  free_string_builder(&builder);
+  return name;
+}
+
+/**
+ * Finds a PCI class and subclass name by 3-byte class code and appends it to a string builder.
+ *
+ * \param builder    the string builder to append to
  * \param class_code the PCI class code to look up
- * \return the class name; uses "unknown" to replace unhandled classes or subclasses
+ * \return whether the name was appended completely; uses "unknown" to replace unhandled classes or subclasses
  */
-CHAR16 *find_pci_class_name(UINT8 class_code[3])
+BOOLEAN append_pci_class_name(string_builder_t *builder, UINT8 class_code[3])
 {
   UINT8 base_class=class_code[2];
   UINT8 sub_class=class_code[1];
@@ -263,28 +283,50 @@ CHAR16 *find_pci_class_name(UINT8 class_code[3])
     break;
   }
 
-  return memsprintf(L"%s, %s",base_name,sub_name);
+  return append_format(builder,L"%s, %s",base_name,sub_name);
 }
 
 /**
- * Prints basic information about a PCI device.
+ * Finds a PCI class and subclass name by 3-byte class code.
  *
- * \param config the PCI's TYPE00 header
+ * \param class_code the PCI class code to look up
+ * \return the class name; uses "unknown" to replace unhandled classes or subclasses
  */
-void describe_pci_device(PCI_TYPE00 *config)
+CHAR16 *find_pci_class_name(UINT8 class_code[3])
 {
-  CHAR16 *classname;
+  CHAR16 buffer[PCI_NAME_BUFFER_LENGTH];
+  string_builder_t builder;
   CHAR16 *name;
 
-  name=find_pci_device_name(config->Hdr.VendorId,config->Hdr.DeviceId,config->Device.SubsystemVendorID,config->Device.SubsystemID);
-  classname=find_pci_class_name(config->Hdr.ClassCode);
+  init_string_builder(&builder,buffer,PCI_NAME_BUFFER_LENGTH);
+  append_pci_class_name(&builder,class_code);
+  name=memsprintf(L"%s",builder.buffer);
+  free_string_builder(&builder);
+  return name;
+}
 
-  Print(L"[%04X:%04X] %s\n",config->Hdr.VendorId,config->Hdr.DeviceId,name);
-  if(classname!=NULL)
-    Print(L"       type: %s\n",classname);
-  Print(L"       status=%04X, command=%04X\n",config->Hdr.Status,config->Hdr.Command);
-  Print(L"       prog_if=%02X, baseclass_code=%02X, subclass_code=%02X, revision_id=%02X\n",
+/**
+ * Prints basic information about a PCI device.
+ * The description is assembled in a stack buffer and printed at once.
+ *
+ * \param config the PCI's TYPE00 header
+ */
+void describe_pci_device(PCI_TYPE00 *config)
+{
+  CHAR16 buffer[PCI_NAME_BUFFER_LENGTH*2];
+  string_builder_t builder;
+
+  init_string_builder(&builder,buffer,PCI_NAME_BUFFER_LENGTH*2);
+  append_format(&builder,L"[%04X:%04X] ",config->Hdr.VendorId,config->Hdr.DeviceId);
+  append_pci_device_name(&builder,config->Hdr.VendorId,config->Hdr.DeviceId,config->Device.SubsystemVendorID,config->Device.SubsystemID);
+  append_string(&builder,L"\r\n       type: ");
+  append_pci_class_name(&builder,config->Hdr.ClassCode);
+  append_format(&builder,L"\n       status=%04X, command=%04X\n",config->Hdr.Status,config->Hdr.Command);
+  append_format(&builder,L"       prog_if=%02X, baseclass_code=%02X, subclass_code=%02X, revision_id=%02X\n",
       config->Hdr.ClassCode[0],config->Hdr.ClassCode[2],config->Hdr.ClassCode[1],config->Hdr.RevisionID);
+
+  gST->ConOut->OutputString(gST->ConOut,builder.buffer);
+  free_string_builder(&builder);
 }
 
 /**
@@ -298,14 +340,13 @@ int enumerate_pci_devices()
   UINTN handles_size=MAX_PCI_DEVICES*sizeof(EFI_HANDLE);
   unsigned int tc;
   EFI_PCI_IO_PROTOCOL *pip;
-  CHAR16 textbuffer[256];
   EFI_GUID guid=EFI_PCI_IO_PROTOCOL_GUID;
 
   if(gST->BootServices->LocateHandle(ByProtocol,&guid,NULL,&handles_size,(void **)&_pci_handles)!=EFI_SUCCESS)
     return -1;
 
   _pci_handle_count=handles_size/sizeof(EFI_HANDLE);
-  LOG.debug(L"handles size: %d bytes (%d entries)",handles_size,_pci_handle_count);
+  LOG_DEBUG(L"handles size: %d bytes (%d entries)",handles_size,_pci_handle_count);
 
   for(tc=0;tc<_pci_handle_count;tc++)
   {
@@ -316,16 +357,14 @@ int enumerate_pci_devices()
     result=gST->BootServices->OpenProtocol(_pci_handles[tc],&guid,(void **)&pip,gImageHandle,NULL,EFI_OPEN_PROTOCOL_BY_HANDLE_PROTOCOL);
     if(result!=EFI_SUCCESS)
     {
-      sprint_status(L"OpenProtocol",result);
-      LOG.warn(textbuffer);
+      LOG.warn(L"OpenProtocol() returned status %d (%r)",result,result);
       continue;
     }
 
     result=pip->Pci.Read(pip,EfiPciIoWidthUint8,0,sizeof(PCI_TYPE00),&_pci_configs[tc]);
     if(result!=EFI_SUCCESS)
     {
-      sprint_status(L"Pci.Read",result);
-      LOG.warn(textbuffer);
+      LOG.warn(L"Pci.Read() returned status %d (%r)",result,result);
       continue;
     }
 
@@ -408,7 +447,7 @@ void print_known_pci_classes()
 void init_pci_lib()
 {
   _pci_handle_count=0;
-  _pci_id_file=NULL;
+  _pci_id_reader_open=FALSE;
 }
 
 /**
@@ -417,9 +456,9 @@ void init_pci_lib()
  */
 void shutdown_pci_lib()
 {
-  if(_pci_id_file)
+  if(_pci_id_reader_open)
   {
-    free_pages(_pci_id_file,_pci_id_file->memory_pages);
-    _pci_id_file=NULL;
+    close_file_reader(&_pci_id_reader);
+    _pci_id_reader_open=FALSE;
   }
 }
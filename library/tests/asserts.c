@@ -16,6 +16,8 @@
 #include <UEFIStarter/tests/output.h>
 #include <UEFIStarter/core/logger.h>
 #include <UEFIStarter/core/string.h>
+#include <UEFIStarter/core/memory.h>
+#include <UEFIStarter/core/timestamp.h>
 
 
 /**
@@ -24,6 +26,18 @@
  */
 BOOLEAN invert_next_assert=FALSE;
 
+/**
+ * The percentage assert_max_duration_us() scales its limits by, set with the "-duration-factor" command-line argument.
+ * Use this on slow emulators (e.g. QEMU without KVM) instead of loosening individual tests.
+ */
+UINTN duration_limit_percent=100;
+
+
+/** the size of the stack buffer assertion descriptions get formatted in, in characters */
+#define ASSERT_DESCRIPTION_BUFFER_LENGTH 256
+
+/** the number of decimals double values are shown with in assertion descriptions */
+#define ASSERT_DOUBLE_DECIMALS 2
 
 /**
  * Helper macro to print an assertion result
@@ -31,11 +45,12 @@ BOOLEAN invert_next_assert=FALSE;
  * \param SUCCESS the result to print
  */
 #define PRINT_ASSERT_RESULT(SUCCESS) \
+  init_string_builder(&desc,buffer,ASSERT_DESCRIPTION_BUFFER_LENGTH); \
   VA_START(args,fmt); \
-  desc=CatVSPrint(NULL,fmt,args); \
+  append_format_va(&desc,fmt,args); \
   VA_END(args); \
-  print_assertion(SUCCESS,desc,message); \
-  FreePool(desc);
+  print_assertion(SUCCESS,desc.buffer,message); \
+  free_string_builder(&desc);
 
 /**
  * Internal assertion function.
@@ -50,7 +65,8 @@ BOOLEAN invert_next_assert=FALSE;
  */
 static BOOLEAN EFIAPI _simple_assert(BOOLEAN check, CHAR16 *message, CHAR16 *fmt, ...)
 {
-  CHAR16 *desc;
+  CHAR16 buffer[ASSERT_DESCRIPTION_BUFFER_LENGTH];
+  string_builder_t desc;
   VA_LIST args;
 
   if(invert_next_assert)
@@ -173,6 +189,20 @@ BOOLEAN assert_uint64_equals(UINT64 expected, UINT64 actual, CHAR16 *message)
 }
 
 
+/**
+ * Internal: formats a double value for assertion descriptions.
+ *
+ * \param buffer the target buffer, NUMBER_STRING_LENGTH characters long
+ * \param value  the number to format
+ * \return the formatted number, or a placeholder if it can't be formatted
+ */
+static CHAR16 *_format_double(CHAR16 *buffer, double value)
+{
+  if(double_to_wcs(buffer,NUMBER_STRING_LENGTH,value,ASSERT_DOUBLE_DECIMALS)==0)
+    return L"(out of range)";
+  return buffer;
+}
+
 /**
  * Asserts a double value is within an epsilon radius around an expected value.
  * To be exact this must hold true: `expected-epsilon <= actual <= expected+epsilon`
@@ -185,8 +215,10 @@ BOOLEAN assert_uint64_equals(UINT64 expected, UINT64 actual, CHAR16 *message)
  */
 BOOLEAN assert_double_near(double expected, double epsilon, double actual, CHAR16 *message)
 {
+  CHAR16 actual_text[NUMBER_STRING_LENGTH], expected_text[NUMBER_STRING_LENGTH], epsilon_text[NUMBER_STRING_LENGTH];
   double delta=expected-actual;
-  return _simple_assert(delta>=-epsilon&&delta<=epsilon,message,L"%s near %s+-%s",ftowcs(actual),ftowcs(expected),ftowcs(epsilon));
+  return _simple_assert(delta>=-epsilon&&delta<=epsilon,message,L"%s near %s+-%s",_format_double(actual_text,actual),
+                        _format_double(expected_text,expected),_format_double(epsilon_text,epsilon));
 }
 
 /**
@@ -199,7 +231,8 @@ BOOLEAN assert_double_near(double expected, double epsilon, double actual, CHAR1
  */
 BOOLEAN assert_double_greater_than(double threshold, double actual, CHAR16 *message)
 {
-  return _simple_assert(actual>threshold,message,L"%s greater than %s",ftowcs(actual),ftowcs(threshold));
+  CHAR16 actual_text[NUMBER_STRING_LENGTH], threshold_text[NUMBER_STRING_LENGTH];
+  return _simple_assert(actual>threshold,message,L"%s greater than %s",_format_double(actual_text,actual),_format_double(threshold_text,threshold));
 }
 
 /**
@@ -212,7 +245,8 @@ BOOLEAN assert_double_greater_than(double threshold, double actual, CHAR16 *mess
  */
 BOOLEAN assert_double_greater_than_or_equal_to(double threshold, double actual, CHAR16 *message)
 {
-  return _simple_assert(actual>=threshold,message,L"%s greater than or equal to %s",ftowcs(actual),ftowcs(threshold));
+  CHAR16 actual_text[NUMBER_STRING_LENGTH], threshold_text[NUMBER_STRING_LENGTH];
+  return _simple_assert(actual>=threshold,message,L"%s greater than or equal to %s",_format_double(actual_text,actual),_format_double(threshold_text,threshold));
 }
 
 /**
@@ -225,7 +259,8 @@ BOOLEAN assert_double_greater_than_or_equal_to(double threshold, double actual,
  */
 BOOLEAN assert_double_less_than(double threshold, double actual, CHAR16 *message)
 {
-  return _simple_assert(actual<threshold,message,L"%s less than %s",ftowcs(actual),ftowcs(threshold));
+  CHAR16 actual_text[NUMBER_STRING_LENGTH], threshold_text[NUMBER_STRING_LENGTH];
+  return _simple_assert(actual<threshold,message,L"%s less than %s",_format_double(actual_text,actual),_format_double(threshold_text,threshold));
 }
 
 /**
@@ -238,7 +273,8 @@ BOOLEAN assert_double_less_than(double threshold, double actual, CHAR16 *message
  */
 BOOLEAN assert_double_less_than_or_equal_to(double threshold, double actual, CHAR16 *message)
 {
-  return _simple_assert(actual<=threshold,message,L"%s less than or equal to %s",ftowcs(actual),ftowcs(threshold));
+  CHAR16 actual_text[NUMBER_STRING_LENGTH], threshold_text[NUMBER_STRING_LENGTH];
+  return _simple_assert(actual<=threshold,message,L"%s less than or equal to %s",_format_double(actual_text,actual),_format_double(threshold_text,threshold));
 }
 
 
@@ -401,3 +437,47 @@ BOOLEAN assert_pixel_near(EFI_GRAPHICS_OUTPUT_BLT_PIXEL exp, INTN epsilon, EFI_G
 {
   return assert_pixel_values_near(exp.Red,exp.Green,exp.Blue,exp.Reserved,epsilon,act,message);
 }
+
+
+/*
+ * performance tests
+ */
+
+/**
+ * Asserts the current test didn't take longer than a given time so far.
+ * Marks the test as incomplete if timestamps aren't available.
+ * The limit is scaled by duration_limit_percent.
+ *
+ * \param max_us  the highest duration allowed on regular hardware, in microseconds
+ * \param message an error message to include on failure
+ * \return whether the assertion passed
+ */
+BOOLEAN assert_max_duration_us(UINT64 max_us, CHAR16 *message)
+{
+  UINT64 ticks_per_second=get_timestamp_ticks_per_second();
+  UINT64 duration_us;
+
+  if(ticks_per_second==0)
+  {
+    LOG.warn(L"timestamps unavailable, can't check test duration");
+    mark_test_incomplete();
+    return FALSE;
+  }
+
+  duration_us=(get_timestamp()-current_test_start_timestamp)*1000000/ticks_per_second;
+  max_us=max_us*duration_limit_percent/100;
+  return _simple_assert(duration_us<=max_us,message,L"duration of %ldus is at most %ldus",duration_us,max_us);
+}
+
+/**
+ * Asserts the current test didn't use more than a given number of tracked memory pages at once so far.
+ *
+ * \param max_pages the highest number of simultaneously tracked memory pages allowed
+ * \param message   an error message to include on failure
+ * \return whether the assertion passed
+ */
+BOOLEAN assert_max_pages(UINTN max_pages, CHAR16 *message)
+{
+  UINTN peak_pages=get_peak_tracked_page_count();
+  return _simple_assert(peak_pages<=max_pages,message,L"peak of %ld page(s) is at most %ld",peak_pages,max_pages);
+}
@@ -0,0 +1,368 @@
+/** \file
+ * Benchmark execution for test suites.
+ * Benchmarks are timed with timestamp ticks and compared against an optional baseline file.
+ *
+ * \author Richard Nusser
+ * \copyright 2017-2018 Richard Nusser
+ * \license GPLv3 (see http://www.gnu.org/licenses/)
+ * \sa https://github.com/rinusser/UEFIStarter
+ * \ingroup group_tests_runner
+ */
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseLib.h>
+#include <Library/PrintLib.h>
+#include <UEFIStarter/core/memory.h>
+#include <UEFIStarter/core/logger.h>
+#include <UEFIStarter/core/files.h>
+#include <UEFIStarter/core/timestamp.h>
+#include <UEFIStarter/core/string.h>
+#include <UEFIStarter/tests/tests.h>
+#include <UEFIStarter/tests/benchmarks.h>
+#include <UEFIStarter/tests/output.h>
+#include <UEFIStarter/tests/report.h>
+
+
+/** maximum number of iterations per timed sample */
+#define BENCHMARK_MAX_BATCH_SIZE 0x100000
+
+/** data type for baseline entries */
+typedef struct
+{
+  CHAR8 name[BENCHMARK_MAX_NAME_LENGTH]; /**< the benchmark's name */
+  UINT64 median_ns;                      /**< the benchmark's baseline median, in nanoseconds */
+} benchmark_baseline_entry_t;
+
+
+benchmark_result_t benchmark_results[BENCHMARK_MAX_RESULTS]; /**< results of all benchmarks run so far */
+UINTN benchmark_result_count=0;                              /**< the number of entries in benchmark_results */
+
+static BOOLEAN _benchmarks_enabled=TRUE;                /**< internal storage for whether benchmarks should run */
+static UINTN _sample_count=BENCHMARK_DEFAULT_SAMPLES;   /**< internal storage for the number of timed samples */
+static UINTN _threshold_percent=BENCHMARK_DEFAULT_THRESHOLD; /**< internal storage for the regression threshold */
+
+static benchmark_baseline_entry_t _baseline[BENCHMARK_MAX_RESULTS]; /**< internal storage for the loaded baseline */
+static UINTN _baseline_count=0;                                      /**< the number of entries in _baseline */
+
+static UINT64 _samples[BENCHMARK_MAX_SAMPLES];    /**< internal storage for timed samples, in ticks per batch */
+static UINT64 _deviations[BENCHMARK_MAX_SAMPLES]; /**< internal storage for sample deviations from the median */
+
+
+/**
+ * Sets benchmark options, usually from command-line arguments.
+ *
+ * \param enabled           whether benchmarks should run at all
+ * \param samples           the number of timed samples per benchmark, between 1 and BENCHMARK_MAX_SAMPLES
+ * \param threshold_percent how much slower than the baseline benchmarks may be before failing, in percent
+ */
+void configure_benchmarks(BOOLEAN enabled, UINTN samples, UINTN threshold_percent)
+{
+  _benchmarks_enabled=enabled;
+  _sample_count=samples<1?1:(samples>BENCHMARK_MAX_SAMPLES?BENCHMARK_MAX_SAMPLES:samples);
+  _threshold_percent=threshold_percent;
+}
+
+/**
+ * Discards all benchmark results and the loaded baseline.
+ */
+void reset_benchmarks()
+{
+  benchmark_result_count=0;
+  _baseline_count=0;
+}
+
+/**
+ * Internal: sorts a list of values in ascending order.
+ * Benchmarks don't take many samples, so insertion sort is good enough.
+ *
+ * \param values the values to sort
+ * \param count  the number of values
+ */
+static void _sort_values(UINT64 *values, UINTN count)
+{
+  UINTN tc, td;
+  UINT64 value;
+
+  for(tc=1;tc<count;tc++)
+  {
+    value=values[tc];
+    for(td=tc;td>0 && values[td-1]>value;td--)
+      values[td]=values[td-1];
+    values[td]=value;
+  }
+}
+
+/**
+ * Internal: gets the median of a sorted list of values.
+ *
+ * \param values the sorted values
+ * \param count  the number of values, must be at least 1
+ * \return the median value
+ */
+static UINT64 _median(UINT64 *values, UINTN count)
+{
+  if(count%2==1)
+    return values[count/2];
+  return (values[count/2-1]+values[count/2])/2;
+}
+
+/**
+ * Internal: converts timestamp ticks per batch into nanoseconds per iteration.
+ *
+ * \param ticks      the number of timestamp ticks
+ * \param batch_size the number of iterations the ticks were measured over
+ * \return the time per iteration, in nanoseconds
+ */
+static UINT64 _ticks_to_ns(UINT64 ticks, UINTN batch_size)
+{
+  return (UINT64)(((double)ticks)*1000000000.0/get_timestamp_ticks_per_second()/batch_size+0.5);
+}
+
+/**
+ * Internal: executes a benchmark function a number of times.
+ *
+ * \param func       the benchmark function to execute
+ * \param batch_size the number of iterations
+ * \return the time taken, in timestamp ticks
+ */
+static UINT64 _time_batch(void (*func)(), UINTN batch_size)
+{
+  UINT64 start;
+  UINTN tc;
+
+  start=get_timestamp();
+  for(tc=0;tc<batch_size;tc++)
+    func();
+  return get_timestamp()-start;
+}
+
+/**
+ * Internal: finds the number of iterations per sample that take at least BENCHMARK_MIN_SAMPLE_US.
+ *
+ * \param func the benchmark function to execute
+ * \return the number of iterations per sample
+ */
+static UINTN _calibrate_batch_size(void (*func)())
+{
+  UINT64 min_ticks=get_timestamp_ticks_per_second()*BENCHMARK_MIN_SAMPLE_US/1000000;
+  UINTN batch_size=1;
+
+  while(batch_size<BENCHMARK_MAX_BATCH_SIZE && _time_batch(func,batch_size)<min_ticks)
+    batch_size*=2;
+  return batch_size;
+}
+
+/**
+ * Looks up a benchmark's baseline median.
+ *
+ * \param name the benchmark's name, as "<group>/<description>"
+ * \return the baseline median in nanoseconds, 0 if there is none
+ */
+UINT64 find_benchmark_baseline(CHAR8 *name)
+{
+  UINTN tc;
+
+  for(tc=0;tc<_baseline_count;tc++)
+    if(AsciiStrCmp(name,_baseline[tc].name)==0)
+      return _baseline[tc].median_ns;
+  return 0;
+}
+
+/**
+ * Calculates a benchmark's throughput.
+ *
+ * \param result the benchmark result to use
+ * \return the number of iterations per second, 0 if the benchmark was too fast to measure
+ */
+double get_benchmark_throughput(benchmark_result_t *result)
+{
+  if(result->median_ns==0)
+    return 0;
+  return 1000000000.0/result->median_ns;
+}
+
+/**
+ * Internal: compares a benchmark result with its baseline and records the outcome as assertion.
+ *
+ * \param result the benchmark result to check
+ */
+static void _check_regression(benchmark_result_t *result)
+{
+  CHAR16 message[100];
+  BOOLEAN passed;
+
+  individual_test_results.assert_count++;
+  if(result->baseline_ns==0)
+  {
+    print_assertion(TRUE,L"benchmark",L"no baseline");
+    result->outcome=SUCCESS;
+    return;
+  }
+
+  passed=result->median_ns*100<=result->baseline_ns*(100+_threshold_percent);
+  UnicodeSPrint(message,sizeof(message),L"median %ldns, baseline %ldns, threshold %d%%",
+                result->median_ns,result->baseline_ns,_threshold_percent);
+  print_assertion(passed,L"benchmark within threshold",message);
+  if(!passed)
+    individual_test_results.assert_fails++;
+  result->outcome=passed?SUCCESS:FAILURE;
+}
+
+/**
+ * Runs a benchmark: executes warmup iterations and timed samples, then compares the median with the baseline.
+ * Benchmarks are handled like tests, so regressions beyond the threshold count as failed tests.
+ *
+ * \param func        the benchmark function to execute, each call should be one iteration
+ * \param description the benchmark's description
+ */
+void run_benchmark(void (*func)(), CHAR16 *description)
+{
+  benchmark_result_t result, *stored_result=NULL;
+  UINTN tc, batch_size;
+  UINT64 median;
+
+  if(!_benchmarks_enabled)
+    return;
+
+  reset_test_environment();
+  reset_test_results(&individual_test_results);
+  print_individual_test_start(description);
+  start_test_measurement();
+
+  if(get_timestamp_ticks_per_second()==0 && init_timestamps()!=0)
+  {
+    LOG.warn(L"timestamps unavailable, can't run benchmark");
+    mark_test_incomplete();
+    stop_test_measurement();
+    handle_individual_result();
+    record_test_result(current_test_group,description,&individual_test_results,NULL);
+    return;
+  }
+
+  for(tc=0;tc<BENCHMARK_WARMUP_ITERATIONS;tc++)
+    func();
+  batch_size=_calibrate_batch_size(func);
+
+  for(tc=0;tc<_sample_count;tc++)
+    _samples[tc]=_time_batch(func,batch_size);
+  _sort_values(_samples,_sample_count);
+  median=_median(_samples,_sample_count);
+  for(tc=0;tc<_sample_count;tc++)
+    _deviations[tc]=_samples[tc]>median?_samples[tc]-median:median-_samples[tc];
+  _sort_values(_deviations,_sample_count);
+
+  AsciiSPrint(result.name,BENCHMARK_MAX_NAME_LENGTH,"%S/%S",current_test_group,description);
+  result.samples=_sample_count;
+  result.batch_size=batch_size;
+  result.median_ns=_ticks_to_ns(median,batch_size);
+  result.mad_ns=_ticks_to_ns(_median(_deviations,_sample_count),batch_size);
+  result.baseline_ns=find_benchmark_baseline(result.name);
+
+  stop_test_measurement();
+  _check_regression(&result);
+  if(benchmark_result_count<BENCHMARK_MAX_RESULTS)
+  {
+    stored_result=&benchmark_results[benchmark_result_count++];
+    *stored_result=result;
+  }
+  else
+    LOG.warn(L"too many benchmarks, not keeping result for %a",result.name);
+
+  reset_test_environment();
+  handle_individual_result();
+  record_test_result(current_test_group,description,&individual_test_results,stored_result);
+  print_benchmark_result(&result);
+
+  stop_tracking_memory();
+}
+
+/**
+ * Internal: parses an unsigned decimal number.
+ *
+ * \param data   the input data
+ * \param length the input data's length
+ * \param pos    the current position in the input data, will be moved past the number
+ * \return the parsed number
+ */
+static UINT64 _parse_uint64(char *data, UINTN length, UINTN *pos)
+{
+  UINT64 value=0;
+
+  for(;*pos<length && data[*pos]>='0' && data[*pos]<='9';(*pos)++)
+    value=value*10+data[*pos]-'0';
+  return value;
+}
+
+/**
+ * Loads a benchmark baseline file, replacing any previously loaded baseline.
+ * Lines that aren't in the "<name>=<median in ns>" format are ignored.
+ *
+ * \param filename the baseline file's full path within the boot volume
+ * \return EFI_SUCCESS, or EFI_NOT_FOUND if the file doesn't exist
+ */
+EFI_STATUS load_benchmark_baseline(CHAR16 *filename)
+{
+  file_contents_t *contents;
+  UINTN pos=0, name_length;
+  benchmark_baseline_entry_t *entry;
+
+  _baseline_count=0;
+  contents=get_file_contents(filename);
+  if(!contents)
+    return EFI_NOT_FOUND;
+
+  while(pos<contents->data_length && _baseline_count<BENCHMARK_MAX_RESULTS)
+  {
+    entry=&_baseline[_baseline_count];
+    for(name_length=0;pos<contents->data_length && contents->data[pos]!='=' && contents->data[pos]!='\n';pos++)
+      if(name_length<BENCHMARK_MAX_NAME_LENGTH-1)
+        entry->name[name_length++]=contents->data[pos];
+    entry->name[name_length]=0;
+
+    if(pos<contents->data_length && contents->data[pos]=='=')
+    {
+      pos++;
+      entry->median_ns=_parse_uint64(contents->data,contents->data_length,&pos);
+      if(name_length>0 && entry->median_ns>0)
+        _baseline_count++;
+    }
+    while(pos<contents->data_length && contents->data[pos]!='\n')
+      pos++;
+    pos++;
+  }
+
+  LOG_DEBUG(L"loaded %d benchmark baseline entries from %s",_baseline_count,filename);
+  free_pages(contents,contents->memory_pages);
+  return EFI_SUCCESS;
+}
+
+/**
+ * Writes the current benchmark results as new baseline file, replacing the existing file.
+ * Only benchmarks that ran are written, so don't skip test groups when saving the baseline.
+ *
+ * \param filename the baseline file's full path within the boot volume
+ * \return EFI_SUCCESS, or an error code
+ */
+EFI_STATUS save_benchmark_baseline(CHAR16 *filename)
+{
+  file_writer_t writer;
+  EFI_STATUS result;
+  UINTN tc;
+
+  if((result=open_file_writer(&writer,filename,0))!=EFI_SUCCESS)
+  {
+    LOG.error(L"could not create benchmark baseline file %s: %r",filename,result);
+    return result;
+  }
+
+  for(tc=0;tc<benchmark_result_count;tc++)
+    write_file_format(&writer,"%a=%ld\n",benchmark_results[tc].name,benchmark_results[tc].median_ns);
+  result=close_file_writer(&writer);
+
+  if(result!=EFI_SUCCESS)
+    LOG.error(L"could not write benchmark baseline file %s: %r",filename,result);
+  else
+    Print(L"saved %d benchmark result%s to %s\n",benchmark_result_count,benchmark_result_count==1?L"":L"s",filename);
+  return result;
+}
@@ -10,6 +10,8 @@
 
 #include <UEFIStarter/tests/output.h>
 #include <UEFIStarter/tests/tests.h>
+#include <UEFIStarter/core/string.h>
+#include <UEFIStarter/core/timestamp.h>
 
 
 #if 0
@@ -90,6 +92,26 @@ void print_assert_counts(INT64 fails, INT64 asserts)
   TRACE_ENDTYPE(L"assert cnt");
 }
 
+/**
+ * Prints a test's duration and peak memory usage, if enabled.
+ *
+ * \param results the test results to print
+ */
+void print_test_timings(test_results_t *results)
+{
+  UINT64 ticks_per_second=get_timestamp_ticks_per_second();
+  CHAR16 ms[NUMBER_STRING_LENGTH];
+
+  TRACE_STARTTYPE(L"timings");
+  if(test_verbosity.test_timings)
+  {
+    if(ticks_per_second>0 && double_to_wcs(ms,NUMBER_STRING_LENGTH,((double)results->duration_ticks)*1000/ticks_per_second,2)>0)
+      Print(L", %sms",ms);
+    Print(L", %d peak page%s",results->peak_pages,results->peak_pages==1?L"":L"s");
+  }
+  TRACE_ENDTYPE(L"timings");
+}
+
 /**
  * Internal: prints a test result status.
  *
@@ -151,10 +173,32 @@ void print_individual_result(test_results_t *results)
     _print_optional_multiline_test_prefix_or(NULL);
     _print_outcome(results->outcome);
     print_assert_counts(results->assert_fails,results->assert_count);
+    print_test_timings(results);
   }
   TRACE_ENDTYPE(L"indiv result");
 }
 
+/**
+ * Prints a benchmark's timings, if individual tests are shown.
+ *
+ * \param result the benchmark result to print
+ */
+void print_benchmark_result(benchmark_result_t *result)
+{
+  CHAR16 throughput[NUMBER_STRING_LENGTH];
+
+  TRACE_STARTTYPE(L"bench result");
+  if(test_verbosity.individual_tests && !test_verbosity.one_char_per_test)
+  {
+    _print_optional_multiline_test_prefix_or(L", ");
+    double_to_wcs(throughput,NUMBER_STRING_LENGTH,get_benchmark_throughput(result),2);
+    Print(L"median %ldns (MAD %ldns), %s ops/s",result->median_ns,result->mad_ns,throughput);
+    if(result->baseline_ns>0)
+      Print(L", baseline %ldns",result->baseline_ns);
+  }
+  TRACE_ENDTYPE(L"bench result");
+}
+
 /**
  * Prints test result summary, if enabled.
  *
@@ -232,14 +276,15 @@ void print_assertion(BOOLEAN success, CHAR16 *description, CHAR16 *message)
  */
 void debug_print_verbosity()
 {
-  ErrorPrint(L"individual groups=%d tests=%d asserts=%d, 1c/t=%d, assertion_cnt=%d, multiline/t=%d, stats=%d\n",
+  ErrorPrint(L"individual groups=%d tests=%d asserts=%d, 1c/t=%d, assertion_cnt=%d, multiline/t=%d, stats=%d, timings=%d\n",
              test_verbosity.individual_groups,
              test_verbosity.individual_tests,
              test_verbosity.individual_assertions,
              test_verbosity.one_char_per_test,
              test_verbosity.assertion_counts,
              test_verbosity.multiple_lines_per_test,
-             test_verbosity.summary_statistics);
+             test_verbosity.summary_statistics,
+             test_verbosity.test_timings);
 }
 
 /**
@@ -0,0 +1,230 @@
+/** \file
+ * Writes test results as JUnit XML file.
+ *
+ * \author Richard Nusser
+ * \copyright 2017-2018 Richard Nusser
+ * \license GPLv3 (see http://www.gnu.org/licenses/)
+ * \sa https://github.com/rinusser/UEFIStarter
+ * \ingroup group_tests_runner
+ */
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/PrintLib.h>
+#include <UEFIStarter/core/logger.h>
+#include <UEFIStarter/core/files.h>
+#include <UEFIStarter/core/timestamp.h>
+#include <UEFIStarter/tests/report.h>
+
+
+/** maximum length of escaped names in the report */
+#define TEST_REPORT_NAME_LENGTH 200
+
+
+/** data type for recorded test results */
+typedef struct
+{
+  CHAR16 *group;                 /**< the test group's name */
+  CHAR16 *description;           /**< the test's description */
+  test_results_t results;        /**< the test's results */
+  benchmark_result_t *benchmark; /**< the benchmark's timings, NULL for regular tests */
+} test_report_entry_t;
+
+
+static test_report_entry_t _entries[TEST_REPORT_MAX_ENTRIES]; /**< internal storage for recorded test results */
+static UINTN _entry_count=0;                                   /**< the number of recorded test results */
+
+
+/**
+ * Records a test's results for the report.
+ * Test group and description strings aren't copied, they need to remain valid until the report is written.
+ *
+ * \param group       the test group's name
+ * \param description the test's description
+ * \param results     the test's results
+ * \param benchmark   the benchmark's timings, or NULL for regular tests
+ */
+void record_test_result(CHAR16 *group, CHAR16 *description, test_results_t *results, benchmark_result_t *benchmark)
+{
+  if(_entry_count>=TEST_REPORT_MAX_ENTRIES)
+  {
+    LOG.warn(L"too many tests, not recording %s for report",description);
+    return;
+  }
+  _entries[_entry_count].group=group;
+  _entries[_entry_count].description=description;
+  _entries[_entry_count].results=*results;
+  _entries[_entry_count].benchmark=benchmark;
+  _entry_count++;
+}
+
+/**
+ * Discards all recorded test results.
+ */
+void reset_test_report()
+{
+  _entry_count=0;
+}
+
+/**
+ * Internal: escapes a string for use in XML attributes.
+ * Non-ASCII characters are replaced with question marks.
+ *
+ * \param target the target buffer
+ * \param size   the target buffer's size, in characters
+ * \param source the string to escape
+ * \return the target buffer
+ */
+static CHAR8 *_escape_xml(CHAR8 *target, UINTN size, CHAR16 *source)
+{
+  UINTN pos=0;
+  CHAR8 *replacement;
+
+  for(;*source && pos<size-1;source++)
+  {
+    switch(*source)
+    {
+      case L'&':  replacement="&amp;";  break;
+      case L'<':  replacement="&lt;";   break;
+      case L'>':  replacement="&gt;";   break;
+      case L'"':  replacement="&quot;"; break;
+      default:    replacement=NULL;
+    }
+
+    if(replacement)
+    {
+      if(pos+AsciiStrLen(replacement)>=size)
+        break;
+      while(*replacement)
+        target[pos++]=*replacement++;
+    }
+    else
+      target[pos++]=*source>=0x20&&*source<0x7F?(CHAR8)*source:'?';
+  }
+  target[pos]=0;
+  return target;
+}
+
+/**
+ * Internal: formats a duration as seconds with microsecond precision, as JUnit's time attributes expect.
+ *
+ * \param target the target buffer, at least 24 characters long
+ * \param ticks  the duration, in timestamp ticks
+ * \return the target buffer
+ */
+static CHAR8 *_format_seconds(CHAR8 *target, UINT64 ticks)
+{
+  UINT64 ticks_per_second=get_timestamp_ticks_per_second();
+  UINT64 us=ticks_per_second>0?(UINT64)(((double)ticks)*1000000/ticks_per_second):0;
+
+  AsciiSPrint(target,24,"%ld.%06ld",us/1000000,us%1000000);
+  return target;
+}
+
+/**
+ * Internal: writes a test's testcase element.
+ *
+ * \param writer the report file's writer
+ * \param entry  the test's recorded results
+ */
+static void _write_testcase(file_writer_t *writer, test_report_entry_t *entry)
+{
+  CHAR8 group[TEST_REPORT_NAME_LENGTH];
+  CHAR8 name[TEST_REPORT_NAME_LENGTH];
+  CHAR8 time[24];
+  benchmark_result_t *benchmark=entry->benchmark;
+
+  write_file_format(writer,"    <testcase classname=\"%a\" name=\"%a\" assertions=\"%ld\" time=\"%a\">\n",
+                    _escape_xml(group,TEST_REPORT_NAME_LENGTH,entry->group),
+                    _escape_xml(name,TEST_REPORT_NAME_LENGTH,entry->description),
+                    entry->results.assert_count,
+                    _format_seconds(time,entry->results.duration_ticks));
+
+  write_file_format(writer,"      <properties>\n");
+  write_file_format(writer,"        <property name=\"peak_pages\" value=\"%ld\"/>\n",(UINT64)entry->results.peak_pages);
+  if(benchmark)
+  {
+    write_file_format(writer,"        <property name=\"median_ns\" value=\"%ld\"/>\n",benchmark->median_ns);
+    write_file_format(writer,"        <property name=\"mad_ns\" value=\"%ld\"/>\n",benchmark->mad_ns);
+    write_file_format(writer,"        <property name=\"baseline_ns\" value=\"%ld\"/>\n",benchmark->baseline_ns);
+    write_file_format(writer,"        <property name=\"ops_per_second\" value=\"%ld\"/>\n",(UINT64)get_benchmark_throughput(benchmark));
+    write_file_format(writer,"        <property name=\"samples\" value=\"%ld\"/>\n",(UINT64)benchmark->samples);
+    write_file_format(writer,"        <property name=\"batch_size\" value=\"%ld\"/>\n",(UINT64)benchmark->batch_size);
+  }
+  write_file_format(writer,"      </properties>\n");
+
+  if(entry->results.outcome==FAILURE)
+    write_file_format(writer,"      <failure message=\"%ld of %ld assertions failed\"/>\n",
+                      entry->results.assert_fails,entry->results.assert_count);
+  else if(entry->results.outcome==INCOMPLETE)
+    write_file_format(writer,"      <skipped message=\"incomplete\"/>\n");
+
+  write_file_format(writer,"    </testcase>\n");
+}
+
+/**
+ * Internal: writes a test group's testsuite element.
+ *
+ * \param writer the report file's writer
+ * \param first  the index of the group's first recorded test
+ * \return the index of the next group's first recorded test
+ */
+static UINTN _write_testsuite(file_writer_t *writer, UINTN first)
+{
+  CHAR8 name[TEST_REPORT_NAME_LENGTH];
+  CHAR8 time[24];
+  UINTN tc, end, failures=0, skipped=0;
+  UINT64 duration_ticks=0;
+
+  for(end=first;end<_entry_count && _entries[end].group==_entries[first].group;end++)
+  {
+    duration_ticks+=_entries[end].results.duration_ticks;
+    if(_entries[end].results.outcome==FAILURE)
+      failures++;
+    else if(_entries[end].results.outcome==INCOMPLETE)
+      skipped++;
+  }
+
+  write_file_format(writer,"  <testsuite name=\"%a\" tests=\"%ld\" failures=\"%ld\" skipped=\"%ld\" time=\"%a\">\n",
+                    _escape_xml(name,TEST_REPORT_NAME_LENGTH,_entries[first].group),(UINT64)(end-first),(UINT64)failures,(UINT64)skipped,
+                    _format_seconds(time,duration_ticks));
+  for(tc=first;tc<end;tc++)
+    _write_testcase(writer,&_entries[tc]);
+  write_file_format(writer,"  </testsuite>\n");
+
+  return end;
+}
+
+/**
+ * Writes all recorded test results as JUnit XML file, replacing the file if it already exists.
+ * Incomplete tests are reported as skipped.
+ *
+ * \param filename       the report's full path within the boot volume
+ * \param global_results the test suite's summarized results
+ * \return EFI_SUCCESS, or an error code
+ */
+EFI_STATUS write_test_report(CHAR16 *filename, test_results_t *global_results)
+{
+  file_writer_t writer;
+  EFI_STATUS result;
+  UINTN pos=0;
+
+  if((result=open_file_writer(&writer,filename,0))!=EFI_SUCCESS)
+  {
+    LOG.error(L"could not create test report %s: %r",filename,result);
+    return result;
+  }
+
+  write_file_format(&writer,"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+  write_file_format(&writer,"<testsuites tests=\"%ld\" failures=\"%ld\" skipped=\"%ld\">\n",
+                    global_results->successful_test_count+global_results->failed_test_count+global_results->incomplete_count,
+                    global_results->failed_test_count,global_results->incomplete_count);
+  while(pos<_entry_count)
+    pos=_write_testsuite(&writer,pos);
+  write_file_format(&writer,"</testsuites>\n");
+
+  result=close_file_writer(&writer);
+  if(result!=EFI_SUCCESS)
+    LOG.error(L"could not write test report %s: %r",filename,result);
+  return result;
+}
@@ -19,15 +19,18 @@
 #include <UEFIStarter/core/logger.h>
 #include <UEFIStarter/core/cmdline.h>
 #include <UEFIStarter/core/string.h>
+#include <UEFIStarter/core/timestamp.h>
 #include <UEFIStarter/tests/tests.h>
 #include <UEFIStarter/tests/output.h>
+#include <UEFIStarter/tests/benchmarks.h>
+#include <UEFIStarter/tests/report.h>
 
 
 /** internal storage for the initial log level to set before each test */
 static LOGLEVEL _initial_log_level;
 
-static CHAR16 **_skipped_tests_list; /**< internal storage for the list of skipped tests */
-static UINTN _skipped_tests_count;   /**< internal storage for the number of skipped tests */
+static wcs_view_t _skipped_tests;  /**< internal storage for the comma-separated list of skipped tests */
+static UINTN _group_index=0;       /**< internal storage for the number of test groups encountered so far */
 
 /** the current test verbosity */
 test_verbosity_t test_verbosity;
@@ -36,13 +39,29 @@ test_results_t individual_test_results; /**< results for the current test */
 test_results_t group_test_results;      /**< results for the current test group */
 test_results_t global_test_results;     /**< results for all tests in this suite */
 
+/** the current test group's name */
+CHAR16 *current_test_group=L"";
 
-#define ARG_SKIP_TESTS    tests_args[0].value.wcstr  /**< helper macro to access the -skip argument's values */
-#define ARG_VERBOSITY     tests_args[1].value.uint64 /**< helper macro to access the -verbosity argument's value */
-#define ARG_MULTILINE     tests_args[2].value.uint64 /**< helper macro to access the -multiline argument's value */
-#define ARG_NO_COUNTS     tests_args[3].value.uint64 /**< helper macro to access the -no-counts argument's value */
-#define ARG_ASSERTIONS    tests_args[4].value.uint64 /**< helper macro to access the -assertions argument's value */
-#define ARG_NO_STATISTICS tests_args[5].value.uint64 /**< helper macro to access the -no-statistics argument's value */
+/** the timestamp the current test started at */
+UINT64 current_test_start_timestamp=0;
+
+
+#define ARG_SKIP_TESTS      tests_args[0].value.wcstr   /**< helper macro to access the -skip argument's values */
+#define ARG_VERBOSITY       tests_args[1].value.uint64  /**< helper macro to access the -verbosity argument's value */
+#define ARG_MULTILINE       tests_args[2].value.uint64  /**< helper macro to access the -multiline argument's value */
+#define ARG_NO_COUNTS       tests_args[3].value.uint64  /**< helper macro to access the -no-counts argument's value */
+#define ARG_ASSERTIONS      tests_args[4].value.uint64  /**< helper macro to access the -assertions argument's value */
+#define ARG_NO_STATISTICS   tests_args[5].value.uint64  /**< helper macro to access the -no-statistics argument's value */
+#define ARG_NO_BENCHMARKS   tests_args[6].value.uint64  /**< helper macro to access the -no-benchmarks argument's value */
+#define ARG_BENCH_SAMPLES   tests_args[7].value.uint64  /**< helper macro to access the -benchmark-samples argument's value */
+#define ARG_BENCH_THRESH    tests_args[8].value.uint64  /**< helper macro to access the -benchmark-threshold argument's value */
+#define ARG_BENCH_BASE      tests_args[9].value.wcstr   /**< helper macro to access the -benchmark-baseline argument's value */
+#define ARG_SAVE_BENCH      tests_args[10].value.uint64 /**< helper macro to access the -save-benchmarks argument's value */
+#define ARG_REPORT          tests_args[11].value.wcstr  /**< helper macro to access the -report argument's value */
+#define ARG_SHARD_COUNT     tests_args[12].value.uint64 /**< helper macro to access the -shard-count argument's value */
+#define ARG_SHARD_INDEX     tests_args[13].value.uint64 /**< helper macro to access the -shard-index argument's value */
+#define ARG_TIMINGS         tests_args[14].value.uint64 /**< helper macro to access the -timings argument's value */
+#define ARG_DURATION_FACTOR tests_args[15].value.uint64 /**< helper macro to access the -duration-factor argument's value */
 
 
 /**
@@ -53,6 +72,46 @@ test_results_t global_test_results;     /**< results for all tests in this suite
  */
 INT_RANGE_VALIDATOR(validate_verbosity,L"verbosity",1,4);
 
+/**
+ * Validator for the `-benchmark-samples <count>` argument.
+ *
+ * \param v the input to validate
+ * \return whether the given value is a valid number of samples
+ */
+INT_RANGE_VALIDATOR(validate_benchmark_samples,L"benchmark samples",1,BENCHMARK_MAX_SAMPLES);
+
+/**
+ * Validator for the `-benchmark-threshold <percent>` argument.
+ *
+ * \param v the input to validate
+ * \return whether the given value is a valid threshold
+ */
+INT_RANGE_VALIDATOR(validate_benchmark_threshold,L"benchmark threshold",0,1000);
+
+/**
+ * Validator for the `-shard-count <count>` argument.
+ *
+ * \param v the input to validate
+ * \return whether the given value is a valid number of shards
+ */
+INT_RANGE_VALIDATOR(validate_shard_count,L"shard count",1,64);
+
+/**
+ * Validator for the `-shard-index <index>` argument.
+ *
+ * \param v the input to validate
+ * \return whether the given value is a valid shard index
+ */
+INT_RANGE_VALIDATOR(validate_shard_index,L"shard index",0,63);
+
+/**
+ * Validator for the `-duration-factor <percent>` argument.
+ *
+ * \param v the input to validate
+ * \return whether the given value is a valid duration factor
+ */
+INT_RANGE_VALIDATOR(validate_duration_factor,L"duration factor",1,100000);
+
 
 /** list of command-line arguments */
 cmdline_argument_t tests_args[]={
@@ -62,6 +121,16 @@ cmdline_argument_t tests_args[]={
   {{uint64:0}, ARG_BOOL,  NULL,              L"-no-counts",    L"Disable assertion counts (shown at verbosities 2 and 4 only)"},
   {{uint64:0}, ARG_BOOL,  NULL,              L"-assertions",   L"Show successful assertions (verbosity 4 only)"},
   {{uint64:0}, ARG_BOOL,  NULL,              L"-no-statistics",L"Disable summary statistics"},
+  {{uint64:0}, ARG_BOOL,  NULL,              L"-no-benchmarks",L"Skip benchmarks"},
+  {{uint64:BENCHMARK_DEFAULT_SAMPLES},ARG_INT,validate_benchmark_samples,L"-benchmark-samples",L"Number of timed samples per benchmark [1..1000]"},
+  {{uint64:BENCHMARK_DEFAULT_THRESHOLD},ARG_INT,validate_benchmark_threshold,L"-benchmark-threshold",L"Allowed slowdown against baseline in percent [0..1000]"},
+  {{wcstr:BENCHMARK_BASELINE_FILENAME},ARG_STRING,NULL,L"-benchmark-baseline",L"Benchmark baseline file"},
+  {{uint64:0}, ARG_BOOL,  NULL,              L"-save-benchmarks",L"Save benchmark results as new baseline"},
+  {{wcstr:L""},ARG_STRING,NULL,              L"-report",       L"Write results as JUnit XML to this file, e.g. \\tests\\results.xml"},
+  {{uint64:1}, ARG_INT,   validate_shard_count,L"-shard-count",L"Split test groups into this many shards [1..64]"},
+  {{uint64:0}, ARG_INT,   validate_shard_index,L"-shard-index",L"Only run this shard's test groups [0..shard count-1]"},
+  {{uint64:0}, ARG_BOOL,  NULL,              L"-timings",      L"Show each test's duration and peak memory pages (verbosity 4 only)"},
+  {{uint64:100},ARG_INT,  validate_duration_factor,L"-duration-factor",L"Scale test duration limits by this percentage, e.g. for emulators [1..100000]"},
 };
 
 /** command-line argument group */
@@ -93,6 +162,8 @@ void reset_test_results(test_results_t *results)
   results->failed_test_count=0;
   results->incomplete_count=0;
   results->skipped_count=0;
+  results->duration_ticks=0;
+  results->peak_pages=0;
   results->outcome=SUCCESS;
 }
 
@@ -127,6 +198,9 @@ void add_test_results(test_results_t *target, test_results_t *source)
   target->failed_test_count+=source->failed_test_count;
   target->incomplete_count+=source->incomplete_count;
   target->skipped_count+=source->skipped_count;
+  target->duration_ticks+=source->duration_ticks;
+  if(source->peak_pages>target->peak_pages)
+    target->peak_pages=source->peak_pages;
   target->outcome=_combine_outcomes(target->outcome,source->outcome);
 }
 
@@ -173,6 +247,33 @@ void handle_group_result()
   print_group_result(&group_test_results);
 }
 
+/**
+ * Restores the logger settings tests may have changed.
+ */
+void reset_test_environment()
+{
+  set_logger_function(log_errorprint);
+  set_log_level(_initial_log_level);
+}
+
+/**
+ * Starts measuring the current test's duration and peak memory usage.
+ */
+void start_test_measurement()
+{
+  reset_peak_tracked_page_count();
+  current_test_start_timestamp=get_timestamp();
+}
+
+/**
+ * Stores the current test's duration and peak memory usage in its results.
+ */
+void stop_test_measurement()
+{
+  individual_test_results.duration_ticks=get_timestamp()-current_test_start_timestamp;
+  individual_test_results.peak_pages=get_peak_tracked_page_count();
+}
+
 /**
  * Runs an individual test.
  * This function takes care of required setup/teardown around tests.
@@ -182,18 +283,19 @@ void handle_group_result()
  */
 void run_test(void (*func)(), CHAR16 *description)
 {
-  set_logger_function(log_errorprint);
-  set_log_level(_initial_log_level);
+  reset_test_environment();
 
   reset_test_results(&individual_test_results);
   print_individual_test_start(description);
+  start_test_measurement();
 
   func();
 
-  set_logger_function(log_errorprint);
-  set_log_level(_initial_log_level);
+  stop_test_measurement();
+  reset_test_environment();
 
   handle_individual_result();
+  record_test_result(current_test_group,description,&individual_test_results,NULL);
 
   stop_tracking_memory();
 }
@@ -201,12 +303,19 @@ void run_test(void (*func)(), CHAR16 *description)
 
 /**
  * Runs a test group.
+ * If the test suite is split into shards, groups belonging to other shards are ignored: they're neither run nor
+ * counted as skipped. Groups are assigned to shards round-robin in the order the test runner calls them, so all shards
+ * agree on the assignment.
  *
  * \param func the test group to run
  */
 void run_group(BOOLEAN (*func)())
 {
   BOOLEAN ran;
+
+  if((_group_index++)%ARG_SHARD_COUNT!=ARG_SHARD_INDEX)
+    return;
+
   reset_test_results(&group_test_results);
   ran=func();
   handle_group_result();
@@ -215,19 +324,14 @@ void run_group(BOOLEAN (*func)())
 }
 
 /**
- * Internal: parses a list of skipped tests into internal storage.
+ * Internal: stores the list of skipped tests.
+ * The list isn't copied or split, it's tokenized on each lookup instead.
  *
- * \param str the list of tests to skip
+ * \param str the comma-separated list of tests to skip
  */
 static void _parse_skipped_tests(CHAR16 *str)
 {
-  if(!str || StrLen(str)<1)
-  {
-    _skipped_tests_list=NULL;
-    return;
-  }
-
-  _skipped_tests_count=split_string(&_skipped_tests_list,str,L',');
+  _skipped_tests=wcs_view(str);
 }
 
 /**
@@ -238,9 +342,15 @@ static void _parse_skipped_tests(CHAR16 *str)
  */
 BOOLEAN is_skipped_test(CHAR16 *name)
 {
-  UINTN tc;
-  for(tc=0;tc<_skipped_tests_count;tc++)
-    if(StrCmp(name,_skipped_tests_list[tc])==0)
+  wcs_tokenizer_t tokenizer;
+  wcs_view_t token;
+
+  if(_skipped_tests.length==0)
+    return FALSE;
+
+  init_wcs_tokenizer(&tokenizer,_skipped_tests,L',');
+  while(next_wcs_token(&tokenizer,&token))
+    if(wcs_view_equals(token,name))
       return TRUE;
   return FALSE;
 }
@@ -263,6 +373,7 @@ void assemble_and_set_verbosity()
   test_verbosity.assertion_counts=(ARG_VERBOSITY==2||ARG_VERBOSITY>=4)&&!ARG_NO_COUNTS;
   test_verbosity.individual_assertions=ARG_VERBOSITY>=4&&ARG_ASSERTIONS;
   test_verbosity.summary_statistics=!ARG_NO_STATISTICS;
+  test_verbosity.test_timings=ARG_VERBOSITY>=4&&ARG_TIMINGS;
 }
 
 /**
@@ -281,19 +392,39 @@ int main(int argc, char **argv_ascii)
   rv=init(argc,argv,1,&tests_arggroup);
   free_argv();
 
+  if(rv==EFI_SUCCESS && ARG_SHARD_INDEX>=ARG_SHARD_COUNT)
+  {
+    LOG.error(L"shard index %d out of range, must be less than shard count %d",ARG_SHARD_INDEX,ARG_SHARD_COUNT);
+    rv=EFI_INVALID_PARAMETER;
+  }
+  if(rv==EFI_SUCCESS && ARG_SAVE_BENCH && ARG_SHARD_COUNT>1)
+  {
+    LOG.error(L"can't save benchmark baseline for a single shard, run the entire test suite instead");
+    rv=EFI_INVALID_PARAMETER;
+  }
+
   if(rv==EFI_SUCCESS)
   {
     assemble_and_set_verbosity();
     reset_test_results(&global_test_results);
     _initial_log_level=get_log_level();
     _parse_skipped_tests(ARG_SKIP_TESTS);
+    duration_limit_percent=ARG_DURATION_FACTOR;
+    if(init_timestamps()!=0)
+      LOG.warn(L"could not initialize timestamps, test durations won't be available");
+    configure_benchmarks(!ARG_NO_BENCHMARKS,ARG_BENCH_SAMPLES,ARG_BENCH_THRESH);
+    if(!ARG_NO_BENCHMARKS && !ARG_SAVE_BENCH)
+      load_benchmark_baseline(ARG_BENCH_BASE);
 
-    //init_timestamps();
     run_tests();
 
+    if(!ARG_NO_BENCHMARKS && ARG_SAVE_BENCH)
+      save_benchmark_baseline(ARG_BENCH_BASE);
+    if(StrLen(ARG_REPORT)>0)
+      write_test_report(ARG_REPORT,&global_test_results);
     print_test_result_summary(&global_test_results);
-    if(_skipped_tests_list)
-      FreePool(_skipped_tests_list);
+    reset_benchmarks();
+    reset_test_report();
   }
 
   shutdown();
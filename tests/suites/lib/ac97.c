@@ -72,6 +72,30 @@ void test_volume_macro()
 }
 
 
+/**
+ * Makes sure the bits used for buffer completion events are where the AC'97 specs put them.
+ *
+ * \test the descriptor's "ioc" bit is bit 15 of the control word
+ * \test AC97_STATUS_BCIS and AC97_STATUS_LVBCI match ac97_busmaster_status_t's fields
+ */
+void test_completion_bits()
+{
+  ac97_buffer_descriptor_t descriptor;
+  ac97_busmaster_status_t status;
+
+  descriptor.control.raw=0;
+  descriptor.control.ioc=1;
+  assert_intn_equals(0x8000,descriptor.control.raw,L"ioc");
+
+  status.raw=AC97_STATUS_BCIS;
+  assert_intn_equals(1,status.buffer_completion_interrupt,L"BCIS");
+  assert_intn_equals(0,status.last_valid_buffer_completion_interrupt,L"BCIS/LVBCI");
+  status.raw=AC97_STATUS_LVBCI;
+  assert_intn_equals(1,status.last_valid_buffer_completion_interrupt,L"LVBCI");
+  assert_intn_equals(0,status.buffer_completion_interrupt,L"LVBCI/BCIS");
+}
+
+
 /**
  * Test runner for this group.
  * Gets called via the generated test runner.
@@ -83,5 +107,6 @@ BOOLEAN run_ac97_tests()
   INIT_TESTGROUP(L"AC97");
   RUN_TEST(test_struct_sizes,L"struct sizes");
   RUN_TEST(test_volume_macro,L"volume register macro");
+  RUN_TEST(test_completion_bits,L"buffer completion bits");
   FINISH_TESTGROUP();
 }
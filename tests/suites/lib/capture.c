@@ -0,0 +1,180 @@
+/** \file
+ * Tests for frame captures.
+ *
+ * \author Richard Nusser
+ * \copyright 2017-2018 Richard Nusser
+ * \license GPLv3 (see http://www.gnu.org/licenses/)
+ * \sa https://github.com/rinusser/UEFIStarter
+ * \ingroup group_lib_capture
+ */
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <UEFIStarter/capture.h>
+#include <UEFIStarter/core.h>
+#include <UEFIStarter/tests/tests.h>
+
+
+#define TEST_CAPTURE_WIDTH 16                                        /**< the test frames' width */
+#define TEST_CAPTURE_HEIGHT 8                                        /**< the test frames' height */
+#define TEST_CAPTURE_PIXELS (TEST_CAPTURE_WIDTH*TEST_CAPTURE_HEIGHT) /**< the test frames' number of pixels */
+#define TEST_CAPTURE_FRAMES 5                                        /**< the number of test frames */
+
+
+/**
+ * internal: decodes a captured frame's runs, the same way tools/decode_capture.py does.
+ *
+ * \param contents the capture file's contents
+ * \param pos      the position of the frame's first run, will be moved past the frame's last run
+ * \param frame    the previously decoded frame, will be updated
+ * \param stats    output: the number of skip, fill and copy runs, incremented for each run
+ * \return whether the frame could be decoded
+ */
+static BOOLEAN _decode_test_frame(file_contents_t *contents, UINTN *pos, UINT32 *frame, UINTN stats[3])
+{
+  UINTN covered=0, count, tc;
+  UINT32 word, type, *data;
+
+  while(covered<TEST_CAPTURE_PIXELS)
+  {
+    if(*pos+sizeof(UINT32)>contents->data_length)
+      return FALSE;
+    word=*(UINT32 *)(contents->data+*pos);
+    *pos+=sizeof(UINT32);
+    type=word>>CAPTURE_RUN_TYPE_SHIFT;
+    count=word&CAPTURE_RUN_MAX;
+    if(count==0 || covered+count>TEST_CAPTURE_PIXELS || type>CAPTURE_RUN_COPY)
+      return FALSE;
+    stats[type]++;
+
+    data=(UINT32 *)(contents->data+*pos);
+    if(type==CAPTURE_RUN_FILL)
+    {
+      for(tc=0;tc<count;tc++)
+        frame[covered+tc]=data[0];
+      *pos+=sizeof(UINT32);
+    }
+    else if(type==CAPTURE_RUN_COPY)
+    {
+      CopyMem(frame+covered,data,count*sizeof(UINT32));
+      *pos+=count*sizeof(UINT32);
+    }
+    if(*pos>contents->data_length)
+      return FALSE;
+    covered+=count;
+  }
+  return TRUE;
+}
+
+/**
+ * Makes sure captured frames can be decoded back to the original frames.
+ * Only every second frame is captured; the frames in between are filled with garbage that mustn't show up.
+ *
+ * \test start_frame_capture() writes the capture file header
+ * \test capture_frame() only captures every interval'th frame, with increasing timestamps
+ * \test capture_frame() encodes unchanged, repeated and individually changed pixels as skip, fill and copy runs
+ * \test decoding all captured frames reproduces the original frames exactly
+ * \test stop_frame_capture() returns EFI_SUCCESS
+ */
+void test_frame_capture()
+{
+  frame_capture_t capture;
+  file_contents_t *contents;
+  capture_file_header_t *header;
+  capture_frame_header_t *frame_header;
+  EFI_FILE_HANDLE file;
+  UINT32 *frames, decoded[TEST_CAPTURE_PIXELS];
+  UINTN tc, frame, pos, stats[3]={0,0,0};
+  UINT64 previous_timestamp=0;
+
+  frames=allocate_pages(1);
+  if(!assert_not_null(frames,L"frame buffers"))
+    return;
+  for(tc=0;tc<TEST_CAPTURE_PIXELS;tc++)
+  {
+    frames[tc]=tc*0x010203;
+    frames[TEST_CAPTURE_PIXELS+tc]=0xDEADBEEF;
+    frames[2*TEST_CAPTURE_PIXELS+tc]=tc>=20&&tc<30?0x00FF00:frames[tc];
+    frames[3*TEST_CAPTURE_PIXELS+tc]=0xDEADBEEF;
+    frames[4*TEST_CAPTURE_PIXELS+tc]=0;
+  }
+  //frame 2 differs from frame 0 by a repeated color and two individual pixels, frame 4 is black
+  frames[2*TEST_CAPTURE_PIXELS+50]=1;
+  frames[2*TEST_CAPTURE_PIXELS+51]=2;
+
+  if(!assert_intn_equals(EFI_SUCCESS,start_frame_capture(&capture,L"\\capture-test.fcp",TEST_CAPTURE_WIDTH,TEST_CAPTURE_HEIGHT,2),L"starting capture"))
+  {
+    free_pages(frames,1);
+    return;
+  }
+  for(frame=0;frame<TEST_CAPTURE_FRAMES;frame++)
+    assert_intn_equals(EFI_SUCCESS,capture_frame(&capture,(EFI_GRAPHICS_OUTPUT_BLT_PIXEL *)(frames+frame*TEST_CAPTURE_PIXELS)),L"capturing frame");
+  assert_uint64_equals(3,capture.captured_frames,L"captured frames");
+  assert_intn_equals(EFI_SUCCESS,stop_frame_capture(&capture),L"stopping capture");
+
+  contents=get_file_contents(L"\\capture-test.fcp");
+  if(assert_not_null(contents,L"capture file") && assert_true(contents->data_length>=sizeof(capture_file_header_t),L"header size"))
+  {
+    header=(capture_file_header_t *)contents->data;
+    assert_uint64_equals(CAPTURE_FILE_MAGIC,header->magic,L"magic number");
+    assert_uint64_equals(TEST_CAPTURE_WIDTH,header->width,L"width");
+    assert_uint64_equals(TEST_CAPTURE_HEIGHT,header->height,L"height");
+    assert_uint64_equals(2,header->interval,L"interval");
+
+    ZeroMem(decoded,sizeof(decoded));
+    pos=sizeof(capture_file_header_t);
+    for(frame=0;frame<TEST_CAPTURE_FRAMES && pos+sizeof(capture_frame_header_t)<=contents->data_length;frame+=2)
+    {
+      frame_header=(capture_frame_header_t *)(contents->data+pos);
+      pos+=sizeof(capture_frame_header_t);
+      assert_uint64_equals(frame,frame_header->frame,L"frame number");
+      assert_true(frame_header->timestamp>=previous_timestamp,L"increasing timestamps");
+      previous_timestamp=frame_header->timestamp;
+      if(!assert_true(_decode_test_frame(contents,&pos,decoded,stats),L"decoding frame"))
+        break;
+      assert_intn_equals(0,CompareMem(decoded,frames+frame*TEST_CAPTURE_PIXELS,sizeof(decoded)),L"decoded frame");
+    }
+    assert_uint64_equals(6,frame,L"decoded frames");
+    assert_uint64_equals(contents->data_length,pos,L"file fully decoded");
+    assert_true(stats[CAPTURE_RUN_SKIP]>0 && stats[CAPTURE_RUN_FILL]>0 && stats[CAPTURE_RUN_COPY]>0,L"all run types used");
+  }
+  if(contents)
+    free_pages(contents,contents->memory_pages);
+
+  if((file=find_file(L"\\capture-test.fcp"))!=NULL)
+    file->Delete(file);
+  free_pages(frames,1);
+}
+
+/**
+ * Makes sure invalid capture settings are rejected.
+ *
+ * \test start_frame_capture() returns EFI_INVALID_PARAMETER for empty frames and an interval of 0
+ * \test capture_frame() and stop_frame_capture() return EFI_NOT_READY for captures that didn't start
+ */
+void test_invalid_frame_capture()
+{
+  frame_capture_t capture;
+  UINT32 pixel=0;
+
+  assert_intn_equals(EFI_INVALID_PARAMETER,start_frame_capture(&capture,L"\\capture-test.fcp",0,10,1),L"empty frames");
+  assert_intn_equals(EFI_INVALID_PARAMETER,start_frame_capture(&capture,L"\\capture-test.fcp",10,10,0),L"interval 0");
+  assert_intn_equals(EFI_NOT_READY,capture_frame(&capture,(EFI_GRAPHICS_OUTPUT_BLT_PIXEL *)&pixel),L"capturing without start");
+  assert_intn_equals(EFI_NOT_READY,stop_frame_capture(&capture),L"stopping without start");
+}
+
+
+/**
+ * Test runner for this group.
+ * Gets called via the generated test runner.
+ *
+ * \return whether the test group was executed
+ */
+BOOLEAN run_capture_tests()
+{
+  INIT_TESTGROUP(L"frame capture");
+  RUN_TEST(test_frame_capture,L"capture and decode frames");
+  RUN_TEST(test_invalid_frame_capture,L"invalid captures");
+  FINISH_TESTGROUP();
+}
@@ -126,6 +126,217 @@ void test_parse_parameters()
 }
 
 
+/** a second list of arguments, used in tests for multiple argument groups */
+cmdline_argument_t cmdline_other_args_list[]=
+{
+  {{uint64:0},ARG_INT, NULL,L"-count",L"some other integer"},
+  {{uint64:0},ARG_BOOL,NULL,L"-bool", L"a duplicate boolean, shadowed by the first group"},
+  {{uint64:0},ARG_BOOL,NULL,L"-debug",L"a duplicate of a logger argument, shadowed by it"},
+};
+
+/** a second argument group, used in tests for multiple argument groups */
+cmdline_argument_group_t cmdline_other_args_group=
+{
+  NULL,
+  sizeof(cmdline_other_args_list)/sizeof(cmdline_argument_t),
+  cmdline_other_args_list
+};
+
+/**
+ * internal: parses a copy of a command line string with the given argument groups, keeping the current log level.
+ *
+ * \param input the command-line argument string to pass to the parser
+ * \param count the number of argument groups passed
+ * \param ...   the list of argument groups (as cmdline_argument_group_t *)
+ * \return the parser's result
+ */
+static EFI_STATUS EFIAPI _parse_test_input(CHAR16 *input, UINTN count, ...)
+{
+  EFI_STATUS result;
+  VA_LIST args;
+  UINTN argc;
+  CHAR16 **argv;
+  CHAR16 *copy;
+  LOGLEVEL previous_log_level=get_log_level();
+
+  if((copy=AllocateCopyPool(StrSize(input),input))==NULL)
+    return EFI_OUT_OF_RESOURCES;
+  argc=split_string(&argv,copy,L' ');
+  VA_START(args,count);
+  result=parse_parameters(argc,argv,count,args);
+  VA_END(args);
+  set_log_level(previous_log_level);
+  FreePool(argv);
+  FreePool(copy);
+  return result;
+}
+
+/**
+ * Makes sure arguments are found in all argument groups.
+ *
+ * \test arguments from multiple groups can be mixed in any order
+ * \test duplicate argument names resolve to the built-in argument or the first group defining them
+ * \test argument values that look like argument names are used as values
+ * \test unknown arguments and too many argument groups result in parse failure
+ */
+void test_parse_multiple_groups()
+{
+  CHAR16 *first_string=cmdline_args_list[3].value.wcstr;
+
+  cmdline_args_list[0].value.uint64=0;
+  cmdline_other_args_list[1].value.uint64=0;
+  cmdline_other_args_list[2].value.uint64=0;
+  assert_intn_equals(EFI_SUCCESS,_parse_test_input(L"-count 7 -no-log -bool -string -count -debug",2,&cmdline_args_group,&cmdline_other_args_group),L"success");
+  assert_uint64_equals(7,cmdline_other_args_list[0].value.uint64,L"second group");
+  assert_uint64_equals(1,cmdline_args_list[0].value.uint64,L"first group wins");
+  assert_uint64_equals(0,cmdline_other_args_list[1].value.uint64,L"shadowed duplicate");
+  assert_uint64_equals(0,cmdline_other_args_list[2].value.uint64,L"shadowed logger argument");
+  assert_wcstr_equals(L"-count",cmdline_args_list[3].value.wcstr,L"argument name as value");
+  if(cmdline_args_list[3].value.wcstr!=first_string)
+    FreePool(cmdline_args_list[3].value.wcstr);
+  cmdline_args_list[3].value.wcstr=first_string;
+
+  assert_intn_equals(EFI_INVALID_PARAMETER,_parse_test_input(L"-no-log -unknown",2,&cmdline_args_group,&cmdline_other_args_group),L"unknown argument");
+  assert_intn_equals(EFI_INVALID_PARAMETER,_parse_test_input(L"-no-log",CMDLINE_MAX_GROUPS+1,&cmdline_args_group),L"too many groups");
+}
+
+/**
+ * internal: writes a test file to the boot volume.
+ *
+ * \param filename the file's full path within the boot volume
+ * \param contents the file's contents
+ * \return whether the file was written
+ */
+static BOOLEAN _write_test_file(CHAR16 *filename, CHAR8 *contents)
+{
+  file_writer_t writer;
+
+  if(open_file_writer(&writer,filename,0)!=EFI_SUCCESS)
+    return FALSE;
+  write_file_chunk(&writer,contents,AsciiStrLen(contents));
+  return close_file_writer(&writer)==EFI_SUCCESS;
+}
+
+/**
+ * internal: resets the test argument group to its defaults, freeing any parsed string.
+ *
+ * \param default_string the string argument's default value
+ */
+static void _reset_test_arguments(CHAR16 *default_string)
+{
+  if(cmdline_args_list[3].value.wcstr!=default_string)
+    FreePool(cmdline_args_list[3].value.wcstr);
+  cmdline_args_list[0].value.uint64=0;
+  cmdline_args_list[1].value.uint64=12;
+  cmdline_args_list[2].value.dbl=2.5;
+  cmdline_args_list[3].value.wcstr=default_string;
+}
+
+/**
+ * internal: deletes a test file from the boot volume, if it exists.
+ *
+ * \param filename the file's full path within the boot volume
+ */
+static void _delete_test_file(CHAR16 *filename)
+{
+  EFI_FILE_HANDLE file;
+
+  if((file=find_file(filename))!=NULL)
+    file->Delete(file);
+}
+
+/**
+ * Makes sure argument values can be loaded from config files and snapshots.
+ *
+ * \test "-config" loads values from text config files, ignoring comments, blank lines and surrounding whitespace
+ * \test command-line arguments override config file values
+ * \test "-save-config" saves all values as snapshot, "-config" loads snapshots back
+ * \test unknown settings, lines without values and values rejected by validators result in load failure
+ * \test snapshots don't load into different argument groups
+ * \test missing config files result in EFI_NOT_FOUND
+ */
+void test_config_files()
+{
+  CHAR16 *default_string=cmdline_args_list[3].value.wcstr;
+
+  if(!assert_true(_write_test_file(L"\\config-test.cfg","# test config\r\n\r\n  bool = yes\r\nint=8\ndouble = -1.5\nstring=from config\n"),L"writing config"))
+    return;
+
+  _reset_test_arguments(default_string);
+  assert_intn_equals(EFI_SUCCESS,_parse_test_input(L"-no-log -config \\config-test.cfg -int 4 -save-config \\config-test.bin",1,&cmdline_args_group),L"text config");
+  assert_uint64_equals(1,cmdline_args_list[0].value.uint64,L"bool from config");
+  assert_uint64_equals(4,cmdline_args_list[1].value.uint64,L"int from command line");
+  assert_double_near(-1.5,0.0000001,cmdline_args_list[2].value.dbl,L"double from config");
+  assert_wcstr_equals(L"from config",cmdline_args_list[3].value.wcstr,L"string from config");
+
+  _reset_test_arguments(default_string);
+  assert_intn_equals(EFI_SUCCESS,_parse_test_input(L"-no-log -config \\config-test.bin",1,&cmdline_args_group),L"snapshot");
+  assert_uint64_equals(1,cmdline_args_list[0].value.uint64,L"bool from snapshot");
+  assert_uint64_equals(4,cmdline_args_list[1].value.uint64,L"int from snapshot");
+  assert_double_near(-1.5,0.0000001,cmdline_args_list[2].value.dbl,L"double from snapshot");
+  assert_wcstr_equals(L"from config",cmdline_args_list[3].value.wcstr,L"string from snapshot");
+  assert_intn_equals(EFI_INCOMPATIBLE_VERSION,_parse_test_input(L"-no-log -config \\config-test.bin",2,&cmdline_args_group,&cmdline_other_args_group),L"snapshot for other groups");
+
+  _write_test_file(L"\\config-test.cfg","int=7\n");
+  assert_intn_equals(EFI_INVALID_PARAMETER,_parse_test_input(L"-no-log -config \\config-test.cfg",1,&cmdline_args_group),L"failing validator");
+  _write_test_file(L"\\config-test.cfg","count=7\n");
+  assert_intn_equals(EFI_INVALID_PARAMETER,_parse_test_input(L"-no-log -config \\config-test.cfg",1,&cmdline_args_group),L"unknown setting");
+  _write_test_file(L"\\config-test.cfg","bool\n");
+  assert_intn_equals(EFI_INVALID_PARAMETER,_parse_test_input(L"-no-log -config \\config-test.cfg",1,&cmdline_args_group),L"missing value");
+  _write_test_file(L"\\config-test.cfg","no-log=1\n");
+  assert_intn_equals(EFI_INVALID_PARAMETER,_parse_test_input(L"-no-log -config \\config-test.cfg",1,&cmdline_args_group),L"built-in argument");
+
+  _delete_test_file(L"\\config-test.cfg");
+  _delete_test_file(L"\\config-test.bin");
+  assert_intn_equals(EFI_NOT_FOUND,_parse_test_input(L"-no-log -config \\config-test.cfg",1,&cmdline_args_group),L"missing file");
+  _reset_test_arguments(default_string);
+}
+
+/** the number of arguments in the benchmark's argument group */
+#define CMDLINE_BENCHMARK_ARGS 64
+
+/** argument list for the command line parser benchmark, gets filled in by _init_benchmark_arguments() */
+static cmdline_argument_t _benchmark_args_list[CMDLINE_BENCHMARK_ARGS];
+
+/** argument names for the command line parser benchmark */
+static CHAR16 _benchmark_arg_names[CMDLINE_BENCHMARK_ARGS][16];
+
+/** argument group for the command line parser benchmark */
+static cmdline_argument_group_t _benchmark_args_group={NULL,CMDLINE_BENCHMARK_ARGS,_benchmark_args_list};
+
+/** command line for the command line parser benchmark, with a leading space: every argument is passed, in reverse order */
+static CHAR16 _benchmark_input[CMDLINE_BENCHMARK_ARGS*12];
+
+/**
+ * internal: sets up the command line parser benchmark's arguments, alternating between integer and boolean types.
+ */
+static void _init_benchmark_arguments()
+{
+  UINTN tc;
+  UINTN pos=0;
+
+  for(tc=0;tc<CMDLINE_BENCHMARK_ARGS;tc++)
+  {
+    UnicodeSPrint(_benchmark_arg_names[tc],sizeof(_benchmark_arg_names[tc]),L"-option%d",tc);
+    _benchmark_args_list[tc].value.uint64=0;
+    _benchmark_args_list[tc].type=tc%2?ARG_BOOL:ARG_INT;
+    _benchmark_args_list[tc].validator_func=NULL;
+    _benchmark_args_list[tc].name=_benchmark_arg_names[tc];
+    _benchmark_args_list[tc].helptext=L"benchmark argument";
+  }
+  for(tc=CMDLINE_BENCHMARK_ARGS;tc>0;tc-=2)
+    pos+=UnicodeSPrint(_benchmark_input+pos,sizeof(_benchmark_input)-pos*sizeof(CHAR16),L" %s %s 5",_benchmark_arg_names[tc-1],_benchmark_arg_names[tc-2]);
+}
+
+/**
+ * Benchmarks parsing all 64 arguments of an argument group, in reverse order.
+ */
+void benchmark_parse_parameters()
+{
+  _parse_test_input(_benchmark_input+1,1,&_benchmark_args_group);
+}
+
+
 /** data type for command-line argument validator testcases */
 typedef struct
 {
@@ -198,6 +409,11 @@ BOOLEAN run_cmdline_tests()
 {
   INIT_TESTGROUP(L"command line");
   RUN_TEST(test_parse_parameters,L"parsing parameters");
+  RUN_TEST(test_parse_multiple_groups,L"parsing multiple argument groups");
+  RUN_TEST(test_config_files,L"config files");
+
+  _init_benchmark_arguments();
+  RUN_BENCHMARK(benchmark_parse_parameters,L"parse 64 arguments");
   RUN_TEST(test_validate_ranges,L"validating value ranges");
   FINISH_TESTGROUP();
 }
@@ -0,0 +1,421 @@
+/** \file
+ * Tests for virtual text screens.
+ * The console is replaced by a recording fake while text screens are presented, the real console is restored before
+ * any assertions print.
+ *
+ * \author Richard Nusser
+ * \copyright 2017-2018 Richard Nusser
+ * \license GPLv3 (see http://www.gnu.org/licenses/)
+ * \sa https://github.com/rinusser/UEFIStarter
+ * \ingroup group_lib_console
+ */
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <UEFIStarter/core.h>
+#include <UEFIStarter/tests/tests.h>
+
+
+#define TEST_CONSOLE_COLUMNS 20  /**< the fake console's number of columns */
+#define TEST_CONSOLE_ROWS 5      /**< the fake console's number of rows */
+#define TEST_CONSOLE_MAX_SPANS 8 /**< the number of OutputString() calls the fake console records */
+
+/** data type for strings output to the fake console */
+typedef struct
+{
+  UINTN x;                             /**< the string's first column */
+  UINTN y;                             /**< the string's row */
+  UINTN attribute;                     /**< the console's attribute at the time of output */
+  CHAR16 text[TEST_CONSOLE_COLUMNS+1]; /**< the output string, cut off at the console's width */
+} recorded_span_t;
+
+/** data type for the fake console, recording calls and the resulting screen contents */
+typedef struct
+{
+  EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL protocol;                   /**< the protocol, needs to be the first member */
+  SIMPLE_TEXT_OUTPUT_MODE mode;                               /**< the protocol's mode */
+  UINTN cursor_calls;                                         /**< the number of SetCursorPosition() calls */
+  UINTN output_calls;                                         /**< the number of OutputString() calls */
+  UINTN attribute_calls;                                      /**< the number of SetAttribute() calls */
+  recorded_span_t spans[TEST_CONSOLE_MAX_SPANS];              /**< the first output strings */
+  CHAR16 characters[TEST_CONSOLE_ROWS][TEST_CONSOLE_COLUMNS]; /**< the characters on screen */
+  UINT16 attributes[TEST_CONSOLE_ROWS][TEST_CONSOLE_COLUMNS]; /**< the attributes on screen */
+  BOOLEAN wrote_last_cell;                                    /**< whether the bottom right cell was written */
+} recording_console_t;
+
+static recording_console_t _console;                  /**< the fake console */
+static EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL *_real_console; /**< the real console while the fake one is in use */
+
+
+/**
+ * internal: fake console's QueryMode(), always reports the test console's size
+ *
+ * \param this    the protocol
+ * \param mode    ignored
+ * \param columns output: the number of columns
+ * \param rows    output: the number of rows
+ * \return EFI_SUCCESS
+ */
+static EFI_STATUS EFIAPI _query_mode(EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL *this, UINTN mode, UINTN *columns, UINTN *rows)
+{
+  *columns=TEST_CONSOLE_COLUMNS;
+  *rows=TEST_CONSOLE_ROWS;
+  return EFI_SUCCESS;
+}
+
+/**
+ * internal: fake console's ClearScreen()
+ *
+ * \param this the protocol
+ * \return EFI_SUCCESS
+ */
+static EFI_STATUS EFIAPI _clear_screen(EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL *this)
+{
+  UINTN x, y;
+
+  for(y=0;y<TEST_CONSOLE_ROWS;y++)
+    for(x=0;x<TEST_CONSOLE_COLUMNS;x++)
+    {
+      _console.characters[y][x]=L' ';
+      _console.attributes[y][x]=(UINT16)_console.mode.Attribute;
+    }
+  _console.mode.CursorColumn=0;
+  _console.mode.CursorRow=0;
+  return EFI_SUCCESS;
+}
+
+/**
+ * internal: fake console's SetAttribute()
+ *
+ * \param this      the protocol
+ * \param attribute the new attribute
+ * \return EFI_SUCCESS
+ */
+static EFI_STATUS EFIAPI _set_attribute(EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL *this, UINTN attribute)
+{
+  _console.attribute_calls++;
+  _console.mode.Attribute=(INT32)attribute;
+  return EFI_SUCCESS;
+}
+
+/**
+ * internal: fake console's SetCursorPosition()
+ *
+ * \param this   the protocol
+ * \param column the cursor's new column
+ * \param row    the cursor's new row
+ * \return EFI_SUCCESS, or EFI_UNSUPPORTED for positions outside the console
+ */
+static EFI_STATUS EFIAPI _set_cursor_position(EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL *this, UINTN column, UINTN row)
+{
+  _console.cursor_calls++;
+  if(column>=TEST_CONSOLE_COLUMNS || row>=TEST_CONSOLE_ROWS)
+    return EFI_UNSUPPORTED;
+  _console.mode.CursorColumn=(INT32)column;
+  _console.mode.CursorRow=(INT32)row;
+  return EFI_SUCCESS;
+}
+
+/**
+ * internal: fake console's OutputString(), records the string and writes it to the fake screen
+ *
+ * \param this   the protocol
+ * \param string the string to output
+ * \return EFI_SUCCESS
+ */
+static EFI_STATUS EFIAPI _output_string(EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL *this, CHAR16 *string)
+{
+  recorded_span_t *span=NULL;
+  UINTN x=_console.mode.CursorColumn;
+  UINTN y=_console.mode.CursorRow;
+  UINTN length=0;
+
+  if(_console.output_calls<TEST_CONSOLE_MAX_SPANS)
+  {
+    span=_console.spans+_console.output_calls;
+    span->x=x;
+    span->y=y;
+    span->attribute=_console.mode.Attribute;
+  }
+  _console.output_calls++;
+
+  for(;*string && y<TEST_CONSOLE_ROWS;string++)
+  {
+    if(span && length<TEST_CONSOLE_COLUMNS)
+      span->text[length++]=*string;
+    if(x==TEST_CONSOLE_COLUMNS-1 && y==TEST_CONSOLE_ROWS-1)
+      _console.wrote_last_cell=TRUE;
+    _console.characters[y][x]=*string;
+    _console.attributes[y][x]=(UINT16)_console.mode.Attribute;
+    if(++x==TEST_CONSOLE_COLUMNS)
+    {
+      x=0;
+      y++;
+    }
+  }
+  if(span)
+    span->text[length]=0;
+  _console.mode.CursorColumn=(INT32)x;
+  _console.mode.CursorRow=(INT32)y;
+  return EFI_SUCCESS;
+}
+
+/**
+ * internal: replaces the console with the fake console.
+ * The fake console keeps its screen contents, only the recorded calls are reset.
+ */
+static void _use_recording_console()
+{
+  _console.protocol.QueryMode=_query_mode;
+  _console.protocol.ClearScreen=_clear_screen;
+  _console.protocol.SetAttribute=_set_attribute;
+  _console.protocol.SetCursorPosition=_set_cursor_position;
+  _console.protocol.OutputString=_output_string;
+  _console.protocol.Mode=&_console.mode;
+  _console.cursor_calls=0;
+  _console.output_calls=0;
+  _console.attribute_calls=0;
+  _console.wrote_last_cell=FALSE;
+  ZeroMem(_console.spans,sizeof(_console.spans));
+
+  _real_console=gST->ConOut;
+  gST->ConOut=&_console.protocol;
+}
+
+/**
+ * internal: restores the real console.
+ */
+static void _restore_console()
+{
+  gST->ConOut=_real_console;
+}
+
+/**
+ * internal: creates a text screen on the fake console, with light gray on black text.
+ *
+ * \param screen the text screen to initialize
+ * \return whether the text screen was created
+ */
+static BOOLEAN _init_test_screen(text_screen_t *screen)
+{
+  EFI_STATUS result;
+
+  _console.mode.Attribute=EFI_TEXT_ATTR(EFI_LIGHTGRAY,EFI_BLACK);
+  _use_recording_console();
+  result=init_text_screen(screen);
+  _restore_console();
+  return assert_intn_equals(EFI_SUCCESS,result,L"creating text screen");
+}
+
+/**
+ * internal: presents a text screen on the fake console.
+ *
+ * \param screen the text screen to present
+ * \return whether presenting succeeded
+ */
+static BOOLEAN _present_test_screen(text_screen_t *screen)
+{
+  EFI_STATUS result;
+
+  _use_recording_console();
+  result=console_present(screen);
+  _restore_console();
+  return assert_intn_equals(EFI_SUCCESS,result,L"presenting");
+}
+
+/**
+ * internal: checks whether the fake console shows a text screen's cells, except for the bottom right cell.
+ *
+ * \param screen the text screen to compare
+ * \return whether all cells match
+ */
+static BOOLEAN _is_screen_shown(text_screen_t *screen)
+{
+  UINTN x, y;
+  text_cell_t *cell;
+
+  for(y=0;y<TEST_CONSOLE_ROWS;y++)
+    for(x=0;x<TEST_CONSOLE_COLUMNS;x++)
+    {
+      if(x==TEST_CONSOLE_COLUMNS-1 && y==TEST_CONSOLE_ROWS-1)
+        continue;
+      cell=screen->cells+y*TEST_CONSOLE_COLUMNS+x;
+      if(_console.characters[y][x]!=cell->character || _console.attributes[y][x]!=cell->attribute)
+        return FALSE;
+    }
+  return TRUE;
+}
+
+
+/**
+ * Makes sure text screen cells are clipped to the screen.
+ *
+ * \test init_text_screen() uses the console's size and attribute
+ * \test set_text_cell() ignores cells outside the screen
+ * \test print_text_screen() cuts off text at both screen edges
+ */
+void test_text_screen_cells()
+{
+  text_screen_t screen;
+  UINTN tc, changed=0;
+
+  if(!_init_test_screen(&screen))
+    return;
+  assert_uint64_equals(TEST_CONSOLE_COLUMNS,screen.columns,L"columns");
+  assert_uint64_equals(TEST_CONSOLE_ROWS,screen.rows,L"rows");
+  assert_uint64_equals(EFI_TEXT_ATTR(EFI_LIGHTGRAY,EFI_BLACK),screen.attribute,L"attribute");
+
+  set_text_cell(&screen,-1,0,L'x',screen.attribute);
+  set_text_cell(&screen,0,-1,L'x',screen.attribute);
+  set_text_cell(&screen,TEST_CONSOLE_COLUMNS,0,L'x',screen.attribute);
+  set_text_cell(&screen,0,TEST_CONSOLE_ROWS,L'x',screen.attribute);
+  for(tc=0;tc<TEST_CONSOLE_COLUMNS*TEST_CONSOLE_ROWS;tc++)
+    if(screen.cells[tc].character!=L' ')
+      changed++;
+  assert_uint64_equals(0,changed,L"cells changed outside screen");
+
+  print_text_screen(&screen,-2,1,screen.attribute,L"abcd");
+  print_text_screen(&screen,TEST_CONSOLE_COLUMNS-2,1,EFI_TEXT_ATTR(EFI_WHITE,EFI_BLACK),L"%d",1234);
+  assert_uint64_equals(L'c',screen.cells[TEST_CONSOLE_COLUMNS].character,L"text cut off on the left");
+  assert_uint64_equals(L'd',screen.cells[TEST_CONSOLE_COLUMNS+1].character,L"text after cut off");
+  assert_uint64_equals(L'1',screen.cells[2*TEST_CONSOLE_COLUMNS-2].character,L"text before cut off on the right");
+  assert_uint64_equals(L'2',screen.cells[2*TEST_CONSOLE_COLUMNS-1].character,L"text cut off on the right");
+  assert_uint64_equals(EFI_TEXT_ATTR(EFI_WHITE,EFI_BLACK),screen.cells[2*TEST_CONSOLE_COLUMNS-1].attribute,L"text attribute");
+  assert_uint64_equals(L' ',screen.cells[2*TEST_CONSOLE_COLUMNS].character,L"no line wrapping");
+
+  free_text_screen(&screen);
+}
+
+/**
+ * Makes sure only changed cells are output, with nearby changes merged into one span.
+ *
+ * \test console_present() doesn't call the console if nothing changed
+ * \test console_present() outputs each span with one SetCursorPosition() and one OutputString() call
+ * \test console_present() bridges up to TEXT_SCREEN_MAX_GAP unchanged cells, but not more
+ * \test console_present() leaves the console showing the text screen's cells
+ */
+void test_console_present_spans()
+{
+  text_screen_t screen;
+  UINTN gap_end=2+TEXT_SCREEN_MAX_GAP+1;
+
+  if(!_init_test_screen(&screen))
+    return;
+  if(!_present_test_screen(&screen))
+  {
+    free_text_screen(&screen);
+    return;
+  }
+  assert_uint64_equals(0,_console.cursor_calls+_console.output_calls+_console.attribute_calls,L"calls without changes");
+
+  //row 0: two changes with the maximum gap between them, row 2: two changes with one more unchanged cell in between
+  set_text_cell(&screen,2,0,L'a',screen.attribute);
+  set_text_cell(&screen,gap_end,0,L'b',screen.attribute);
+  set_text_cell(&screen,2,2,L'c',screen.attribute);
+  set_text_cell(&screen,gap_end+1,2,L'd',screen.attribute);
+  if(_present_test_screen(&screen))
+  {
+    assert_uint64_equals(3,_console.cursor_calls,L"SetCursorPosition() calls");
+    assert_uint64_equals(3,_console.output_calls,L"OutputString() calls");
+    assert_uint64_equals(0,_console.attribute_calls,L"SetAttribute() calls");
+
+    assert_uint64_equals(2,_console.spans[0].x,L"bridged span column");
+    assert_uint64_equals(0,_console.spans[0].y,L"bridged span row");
+    assert_intn_equals(0,StrCmp(L"a    b",_console.spans[0].text),L"bridged span contents");
+    assert_uint64_equals(TEXT_SCREEN_MAX_GAP+2,StrLen(_console.spans[0].text),L"bridged span length");
+
+    assert_uint64_equals(2,_console.spans[1].x,L"1st separate span column");
+    assert_uint64_equals(2,_console.spans[1].y,L"1st separate span row");
+    assert_intn_equals(0,StrCmp(L"c",_console.spans[1].text),L"1st separate span contents");
+    assert_uint64_equals(gap_end+1,_console.spans[2].x,L"2nd separate span column");
+    assert_intn_equals(0,StrCmp(L"d",_console.spans[2].text),L"2nd separate span contents");
+  }
+  assert_true(_is_screen_shown(&screen),L"console contents");
+
+  if(_present_test_screen(&screen))
+    assert_uint64_equals(0,_console.output_calls,L"OutputString() calls after presenting");
+
+  free_text_screen(&screen);
+}
+
+/**
+ * Makes sure attribute changes split spans and the console's attribute is restored.
+ *
+ * \test console_present() starts a new span when the attribute changes, even between adjacent cells
+ * \test console_present() only calls SetAttribute() when the attribute changes, and restores the original attribute
+ */
+void test_console_present_attributes()
+{
+  text_screen_t screen;
+  UINTN original_attribute;
+
+  if(!_init_test_screen(&screen))
+    return;
+  original_attribute=_console.mode.Attribute;
+
+  print_text_screen(&screen,0,1,EFI_TEXT_ATTR(EFI_WHITE,EFI_BLACK),L"ab");
+  print_text_screen(&screen,2,1,EFI_TEXT_ATTR(EFI_RED,EFI_BLACK),L"cd");
+  print_text_screen(&screen,0,3,EFI_TEXT_ATTR(EFI_RED,EFI_BLACK),L"ef");
+  if(_present_test_screen(&screen))
+  {
+    assert_uint64_equals(3,_console.output_calls,L"OutputString() calls");
+    assert_uint64_equals(3,_console.attribute_calls,L"SetAttribute() calls, including restore");
+    assert_intn_equals(0,StrCmp(L"ab",_console.spans[0].text),L"1st span contents");
+    assert_uint64_equals(EFI_TEXT_ATTR(EFI_WHITE,EFI_BLACK),_console.spans[0].attribute,L"1st span attribute");
+    assert_intn_equals(0,StrCmp(L"cd",_console.spans[1].text),L"2nd span contents");
+    assert_uint64_equals(EFI_TEXT_ATTR(EFI_RED,EFI_BLACK),_console.spans[1].attribute,L"2nd span attribute");
+    assert_intn_equals(0,StrCmp(L"ef",_console.spans[2].text),L"3rd span contents");
+    assert_uint64_equals(EFI_TEXT_ATTR(EFI_RED,EFI_BLACK),_console.spans[2].attribute,L"3rd span attribute");
+    assert_uint64_equals(original_attribute,_console.mode.Attribute,L"restored attribute");
+  }
+  assert_true(_is_screen_shown(&screen),L"console contents");
+
+  free_text_screen(&screen);
+}
+
+/**
+ * Makes sure the bottom right cell isn't output, so consoles don't scroll.
+ *
+ * \test console_present() never writes the bottom right cell, but writes the cells before it
+ */
+void test_console_present_last_cell()
+{
+  text_screen_t screen;
+
+  if(!_init_test_screen(&screen))
+    return;
+
+  set_text_cell(&screen,TEST_CONSOLE_COLUMNS-1,TEST_CONSOLE_ROWS-1,L'z',screen.attribute);
+  if(_present_test_screen(&screen))
+    assert_uint64_equals(0,_console.output_calls,L"OutputString() calls for bottom right cell");
+
+  print_text_screen(&screen,TEST_CONSOLE_COLUMNS-3,TEST_CONSOLE_ROWS-1,screen.attribute,L"xyz");
+  if(_present_test_screen(&screen))
+  {
+    assert_uint64_equals(1,_console.output_calls,L"OutputString() calls for last row");
+    assert_intn_equals(0,StrCmp(L"xy",_console.spans[0].text),L"span contents in last row");
+    assert_false(_console.wrote_last_cell,L"bottom right cell written");
+  }
+  assert_true(_is_screen_shown(&screen),L"console contents");
+
+  free_text_screen(&screen);
+}
+
+
+/**
+ * Test runner for this group.
+ * Gets called via the generated test runner.
+ *
+ * \return whether the test group was executed
+ */
+BOOLEAN run_console_tests()
+{
+  INIT_TESTGROUP(L"console");
+  RUN_TEST(test_text_screen_cells,L"text screen cells");
+  RUN_TEST(test_console_present_spans,L"present changed spans");
+  RUN_TEST(test_console_present_attributes,L"present attribute changes");
+  RUN_TEST(test_console_present_last_cell,L"skip bottom right cell");
+  FINISH_TESTGROUP();
+}
@@ -10,6 +10,8 @@
 
 #include <Uefi.h>
 #include <Library/UefiLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/BaseMemoryLib.h>
 #include <UEFIStarter/core.h>
 #include <UEFIStarter/tests/tests.h>
 
@@ -36,6 +38,204 @@ void test_get_file_contents()
   free_pages(contents,contents->memory_pages);
 }
 
+/**
+ * Makes sure files can be found on the cached volumes.
+ *
+ * \test get_volume_count() reports at least one volume
+ * \test get_volume_root() returns the same cached handle on repeated calls, and NULL for invalid volumes
+ * \test find_file() finds existing files repeatedly, also after the file system cache was flushed
+ * \test find_file() and find_file_on_volume() return NULL for missing files and invalid volumes
+ */
+void test_find_file()
+{
+  EFI_FILE_HANDLE file;
+  UINTN tc;
+
+  if(!assert_intn_greater_than_or_equal_to(1,get_volume_count(),L"volume count"))
+    return;
+  assert_not_null(get_volume_root(0),L"first volume's root");
+  assert_true(get_volume_root(0)==get_volume_root(0),L"cached root handle");
+  assert_null(get_volume_root(get_volume_count()),L"invalid volume");
+
+  for(tc=0;tc<3;tc++)
+  {
+    file=find_file(L"\\startup.nsh");
+    if(!assert_not_null(file,L"existing file"))
+      return;
+    file->Close(file);
+    if(tc==1)
+      flush_file_system_cache();
+  }
+
+  assert_null(find_file(L"\\does-not-exist.txt"),L"missing file");
+  assert_null(find_file(L"\\does-not-exist\\file.txt"),L"missing directory");
+  assert_null(find_file_on_volume(get_volume_count(),L"\\startup.nsh"),L"invalid volume");
+}
+
+/**
+ * Makes sure asynchronous reads return the same contents as synchronous ones.
+ *
+ * \test start_async_read() reads multiple files concurrently
+ * \test get_async_read_progress() reports completion once all reads are done
+ * \test finish_async_read() returns the files' contents
+ * \test finish_async_read() returns NULL if the read couldn't start
+ */
+void test_async_read()
+{
+  async_read_t reads[3];
+  file_contents_t *expected, *actual;
+
+  assert_intn_equals(EFI_SUCCESS,start_async_read(reads+0,L"\\startup.nsh"),L"starting 1st read");
+  assert_intn_equals(EFI_SUCCESS,start_async_read(reads+1,L"\\font815.pgm"),L"starting 2nd read");
+  assert_intn_equals(EFI_NOT_FOUND,start_async_read(reads+2,L"\\does-not-exist.txt"),L"starting read of missing file");
+
+  while(count_pending_async_reads(3,reads)>0)
+    gBS->Stall(ASYNC_READ_POLL_INTERVAL);
+  assert_double_near(1.0,0.0001,get_async_read_progress(3,reads),L"progress");
+
+  assert_null(finish_async_read(reads+2),L"missing file");
+
+  expected=get_file_contents(L"\\font815.pgm");
+  actual=finish_async_read(reads+1);
+  if(assert_not_null(expected,L"synchronous read") && assert_not_null(actual,L"asynchronous read"))
+  {
+    assert_uint64_equals(expected->data_length,actual->data_length,L"file size");
+    assert_intn_equals(0,CompareMem(expected->data,actual->data,expected->data_length),L"file contents");
+  }
+  if(expected)
+    free_pages(expected,expected->memory_pages);
+  if(actual)
+    free_pages(actual,actual->memory_pages);
+
+  actual=finish_async_read(reads+0);
+  if(assert_not_null(actual,L"asynchronous read of small file"))
+  {
+    assert_intn_equals('@',actual->data[0],L"first character");
+    free_pages(actual,actual->memory_pages);
+  }
+}
+
+/**
+ * Makes sure buffered file readers return the same data as get_file_contents().
+ * A tiny buffer is used so the file doesn't fit into it.
+ *
+ * \test read_file_line() returns all lines without line separators
+ * \test peek_file_reader() returns the next bytes without consuming them
+ * \test read_file_chunk() reads across buffer boundaries and stops at the file's end
+ * \test seek_file_reader() moves the read position
+ * \test open_file_reader() returns EFI_NOT_FOUND for missing files
+ */
+void test_file_reader()
+{
+  file_contents_t *expected;
+  file_reader_t reader;
+  ascii_view_t line, peeked;
+  CHAR8 buffer[64];
+  UINTN total=0, lines=0, read;
+
+  expected=get_file_contents(L"\\startup.nsh");
+  if(!assert_not_null(expected,L"reference contents"))
+    return;
+  if(!assert_intn_equals(EFI_SUCCESS,open_file_reader(&reader,L"\\startup.nsh",8),L"opening reader"))
+  {
+    free_pages(expected,expected->memory_pages);
+    return;
+  }
+
+  peeked=peek_file_reader(&reader,2);
+  assert_uint64_equals(2,peeked.length,L"peeked length");
+  assert_intn_equals('@',peeked.start[0],L"peeked character");
+  assert_uint64_equals(0,get_file_reader_position(&reader),L"position after peeking");
+
+  while(read_file_line(&reader,&line))
+  {
+    total+=line.length;
+    lines++;
+    assert_uint64_equals(line.length,find_ascii_char(line.start,line.length,'\n'),L"no line separator");
+  }
+  assert_uint64_equals(expected->data_length,get_file_reader_position(&reader),L"position at end");
+  assert_true(total<=expected->data_length && total+2*lines>=expected->data_length,L"total line length");
+
+  assert_intn_equals(EFI_SUCCESS,seek_file_reader(&reader,1),L"seeking");
+  read=read_file_chunk(&reader,buffer,sizeof(buffer));
+  assert_uint64_equals(expected->data_length-1<sizeof(buffer)?expected->data_length-1:sizeof(buffer),read,L"chunk length");
+  assert_intn_equals(0,CompareMem(buffer,expected->data+1,read),L"chunk contents");
+
+  assert_intn_equals(EFI_SUCCESS,seek_file_reader(&reader,expected->data_length),L"seeking to end");
+  assert_uint64_equals(0,read_file_chunk(&reader,buffer,sizeof(buffer)),L"reading at end");
+
+  close_file_reader(&reader);
+  free_pages(expected,expected->memory_pages);
+
+  assert_intn_equals(EFI_NOT_FOUND,open_file_reader(&reader,L"\\does-not-exist.txt",0),L"missing file");
+}
+
+/**
+ * Makes sure the buffered file writer works.
+ * The file is written with the smallest buffer, so both buffered and direct writes happen.
+ *
+ * \test write_file_format() and write_file_chunk() write all data in order, across buffer boundaries
+ * \test write_file_format() writes line feeds as single 0x0A bytes
+ * \test flush_file_writer() and close_file_writer() return EFI_SUCCESS
+ * \test open_file_writer() replaces existing files
+ */
+void test_file_writer()
+{
+  file_writer_t writer;
+  file_contents_t *contents;
+  EFI_FILE_HANDLE file;
+  CHAR8 *pattern;
+  UINTN tc, pattern_size=10000, text_size;
+
+  pattern=allocate_pages(3);
+  if(!assert_not_null(pattern,L"pattern buffer"))
+    return;
+  for(tc=0;tc<pattern_size;tc++)
+    pattern[tc]=(CHAR8)('a'+tc%26);
+
+  if(!assert_intn_equals(EFI_SUCCESS,open_file_writer(&writer,L"\\writer-test.txt",1),L"opening writer"))
+  {
+    free_pages(pattern,3);
+    return;
+  }
+  assert_uint64_equals(4096,writer.buffer_size,L"buffer size rounded to pages");
+  for(tc=0;tc<1000;tc++)
+    write_file_format(&writer,"line %d\n",tc);
+  text_size=writer.bytes_written;
+  assert_uint64_equals(8890,text_size,L"text size, with line feeds only");
+  write_file_chunk(&writer,pattern,5);
+  assert_intn_equals(EFI_SUCCESS,flush_file_writer(&writer),L"flushing");
+  write_file_chunk(&writer,pattern+5,pattern_size-5);
+  assert_uint64_equals(text_size+pattern_size,writer.bytes_written,L"bytes written");
+  assert_intn_equals(EFI_SUCCESS,close_file_writer(&writer),L"closing");
+
+  contents=get_file_contents(L"\\writer-test.txt");
+  if(assert_not_null(contents,L"reading file back"))
+  {
+    assert_uint64_equals(text_size+pattern_size,contents->data_length,L"file length");
+    assert_intn_equals(0,CompareMem(contents->data,"line 0\nline 1\n",14),L"text start");
+    assert_intn_equals(0,CompareMem(contents->data+text_size-9,"line 999\n",9),L"text end");
+    assert_intn_equals(0,CompareMem(contents->data+text_size,pattern,pattern_size),L"binary data");
+    free_pages(contents,contents->memory_pages);
+  }
+
+  if(assert_intn_equals(EFI_SUCCESS,open_file_writer(&writer,L"\\writer-test.txt",0),L"reopening writer"))
+  {
+    write_file_format(&writer,"%a","replaced");
+    assert_intn_equals(EFI_SUCCESS,close_file_writer(&writer),L"closing replaced file");
+    contents=get_file_contents(L"\\writer-test.txt");
+    if(assert_not_null(contents,L"reading replaced file"))
+    {
+      assert_uint64_equals(8,contents->data_length,L"replaced file length");
+      free_pages(contents,contents->memory_pages);
+    }
+  }
+
+  if((file=find_file(L"\\writer-test.txt"))!=NULL)
+    file->Delete(file);
+  free_pages(pattern,3);
+}
+
 /**
  * Test runner for this group.
  * Gets called via the generated test runner.
@@ -46,5 +246,9 @@ BOOLEAN run_files_tests()
 {
   INIT_TESTGROUP(L"files");
   RUN_TEST(test_get_file_contents,L"get_file_contents");
+  RUN_TEST(test_find_file,L"find_file");
+  RUN_TEST(test_async_read,L"asynchronous reads");
+  RUN_TEST(test_file_reader,L"buffered reader");
+  RUN_TEST(test_file_writer,L"buffered writer");
   FINISH_TESTGROUP();
 }
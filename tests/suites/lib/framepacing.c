@@ -0,0 +1,128 @@
+/** \file
+ * Tests for the frame pacer.
+ *
+ * \author Richard Nusser
+ * \copyright 2017-2018 Richard Nusser
+ * \license GPLv3 (see http://www.gnu.org/licenses/)
+ * \sa https://github.com/rinusser/UEFIStarter
+ * \ingroup group_lib_framepacing
+ */
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <UEFIStarter/framepacing.h>
+#include <UEFIStarter/core.h>
+#include <UEFIStarter/tests/tests.h>
+
+
+/**
+ * internal: prepares a frame pacer with fixed timing, so tests don't depend on the timestamp frequency.
+ *
+ * \param pacer the frame pacer to prepare
+ */
+static void _init_test_pacer(frame_pacer_t *pacer)
+{
+  reset_frame_statistics(pacer);
+  pacer->ticks_per_ms=1000;
+  pacer->budget_ticks=1000000;
+  pacer->frame_start=get_timestamp();
+  pacer->deadline=pacer->frame_start+pacer->budget_ticks;
+}
+
+/**
+ * Makes sure frame times are recorded correctly.
+ *
+ * \test frame times are sorted into 1ms histogram buckets
+ * \test frame times beyond the histogram's range are collected in the last bucket
+ * \test minimum, maximum, average and last frame times are tracked
+ */
+void test_frame_statistics()
+{
+  frame_pacer_t pacer;
+
+  _init_test_pacer(&pacer);
+  record_frame_time(&pacer,500);
+  record_frame_time(&pacer,1500);
+  record_frame_time(&pacer,16999);
+  record_frame_time(&pacer,200000);
+
+  assert_uint64_equals(4,pacer.frame_count,L"frame count");
+  assert_uint64_equals(1,pacer.histogram[0],L"bucket 0");
+  assert_uint64_equals(1,pacer.histogram[1],L"bucket 1");
+  assert_uint64_equals(1,pacer.histogram[16],L"bucket 16");
+  assert_uint64_equals(1,pacer.histogram[FRAME_HISTOGRAM_BUCKETS-1],L"last bucket");
+  assert_uint64_equals(500,pacer.min_ticks,L"min");
+  assert_uint64_equals(200000,pacer.max_ticks,L"max");
+  assert_double_near(54.74975,0.001,get_average_frame_ms(&pacer),L"average");
+  assert_double_near(200,0.001,get_last_frame_ms(&pacer),L"last frame");
+
+  reset_frame_statistics(&pacer);
+  assert_uint64_equals(0,pacer.frame_count,L"frame count after reset");
+  assert_uint64_equals(0,pacer.histogram[0],L"bucket 0 after reset");
+}
+
+/**
+ * Makes sure frame time percentiles are estimated from the histogram.
+ *
+ * \test percentiles return the upper bound of the matching histogram bucket
+ * \test percentiles in the last histogram bucket return the maximum frame time
+ * \test percentiles without recorded frames are 0
+ */
+void test_frame_time_percentiles()
+{
+  frame_pacer_t pacer;
+  UINTN tc;
+
+  _init_test_pacer(&pacer);
+  assert_double_near(0,0.001,get_frame_time_percentile_ms(&pacer,99),L"no frames");
+
+  for(tc=0;tc<99;tc++)
+    record_frame_time(&pacer,2500);
+  record_frame_time(&pacer,30000);
+  assert_double_near(3,0.001,get_frame_time_percentile_ms(&pacer,50),L"p50");
+  assert_double_near(3,0.001,get_frame_time_percentile_ms(&pacer,99),L"p99");
+  assert_double_near(31,0.001,get_frame_time_percentile_ms(&pacer,100),L"p100");
+
+  record_frame_time(&pacer,500000);
+  assert_double_near(500,0.001,get_frame_time_percentile_ms(&pacer,100),L"p100 beyond histogram");
+}
+
+/**
+ * Makes sure missed deadlines are counted as dropped frames.
+ *
+ * \test missing a deadline by 2.5 frame budgets drops 3 frames
+ * \test the next deadline gets scheduled one budget after the late frame
+ * \test the remaining budget is 0 after the deadline passed
+ */
+void test_dropped_frames()
+{
+  frame_pacer_t pacer;
+  UINT64 before;
+
+  _init_test_pacer(&pacer);
+  pacer.deadline=get_timestamp()-pacer.budget_ticks*5/2;
+  before=get_timestamp();
+  assert_uint64_equals(EFI_SUCCESS,end_frame(&pacer),L"end frame");
+  assert_uint64_equals(3,pacer.dropped_frames,L"dropped frames");
+  assert_uint64_equals(1,pacer.frame_count,L"frame count");
+  assert_intn_greater_than_or_equal_to(before+pacer.budget_ticks,pacer.deadline,L"next deadline");
+
+  pacer.deadline=get_timestamp()-1;
+  assert_uint64_equals(0,get_frame_budget_remaining_ticks(&pacer),L"remaining budget");
+}
+
+
+/**
+ * Test runner for this group.
+ * Gets called via the generated test runner.
+ *
+ * \return whether the test group was executed
+ */
+BOOLEAN run_framepacing_tests()
+{
+  INIT_TESTGROUP(L"frame pacing");
+  RUN_TEST(test_frame_statistics,L"frame statistics");
+  RUN_TEST(test_frame_time_percentiles,L"frame time percentiles");
+  RUN_TEST(test_dropped_frames,L"dropped frames");
+  FINISH_TESTGROUP();
+}
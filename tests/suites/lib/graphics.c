@@ -17,6 +17,9 @@
 #include <UEFIStarter/tests/tests.h>
 
 
+/** the asset loaded by the image asset benchmarks, in a subdirectory so the directory handle cache gets used */
+#define ASSET_BENCHMARK_FILENAME L"\\benchmark\\tile.pgm"
+
 /******************
  * Image resources
  ***/
@@ -190,6 +193,207 @@ void test_parse_pbm_image_data()
 }
 
 
+//netpbm: files
+
+/**
+ * Makes sure load_netpbm_file() loads the bundled images within time and memory limits.
+ * The memory limit is the file's contents plus the resulting image: anything more means the loader keeps extra copies.
+ *
+ * \test load_netpbm_file() reads a PPM file's dimensions
+ * \test load_netpbm_file() reads a PGM file's dimensions
+ * \test load_netpbm_file() reads files in subdirectories
+ * \test load_netpbm_file() doesn't take longer than 500ms for either file
+ * \test load_netpbm_file() doesn't need more than 133 tracked pages at once for a 320x240 PPM file
+ */
+void test_load_netpbm_file()
+{
+  image_t *image;
+
+  image=load_netpbm_file(L"\\demoimg.ppm");
+  assert_not_null(image,L"PPM image");
+  if(image)
+  {
+    assert_intn_equals(320,image->width,L"PPM width");
+    assert_intn_equals(240,image->height,L"PPM height");
+    free_image(image);
+  }
+
+  image=load_netpbm_file(L"\\font815.pgm");
+  assert_not_null(image,L"PGM image");
+  if(image)
+  {
+    assert_intn_equals(258,image->width,L"PGM width");
+    assert_intn_equals(61,image->height,L"PGM height");
+    free_image(image);
+  }
+
+  image=load_netpbm_file(ASSET_BENCHMARK_FILENAME);
+  assert_not_null(image,L"image in subdirectory");
+  if(image)
+  {
+    assert_intn_equals(32,image->width,L"subdirectory image width");
+    free_image(image);
+  }
+
+  assert_max_duration_us(500000,L"load duration");
+  assert_max_pages(133,L"peak memory pages");
+}
+
+/**
+ * Makes sure save_ppm_image() writes images that load_netpbm_file() reads back unchanged.
+ * The image has more pixels than are converted at once, so multiple chunks get written.
+ *
+ * \test save_ppm_image() writes an image's dimensions and color channels
+ * \test save_ppm_image() returns EFI_INVALID_PARAMETER for NULL images
+ */
+void test_save_ppm_image()
+{
+  image_t *image, *loaded;
+  EFI_FILE_HANDLE file;
+  UINTN tc, count=100*25, mismatches=0;
+
+  image=create_image(100,25);
+  if(!assert_not_null(image,L"image"))
+    return;
+  for(tc=0;tc<count;tc++)
+  {
+    image->data[tc].Red=(UINT8)tc;
+    image->data[tc].Green=(UINT8)(tc>>8);
+    image->data[tc].Blue=(UINT8)(255-tc);
+  }
+
+  assert_intn_equals(EFI_SUCCESS,save_ppm_image(image,L"\\save-test.ppm"),L"saving");
+  loaded=load_netpbm_file(L"\\save-test.ppm");
+  if(assert_not_null(loaded,L"loading saved image"))
+  {
+    assert_intn_equals(100,loaded->width,L"width");
+    assert_intn_equals(25,loaded->height,L"height");
+    for(tc=0;tc<count;tc++)
+      if(loaded->data[tc].Red!=image->data[tc].Red || loaded->data[tc].Green!=image->data[tc].Green
+         || loaded->data[tc].Blue!=image->data[tc].Blue)
+        mismatches++;
+    assert_uint64_equals(0,mismatches,L"mismatched pixels");
+    free_image(loaded);
+  }
+  free_image(image);
+
+  if((file=find_file(L"\\save-test.ppm"))!=NULL)
+    file->Delete(file);
+  assert_intn_equals(EFI_INVALID_PARAMETER,save_ppm_image(NULL,L"\\save-test.ppm"),L"NULL image");
+}
+
+/**
+ * Makes sure load_image_manifest() loads images into a single allocation.
+ *
+ * \test load_image_manifest() loads PPM and PGM images with correct dimensions and contents
+ * \test load_image_manifest() sets missing assets to NULL and reports the error
+ * \test load_image_manifest() records each asset's file size
+ * \test free_image_manifest() frees all images and sets them to NULL
+ */
+void test_load_image_manifest()
+{
+  image_t *ppm=NULL, *pgm=NULL, *missing=NULL, *expected;
+  image_asset_t assets[]={
+    {&ppm,L"\\demoimg.ppm"},
+    {&missing,L"\\does-not-exist.ppm"},
+    {&pgm,L"\\font815.pgm"},
+  };
+  image_manifest_t manifest;
+
+  assert_intn_equals(EFI_NOT_FOUND,load_image_manifest(&manifest,3,assets),L"result");
+  assert_null(missing,L"missing image");
+  if(!assert_not_null(ppm,L"PPM image") || !assert_not_null(pgm,L"PGM image"))
+  {
+    free_image_manifest(&manifest);
+    return;
+  }
+  assert_intn_equals(320,ppm->width,L"PPM width");
+  assert_intn_equals(240,ppm->height,L"PPM height");
+  assert_intn_equals(258,pgm->width,L"PGM width");
+  assert_intn_equals(61,pgm->height,L"PGM height");
+  assert_intn_equals(0,assets[1].file_bytes,L"missing file's size");
+  assert_uint64_equals(assets[0].file_bytes+assets[2].file_bytes,manifest.total_file_bytes,L"total size");
+  assert_true((UINT8 *)pgm>(UINT8 *)ppm && (UINT8 *)pgm<(UINT8 *)manifest.arena+manifest.arena_pages*4096,L"shared memory");
+
+  expected=load_netpbm_file(L"\\font815.pgm");
+  if(assert_not_null(expected,L"reference image"))
+  {
+    assert_intn_equals(0,CompareMem(expected->data,pgm->data,pgm->width*pgm->height*sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL)),L"PGM contents");
+    free_image(expected);
+  }
+
+  free_image_manifest(&manifest);
+  assert_null(ppm,L"PPM image after freeing");
+  assert_null(pgm,L"PGM image after freeing");
+}
+
+/** number of assets loaded per benchmark iteration */
+#define ASSET_BENCHMARK_COUNT 16
+
+/** image storage for the asset loading benchmarks */
+static image_t *_benchmark_images[ASSET_BENCHMARK_COUNT];
+
+/**
+ * Internal: loads and frees a batch of small image assets.
+ *
+ * \param flush_cache  whether to flush the file system cache before each asset, as every file access used to
+ * \param use_manifest whether to load the assets as manifest instead
+ */
+static void _load_benchmark_assets(BOOLEAN flush_cache, BOOLEAN use_manifest)
+{
+  image_asset_t assets[ASSET_BENCHMARK_COUNT];
+  image_manifest_t manifest;
+  UINTN tc;
+
+  for(tc=0;tc<ASSET_BENCHMARK_COUNT;tc++)
+  {
+    assets[tc].image=&_benchmark_images[tc];
+    assets[tc].filename=ASSET_BENCHMARK_FILENAME;
+  }
+  if(use_manifest)
+  {
+    load_image_manifest(&manifest,ASSET_BENCHMARK_COUNT,assets);
+    free_image_manifest(&manifest);
+    return;
+  }
+  if(flush_cache)
+  {
+    for(tc=0;tc<ASSET_BENCHMARK_COUNT;tc++)
+    {
+      flush_file_system_cache();
+      load_image_assets(1,assets+tc);
+    }
+  }
+  else
+    load_image_assets(ASSET_BENCHMARK_COUNT,assets);
+  free_image_assets(ASSET_BENCHMARK_COUNT,assets);
+}
+
+/**
+ * Benchmarks loading 16 image assets from a subdirectory with cached volume and directory handles.
+ */
+void benchmark_load_image_assets()
+{
+  _load_benchmark_assets(FALSE,FALSE);
+}
+
+/**
+ * Benchmarks loading 16 image assets as manifest.
+ */
+void benchmark_load_image_manifest()
+{
+  _load_benchmark_assets(FALSE,TRUE);
+}
+
+/**
+ * Benchmarks loading 16 image assets while looking up the volume and subdirectory for each file, for comparison.
+ */
+void benchmark_load_image_assets_uncached()
+{
+  _load_benchmark_assets(TRUE,FALSE);
+}
+
+
 /*********************
  * Image manipulation
  ***/
@@ -405,12 +609,16 @@ static glyph_list_t *_get_parse_glyphs_font()
  * \test parse_glyphs() initializes the glyph list correctly
  * \test parse_glyphs() splits an input text of 4 characters into 4 glyphs
  * \test parse_glyphs() reads glyphs correctly when given a multiline input string
+ * \test parse_glyphs() doesn't take longer than 10ms or need more than 2 tracked pages at once for 4 glyphs
  */
 void test_parse_glyphs()
 {
   UINT8 expected_glyph_data[8*15];
   glyph_list_t *glyphs=_get_parse_glyphs_font();
 
+  assert_max_duration_us(10000,L"parse duration");
+  assert_max_pages(2,L"peak memory pages");
+
   assert_intn_equals(1,glyphs->memory_pages,L"memory pages");
   assert_intn_equals(4,glyphs->glyph_count,L"glyph count");
 
@@ -495,6 +703,12 @@ BOOLEAN run_graphics_tests()
   RUN_TEST(test_parse_ppm_image_data,L"PPM image parser");
   RUN_TEST(test_parse_pgm_image_data,L"PGM image parser");
   RUN_TEST(test_parse_pbm_image_data,L"PBM image parser");
+  RUN_TEST(test_load_netpbm_file,L"netpbm file loader");
+  RUN_TEST(test_save_ppm_image,L"PPM file export");
+  RUN_BENCHMARK(benchmark_load_image_assets,L"load 16 image assets");
+  RUN_BENCHMARK(benchmark_load_image_assets_uncached,L"load 16 image assets, uncached volume");
+  RUN_TEST(test_load_image_manifest,L"image manifest loader");
+  RUN_BENCHMARK(benchmark_load_image_manifest,L"load 16 image assets as manifest");
 
   RUN_TEST(test_rotate_image,L"arbitrary image rotation");
 
@@ -103,6 +103,156 @@ void test_logger()
 }
 
 
+/** number of times _counted_argument() was called */
+static UINTN _argument_evaluations;
+
+/**
+ * Log argument that counts how often it gets evaluated.
+ *
+ * \return a constant value to log
+ */
+static UINTN _counted_argument()
+{
+  _argument_evaluations++;
+  return 123;
+}
+
+/**
+ * Makes sure the LOG_* macros only evaluate arguments of messages that get logged.
+ *
+ * \test arguments of messages below the current log level aren't evaluated
+ * \test filtered messages still count towards get_logger_entry_count(), unless they're compiled out
+ * \test messages at or above the current log level get logged with evaluated arguments
+ */
+void test_log_macros()
+{
+  logger_print_function_t *previous_logger;
+  LOGLEVEL previous_level;
+
+  _reset_log_counts();
+  _argument_evaluations=0;
+  previous_level=set_log_level(INFO);
+  previous_logger=set_logger_function(_counting_logger);
+  reset_logger_entry_counts();
+
+  LOG_TRACE(L"%d",_counted_argument());
+  LOG_DEBUG(L"%d",_counted_argument());
+  assert_intn_equals(0,_argument_evaluations,L"filtered argument evaluations");
+  assert_intn_equals(TRACE<=LOG_COMPILE_LEVEL,get_logger_entry_count(TRACE),L"filtered trace entry count");
+  assert_intn_equals(DEBUG<=LOG_COMPILE_LEVEL,get_logger_entry_count(DEBUG),L"filtered debug entry count");
+  _assert_log_counts(0,0,0,0,0);
+
+  LOG_INFO(L"%d",_counted_argument());
+  LOG_WARN(L"%d",_counted_argument());
+  LOG_ERROR(L"%d",_counted_argument());
+  assert_intn_equals(3,_argument_evaluations,L"logged argument evaluations");
+  assert_intn_equals(1,get_logger_entry_count(INFO),L"info entry count");
+  _assert_log_counts(1,1,1,0,0);
+
+  set_log_level(OFF);
+  LOG_ERROR(L"%d",_counted_argument());
+  assert_intn_equals(3,_argument_evaluations,L"argument evaluations with logging disabled");
+  assert_intn_equals(2,get_logger_entry_count(ERROR),L"error entry count with logging disabled");
+
+  set_logger_function(previous_logger);
+  set_log_level(previous_level);
+}
+
+
+/** copy of the last message received by _capturing_logger() */
+static CHAR16 _last_message[256];
+
+/**
+ * A log printer that counts entries like _counting_logger() and keeps a copy of the last message.
+ *
+ * \param level the entry's log level
+ * \param msg   the entry's log message
+ */
+static void _capturing_logger(LOGLEVEL level, CHAR16 *msg)
+{
+  _log_counts[level]++;
+  UnicodeSPrint(_last_message,sizeof(_last_message),L"%s",msg);
+}
+
+/**
+ * Assertion for the end of the last captured message.
+ * Deferred log messages are prefixed with a timestamp, so only the end of the message is compared.
+ *
+ * \param expected the expected end of the message
+ */
+static void _assert_last_message_ends_with(CHAR16 *expected)
+{
+  UINTN expected_length=StrLen(expected);
+  UINTN actual_length=StrLen(_last_message);
+
+  if(!assert_intn_greater_than_or_equal_to(expected_length,actual_length,L"message length"))
+    return;
+  assert_wcstr_equals(expected,_last_message+actual_length-expected_length,L"message");
+}
+
+/**
+ * Makes sure deferred logging works.
+ *
+ * \test deferred messages aren't printed until the log is flushed
+ * \test deferred messages still count towards get_logger_entry_count()
+ * \test messages below the current log level aren't stored
+ * \test flushed messages are formatted with the arguments passed when logging, including "*" widths
+ * \test when the ring buffer overflows only the newest entries are printed, after a warning
+ * \test messages with too many arguments are printed immediately
+ * \test disabling deferred logging flushes the remaining entries
+ */
+void test_deferred_logging()
+{
+  logger_print_function_t *previous_logger;
+  LOGLEVEL previous_level;
+
+  _reset_log_counts();
+  previous_level=set_log_level(INFO);
+  previous_logger=set_logger_function(_capturing_logger);
+  reset_logger_entry_counts();
+
+  assert_uint64_equals(EFI_INVALID_PARAMETER,enable_deferred_logging(0),L"capacity 0");
+  assert_uint64_equals(EFI_SUCCESS,enable_deferred_logging(3),L"enable");
+
+  LOG.info(L"first %d %s",12,L"abc");
+  LOG.debug(L"filtered %d",1);
+  LOG.warn(L"second %5d|%-*d|%ld%%",34,4,5,0x123456789ABCDEFULL);
+  _assert_log_counts(0,0,0,0,0);
+  assert_intn_equals(1,get_logger_entry_count(INFO),L"info entry count");
+  assert_intn_equals(1,get_logger_entry_count(WARN),L"warn entry count");
+
+  assert_intn_equals(2,flush_deferred_log(),L"flushed entries");
+  _assert_log_counts(0,1,1,0,0);
+  _assert_last_message_ends_with(L"second    34|5   |81985529216486895%");
+  assert_intn_equals(0,flush_deferred_log(),L"flushed again");
+
+  LOG.info(L"overwritten");
+  LOG.info(L"kept %d",1);
+  LOG.info(L"kept %d",2);
+  LOG.info(L"kept %d",3);
+  _reset_log_counts();
+  assert_intn_equals(3,flush_deferred_log(),L"flushed after overflow");
+  _assert_log_counts(0,1,3,0,0);
+  _assert_last_message_ends_with(L"kept 3");
+
+  _reset_log_counts();
+  LOG.info(L"%d%d%d%d%d%d%d%d%d",1,2,3,4,5,6,7,8,9);
+  _assert_log_counts(0,0,1,0,0);
+  assert_wcstr_equals(L"123456789",_last_message,L"immediate message");
+
+  LOG.info(L"last");
+  disable_deferred_logging();
+  _assert_log_counts(0,0,2,0,0);
+  _assert_last_message_ends_with(L"last");
+
+  LOG.info(L"immediate");
+  assert_wcstr_equals(L"immediate",_last_message,L"message after disabling");
+
+  set_logger_function(previous_logger);
+  set_log_level(previous_level);
+}
+
+
 /**
  * Test runner for this group.
  * Gets called via the generated test runner.
@@ -113,5 +263,7 @@ BOOLEAN run_logger_tests()
 {
   INIT_TESTGROUP(L"logger");
   RUN_TEST(test_logger,L"logger");
+  RUN_TEST(test_log_macros,L"log macros");
+  RUN_TEST(test_deferred_logging,L"deferred logging");
   FINISH_TESTGROUP();
 }
@@ -77,6 +77,35 @@ void test_pool_tracking()
   assert_intn_equals(3,result,L"function should return number of freed entries");
 }
 
+/**
+ * Makes sure the peak number of tracked pages is recorded.
+ *
+ * \test allocating tracked pages raises the current and peak page counts
+ * \test freeing tracked pages lowers the current page count but keeps the peak
+ * \test resetting the peak page count sets it to the current page count
+ * \test untracked pages aren't counted
+ */
+void test_peak_page_tracking()
+{
+  void *ptr1, *ptr2, *untracked;
+  UINTN base=get_tracked_page_count();
+
+  reset_peak_tracked_page_count();
+  ptr1=allocate_pages(2);
+  ptr2=allocate_pages(3);
+  untracked=allocate_pages_ex(4,FALSE,AllocateAnyPages,NULL);
+  assert_intn_equals(base+5,get_tracked_page_count(),L"current after allocation");
+  assert_intn_equals(base+5,get_peak_tracked_page_count(),L"peak after allocation");
+
+  free_pages(ptr2,3);
+  free_pages_ex(untracked,4,FALSE);
+  assert_intn_equals(base+2,get_tracked_page_count(),L"current after free");
+  assert_intn_equals(base+5,get_peak_tracked_page_count(),L"peak after free");
+
+  reset_peak_tracked_page_count();
+  assert_intn_equals(base+2,get_peak_tracked_page_count(),L"peak after reset");
+  free_pages(ptr1,2);
+}
 
 /**
  * Test runner for this group.
@@ -89,5 +118,6 @@ BOOLEAN run_memory_tests()
   INIT_TESTGROUP(L"memory");
   RUN_TEST(test_page_tracking,L"page tracking");
   RUN_TEST(test_pool_tracking,L"pool tracking");
+  RUN_TEST(test_peak_page_tracking,L"peak page tracking");
   FINISH_TESTGROUP();
 }
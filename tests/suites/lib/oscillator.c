@@ -0,0 +1,203 @@
+/** \file
+ * Tests for wavetable oscillator functions.
+ *
+ * \author Richard Nusser
+ * \copyright 2017-2018 Richard Nusser
+ * \license GPLv3 (see http://www.gnu.org/licenses/)
+ * \sa https://github.com/rinusser/UEFIStarter
+ * \ingroup group_lib_oscillator
+ */
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <UEFIStarter/oscillator.h>
+#include <UEFIStarter/core.h>
+#include <UEFIStarter/tests/tests.h>
+
+
+/** data type for test_phase_increment() test cases */
+typedef struct
+{
+  UINT32 expected;     /**< the expected phase increment */
+  double frequency;    /**< the input frequency */
+  UINT32 sample_rate;  /**< the input sample rate */
+} phase_increment_testcase_t;
+
+/** test cases for test_phase_increment() */
+phase_increment_testcase_t phase_increment_testcases[]={
+  {42852281,  440.0,   44100},
+  {0x40000000,12000.0, 48000},
+  {0x01000000,187.5,   48000},
+  {0,         0.0,     48000},
+  {0,         24000.0, 48000},
+  {0,         30000.0, 48000},
+  {0,         440.0,   0},
+};
+
+/**
+ * Makes sure phase increments are calculated correctly.
+ *
+ * \test oscillator_phase_increment() maps one period to the full 32 bit range, rounded to the nearest integer
+ * \test oscillator_phase_increment() returns 0 for frequencies at or above the Nyquist frequency
+ * \test oscillator_phase_increment() returns 0 for a sample rate of 0
+ */
+void test_phase_increment()
+{
+  UINTN tc, count=sizeof(phase_increment_testcases)/sizeof(phase_increment_testcase_t);
+  phase_increment_testcase_t *cases=phase_increment_testcases;
+
+  for(tc=0;tc<count;tc++)
+    assert_uint64_equals(cases[tc].expected,oscillator_phase_increment(cases[tc].frequency,cases[tc].sample_rate),L"increment");
+}
+
+/**
+ * Makes sure the generated wavetables have the expected shape.
+ *
+ * \test the sine table starts at 0, peaks at a quarter period and bottoms out at three quarters
+ * \test the square table is positive for the first half period and negative for the second
+ * \test the sawtooth table rises from minimum to maximum
+ * \test the triangle table peaks at a quarter period and bottoms out at three quarters
+ * \test invalid waveforms are rejected
+ */
+void test_wavetables()
+{
+  const INT16 *table;
+  LOGLEVEL previous_log_level;
+
+  table=get_wavetable(WAVEFORM_SINE);
+  assert_intn_equals(0,table[0],L"sine start");
+  assert_intn_in_closed_interval(32760,32767,table[OSCILLATOR_TABLE_SIZE/4],L"sine peak");
+  assert_intn_in_closed_interval(-1,1,table[OSCILLATOR_TABLE_SIZE/2],L"sine center");
+  assert_intn_in_closed_interval(-32767,-32760,table[OSCILLATOR_TABLE_SIZE*3/4],L"sine trough");
+
+  table=get_wavetable(WAVEFORM_SQUARE);
+  assert_intn_equals(OSCILLATOR_MAX_AMPLITUDE,table[OSCILLATOR_TABLE_SIZE/2-1],L"square high");
+  assert_intn_equals(-OSCILLATOR_MAX_AMPLITUDE,table[OSCILLATOR_TABLE_SIZE/2],L"square low");
+
+  table=get_wavetable(WAVEFORM_SAWTOOTH);
+  assert_intn_equals(-32768,table[0],L"sawtooth start");
+  assert_intn_equals(0,table[OSCILLATOR_TABLE_SIZE/2],L"sawtooth center");
+  assert_intn_greater_than_or_equal_to(32700,table[OSCILLATOR_TABLE_SIZE-1],L"sawtooth end");
+
+  table=get_wavetable(WAVEFORM_TRIANGLE);
+  assert_intn_equals(0,table[0],L"triangle start");
+  assert_intn_equals(OSCILLATOR_MAX_AMPLITUDE,table[OSCILLATOR_TABLE_SIZE/4],L"triangle peak");
+  assert_intn_equals(-OSCILLATOR_MAX_AMPLITUDE,table[OSCILLATOR_TABLE_SIZE*3/4],L"triangle trough");
+
+  previous_log_level=get_log_level();
+  set_log_level(OFF);
+  assert_null((void *)get_wavetable(WAVEFORM_COUNT),L"invalid waveform");
+  set_log_level(previous_log_level);
+}
+
+/**
+ * Makes sure the sawtooth oscillator matches the direct per-sample calculation it replaces in the AC'97 demo.
+ *
+ * \test a sawtooth with a period of 64 samples matches ((tc%64)*60000/64-30000) within rounding errors
+ * \test the phase continues across consecutive fill calls
+ */
+void test_sawtooth_output()
+{
+  INT16 buffer[256];
+  oscillator_t osc;
+  UINTN tc;
+
+  assert_uint64_equals(EFI_SUCCESS,init_oscillator(&osc,WAVEFORM_SAWTOOTH,750,48000,30000),L"init");
+  oscillator_fill_s16(&osc,buffer,100,1);
+  oscillator_fill_s16(&osc,buffer+100,156,1);
+
+  for(tc=0;tc<256;tc++)
+    assert_intn_in_closed_interval((tc%64)*60000/64-30000-1,(tc%64)*60000/64-30000+1,buffer[tc],L"sample");
+}
+
+/**
+ * Makes sure interleaved buffers and attack ramps work.
+ *
+ * \test a stride of 2 only writes every other sample
+ * \test the attack ramp starts at 0 and reaches full amplitude after the configured number of samples
+ * \test restarting the oscillator restarts the attack ramp
+ */
+void test_stride_and_attack()
+{
+  INT16 buffer[64];
+  oscillator_t osc;
+  UINTN tc;
+
+  for(tc=0;tc<64;tc++)
+    buffer[tc]=1234;
+
+  init_oscillator(&osc,WAVEFORM_SQUARE,100,48000,20000);
+  set_oscillator_attack(&osc,16);
+  oscillator_fill_s16(&osc,buffer,32,2);
+
+  for(tc=0;tc<32;tc++)
+    assert_intn_equals(1234,buffer[tc*2+1],L"untouched channel");
+  assert_intn_equals(0,buffer[0],L"attack start");
+  assert_intn_in_closed_interval(9990,10000,buffer[16],L"attack center");
+  for(tc=16;tc<32;tc++)
+    assert_intn_in_closed_interval(19990,20000,buffer[tc*2],L"after attack");
+
+  restart_oscillator(&osc);
+  oscillator_fill_s16(&osc,buffer,1,1);
+  assert_intn_equals(0,buffer[0],L"restarted attack");
+}
+
+/**
+ * Makes sure the tone generator rejects invalid parameters.
+ *
+ * \test generate_tone_s16() fills all channels of interleaved buffers
+ * \test generate_tone_s16() rejects frequencies above the Nyquist frequency
+ * \test generate_tone_s16() rejects amplitudes above OSCILLATOR_MAX_AMPLITUDE
+ */
+void test_generate_tone()
+{
+  INT16 buffer[32];
+  LOGLEVEL previous_log_level;
+  UINTN tc;
+
+  assert_uint64_equals(EFI_SUCCESS,generate_tone_s16(buffer,16,2,WAVEFORM_TRIANGLE,3000,48000,16000),L"valid tone");
+  for(tc=0;tc<16;tc++)
+    assert_intn_equals(buffer[tc*2],buffer[tc*2+1],L"channels");
+  assert_intn_in_closed_interval(15990,16000,buffer[8],L"triangle peak");
+
+  previous_log_level=get_log_level();
+  set_log_level(OFF);
+  assert_uint64_equals(EFI_INVALID_PARAMETER,generate_tone_s16(buffer,16,2,WAVEFORM_SINE,25000,48000,1000),L"frequency");
+  assert_uint64_equals(EFI_INVALID_PARAMETER,generate_tone_s16(buffer,16,2,WAVEFORM_SINE,1000,48000,40000),L"amplitude");
+  set_log_level(previous_log_level);
+}
+
+/** oscillator for benchmark_oscillator_fill() */
+static oscillator_t _benchmark_oscillator;
+
+/** output buffer for benchmark_oscillator_fill() */
+static INT16 _benchmark_buffer[1024];
+
+/**
+ * Benchmarks filling an interleaved stereo buffer, as the AC'97 demo does.
+ */
+void benchmark_oscillator_fill()
+{
+  oscillator_fill_s16(&_benchmark_oscillator,_benchmark_buffer,512,2);
+}
+
+
+/**
+ * Test runner for this group.
+ * Gets called via the generated test runner.
+ *
+ * \return whether the test group was executed
+ */
+BOOLEAN run_oscillator_tests()
+{
+  INIT_TESTGROUP(L"oscillator");
+  RUN_TEST(test_phase_increment,L"phase increment");
+  RUN_TEST(test_wavetables,L"wavetables");
+  RUN_TEST(test_sawtooth_output,L"sawtooth output");
+  RUN_TEST(test_stride_and_attack,L"stride and attack");
+  RUN_TEST(test_generate_tone,L"tone generator");
+
+  init_oscillator(&_benchmark_oscillator,WAVEFORM_SINE,440,48000,20000);
+  RUN_BENCHMARK(benchmark_oscillator_fill,L"fill 512 stereo samples");
+  FINISH_TESTGROUP();
+}
@@ -0,0 +1,218 @@
+/** \file
+ * Tests for particle systems.
+ *
+ * \author Richard Nusser
+ * \copyright 2017-2018 Richard Nusser
+ * \license GPLv3 (see http://www.gnu.org/licenses/)
+ * \sa https://github.com/rinusser/UEFIStarter
+ * \ingroup group_lib_particles
+ */
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <UEFIStarter/particles.h>
+#include <UEFIStarter/core.h>
+#include <UEFIStarter/tests/tests.h>
+
+
+#define TEST_PARTICLE_COUNT 10         /**< the number of particles in test systems */
+#define BENCHMARK_PARTICLE_COUNT 16384 /**< the number of particles in the benchmark's system */
+
+
+/**
+ * Makes sure the random number generator is deterministic and stays in range.
+ *
+ * \test seed_random() with the same seed makes next_random() return the same numbers
+ * \test seed_random() with different seeds makes next_random() return different numbers
+ * \test next_random_below() returns numbers smaller than the bound, 0 for bound 0
+ */
+void test_random_numbers()
+{
+  random_t first, second;
+  UINTN tc, differences=0;
+  UINT32 value;
+  BOOLEAN in_range=TRUE;
+
+  seed_random(&first,12345);
+  seed_random(&second,12345);
+  for(tc=0;tc<100;tc++)
+    if(next_random(&first)!=next_random(&second))
+      break;
+  assert_uint64_equals(100,tc,L"identical numbers for identical seeds");
+
+  seed_random(&first,12345);
+  seed_random(&second,12346);
+  for(tc=0;tc<100;tc++)
+    if(next_random(&first)!=next_random(&second))
+      differences++;
+  assert_true(differences>90,L"different numbers for different seeds");
+
+  for(tc=0;tc<1000;tc++)
+  {
+    value=next_random_below(&first,7);
+    if(value>=7)
+      in_range=FALSE;
+  }
+  assert_true(in_range,L"numbers within bound");
+  assert_uint64_equals(0,next_random_below(&first,0),L"bound 0");
+}
+
+/**
+ * internal: spawn callback for tests, puts particles in row 0 at their index's column.
+ * Particles move down 1.5 rows per update, odd particles respond to drift only half.
+ *
+ * \param system the particle system
+ * \param index  the index of the particle to spawn
+ */
+static void _spawn_test_particle(particle_system_t *system, UINTN index)
+{
+  system->x[index]=PARTICLE_FROM_INT(index);
+  system->y[index]=0;
+  system->velocity_x[index]=0;
+  system->velocity_y[index]=PARTICLE_FROM_DOUBLE(1.5);
+  system->drift_response[index]=index%2?PARTICLE_FIXED_ONE/2:PARTICLE_FIXED_ONE;
+  system->shade[index]=(UINT8)index;
+}
+
+/**
+ * Makes sure particles move by their velocity and drift, and get respawned below the limit.
+ *
+ * \test init_particle_system() spawns all particles
+ * \test update_particles() moves particles by their velocity plus drift scaled by their drift response
+ * \test update_particles() respawns particles below the limit and returns their number
+ * \test free_particle_system() frees the particle arrays
+ */
+void test_update_particles()
+{
+  particle_system_t system;
+  UINTN tc;
+
+  if(!assert_intn_equals(EFI_SUCCESS,init_particle_system(&system,TEST_PARTICLE_COUNT,PARTICLE_FROM_INT(2),_spawn_test_particle,1,NULL),L"creating system"))
+    return;
+  assert_uint64_equals(TEST_PARTICLE_COUNT,system.count,L"particle count");
+  assert_intn_equals(PARTICLE_FROM_INT(3),system.x[3],L"spawned column");
+  assert_uint64_equals(3,system.shade[3],L"spawned shade");
+
+  assert_uint64_equals(0,update_particles(&system,PARTICLE_FROM_INT(2),0),L"respawns after 1st update");
+  assert_intn_equals(PARTICLE_FROM_INT(2),system.x[0],L"column with full drift");
+  assert_intn_equals(PARTICLE_FROM_INT(2),system.x[1],L"column with half drift");
+  assert_intn_equals(PARTICLE_FROM_DOUBLE(1.5),system.y[0],L"row after 1st update");
+
+  assert_uint64_equals(TEST_PARTICLE_COUNT,update_particles(&system,0,0),L"respawns after 2nd update");
+  for(tc=0;tc<TEST_PARTICLE_COUNT;tc++)
+    if(system.y[tc]!=0 || system.x[tc]!=PARTICLE_FROM_INT(tc))
+      break;
+  assert_uint64_equals(TEST_PARTICLE_COUNT,tc,L"respawned particles");
+
+  free_particle_system(&system);
+  assert_null(system.memory,L"memory after freeing");
+}
+
+/**
+ * Makes sure invalid particle systems are rejected.
+ *
+ * \test init_particle_system() returns EFI_INVALID_PARAMETER for 0 particles or without spawn callback
+ */
+void test_invalid_particle_system()
+{
+  particle_system_t system;
+
+  assert_intn_equals(EFI_INVALID_PARAMETER,init_particle_system(&system,0,0,_spawn_test_particle,1,NULL),L"0 particles");
+  assert_intn_equals(EFI_INVALID_PARAMETER,init_particle_system(&system,1,0,NULL,1,NULL),L"no spawn callback");
+}
+
+/**
+ * internal: render callback for tests, counts rendered particles and checks their coordinates.
+ *
+ * \param system  the particle system
+ * \param index   the index of the particle to render
+ * \param x       the particle's column
+ * \param y       the particle's row
+ * \param context the number of rendered particles, as UINTN[2]: the count and the number of mismatched coordinates
+ */
+static void _render_test_particle(particle_system_t *system, UINTN index, INT32 x, INT32 y, void *context)
+{
+  UINTN *counts=context;
+
+  counts[0]++;
+  if(x!=PARTICLE_TO_INT(system->x[index]) || y!=PARTICLE_TO_INT(system->y[index]))
+    counts[1]++;
+}
+
+/**
+ * Makes sure only particles within the rendered area get rendered.
+ *
+ * \test render_particles() calls the render callback for particles within the area, with integer coordinates
+ * \test render_particles() skips particles left of, right of, above and below the area
+ */
+void test_render_particles()
+{
+  particle_system_t system;
+  UINTN counts[2]={0,0};
+
+  if(!assert_intn_equals(EFI_SUCCESS,init_particle_system(&system,TEST_PARTICLE_COUNT,PARTICLE_FROM_INT(100),_spawn_test_particle,1,NULL),L"creating system"))
+    return;
+  system.x[0]=-1;
+  system.y[1]=PARTICLE_FROM_DOUBLE(-0.5);
+  system.y[2]=PARTICLE_FROM_DOUBLE(2.5);
+  system.y[3]=PARTICLE_FROM_DOUBLE(3.5);
+
+  //particles 0, 1, 3 and 8+ are outside an 8x3 area
+  render_particles(&system,8,3,_render_test_particle,counts);
+  assert_uint64_equals(5,counts[0],L"rendered particles");
+  assert_uint64_equals(0,counts[1],L"mismatched coordinates");
+
+  free_particle_system(&system);
+}
+
+
+/**
+ * internal: spawn callback for the benchmark, similar to snowflakes.
+ *
+ * \param system the particle system
+ * \param index  the index of the particle to spawn
+ */
+static void _spawn_benchmark_particle(particle_system_t *system, UINTN index)
+{
+  INT32 speed=PARTICLE_FROM_INT(next_random_below(&system->random,60)+40)/100;
+
+  system->x[index]=PARTICLE_FROM_INT(next_random_below(&system->random,160));
+  system->y[index]=-PARTICLE_FROM_INT(next_random_below(&system->random,20));
+  system->velocity_x[index]=0;
+  system->velocity_y[index]=speed;
+  system->drift_response[index]=(INT32)(((INT64)speed*speed)>>PARTICLE_FIXED_SHIFT);
+  system->shade[index]=7;
+}
+
+/** particle system for the update benchmark */
+static particle_system_t _benchmark_system;
+
+/**
+ * Benchmarks updating 16384 particles.
+ */
+void benchmark_update_particles()
+{
+  update_particles(&_benchmark_system,PARTICLE_FROM_DOUBLE(0.3),0);
+}
+
+
+/**
+ * Test runner for this group.
+ * Gets called via the generated test runner.
+ *
+ * \return whether the test group was executed
+ */
+BOOLEAN run_particles_tests()
+{
+  INIT_TESTGROUP(L"particles");
+  RUN_TEST(test_random_numbers,L"random numbers");
+  RUN_TEST(test_update_particles,L"update particles");
+  RUN_TEST(test_invalid_particle_system,L"invalid particle systems");
+  RUN_TEST(test_render_particles,L"render particles");
+  if(init_particle_system(&_benchmark_system,BENCHMARK_PARTICLE_COUNT,PARTICLE_FROM_INT(50),_spawn_benchmark_particle,1,NULL)==EFI_SUCCESS)
+  {
+    RUN_BENCHMARK(benchmark_update_particles,L"update 16384 particles");
+    free_particle_system(&_benchmark_system);
+  }
+  FINISH_TESTGROUP();
+}
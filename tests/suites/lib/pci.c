@@ -28,7 +28,8 @@ pci_device_name_testcase_t pci_device_name_testcases[]=
   {0x106b,0x003f,L"Apple Inc., KeyLargo/Intrepid USB"}, //first entry in shortened pci.ids, there was a strstr() bug affecting this
   {0x8086,0x2415,L"Intel Corporation, 82801AA AC'97 Audio Controller"},
   {0x0000,0x0000,L"(unknown)"},
-  {0x8086,0x0000,L"Intel Corporation, unknown device"}
+  {0x8086,0x0000,L"Intel Corporation, unknown device"},
+  {0xffff,0x0000,L"(unknown)"}, //sorts after all vendors, so every line is compared, including the reader buffer's last ones
 };
 
 /**
@@ -37,6 +38,7 @@ pci_device_name_testcase_t pci_device_name_testcases[]=
  * \test find_pci_device_name() finds entries with known vendor and device IDs
  * \test find_pci_device_name() finds known vendor entries and marks unknown device IDs
  * \test find_pci_device_name() marks unknown vendor IDs
+ * \test find_pci_device_name() marks unknown vendor IDs sorting after all vendors, reading all of pci.ids
  * \test find_pci_device_name() isn't affected by old strstr() bug
  */
 void test_find_pci_device_name()
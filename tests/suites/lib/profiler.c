@@ -0,0 +1,117 @@
+/** \file
+ * Tests for the scoped profiler.
+ *
+ * \author Richard Nusser
+ * \copyright 2017-2018 Richard Nusser
+ * \license GPLv3 (see http://www.gnu.org/licenses/)
+ * \sa https://github.com/rinusser/UEFIStarter
+ * \ingroup group_lib_profiler
+ */
+
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <UEFIStarter/core.h>
+#include <UEFIStarter/tests/tests.h>
+
+
+/**
+ * Profiled function to run tests against.
+ *
+ * \param iterations the number of loop iterations to spend time in, 0 to return early
+ * \return a meaningless value, just so the loop doesn't get optimized away
+ */
+static UINTN _profiled_function(UINTN iterations)
+{
+  volatile UINTN sum=0;
+  UINTN tc;
+  PROFILE_SCOPE(L"test zone");
+
+  if(iterations==0)
+    return 0;
+  for(tc=0;tc<iterations;tc++)
+    sum+=tc;
+  return sum;
+}
+
+/**
+ * Makes sure zone statistics are recorded while the profiler runs.
+ *
+ * \test zones aren't recorded while the profiler is stopped
+ * \test early returns still count as zone executions
+ * \test statistics are consistent: min <= mean <= max, and p99 equals max for fewer than 100 executions
+ * \test resetting the profiler discards all zones
+ */
+void test_profile_zones()
+{
+  profile_zone_t *zone;
+  profile_stats_t stats;
+  UINTN tc;
+
+  reset_profiler();
+  _profiled_function(10);
+  assert_null(find_profile_zone(L"test zone"),L"zone before start");
+
+  assert_uint64_equals(EFI_SUCCESS,start_profiling(16),L"start");
+  _profiled_function(0);
+  for(tc=1;tc<5;tc++)
+    _profiled_function(tc*100);
+  stop_profiling();
+  _profiled_function(10);
+
+  zone=find_profile_zone(L"test zone");
+  assert_not_null(zone,L"zone after start");
+  assert_true(get_profile_zone_stats(zone,&stats),L"stats available");
+  assert_uint64_equals(5,stats.count,L"count");
+  assert_true(stats.min<=stats.mean,L"min<=mean");
+  assert_true(stats.mean<=stats.max,L"mean<=max");
+  assert_uint64_equals(stats.max,stats.p99,L"p99");
+  assert_uint64_equals(0,get_profile_dropped_event_count(),L"dropped events");
+
+  reset_profiler();
+  assert_null(find_profile_zone(L"test zone"),L"zone after reset");
+}
+
+/**
+ * Makes sure zone executions exceeding the event buffer are still counted.
+ *
+ * \test executions exceeding the event buffer are counted as dropped
+ * \test zone statistics include dropped executions
+ * \test profiling without an event buffer records statistics only
+ */
+void test_profile_event_capacity()
+{
+  profile_stats_t stats;
+  UINTN tc;
+
+  start_profiling(4);
+  for(tc=0;tc<10;tc++)
+    _profiled_function(10);
+  assert_uint64_equals(6,get_profile_dropped_event_count(),L"dropped events");
+  get_profile_zone_stats(find_profile_zone(L"test zone"),&stats);
+  assert_uint64_equals(10,stats.count,L"count with dropped events");
+
+  start_profiling(0);
+  for(tc=0;tc<3;tc++)
+    _profiled_function(10);
+  assert_uint64_equals(3,get_profile_dropped_event_count(),L"dropped events without buffer");
+  get_profile_zone_stats(find_profile_zone(L"test zone"),&stats);
+  assert_uint64_equals(3,stats.count,L"count without buffer");
+  assert_uint64_equals(0,stats.p99,L"p99 without buffer");
+
+  reset_profiler();
+}
+
+
+/**
+ * Test runner for this group.
+ * Gets called via the generated test runner.
+ *
+ * \return whether the test group was executed
+ */
+BOOLEAN run_profiler_tests()
+{
+  INIT_TESTGROUP(L"profiler");
+  RUN_TEST(test_profile_zones,L"profile zones");
+  RUN_TEST(test_profile_event_capacity,L"event capacity");
+  FINISH_TESTGROUP();
+}
@@ -10,6 +10,8 @@
 
 #include <Uefi.h>
 #include <Library/UefiLib.h>
+#include <Library/PrintLib.h>
+#include <Library/BaseMemoryLib.h>
 #include <UEFIStarter/core.h>
 #include <UEFIStarter/tests/tests.h>
 
@@ -251,6 +253,253 @@ void test_atoui64()
 }
 
 
+/** data type for test_uint64_to_string() test cases */
+typedef struct
+{
+  UINT64 input;        /**< the input number to convert */
+  CHAR16 *expectation; /**< the expected resulting string */
+} uint64_to_string_testcase_t;
+
+/** test cases for test_uint64_to_string() */
+uint64_to_string_testcase_t uint64_to_string_testcases[]=
+{
+  {0,L"0"},
+  {7,L"7"},
+  {10,L"10"},
+  {99,L"99"},
+  {100,L"100"},
+  {12345,L"12345"},
+  {4294967296,L"4294967296"},
+  {18446744073709551615u,L"18446744073709551615"},
+};
+
+/**
+ * Makes sure uint64_to_wcs() and uint64_to_ascii() work.
+ *
+ * \test uint64_to_wcs() and uint64_to_ascii() convert integers from 0 to 2^64-1
+ * \test uint64_to_wcs() and uint64_to_ascii() return the resulting string's length
+ * \test uint64_to_wcs() and uint64_to_ascii() return 0 and an empty string if the buffer is too small
+ */
+void test_uint64_to_string()
+{
+  UINTN tc;
+  UINTN count=sizeof(uint64_to_string_testcases)/sizeof(uint64_to_string_testcase_t);
+  uint64_to_string_testcase_t *cases=uint64_to_string_testcases;
+  CHAR16 wcs[NUMBER_STRING_LENGTH];
+  CHAR8 ascii[NUMBER_STRING_LENGTH];
+  CHAR16 expected_ascii[NUMBER_STRING_LENGTH];
+
+  for(tc=0;tc<count;tc++)
+  {
+    assert_uint64_equals(StrLen(cases[tc].expectation),uint64_to_wcs(wcs,NUMBER_STRING_LENGTH,cases[tc].input),L"UTF-16 length");
+    assert_wcstr_equals(cases[tc].expectation,wcs,L"UTF-16 string");
+    assert_uint64_equals(StrLen(cases[tc].expectation),uint64_to_ascii(ascii,NUMBER_STRING_LENGTH,cases[tc].input),L"ASCII length");
+    UnicodeSPrint(expected_ascii,sizeof(expected_ascii),L"%a",ascii);
+    assert_wcstr_equals(cases[tc].expectation,expected_ascii,L"ASCII string");
+  }
+
+  assert_uint64_equals(0,uint64_to_wcs(wcs,3,123),L"buffer too small");
+  assert_wcstr_equals(L"",wcs,L"buffer too small");
+  assert_uint64_equals(2,uint64_to_wcs(wcs,3,12),L"buffer just large enough");
+}
+
+/** data type for test_double_to_string() test cases */
+typedef struct
+{
+  double input;        /**< the input number to convert */
+  UINTN decimals;      /**< the number of decimals to convert with */
+  CHAR16 *expectation; /**< the expected resulting string, empty if the conversion should fail */
+} double_to_string_testcase_t;
+
+/** test cases for test_double_to_string() */
+double_to_string_testcase_t double_to_string_testcases[]=
+{
+  {1.5,0,L"2"},
+  {-1.5,0,L"-2"},
+  {1.49,0,L"1"},
+  {3.14159,4,L"3.1416"},
+  {0.001,3,L"0.001"},
+  {-0.0004,3,L"-0.000"},
+  {1.0,9,L"1.000000000"},
+  {1234567890123.0,0,L"1234567890123"},
+  {18446744073709549568.0,0,L"18446744073709549568"},
+  {18446744073709551616.0,0,L""},
+  {1.0,10,L""},
+};
+
+/**
+ * Makes sure double_to_wcs() and double_to_ascii() work.
+ *
+ * \test double_to_wcs() and double_to_ascii() round to the given number of decimals with "half away from zero"
+ * \test double_to_wcs() and double_to_ascii() zero-pad to the given number of decimals
+ * \test double_to_wcs() and double_to_ascii() fail for numbers that don't fit into UINT64 after scaling
+ * \test double_to_wcs() and double_to_ascii() fail for more than MAX_DOUBLE_DECIMALS decimals
+ */
+void test_double_to_string()
+{
+  UINTN tc;
+  UINTN count=sizeof(double_to_string_testcases)/sizeof(double_to_string_testcase_t);
+  double_to_string_testcase_t *cases=double_to_string_testcases;
+  CHAR16 wcs[NUMBER_STRING_LENGTH];
+  CHAR8 ascii[NUMBER_STRING_LENGTH];
+  CHAR16 converted_ascii[NUMBER_STRING_LENGTH];
+
+  for(tc=0;tc<count;tc++)
+  {
+    assert_uint64_equals(StrLen(cases[tc].expectation),double_to_wcs(wcs,NUMBER_STRING_LENGTH,cases[tc].input,cases[tc].decimals),L"UTF-16 length");
+    assert_wcstr_equals(cases[tc].expectation,wcs,L"UTF-16 string");
+    assert_uint64_equals(StrLen(cases[tc].expectation),double_to_ascii(ascii,NUMBER_STRING_LENGTH,cases[tc].input,cases[tc].decimals),L"ASCII length");
+    UnicodeSPrint(converted_ascii,sizeof(converted_ascii),L"%a",ascii);
+    assert_wcstr_equals(cases[tc].expectation,converted_ascii,L"ASCII string");
+  }
+}
+
+/** data type for test_string_to_number() test cases */
+typedef struct
+{
+  CHAR16 *input;        /**< the input string to parse */
+  UINTN length;         /**< the expected number of parsed characters */
+  double expectation;   /**< the expected parsed number */
+} string_to_number_testcase_t;
+
+/** test cases for test_string_to_number() */
+string_to_number_testcase_t string_to_number_testcases[]=
+{
+  {L"12.5abc",4,12.5},
+  {L"-0.25",5,-0.25},
+  {L".5",2,0.5},
+  {L"1.",1,1.0},
+  {L"1.2.3",3,1.2},
+  {L"0.00000000000000000000000000001",31,1E-29},
+  {L"123456789012345678901234567890",30,1.2345678901234568E29},
+  {L"-",0,0},
+  {L"abc",0,0},
+  {L"",0,0},
+};
+
+/**
+ * Makes sure wcs_to_double(), ascii_to_double(), wcs_to_uint64() and ascii_to_uint64() work.
+ *
+ * \test wcs_to_double() and ascii_to_double() parse numbers at the start of strings
+ * \test wcs_to_double() and ascii_to_double() return the number of parsed characters, 0 if there's no number
+ * \test wcs_to_double() and ascii_to_double() don't include trailing decimal points
+ * \test wcs_to_uint64() and ascii_to_uint64() fail for numbers exceeding UINT64
+ */
+void test_string_to_number()
+{
+  UINTN tc;
+  UINTN count=sizeof(string_to_number_testcases)/sizeof(string_to_number_testcase_t);
+  string_to_number_testcase_t *cases=string_to_number_testcases;
+  double value, epsilon;
+  UINT64 integer;
+  CHAR8 ascii[NUMBER_STRING_LENGTH*2];
+
+  for(tc=0;tc<count;tc++)
+  {
+    epsilon=(cases[tc].expectation<0?-cases[tc].expectation:cases[tc].expectation)/1E15;
+    value=0;
+    assert_uint64_equals(cases[tc].length,wcs_to_double(cases[tc].input,&value),L"UTF-16 length");
+    assert_double_near(cases[tc].expectation,epsilon,value,L"UTF-16 value");
+    value=0;
+    AsciiSPrint(ascii,sizeof(ascii),"%s",cases[tc].input);
+    assert_uint64_equals(cases[tc].length,ascii_to_double(ascii,&value),L"ASCII length");
+    assert_double_near(cases[tc].expectation,epsilon,value,L"ASCII value");
+  }
+
+  assert_uint64_equals(20,wcs_to_uint64(L"18446744073709551615",&integer),L"2^64-1 length");
+  assert_uint64_equals(18446744073709551615u,integer,L"2^64-1 value");
+  assert_uint64_equals(0,wcs_to_uint64(L"18446744073709551616",&integer),L"2^64");
+  assert_uint64_equals(0,ascii_to_uint64("99999999999999999999",&integer),L"10^20-1");
+  assert_uint64_equals(3,ascii_to_uint64("123 456",&integer),L"partial length");
+  assert_uint64_equals(123,integer,L"partial value");
+}
+
+/**
+ * Makes sure numbers survive conversion to strings and back.
+ *
+ * \test uint64_to_wcs() and wcs_to_uint64() round-trip integers across the entire UINT64 range
+ * \test double_to_wcs() and wcs_to_double() round-trip decimals within half of the last decimal's precision
+ * \test decimal strings with up to 15 significant digits are reproduced exactly after parsing and formatting
+ */
+void test_number_round_trip()
+{
+  CHAR16 buffer[NUMBER_STRING_LENGTH];
+  CHAR16 *strings[]={L"0.1",L"-3.1",L"4321.987",L"654321.654",L"87654321.321",L"123456789.0123",L"-0.000001"};
+  UINT64 integer, parsed_integer;
+  double value, parsed;
+  UINTN tc, decimals;
+
+  for(tc=0,integer=1;tc<64;tc++,integer=integer*2+tc%3)
+  {
+    uint64_to_wcs(buffer,NUMBER_STRING_LENGTH,integer);
+    if(!assert_uint64_equals(StrLen(buffer),wcs_to_uint64(buffer,&parsed_integer),L"integer length"))
+      break;
+    assert_uint64_equals(integer,parsed_integer,L"integer");
+  }
+
+  for(tc=0,value=-1000000.0;tc<100;tc++,value=value*-0.77+0.123456789)
+  {
+    double_to_wcs(buffer,NUMBER_STRING_LENGTH,value,6);
+    wcs_to_double(buffer,&parsed);
+    assert_double_near(value,0.0000005000001,parsed,L"decimal");
+  }
+
+  for(tc=0;tc<sizeof(strings)/sizeof(CHAR16 *);tc++)
+  {
+    wcs_to_double(strings[tc],&parsed);
+    decimals=StrLen(strings[tc])-(StrStr(strings[tc],L".")-strings[tc])-1;
+    double_to_wcs(buffer,NUMBER_STRING_LENGTH,parsed,decimals);
+    assert_wcstr_equals(strings[tc],buffer,L"decimal string");
+  }
+}
+
+/** number of conversions per benchmark iteration */
+#define NUMBER_BENCHMARK_BATCH 16
+
+/** output buffer for number conversion benchmarks */
+static CHAR16 _benchmark_number_buffer[NUMBER_STRING_LENGTH];
+
+/** input strings for number parsing benchmarks */
+static CHAR16 *_benchmark_number_strings[]={L"1",L"42",L"-3.25",L"1920",L"0.000123",L"65535",L"-87654321.321",L"4294967296"};
+
+/** sink for parsed numbers, so benchmarked conversions can't be optimized away */
+static volatile double _benchmark_number_sink;
+
+/**
+ * Benchmarks converting integers to UTF-16 strings.
+ */
+void benchmark_uint64_to_wcs()
+{
+  UINTN tc;
+  for(tc=0;tc<NUMBER_BENCHMARK_BATCH;tc++)
+    uint64_to_wcs(_benchmark_number_buffer,NUMBER_STRING_LENGTH,0x123456789ULL*tc*tc);
+}
+
+/**
+ * Benchmarks converting double values to UTF-16 strings with 3 decimals.
+ */
+void benchmark_double_to_wcs()
+{
+  UINTN tc;
+  for(tc=0;tc<NUMBER_BENCHMARK_BATCH;tc++)
+    double_to_wcs(_benchmark_number_buffer,NUMBER_STRING_LENGTH,tc*-1234.5678,3);
+}
+
+/**
+ * Benchmarks parsing UTF-16 strings as double values.
+ */
+void benchmark_wcs_to_double()
+{
+  UINTN tc;
+  double value;
+  for(tc=0;tc<NUMBER_BENCHMARK_BATCH;tc++)
+  {
+    wcs_to_double(_benchmark_number_strings[tc%8],&value);
+    _benchmark_number_sink=value;
+  }
+}
+
+
 /** data type for test_sprint_status() test cases */
 typedef struct
 {
@@ -303,6 +552,117 @@ void test_memsprintf()
 }
 
 
+/**
+ * Makes sure string builders use the caller's buffer as long as the string fits.
+ *
+ * \test string builders start out with an empty string in the given buffer
+ * \test appending text that fits into the buffer doesn't allocate memory
+ * \test formatted text, strings, characters and numbers are appended in order
+ * \test clearing a string builder empties its string
+ */
+void test_string_builder()
+{
+  CHAR16 buffer[64];
+  string_builder_t builder;
+
+  init_string_builder(&builder,buffer,64);
+  assert_wcstr_equals(L"",builder.buffer,L"initial string");
+  assert_uint64_equals(0,builder.length,L"initial length");
+
+  assert_true(append_format(&builder,L"%d-%s",12,L"ab"),L"format result");
+  assert_true(append_char(&builder,L'|'),L"char result");
+  assert_true(append_string(&builder,L"cd "),L"string result");
+  assert_true(append_double(&builder,-2.5,2),L"double result");
+  assert_wcstr_equals(L"12-ab|cd -2.50",builder.buffer,L"built string");
+  assert_uint64_equals(14,builder.length,L"built length");
+  assert_true(builder.buffer==buffer,L"stack buffer should be used");
+  assert_false(builder.allocated,L"allocated flag");
+  assert_false(builder.truncated,L"truncated flag");
+
+  clear_string_builder(&builder);
+  assert_wcstr_equals(L"",builder.buffer,L"cleared string");
+  assert_uint64_equals(0,builder.length,L"cleared length");
+  free_string_builder(&builder);
+}
+
+/**
+ * Makes sure string builders switch to pool memory when text doesn't fit into the caller's buffer.
+ *
+ * \test string builders grow when appended text would exceed their buffer
+ * \test previously appended text is kept when a string builder grows
+ * \test string builders without an initial buffer allocate memory on first use
+ * \test cleared string builders keep their grown buffer
+ */
+void test_string_builder_growth()
+{
+  CHAR16 buffer[8];
+  string_builder_t builder;
+  CHAR16 *grown;
+  UINTN tc;
+
+  init_string_builder(&builder,buffer,8);
+  append_string(&builder,L"1234");
+  assert_true(append_format(&builder,L"%s%d",L"abcd",5678),L"format result");
+  assert_wcstr_equals(L"1234abcd5678",builder.buffer,L"grown by format");
+  assert_true(builder.allocated,L"format should allocate");
+  assert_true(builder.capacity>12,L"grown capacity");
+
+  grown=builder.buffer;
+  clear_string_builder(&builder);
+  append_string(&builder,L"xyz");
+  assert_true(builder.buffer==grown,L"cleared builder should keep its buffer");
+  free_string_builder(&builder);
+  assert_false(builder.allocated,L"freed builder");
+
+  init_string_builder(&builder,NULL,0);
+  for(tc=0;tc<100;tc++)
+    append_char(&builder,L'a'+tc%26);
+  assert_uint64_equals(100,builder.length,L"appended chars");
+  assert_uint64_equals(L'v',builder.buffer[99],L"last char");
+  assert_uint64_equals(0,builder.buffer[100],L"null termination");
+  for(tc=0;tc<20;tc++)
+    append_format(&builder,L"%08X",tc);
+  assert_uint64_equals(260,builder.length,L"appended numbers");
+  assert_wcstr_equals(L"00000013",builder.buffer+252,L"last number");
+  assert_false(builder.truncated,L"truncated flag");
+  free_string_builder(&builder);
+}
+
+/**
+ * Makes sure append_status() works.
+ *
+ * \test append_status() formats status codes like sprint_status() does
+ */
+void test_append_status()
+{
+  CHAR16 buffer[64];
+  string_builder_t builder;
+  UINTN tc;
+  UINTN count=sizeof(sprint_status_testcases)/sizeof(sprint_status_testcase_t);
+
+  init_string_builder(&builder,buffer,64);
+  for(tc=0;tc<count;tc++)
+  {
+    clear_string_builder(&builder);
+    append_status(&builder,sprint_status_testcases[tc].function_name,sprint_status_testcases[tc].code);
+    assert_wcstr_equals(sprint_status_testcases[tc].expected_message,builder.buffer,L"status message");
+  }
+  free_string_builder(&builder);
+}
+
+/**
+ * Benchmarks formatting a short message with a reused string builder.
+ */
+void benchmark_string_builder()
+{
+  CHAR16 buffer[64];
+  string_builder_t builder;
+
+  init_string_builder(&builder,buffer,64);
+  append_format(&builder,L"[%04X:%04X] %s",0x8086,0x2415,L"device");
+  free_string_builder(&builder);
+}
+
 /**
  * Makes sure split_string() works.
  *
@@ -342,6 +702,138 @@ void test_split_string()
 }
 
 
+/**
+ * Makes sure find_wcs_char() and find_ascii_char() work for all lengths and alignments.
+ *
+ * \test find_wcs_char() and find_ascii_char() return the first matching character's position
+ * \test find_wcs_char() and find_ascii_char() return the text's length if there's no match
+ * \test find_wcs_char() and find_ascii_char() don't read past the given length
+ */
+void test_find_char()
+{
+  CHAR16 wcs[80];
+  CHAR8 ascii[80];
+  UINTN offset, length, match, expected;
+  BOOLEAN success=TRUE;
+
+  for(offset=0;offset<8;offset++)
+  {
+    for(length=0;length<64;length++)
+    {
+      for(match=0;match<=length;match++)
+      {
+        SetMem16(wcs,sizeof(wcs),L'a');
+        SetMem(ascii,sizeof(ascii),'a');
+        wcs[offset+match]=L'|';
+        ascii[offset+match]='|';
+        wcs[offset+match+1]=L'|';
+        ascii[offset+match+1]='|';
+        expected=match<length?match:length;
+        success&=find_wcs_char(wcs+offset,length,L'|')==expected;
+        success&=find_ascii_char(ascii+offset,length,'|')==expected;
+      }
+    }
+  }
+  assert_true(success,L"all positions");
+
+  assert_uint64_equals(3,find_ascii_char("abc\x80\x81def",8,(CHAR8)0x80),L"high-bit ASCII");
+  assert_uint64_equals(5,find_wcs_char(L"abcde\x2020" L"fghijklmnopqrstuvwxyz",27,0x2020),L"non-ASCII UTF-16");
+}
+
+/**
+ * Makes sure string views work.
+ *
+ * \test wcs_view() and ascii_view() view entire null-terminated strings, NULL becomes an empty view
+ * \test wcs_view_equals() compares the entire view with a null-terminated string
+ * \test ascii_view_starts_with() checks prefixes within the view's length only
+ * \test ascii_view_skip() doesn't skip past the view's end
+ */
+void test_string_views()
+{
+  wcs_view_t wcs=wcs_view(L"abcdef");
+  ascii_view_t ascii=ascii_view("abcdef");
+
+  assert_uint64_equals(6,wcs.length,L"UTF-16 length");
+  assert_uint64_equals(6,ascii.length,L"ASCII length");
+  assert_uint64_equals(0,wcs_view(NULL).length,L"NULL UTF-16 view");
+  assert_uint64_equals(0,ascii_view(NULL).length,L"NULL ASCII view");
+
+  assert_true(wcs_view_equals(wcs,L"abcdef"),L"equal");
+  assert_false(wcs_view_equals(wcs,L"abcde"),L"shorter string");
+  assert_false(wcs_view_equals(wcs,L"abcdefg"),L"longer string");
+  assert_true(wcs_view_equals(wcs_view_n(L"abcdef",3),L"abc"),L"partial view");
+  assert_true(wcs_view_equals(wcs_view_n(NULL,0),L""),L"empty view");
+
+  assert_true(ascii_view_starts_with(ascii,"abc"),L"prefix");
+  assert_true(ascii_view_starts_with(ascii,""),L"empty prefix");
+  assert_false(ascii_view_starts_with(ascii,"abd"),L"different prefix");
+  assert_false(ascii_view_starts_with(ascii_view_n("abcdef",2),"abc"),L"prefix beyond view");
+
+  assert_uint64_equals(2,ascii_view_skip(ascii,4).length,L"skipped length");
+  assert_true(ascii_view_starts_with(ascii_view_skip(ascii,4),"ef"),L"skipped text");
+  assert_uint64_equals(0,ascii_view_skip(ascii,10).length,L"skipped past end");
+}
+
+/**
+ * Makes sure tokenizers split text like split_string() does, without modifying it.
+ *
+ * \test next_wcs_token() and next_ascii_token() return all parts between separators, in order
+ * \test next_wcs_token() and next_ascii_token() return empty parts between adjacent separators
+ * \test next_wcs_token() and next_ascii_token() return a single empty token for empty input
+ * \test tokenizers don't modify their input
+ */
+void test_tokenizers()
+{
+  CHAR16 *input=L"this|is||a|list|";
+  CHAR16 *expected[]={L"this",L"is",L"",L"a",L"list",L""};
+  CHAR16 converted[16];
+  wcs_tokenizer_t wcs_tokenizer;
+  ascii_tokenizer_t ascii_tokenizer;
+  wcs_view_t wcs_token;
+  ascii_view_t ascii_token;
+  UINTN count;
+
+  init_wcs_tokenizer(&wcs_tokenizer,wcs_view(input),L'|');
+  for(count=0;next_wcs_token(&wcs_tokenizer,&wcs_token) && count<6;count++)
+    assert_true(wcs_view_equals(wcs_token,expected[count]),L"UTF-16 token");
+  assert_uint64_equals(6,count,L"UTF-16 token count");
+  assert_wcstr_equals(L"this|is||a|list|",input,L"unmodified input");
+
+  init_ascii_tokenizer(&ascii_tokenizer,ascii_view("this|is||a|list|"),'|');
+  for(count=0;next_ascii_token(&ascii_tokenizer,&ascii_token) && count<6;count++)
+  {
+    UnicodeSPrint(converted,sizeof(converted),L"%a",ascii_token.start);
+    converted[ascii_token.length]=0;
+    assert_wcstr_equals(expected[count],converted,L"ASCII token");
+  }
+  assert_uint64_equals(6,count,L"ASCII token count");
+
+  init_wcs_tokenizer(&wcs_tokenizer,wcs_view(L""),L'|');
+  assert_true(next_wcs_token(&wcs_tokenizer,&wcs_token),L"empty input");
+  assert_uint64_equals(0,wcs_token.length,L"empty input");
+  assert_false(next_wcs_token(&wcs_tokenizer,&wcs_token),L"empty input, 2nd token");
+}
+
+/** length of the text searched in benchmark_find_ascii_char() */
+#define FIND_BENCHMARK_LENGTH 4096
+
+/** text for benchmark_find_ascii_char(), with a newline at the end only */
+static CHAR8 _benchmark_find_text[FIND_BENCHMARK_LENGTH];
+
+/**
+ * Benchmarks finding a newline at the end of a 4KB text, as when reading long lines.
+ */
+void benchmark_find_ascii_char()
+{
+  if(_benchmark_find_text[FIND_BENCHMARK_LENGTH-1]!='\n')
+  {
+    SetMem(_benchmark_find_text,FIND_BENCHMARK_LENGTH-1,'a');
+    _benchmark_find_text[FIND_BENCHMARK_LENGTH-1]='\n';
+  }
+  find_ascii_char(_benchmark_find_text,FIND_BENCHMARK_LENGTH,'\n');
+}
+
+
 /**
  * Test runner for this group.
  * Gets called via the generated test runner.
@@ -357,8 +849,23 @@ BOOLEAN run_string_tests()
   RUN_TEST(test_ftowcs_boundaries,L"ftowcs boundaries");
   RUN_TEST(test_wcstof,L"wcstof");
   RUN_TEST(test_atoui64,L"atoui64");
+  RUN_TEST(test_uint64_to_string,L"uint64 to string");
+  RUN_TEST(test_double_to_string,L"double to string");
+  RUN_TEST(test_string_to_number,L"string to number");
+  RUN_TEST(test_number_round_trip,L"number round trips");
+  RUN_BENCHMARK(benchmark_uint64_to_wcs,L"uint64_to_wcs x16");
+  RUN_BENCHMARK(benchmark_double_to_wcs,L"double_to_wcs x16");
+  RUN_BENCHMARK(benchmark_wcs_to_double,L"wcs_to_double x16");
   RUN_TEST(test_sprint_status,L"sprint_status");
   RUN_TEST(test_memsprintf,L"memsprintf");
+  RUN_TEST(test_string_builder,L"string builder");
+  RUN_TEST(test_string_builder_growth,L"string builder growth");
+  RUN_TEST(test_append_status,L"append_status");
+  RUN_BENCHMARK(benchmark_string_builder,L"string builder format");
   RUN_TEST(test_split_string,L"split_string");
+  RUN_TEST(test_find_char,L"find character");
+  RUN_TEST(test_string_views,L"string views");
+  RUN_TEST(test_tokenizers,L"tokenizers");
+  RUN_BENCHMARK(benchmark_find_ascii_char,L"find_ascii_char 4KB");
   FINISH_TESTGROUP();
 }
@@ -9,6 +9,8 @@
  */
 #include <Uefi.h>
 #include <Library/UefiLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <UEFIStarter/core/memory.h>
 #include <UEFIStarter/tests/tests.h>
 
 
@@ -154,6 +156,34 @@ void test_graphics()
   assert_pixel_near(data[0],22,data[1],L"should fail");
 }
 
+/**
+ * Makes sure the performance assertions work.
+ *
+ * \test assert_max_duration_us() asserts the test's duration so far is within the limit and can be inverted
+ * \test assert_max_duration_us() scales the limit by duration_limit_percent
+ * \test assert_max_pages() asserts the test's peak number of tracked memory pages is within the limit and can be inverted
+ */
+void test_performance()
+{
+  void *pages;
+  UINTN duration_factor=duration_limit_percent;
+
+  assert_max_duration_us(10000000,L"should work");
+  gBS->Stall(100);
+  //scaled by -duration-factor the limit could exceed the stall, so this assertion needs the unscaled limit
+  duration_limit_percent=100;
+  invert_next_assert=TRUE;
+  assert_max_duration_us(50,L"should fail");
+  duration_limit_percent=100000;
+  assert_max_duration_us(50,L"should work when scaled");
+  duration_limit_percent=duration_factor;
+
+  pages=allocate_pages(3);
+  free_pages(pages,3);
+  assert_max_pages(3,L"should work");
+  invert_next_assert=TRUE;
+  assert_max_pages(2,L"should fail");
+}
 
 /**
  * Test runner for this group.
@@ -169,5 +199,6 @@ BOOLEAN run_asserts_tests()
   RUN_TEST(test_double,L"floating point assertions");
   RUN_TEST(test_compounds,L"compound/pointer assertions");
   RUN_TEST(test_graphics,L"graphics assertions");
+  RUN_TEST(test_performance,L"performance assertions");
   FINISH_TESTGROUP();
 }
@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+# Decodes frame capture files written by the capture library (see include/UEFIStarter/capture.h)
+# Prints each captured frame's timestamp and encoded size, optionally writes the frames as PPM images
+#
+# usage: decode_capture.py <capture file> [output directory]
+#
+# \author Richard Nusser
+# \copyright 2017-2018 Richard Nusser
+# \license GPLv3 (see http://www.gnu.org/licenses/)
+# \link https://github.com/rinusser/UEFIStarter
+#
+
+import os
+import struct
+import sys
+
+CAPTURE_FILE_MAGIC = 0x50434655
+CAPTURE_FILE_VERSION = 1
+FILE_HEADER = struct.Struct("<IIIIQII")
+FRAME_HEADER = struct.Struct("<IIQ")
+RUN_SKIP, RUN_FILL, RUN_COPY = 0, 1, 2
+
+
+def fail(message):
+    sys.stderr.write("ERROR: %s\n" % message)
+    sys.exit(1)
+
+
+def decode_frame(data, pos, frame):
+    """Applies one frame's runs to the previous frame, returns the position after the frame and the changed pixels."""
+    covered = 0
+    changed = 0
+    pixels = len(frame)
+    while covered < pixels:
+        if pos + 4 > len(data):
+            fail("unexpected end of file in frame data")
+        word, = struct.unpack_from("<I", data, pos)
+        pos += 4
+        run_type = word >> 30
+        count = word & 0x3FFFFFFF
+        if count == 0 or covered + count > pixels:
+            fail("invalid run length %d at offset %d" % (count, pos - 4))
+        if run_type == RUN_FILL:
+            frame[covered:covered + count] = [data[pos:pos + 4]] * count
+            pos += 4
+            changed += count
+        elif run_type == RUN_COPY:
+            for tc in range(count):
+                frame[covered + tc] = data[pos + tc * 4:pos + tc * 4 + 4]
+            pos += count * 4
+            changed += count
+        elif run_type != RUN_SKIP:
+            fail("invalid run type %d at offset %d" % (run_type, pos - 4))
+        if pos > len(data):
+            fail("unexpected end of file in run data")
+        covered += count
+    return pos, changed
+
+
+def write_ppm(filename, width, height, frame):
+    """Writes a frame as binary PPM image, pixels are stored as BGRX."""
+    rgb = bytearray(width * height * 3)
+    for tc, pixel in enumerate(frame):
+        rgb[tc * 3] = pixel[2]
+        rgb[tc * 3 + 1] = pixel[1]
+        rgb[tc * 3 + 2] = pixel[0]
+    with open(filename, "wb") as output:
+        output.write(b"P6\n%d %d\n255\n" % (width, height))
+        output.write(rgb)
+
+
+def main():
+    if len(sys.argv) not in (2, 3):
+        sys.stderr.write("Syntax: %s <capture file> [output directory]\n" % os.path.basename(sys.argv[0]))
+        sys.exit(2)
+    output_dir = sys.argv[2] if len(sys.argv) == 3 else None
+
+    with open(sys.argv[1], "rb") as capture:
+        data = capture.read()
+    if len(data) < FILE_HEADER.size:
+        fail("file too short for capture header")
+    magic, version, width, height, ticks_per_second, interval, _ = FILE_HEADER.unpack_from(data, 0)
+    if magic != CAPTURE_FILE_MAGIC:
+        fail("not a capture file")
+    if version != CAPTURE_FILE_VERSION:
+        fail("unsupported capture file version %d" % version)
+    if output_dir:
+        os.makedirs(output_dir, exist_ok=True)
+
+    print("%dx%d, every %d. frame, %d ticks per second" % (width, height, interval, ticks_per_second))
+    print("  frame    time (ms)   delta (ms)        bytes  changed pixels")
+
+    frame = [b"\0\0\0\0"] * (width * height)
+    pos = FILE_HEADER.size
+    count = 0
+    first_ms = previous_ms = None
+    while pos < len(data):
+        if pos + FRAME_HEADER.size > len(data):
+            fail("unexpected end of file in frame header")
+        number, _, timestamp = FRAME_HEADER.unpack_from(data, pos)
+        start = pos
+        pos, changed = decode_frame(data, pos + FRAME_HEADER.size, frame)
+
+        ms = timestamp * 1000.0 / ticks_per_second if ticks_per_second else 0.0
+        delta = ms - previous_ms if previous_ms is not None else 0.0
+        print("%7d %12.3f %12.3f %12d %15d" % (number, ms, delta, pos - start, changed))
+        if first_ms is None:
+            first_ms = ms
+        previous_ms = ms
+        count += 1
+
+        if output_dir:
+            write_ppm(os.path.join(output_dir, "frame_%06d.ppm" % number), width, height, frame)
+
+    if count > 1 and previous_ms > first_ms:
+        print("%d frames captured, %.2f captured frames per second" % (count, (count - 1) * 1000.0 / (previous_ms - first_ms)))
+    else:
+        print("%d frames captured" % count)
+
+
+if __name__ == "__main__":
+    main()
@@ -2,6 +2,11 @@
 # Generates a script to run all testsuites
 # Outputs script to stdout - gets used by Makefile.edk to create tests/run.nsh
 #
+# usage: generate_runall_tests_script.sh [suites directory] [shard count shard index]
+#
+# With a shard count and index the script only runs that shard's test groups, writes the reports as
+# e.g. tests\testlib-shard0.xml and shuts down the VM afterwards.
+#
 # \author Richard Nusser
 # \copyright 2017-2018 Richard Nusser
 # \license GPLv3 (see http://www.gnu.org/licenses/)
@@ -13,14 +18,25 @@ dir=$1
 suites=`\grep -hE "^[[:space:]]*BASE_NAME[[:space:]=]*" $dir/*/*.inf | sed 's/^[^=]*=[[:space:]*]//'`
 scriptfile=/dev/stdout
 
+shard_args=""
+report_suffix=""
+if [ "$2" != "" ]; then
+  shard_args=" -shard-count $2 -shard-index $3"
+  report_suffix="-shard$3"
+fi
+
 echo "@echo -off" > $scriptfile
 
 #run self test suite first to make sure test framework actually works as expected and so (usually useless) results are the first thing to go off-screen
 for suite in $suites; do
-  [ "$suite" == "testself" ] && echo $suite -skip runner >> $scriptfile -verbosity 3
+  [ "$suite" == "testself" ] && echo $suite -skip runner -verbosity 3$shard_args -report \\tests\\$suite$report_suffix.xml >> $scriptfile
 done
 
 #run other test suites
 for suite in $suites; do
-  [ "$suite" == "testself" ] || echo $suite >> $scriptfile -verbosity 3
+  [ "$suite" == "testself" ] || echo $suite -verbosity 3$shard_args -report \\tests\\$suite$report_suffix.xml >> $scriptfile
 done
+
+#shards run unattended, the launcher waits for QEMU to exit
+[ "$2" != "" ] && echo "reset -s" >> $scriptfile
+exit 0
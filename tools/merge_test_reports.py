@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+# Merges JUnit XML reports written by sharded test suite runs (see README.md) into one report per test suite
+# Shard reports are named e.g. testlib-shard0.xml, the merged report would be testlib.xml in the output directory.
+# Test groups are ordered by shard index, then by their order within the shard, so merging is deterministic.
+#
+# usage: merge_test_reports.py <shard report directory> <output directory>
+#
+# \author Richard Nusser
+# \copyright 2017-2018 Richard Nusser
+# \license GPLv3 (see http://www.gnu.org/licenses/)
+# \link https://github.com/rinusser/UEFIStarter
+#
+
+import os
+import re
+import sys
+import xml.etree.ElementTree as ElementTree
+
+SHARD_REPORT_PATTERN = re.compile(r"^(.+)-shard(\d+)\.xml$")
+
+
+def fail(message):
+    sys.stderr.write("ERROR: %s\n" % message)
+    sys.exit(1)
+
+
+def find_shard_reports(directory):
+    """Returns the shard reports' filenames per test suite, ordered by shard index."""
+    suites = {}
+    for filename in os.listdir(directory):
+        match = SHARD_REPORT_PATTERN.match(filename)
+        if match:
+            suites.setdefault(match.group(1), []).append((int(match.group(2)), filename))
+    return {suite: [filename for _, filename in sorted(shards)] for suite, shards in suites.items()}
+
+
+def merge_reports(directory, filenames):
+    """Merges shard reports into a single testsuites element, summing up the totals."""
+    merged = ElementTree.Element("testsuites")
+    totals = {"tests": 0, "failures": 0, "skipped": 0}
+    for filename in filenames:
+        try:
+            root = ElementTree.parse(os.path.join(directory, filename)).getroot()
+        except ElementTree.ParseError as error:
+            fail("could not parse %s: %s" % (filename, error))
+        if root.tag != "testsuites":
+            fail("%s is not a test report" % filename)
+        for key in totals:
+            totals[key] += int(root.get(key, "0"))
+        merged.extend(root.findall("testsuite"))
+    for key, value in totals.items():
+        merged.set(key, str(value))
+    return merged, totals
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.stderr.write("Syntax: %s <shard report directory> <output directory>\n" % os.path.basename(sys.argv[0]))
+        sys.exit(2)
+    input_dir, output_dir = sys.argv[1:]
+    os.makedirs(output_dir, exist_ok=True)
+
+    suites = find_shard_reports(input_dir)
+    if not suites:
+        fail("no shard reports found in %s" % input_dir)
+    for suite in sorted(suites):
+        merged, totals = merge_reports(input_dir, suites[suite])
+        ElementTree.ElementTree(merged).write(os.path.join(output_dir, suite + ".xml"), encoding="UTF-8",
+                                              xml_declaration=True)
+        print("%s: %d shards, %d tests, %d failures, %d skipped" % (suite, len(suites[suite]), totals["tests"],
+                                                                    totals["failures"], totals["skipped"]))
+
+
+if __name__ == "__main__":
+    main()